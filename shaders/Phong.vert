@@ -4,8 +4,10 @@
 // Uniforms for world transform and view-proj
 uniform mat4 uWorldTransform;
 uniform mat4 uViewProj;
+// Set for quantized meshes, whose normals are octahedral encoded
+uniform bool uOctNormals;
 
-// Attribute 0 is position, 1 is normal, 2 is tex coords.
+// Attribute 0 is position, 1 is normal (or its octahedral xy), 2 is tex coords.
 layout(location = 0) in vec3 inPosition;
 layout(location = 1) in vec3 inNormal;
 layout(location = 2) in vec2 inTexCoord;
@@ -17,6 +19,18 @@ out vec3 fragNormal;
 // Position (in world space)
 out vec3 fragWorldPos;
 
+// Point on the unfolded octahedron back to a unit normal
+vec3 OctDecode(vec2 e)
+{
+	vec3 n = vec3(e, 1.0 - abs(e.x) - abs(e.y));
+	if (n.z < 0.0)
+	{
+		vec2 signs = vec2(e.x >= 0.0 ? 1.0 : -1.0, e.y >= 0.0 ? 1.0 : -1.0);
+		n.xy = (1.0 - abs(e.yx)) * signs;
+	}
+	return normalize(n);
+}
+
 void main()
 {
 	// Convert position to homogeneous coordinates
@@ -29,7 +43,8 @@ void main()
 	gl_Position = pos * uViewProj;
 
 	// Transform normal into world space (w = 0)
-	fragNormal = (vec4(inNormal, 0.0f) * uWorldTransform).xyz;
+	vec3 normal = uOctNormals ? OctDecode(inNormal.xy) : inNormal;
+	fragNormal = (vec4(normal, 0.0f) * uWorldTransform).xyz;
 
 	// Pass along the texture coordinate to frag shader
 	fragTexCoord = inTexCoord;
@@ -1,12 +1,13 @@
 // Request GLSL 3.3
 #version 330
 
-// Uniforms for world transform and view-proj
-uniform mat4 uWorldTransform;
+// Uniform for view-proj
 uniform mat4 uViewProj;
 
-// uniform for matrix palette
-uniform mat4 uMatrixPalette[96];
+// palettes and instance records packed as 3x4 matrices (see SkinningBuffer)
+uniform samplerBuffer uSkinningBuffer;
+// texel offset of the first instance record of this draw
+uniform int uInstanceOffset;
 
 // Attribute 0 is position, 1 is normal, 2 is tex coords.
 layout(location = 0) in vec3 inPosition;
@@ -22,33 +23,46 @@ out vec3 fragNormal;
 // Position (in world space)
 out vec3 fragWorldPos;
 
+// weighted column of the four bone matrices influencing this vertex
+vec4 SkinColumn(int paletteOffset, int column)
+{
+	return texelFetch(uSkinningBuffer, paletteOffset + int(inSkinBones.x) * 3 + column) * inSkinWeights.x
+		+ texelFetch(uSkinningBuffer, paletteOffset + int(inSkinBones.y) * 3 + column) * inSkinWeights.y
+		+ texelFetch(uSkinningBuffer, paletteOffset + int(inSkinBones.z) * 3 + column) * inSkinWeights.z
+		+ texelFetch(uSkinningBuffer, paletteOffset + int(inSkinBones.w) * 3 + column) * inSkinWeights.w;
+}
+
 void main()
 {
-	// Convert position to homogeneous coordinates
-	vec4 pos = vec4(inPosition, 1.0);
+	// instance record: world transform columns, then palette offset
+	int instance = uInstanceOffset + gl_InstanceID * 4;
+	vec4 world0 = texelFetch(uSkinningBuffer, instance);
+	vec4 world1 = texelFetch(uSkinningBuffer, instance + 1);
+	vec4 world2 = texelFetch(uSkinningBuffer, instance + 2);
+	int paletteOffset = int(texelFetch(uSkinningBuffer, instance + 3).x);
+
+	// blend the bone matrices then transform once
+	vec4 skin0 = SkinColumn(paletteOffset, 0);
+	vec4 skin1 = SkinColumn(paletteOffset, 1);
+	vec4 skin2 = SkinColumn(paletteOffset, 2);
 
 	// skin the position
-	vec4 skinnedPos = (pos * uMatrixPalette[inSkinBones.x]) * inSkinWeights.x;
-	skinnedPos += (pos * uMatrixPalette[inSkinBones.y]) * inSkinWeights.y;
-	skinnedPos += (pos * uMatrixPalette[inSkinBones.z]) * inSkinWeights.z;
-	skinnedPos += (pos * uMatrixPalette[inSkinBones.w]) * inSkinWeights.w;
+	vec4 pos = vec4(inPosition, 1.0);
+	vec4 skinnedPos = vec4(dot(pos, skin0), dot(pos, skin1), dot(pos, skin2), 1.0);
 
 	// Transform position to world space
-	skinnedPos = skinnedPos * uWorldTransform;
+	vec4 worldPos = vec4(dot(skinnedPos, world0), dot(skinnedPos, world1), dot(skinnedPos, world2), 1.0);
 	// Save world position
-	fragWorldPos = skinnedPos.xyz;
+	fragWorldPos = worldPos.xyz;
 	// Transform to clip space
-	gl_Position = skinnedPos * uViewProj;
+	gl_Position = worldPos * uViewProj;
 
-	// skin the vertex normal
-	vec4 skinnedNormal = vec4(inNormal, 0.0f);
-	skinnedNormal = (skinnedNormal * uMatrixPalette[inSkinBones.x]) * inSkinWeights.x
-		+ (skinnedNormal * uMatrixPalette[inSkinBones.y]) * inSkinWeights.y
-		+ (skinnedNormal * uMatrixPalette[inSkinBones.z]) * inSkinWeights.z
-		+ (skinnedNormal * uMatrixPalette[inSkinBones.w]) * inSkinWeights.w;
+	// skin the vertex normal (w = 0)
+	vec4 normal = vec4(inNormal, 0.0);
+	vec4 skinnedNormal = vec4(dot(normal, skin0), dot(normal, skin1), dot(normal, skin2), 0.0);
 
-	// Transform normal into world space (w = 0)
-	fragNormal = (skinnedNormal * uWorldTransform).xyz;
+	// Transform normal into world space
+	fragNormal = vec3(dot(skinnedNormal, world0), dot(skinnedNormal, world1), dot(skinnedNormal, world2));
 
 	// Pass along the texture coordinate to frag shader
 	fragTexCoord = inTexCoord;
@@ -0,0 +1,518 @@
+#include "AABBTree.h"
+#include "SIMD.h"
+
+#include <utility>
+
+namespace
+{
+  AABB Combine(const AABB& a, const AABB& b)
+  {
+    return AABB(
+      Vector3(Math::Min(a.m_Min.x, b.m_Min.x), Math::Min(a.m_Min.y, b.m_Min.y), Math::Min(a.m_Min.z, b.m_Min.z)),
+      Vector3(Math::Max(a.m_Max.x, b.m_Max.x), Math::Max(a.m_Max.y, b.m_Max.y), Math::Max(a.m_Max.z, b.m_Max.z)));
+  }
+
+  float SurfaceArea(const AABB& box)
+  {
+    Vector3 d = box.m_Max - box.m_Min;
+    return 2.0f * (d.x * d.y + d.y * d.z + d.z * d.x);
+  }
+
+  bool Contains(const AABB& outer, const AABB& inner)
+  {
+    return outer.m_Min.x <= inner.m_Min.x && outer.m_Min.y <= inner.m_Min.y
+      && outer.m_Min.z <= inner.m_Min.z && inner.m_Max.x <= outer.m_Max.x
+      && inner.m_Max.y <= outer.m_Max.y && inner.m_Max.z <= outer.m_Max.z;
+  }
+
+  AABB Grow(const AABB& box, float margin)
+  {
+    Vector3 r(margin, margin, margin);
+    return AABB(box.m_Min - r, box.m_Max + r);
+  }
+}
+
+AABBTree::RayPacket::RayPacket()
+{
+  for (int lane = 0; lane < 4; ++lane)
+  {
+    m_StartX[lane] = m_StartY[lane] = m_StartZ[lane] = 0.0f;
+    m_InvDirX[lane] = m_InvDirY[lane] = m_InvDirZ[lane] = 0.0f;
+    m_MaxT[lane] = -1.0f;
+  }
+}
+
+void AABBTree::RayPacket::SetSegment(int lane, const LineSegment& segment)
+{
+  Vector3 dir = segment.m_End - segment.m_Start;
+  m_StartX[lane] = segment.m_Start.x;
+  m_StartY[lane] = segment.m_Start.y;
+  m_StartZ[lane] = segment.m_Start.z;
+  m_InvDirX[lane] = SlabInverse(dir.x);
+  m_InvDirY[lane] = SlabInverse(dir.y);
+  m_InvDirZ[lane] = SlabInverse(dir.z);
+  m_MaxT[lane] = 1.0f;
+}
+
+int AABBTree::IntersectPacket(const AABB& box, const RayPacket& packet)
+{
+  // slab test, the segment's entry (largest near t) must not be
+  // past its exit (smallest far t) or its length
+#if USE_SSE
+  __m128 tMin = _mm_setzero_ps();
+  __m128 tMax = _mm_load_ps(packet.m_MaxT);
+
+  __m128 start = _mm_load_ps(packet.m_StartX);
+  __m128 inv = _mm_load_ps(packet.m_InvDirX);
+  __m128 t1 = _mm_mul_ps(_mm_sub_ps(_mm_set1_ps(box.m_Min.x), start), inv);
+  __m128 t2 = _mm_mul_ps(_mm_sub_ps(_mm_set1_ps(box.m_Max.x), start), inv);
+  tMin = _mm_max_ps(tMin, _mm_min_ps(t1, t2));
+  tMax = _mm_min_ps(tMax, _mm_max_ps(t1, t2));
+
+  start = _mm_load_ps(packet.m_StartY);
+  inv = _mm_load_ps(packet.m_InvDirY);
+  t1 = _mm_mul_ps(_mm_sub_ps(_mm_set1_ps(box.m_Min.y), start), inv);
+  t2 = _mm_mul_ps(_mm_sub_ps(_mm_set1_ps(box.m_Max.y), start), inv);
+  tMin = _mm_max_ps(tMin, _mm_min_ps(t1, t2));
+  tMax = _mm_min_ps(tMax, _mm_max_ps(t1, t2));
+
+  start = _mm_load_ps(packet.m_StartZ);
+  inv = _mm_load_ps(packet.m_InvDirZ);
+  t1 = _mm_mul_ps(_mm_sub_ps(_mm_set1_ps(box.m_Min.z), start), inv);
+  t2 = _mm_mul_ps(_mm_sub_ps(_mm_set1_ps(box.m_Max.z), start), inv);
+  tMin = _mm_max_ps(tMin, _mm_min_ps(t1, t2));
+  tMax = _mm_min_ps(tMax, _mm_max_ps(t1, t2));
+
+  return _mm_movemask_ps(_mm_cmple_ps(tMin, tMax));
+#else
+  int mask = 0;
+  for (int lane = 0; lane < 4; ++lane)
+  {
+    float tMin = 0.0f;
+    float tMax = packet.m_MaxT[lane];
+
+    float t1 = (box.m_Min.x - packet.m_StartX[lane]) * packet.m_InvDirX[lane];
+    float t2 = (box.m_Max.x - packet.m_StartX[lane]) * packet.m_InvDirX[lane];
+    tMin = Math::Max(tMin, Math::Min(t1, t2));
+    tMax = Math::Min(tMax, Math::Max(t1, t2));
+
+    t1 = (box.m_Min.y - packet.m_StartY[lane]) * packet.m_InvDirY[lane];
+    t2 = (box.m_Max.y - packet.m_StartY[lane]) * packet.m_InvDirY[lane];
+    tMin = Math::Max(tMin, Math::Min(t1, t2));
+    tMax = Math::Min(tMax, Math::Max(t1, t2));
+
+    t1 = (box.m_Min.z - packet.m_StartZ[lane]) * packet.m_InvDirZ[lane];
+    t2 = (box.m_Max.z - packet.m_StartZ[lane]) * packet.m_InvDirZ[lane];
+    tMin = Math::Max(tMin, Math::Min(t1, t2));
+    tMax = Math::Min(tMax, Math::Max(t1, t2));
+
+    if (tMin <= tMax)
+    {
+      mask |= 1 << lane;
+    }
+  }
+  return mask;
+#endif
+}
+
+AABBTree::Node::Node()
+  :m_Box(Vector3::Zero, Vector3::Zero)
+  , m_UserData(nullptr)
+  , m_Parent(NullNode)
+  , m_Child1(NullNode)
+  , m_Child2(NullNode)
+  , m_Height(-1)
+{}
+
+AABBTree::AABBTree(float margin, float displacementScale)
+  :m_Root(NullNode)
+  , m_FreeList(NullNode)
+  , m_NumProxies(0)
+  , m_Margin(margin)
+  , m_DisplacementScale(displacementScale)
+{}
+
+int AABBTree::AllocateNode()
+{
+  if (m_FreeList == NullNode)
+  {
+    m_Nodes.emplace_back();
+    m_FreeList = static_cast<int>(m_Nodes.size()) - 1;
+  }
+
+  int node = m_FreeList;
+  m_FreeList = m_Nodes[node].m_Parent;
+  m_Nodes[node] = Node();
+  m_Nodes[node].m_Height = 0;
+  return node;
+}
+
+void AABBTree::FreeNode(int node)
+{
+  m_Nodes[node].m_Parent = m_FreeList;
+  m_Nodes[node].m_Height = -1;
+  m_Nodes[node].m_UserData = nullptr;
+  m_FreeList = node;
+}
+
+int AABBTree::CreateProxy(const AABB& box, void* userData)
+{
+  int proxy = AllocateNode();
+  m_Nodes[proxy].m_Box = Grow(box, m_Margin);
+  m_Nodes[proxy].m_UserData = userData;
+  InsertLeaf(proxy);
+  ++m_NumProxies;
+  return proxy;
+}
+
+void AABBTree::DestroyProxy(int proxy)
+{
+  RemoveLeaf(proxy);
+  FreeNode(proxy);
+  --m_NumProxies;
+}
+
+bool AABBTree::MoveProxy(int proxy, const AABB& box, const Vector3& displacement)
+{
+  AABB& fat = m_Nodes[proxy].m_Box;
+
+  // still inside and the fat box hasn't become much too big (e.g. after a fast move)
+  if (Contains(fat, box) && Contains(Grow(box, 4.0f * m_Margin), fat))
+  {
+    return false;
+  }
+
+  // grow by the margin, and further in the direction it's heading. capped so
+  // a teleport (or the first update after spawning) doesn't leave a huge box
+  AABB newFat = Grow(box, m_Margin);
+  float maxExtension = 3.0f * m_Margin;
+  Vector3 d = displacement * m_DisplacementScale;
+  d.x = Math::Clamp(d.x, -maxExtension, maxExtension);
+  d.y = Math::Clamp(d.y, -maxExtension, maxExtension);
+  d.z = Math::Clamp(d.z, -maxExtension, maxExtension);
+  if (d.x < 0.0f) { newFat.m_Min.x += d.x; } else { newFat.m_Max.x += d.x; }
+  if (d.y < 0.0f) { newFat.m_Min.y += d.y; } else { newFat.m_Max.y += d.y; }
+  if (d.z < 0.0f) { newFat.m_Min.z += d.z; } else { newFat.m_Max.z += d.z; }
+
+  RemoveLeaf(proxy);
+  m_Nodes[proxy].m_Box = newFat;
+  InsertLeaf(proxy);
+  return true;
+}
+
+void* AABBTree::GetUserData(int proxy) const
+{
+  return m_Nodes[proxy].m_UserData;
+}
+
+const AABB& AABBTree::GetFatBox(int proxy) const
+{
+  return m_Nodes[proxy].m_Box;
+}
+
+void AABBTree::InsertLeaf(int leaf)
+{
+  if (m_Root == NullNode)
+  {
+    m_Root = leaf;
+    m_Nodes[leaf].m_Parent = NullNode;
+    return;
+  }
+
+  // find the sibling that adds the least total area: the leaf's parent gets
+  // area(sibling + leaf) and every ancestor grows by area(ancestor + leaf) - area(ancestor).
+  // search depth first, skipping subtrees whose lower bound can't beat the best so far
+  AABB leafBox = m_Nodes[leaf].m_Box;
+  float leafArea = SurfaceArea(leafBox);
+
+  int bestSibling = m_Root;
+  float bestCost = SurfaceArea(Combine(m_Nodes[m_Root].m_Box, leafBox));
+
+  // node index and the growth of its ancestors so far
+  int stack[AABB_TREE_STACK_SIZE];
+  float inherited[AABB_TREE_STACK_SIZE];
+  int count = 0;
+  stack[count] = m_Root;
+  inherited[count++] = 0.0f;
+  while (count > 0)
+  {
+    --count;
+    int index = stack[count];
+    float inheritedCost = inherited[count];
+
+    const Node& node = m_Nodes[index];
+    float combinedArea = SurfaceArea(Combine(node.m_Box, leafBox));
+    float cost = combinedArea + inheritedCost;
+    if (cost < bestCost)
+    {
+      bestCost = cost;
+      bestSibling = index;
+    }
+
+    // children at best cost the leaf area plus this node's growth
+    float childInherited = inheritedCost + combinedArea - SurfaceArea(node.m_Box);
+    if (!node.IsLeaf() && leafArea + childInherited < bestCost
+      && count + 2 <= AABB_TREE_STACK_SIZE)
+    {
+      // the child that grows least is likely the better branch, visit it first
+      int first = node.m_Child1;
+      int second = node.m_Child2;
+      if (SurfaceArea(Combine(m_Nodes[second].m_Box, leafBox)) - SurfaceArea(m_Nodes[second].m_Box)
+        < SurfaceArea(Combine(m_Nodes[first].m_Box, leafBox)) - SurfaceArea(m_Nodes[first].m_Box))
+      {
+        std::swap(first, second);
+      }
+      stack[count] = second;
+      inherited[count++] = childInherited;
+      stack[count] = first;
+      inherited[count++] = childInherited;
+    }
+  }
+  int index = bestSibling;
+  int sibling = index;
+
+  // new parent takes the sibling's place
+  int oldParent = m_Nodes[sibling].m_Parent;
+  int newParent = AllocateNode();
+  m_Nodes[newParent].m_Parent = oldParent;
+  m_Nodes[newParent].m_Box = Combine(leafBox, m_Nodes[sibling].m_Box);
+  m_Nodes[newParent].m_Height = m_Nodes[sibling].m_Height + 1;
+  m_Nodes[newParent].m_Child1 = sibling;
+  m_Nodes[newParent].m_Child2 = leaf;
+  m_Nodes[sibling].m_Parent = newParent;
+  m_Nodes[leaf].m_Parent = newParent;
+
+  if (oldParent == NullNode)
+  {
+    m_Root = newParent;
+  }
+  else if (m_Nodes[oldParent].m_Child1 == sibling)
+  {
+    m_Nodes[oldParent].m_Child1 = newParent;
+  }
+  else
+  {
+    m_Nodes[oldParent].m_Child2 = newParent;
+  }
+
+  // refit and rebalance back up to the root
+  index = m_Nodes[leaf].m_Parent;
+  while (index != NullNode)
+  {
+    index = Balance(index);
+
+    int child1 = m_Nodes[index].m_Child1;
+    int child2 = m_Nodes[index].m_Child2;
+    m_Nodes[index].m_Height = 1 + Math::Max(m_Nodes[child1].m_Height, m_Nodes[child2].m_Height);
+    m_Nodes[index].m_Box = Combine(m_Nodes[child1].m_Box, m_Nodes[child2].m_Box);
+
+    index = m_Nodes[index].m_Parent;
+  }
+}
+
+void AABBTree::RemoveLeaf(int leaf)
+{
+  if (leaf == m_Root)
+  {
+    m_Root = NullNode;
+    return;
+  }
+
+  // the sibling replaces the leaf's parent
+  int parent = m_Nodes[leaf].m_Parent;
+  int grandParent = m_Nodes[parent].m_Parent;
+  int sibling = m_Nodes[parent].m_Child1 == leaf ? m_Nodes[parent].m_Child2 : m_Nodes[parent].m_Child1;
+
+  if (grandParent == NullNode)
+  {
+    m_Root = sibling;
+    m_Nodes[sibling].m_Parent = NullNode;
+    FreeNode(parent);
+    return;
+  }
+
+  if (m_Nodes[grandParent].m_Child1 == parent)
+  {
+    m_Nodes[grandParent].m_Child1 = sibling;
+  }
+  else
+  {
+    m_Nodes[grandParent].m_Child2 = sibling;
+  }
+  m_Nodes[sibling].m_Parent = grandParent;
+  FreeNode(parent);
+
+  int index = grandParent;
+  while (index != NullNode)
+  {
+    index = Balance(index);
+
+    int child1 = m_Nodes[index].m_Child1;
+    int child2 = m_Nodes[index].m_Child2;
+    m_Nodes[index].m_Box = Combine(m_Nodes[child1].m_Box, m_Nodes[child2].m_Box);
+    m_Nodes[index].m_Height = 1 + Math::Max(m_Nodes[child1].m_Height, m_Nodes[child2].m_Height);
+
+    index = m_Nodes[index].m_Parent;
+  }
+}
+
+int AABBTree::Balance(int iA)
+{
+  // A has children B and C, C has children F and G (or B has D and E)
+  // if one side is more than one level taller, promote its root
+  Node& A = m_Nodes[iA];
+  if (A.IsLeaf() || A.m_Height < 2)
+  {
+    return iA;
+  }
+
+  int iB = A.m_Child1;
+  int iC = A.m_Child2;
+  Node& B = m_Nodes[iB];
+  Node& C = m_Nodes[iC];
+
+  int balance = C.m_Height - B.m_Height;
+
+  // rotate C up
+  if (balance > 1)
+  {
+    int iF = C.m_Child1;
+    int iG = C.m_Child2;
+    Node& F = m_Nodes[iF];
+    Node& G = m_Nodes[iG];
+
+    // swap A and C
+    C.m_Child1 = iA;
+    C.m_Parent = A.m_Parent;
+    A.m_Parent = iC;
+
+    // A's old parent should point to C
+    if (C.m_Parent != NullNode)
+    {
+      if (m_Nodes[C.m_Parent].m_Child1 == iA)
+      {
+        m_Nodes[C.m_Parent].m_Child1 = iC;
+      }
+      else
+      {
+        m_Nodes[C.m_Parent].m_Child2 = iC;
+      }
+    }
+    else
+    {
+      m_Root = iC;
+    }
+
+    // the taller of F/G stays under C
+    if (F.m_Height > G.m_Height)
+    {
+      C.m_Child2 = iF;
+      A.m_Child2 = iG;
+      G.m_Parent = iA;
+      A.m_Box = Combine(B.m_Box, G.m_Box);
+      C.m_Box = Combine(A.m_Box, F.m_Box);
+      A.m_Height = 1 + Math::Max(B.m_Height, G.m_Height);
+      C.m_Height = 1 + Math::Max(A.m_Height, F.m_Height);
+    }
+    else
+    {
+      C.m_Child2 = iG;
+      A.m_Child2 = iF;
+      F.m_Parent = iA;
+      A.m_Box = Combine(B.m_Box, F.m_Box);
+      C.m_Box = Combine(A.m_Box, G.m_Box);
+      A.m_Height = 1 + Math::Max(B.m_Height, F.m_Height);
+      C.m_Height = 1 + Math::Max(A.m_Height, G.m_Height);
+    }
+    return iC;
+  }
+
+  // rotate B up
+  if (balance < -1)
+  {
+    int iD = B.m_Child1;
+    int iE = B.m_Child2;
+    Node& D = m_Nodes[iD];
+    Node& E = m_Nodes[iE];
+
+    // swap A and B
+    B.m_Child1 = iA;
+    B.m_Parent = A.m_Parent;
+    A.m_Parent = iB;
+
+    if (B.m_Parent != NullNode)
+    {
+      if (m_Nodes[B.m_Parent].m_Child1 == iA)
+      {
+        m_Nodes[B.m_Parent].m_Child1 = iB;
+      }
+      else
+      {
+        m_Nodes[B.m_Parent].m_Child2 = iB;
+      }
+    }
+    else
+    {
+      m_Root = iB;
+    }
+
+    if (D.m_Height > E.m_Height)
+    {
+      B.m_Child2 = iD;
+      A.m_Child1 = iE;
+      E.m_Parent = iA;
+      A.m_Box = Combine(C.m_Box, E.m_Box);
+      B.m_Box = Combine(A.m_Box, D.m_Box);
+      A.m_Height = 1 + Math::Max(C.m_Height, E.m_Height);
+      B.m_Height = 1 + Math::Max(A.m_Height, D.m_Height);
+    }
+    else
+    {
+      B.m_Child2 = iE;
+      A.m_Child1 = iD;
+      D.m_Parent = iA;
+      A.m_Box = Combine(C.m_Box, D.m_Box);
+      B.m_Box = Combine(A.m_Box, E.m_Box);
+      A.m_Height = 1 + Math::Max(C.m_Height, D.m_Height);
+      B.m_Height = 1 + Math::Max(A.m_Height, E.m_Height);
+    }
+    return iB;
+  }
+
+  return iA;
+}
+
+int AABBTree::GetHeight() const
+{
+  return m_Root == NullNode ? 0 : m_Nodes[m_Root].m_Height;
+}
+
+size_t AABBTree::GetNumProxies() const
+{
+  return m_NumProxies;
+}
+
+float AABBTree::GetAreaRatio() const
+{
+  if (m_Root == NullNode) { return 0.0f; }
+
+  float rootArea = SurfaceArea(m_Nodes[m_Root].m_Box);
+  float totalArea = 0.0f;
+  for (const Node& node : m_Nodes)
+  {
+    // skip free nodes and leaves
+    if (node.m_Height > 0)
+    {
+      totalArea += SurfaceArea(node.m_Box);
+    }
+  }
+  return rootArea > 0.0f ? totalArea / rootArea : 0.0f;
+}
+
+void AABBTree::Clear()
+{
+  m_Nodes.clear();
+  m_Root = NullNode;
+  m_FreeList = NullNode;
+  m_NumProxies = 0;
+}
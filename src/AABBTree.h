@@ -0,0 +1,159 @@
+#pragma once
+
+#include "Collision.h"
+#include <vector>
+
+// dynamic bounding volume tree used as the PhysWorld broadphase
+// leaves hold "fat" boxes (the real box grown by a margin and the last
+// displacement) so small moves don't touch the tree at all, internal
+// nodes are kept height balanced and new leaves go where they add the
+// least surface area
+class AABBTree
+{
+public:
+  static const int NullNode = -1;
+
+  // up to 4 segments cast through the tree together, stored SoA so one
+  // node is tested against the whole packet at once. A segment covers
+  // start + t * (end - start) for t in [0, m_MaxT], lanes with m_MaxT < 0 are off
+  struct RayPacket
+  {
+    RayPacket();
+    void SetSegment(int lane, const LineSegment& segment);
+
+    alignas(16) float m_StartX[4];
+    alignas(16) float m_StartY[4];
+    alignas(16) float m_StartZ[4];
+    alignas(16) float m_InvDirX[4];
+    alignas(16) float m_InvDirY[4];
+    alignas(16) float m_InvDirZ[4];
+    alignas(16) float m_MaxT[4];
+  };
+
+  AABBTree(float margin = 1.0f, float displacementScale = 2.0f);
+
+  // returns the proxy id used for every other call
+  int CreateProxy(const AABB& box, void* userData);
+  void DestroyProxy(int proxy);
+
+  // returns true if box left the proxy's fat box and the leaf was reinserted
+  bool MoveProxy(int proxy, const AABB& box, const Vector3& displacement);
+
+  void* GetUserData(int proxy) const;
+  const AABB& GetFatBox(int proxy) const;
+
+  // calls callback(proxy) for every leaf whose fat box overlaps box,
+  // stops early if callback returns false
+  template <typename Callback>
+  void Query(const AABB& box, Callback&& callback) const;
+
+  // calls callback(proxy, laneMask) for every leaf whose fat box is crossed
+  // by the packet, bit i of laneMask set for lane i. The callback can lower
+  // packet.m_MaxT for a lane once it has a hit, pruning the rest of the walk
+  template <typename Callback>
+  void RayCast(RayPacket& packet, Callback&& callback) const;
+
+  // bit mask of the packet lanes that cross box
+  static int IntersectPacket(const AABB& box, const RayPacket& packet);
+
+  // 0 for an empty tree
+  int GetHeight() const;
+  size_t GetNumProxies() const;
+  // total internal node area / root area, lower is a better tree
+  float GetAreaRatio() const;
+
+  void Clear();
+
+private:
+  struct Node
+  {
+    Node();
+    bool IsLeaf() const { return m_Child1 == NullNode; }
+
+    AABB m_Box;
+    void* m_UserData;
+    // next free node while on the free list
+    int m_Parent;
+    int m_Child1;
+    int m_Child2;
+    // leaf = 0, free node = -1
+    int m_Height;
+  };
+
+  int AllocateNode();
+  void FreeNode(int node);
+
+  void InsertLeaf(int leaf);
+  void RemoveLeaf(int leaf);
+  // AVL style rotation, returns the node now at index's place
+  int Balance(int index);
+
+  std::vector<Node> m_Nodes;
+  int m_Root;
+  int m_FreeList;
+  size_t m_NumProxies;
+
+  float m_Margin;
+  float m_DisplacementScale;
+};
+
+// balanced trees stay well under this even with millions of proxies
+const int AABB_TREE_STACK_SIZE = 256;
+
+template <typename Callback>
+void AABBTree::Query(const AABB& box, Callback&& callback) const
+{
+  if (m_Root == NullNode) { return; }
+
+  // fixed stack so queries can run on any thread without allocating
+  int stack[AABB_TREE_STACK_SIZE];
+  int count = 0;
+  stack[count++] = m_Root;
+
+  while (count > 0)
+  {
+    const Node& node = m_Nodes[stack[--count]];
+    if (!Intersect(node.m_Box, box)) { continue; }
+
+    if (node.IsLeaf())
+    {
+      if (!callback(static_cast<int>(&node - m_Nodes.data())))
+      {
+        return;
+      }
+    }
+    else if (count + 2 <= AABB_TREE_STACK_SIZE)
+    {
+      stack[count++] = node.m_Child1;
+      stack[count++] = node.m_Child2;
+    }
+  }
+}
+
+template <typename Callback>
+void AABBTree::RayCast(RayPacket& packet, Callback&& callback) const
+{
+  if (m_Root == NullNode) { return; }
+
+  int stack[AABB_TREE_STACK_SIZE];
+  int count = 0;
+  stack[count++] = m_Root;
+
+  while (count > 0)
+  {
+    int index = stack[--count];
+    const Node& node = m_Nodes[index];
+    int laneMask = IntersectPacket(node.m_Box, packet);
+    if (laneMask == 0) { continue; }
+
+    if (node.IsLeaf())
+    {
+      callback(index, laneMask);
+    }
+    else if (count + 2 <= AABB_TREE_STACK_SIZE)
+    {
+      stack[count++] = node.m_Child1;
+      stack[count++] = node.m_Child2;
+    }
+  }
+}
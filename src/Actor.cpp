@@ -9,6 +9,9 @@ Actor::Actor(class Game* game)
   , m_Rotation(Quaternion::Identity)
   , m_Scale(1.0f)
   , m_RecomputeWorldTransform(true)
+  , m_Static(false)
+  , m_SceneSection(-1)
+  , m_GameIndex(0)
   , m_Game(game)
 {
   m_Game->AddActor(this);
@@ -127,6 +130,18 @@ Actor::State Actor::GetState() const { return m_State;}
 
 void Actor::SetState(State state) { m_State = state;}
 
+bool Actor::IsStatic() const { return m_Static; }
+
+void Actor::SetStatic(bool value) { m_Static = value; }
+
+int Actor::GetSceneSection() const { return m_SceneSection; }
+
+void Actor::SetSceneSection(int section) { m_SceneSection = section; }
+
+size_t Actor::GetGameIndex() const { return m_GameIndex; }
+
+void Actor::SetGameIndex(size_t index) { m_GameIndex = index; }
+
 const Vector3& Actor::GetPosition() const { return m_Position;}
 
 void Actor::SetPosition(const Vector3& pos)
@@ -184,6 +199,11 @@ void Actor::RemoveComponent(class Component* component)
   }
 }
 
+const std::vector<Component*>& Actor::GetComponents() const
+{
+  return m_Components;
+}
+
 void Actor::ClampToScreen(float& pos, int objSize, float lowerLimit, float upperLimit)
 {
   if (pos < lowerLimit + (objSize/2.0f))
@@ -20,6 +20,11 @@ private:
   float m_Scale; // 1.0f is 100%
   Quaternion m_Rotation;
   bool m_RecomputeWorldTransform;
+  bool m_Static;
+  // scene section that created it (SceneLoader), -1 if made in code
+  int m_SceneSection;
+  // slot in whichever of Game's actor lists holds it, kept by Game
+  size_t m_GameIndex;
 
   std::vector<class Component*> m_Components; // sorted by update order
   class Game* m_Game;
@@ -45,6 +50,14 @@ public:
   void SetRotation(const Quaternion& rotation);
   State GetState() const;
   void SetState(State state);
+  // static actors never move once the level is loaded, Game stops updating
+  // them and Renderer merges their meshes (Game::BuildStaticGeometry)
+  bool IsStatic() const;
+  void SetStatic(bool value);
+  int GetSceneSection() const;
+  void SetSceneSection(int section);
+  size_t GetGameIndex() const;
+  void SetGameIndex(size_t index);
   class Game* GetGame();
   Vector3 GetForward() const;
   Vector3 GetRight() const;
@@ -53,6 +66,8 @@ public:
   void ComputeWorldTransform();
   Matrix4 GetWorldTransform() const;
 
+  // sorted by update order
+  const std::vector<class Component*>& GetComponents() const;
   void AddComponent(class Component* component);
   void RemoveComponent(class Component* component);
 
@@ -1,5 +1,8 @@
 #include "Animation.h"
 #include "Skeleton.h"
+#include "LocalPose.h"
+#include "MatrixPalette.h"
+#include <algorithm>
 #include <fstream>
 #include <sstream>
 #include "include/rapidjson/document.h"
@@ -10,6 +13,8 @@ Animation::Animation()
 	, m_NumFrames(0)
 	, m_Duration(0.0f)
 	, m_FrameDuration(0.0f)
+	, m_BoneStride(0)
+	, m_IsCompressed(false)
 {}
 
 bool Animation::Load(const std::string& fileName)
@@ -65,7 +70,28 @@ bool Animation::Load(const std::string& fileName)
 	m_NumBones = bonecount.GetUint();
 	m_FrameDuration = m_Duration / (m_NumFrames - 1);
 
-	m_Tracks.resize(m_NumBones);
+	if (m_NumFrames < 2 || m_NumFrames > UINT16_MAX)
+	{
+		SDL_Log("Sequence %s has an unsupported number of frames.", fileName.c_str());
+		return false;
+	}
+
+	if (m_NumBones > MAX_SKELETON_BONES)
+	{
+		SDL_Log("Sequence %s exceeds maximum bone count.", fileName.c_str());
+		return false;
+	}
+
+	// pad to a whole number of SIMD lanes, start every key at identity
+	m_BoneStride = (m_NumBones + 3) & ~static_cast<size_t>(3);
+	size_t numKeys = m_NumFrames * m_BoneStride;
+	m_RotX.assign(numKeys, 0.0f);
+	m_RotY.assign(numKeys, 0.0f);
+	m_RotZ.assign(numKeys, 0.0f);
+	m_RotW.assign(numKeys, 1.0f);
+	m_TransX.assign(numKeys, 0.0f);
+	m_TransY.assign(numKeys, 0.0f);
+	m_TransZ.assign(numKeys, 0.0f);
 
 	const rapidjson::Value& tracks = sequence["tracks"];
 
@@ -84,6 +110,11 @@ bool Animation::Load(const std::string& fileName)
 		}
 
 		size_t boneIndex = tracks[i]["bone"].GetUint();
+		if (boneIndex >= m_NumBones)
+		{
+			SDL_Log("Animation %s: Track element %d has an invalid bone.", fileName.c_str(), i);
+			return false;
+		}
 
 		const rapidjson::Value& transforms = tracks[i]["transforms"];
 		if (!transforms.IsArray())
@@ -92,15 +123,13 @@ bool Animation::Load(const std::string& fileName)
 			return false;
 		}
 
-		BoneTransform temp;
-
 		if (transforms.Size() < m_NumFrames)
 		{
 			SDL_Log("Animation %s: Track element %d has fewer frames than expected.", fileName.c_str(), i);
 			return false;
 		}
 
-		for (rapidjson::SizeType j = 0; j < transforms.Size(); j++)
+		for (rapidjson::SizeType j = 0; j < m_NumFrames; j++)
 		{
 			const rapidjson::Value& rot = transforms[j]["rot"];
 			const rapidjson::Value& trans = transforms[j]["trans"];
@@ -111,16 +140,15 @@ bool Animation::Load(const std::string& fileName)
 				return false;
 			}
 
-			temp.m_Rotation.x = rot[0].GetDouble();
-			temp.m_Rotation.y = rot[1].GetDouble();
-			temp.m_Rotation.z = rot[2].GetDouble();
-			temp.m_Rotation.w = rot[3].GetDouble();
-
-			temp.m_Translation.x = trans[0].GetDouble();
-			temp.m_Translation.y = trans[1].GetDouble();
-			temp.m_Translation.z = trans[2].GetDouble();
+			size_t key = j * m_BoneStride + boneIndex;
+			m_RotX[key] = static_cast<float>(rot[0].GetDouble());
+			m_RotY[key] = static_cast<float>(rot[1].GetDouble());
+			m_RotZ[key] = static_cast<float>(rot[2].GetDouble());
+			m_RotW[key] = static_cast<float>(rot[3].GetDouble());
 
-			m_Tracks[boneIndex].emplace_back(temp);
+			m_TransX[key] = static_cast<float>(trans[0].GetDouble());
+			m_TransY[key] = static_cast<float>(trans[1].GetDouble());
+			m_TransZ[key] = static_cast<float>(trans[2].GetDouble());
 		}
 	}
 
@@ -131,49 +159,337 @@ bool Animation::Load(const std::string& fileName)
 size_t Animation::GetNumBones() const { return m_NumBones; }
 float Animation::GetDuration() const { return m_Duration; }
 float Animation::GetFrameDuration() const { return m_FrameDuration; }
+bool Animation::IsCompressed() const { return m_IsCompressed; }
+
+size_t Animation::GetKeyDataSize() const
+{
+  if (m_IsCompressed)
+  {
+    return m_Tracks.size() * sizeof(CompressedTrack)
+      + m_KeyFrames.size() * sizeof(uint16_t)
+      + m_KeyRotations.size() * sizeof(uint16_t)
+      + m_KeyTranslations.size() * sizeof(uint16_t);
+  }
+  return 7 * m_RotX.size() * sizeof(float);
+}
+
+namespace
+{
+  // smallest three: drop the largest component (its sign is made positive,
+  // q and -q are the same rotation) and store the other three in
+  // [-1/sqrt(2), 1/sqrt(2)] with 15 bits each, the 2-bit index of the
+  // dropped component goes in the top bit of the first two words
+  const float SqrtHalf = 0.70710678f;
+  const float RotQuantScale = 32767.0f;
+
+  void EncodeRotation(const Quaternion& q, uint16_t* out)
+  {
+    float c[4] = { q.x, q.y, q.z, q.w };
+    int largest = 0;
+    for (int i = 1; i < 4; ++i)
+    {
+      if (Math::Abs(c[i]) > Math::Abs(c[largest])) { largest = i; }
+    }
+    float sign = c[largest] < 0.0f ? -1.0f : 1.0f;
+
+    int word = 0;
+    for (int i = 0; i < 4; ++i)
+    {
+      if (i == largest) { continue; }
+      float v = Math::Clamp(c[i] * sign, -SqrtHalf, SqrtHalf);
+      float unit = (v / SqrtHalf) * 0.5f + 0.5f;
+      out[word++] = static_cast<uint16_t>(unit * RotQuantScale + 0.5f);
+    }
+    out[0] |= static_cast<uint16_t>((largest & 1) << 15);
+    out[1] |= static_cast<uint16_t>((largest >> 1) << 15);
+  }
+
+  inline void DecodeRotation(const uint16_t* in, float& x, float& y, float& z, float& w)
+  {
+    int largest = (in[0] >> 15) | ((in[1] >> 15) << 1);
+    float small[3];
+    for (int i = 0; i < 3; ++i)
+    {
+      float unit = (in[i] & 0x7fff) / RotQuantScale;
+      small[i] = (unit * 2.0f - 1.0f) * SqrtHalf;
+    }
+    float sumSq = small[0] * small[0] + small[1] * small[1] + small[2] * small[2];
+    float big = Math::Sqrt(Math::Max(0.0f, 1.0f - sumSq));
+
+    float c[4];
+    int word = 0;
+    for (int i = 0; i < 4; ++i)
+    {
+      c[i] = i == largest ? big : small[word++];
+    }
+    x = c[0];
+    y = c[1];
+    z = c[2];
+    w = c[3];
+  }
+
+  const float TransQuantScale = 65535.0f;
+}
 
 // fills the provided vector with the global (current) pose matrices
 // for each bone at the specified time in the animation
 void Animation::GetGlobalPoseAtTime(std::vector<Matrix4>& outPoses
   , const class Skeleton* inSkeleton, float inTime) const
+{
+  if (outPoses.size() != m_NumBones)
+  {
+    outPoses.resize(m_NumBones);
+  }
+
+  alignas(16) float storage[7 * MAX_SKELETON_BONES];
+  LocalPose pose;
+  pose.Attach(storage, m_NumBones);
+  SampleLocalPose(inTime, pose);
+  pose.ToGlobalPoses(inSkeleton, outPoses.data());
+}
+
+void Animation::SampleLocalPose(float inTime, LocalPose& outPose) const
+{
+  if (m_IsCompressed)
+  {
+    // decode just the keys we need onto the stack, no allocation
+    alignas(16) float storageA[7 * MAX_SKELETON_BONES];
+    alignas(16) float storageB[7 * MAX_SKELETON_BONES];
+    alignas(16) float boneT[MAX_SKELETON_BONES];
+    LocalPose a;
+    LocalPose b;
+    a.Attach(storageA, m_NumBones);
+    b.Attach(storageB, m_NumBones);
+    SampleCompressed(inTime, a, b, boneT);
+    LocalPose::Blend(a, b, 1.0f, boneT, outPose);
+    return;
+  }
+
+  // Figure out the current frame index and next frame
+  // (This assumes inTime is bounded by [0, AnimDuration]
+  size_t frame = static_cast<size_t>(inTime / m_FrameDuration);
+  size_t nextFrame = frame + 1;
+  // Calculate fractional value between frame and next frame
+  float pct = inTime / m_FrameDuration - frame;
+  // inTime == duration lands on the last frame, hold it
+  if (nextFrame >= m_NumFrames)
+  {
+    frame = m_NumFrames - 2;
+    nextFrame = m_NumFrames - 1;
+    pct = 1.0f;
+  }
+
+  LocalPose::Blend(GetFrame(frame), GetFrame(nextFrame), pct, nullptr, outPose);
+}
+
+LocalPose Animation::GetFrame(size_t frame) const
+{
+  // read only view of the frame's keys, Blend never writes to its inputs
+  const size_t key = frame * m_BoneStride;
+  LocalPose pose;
+  pose.m_RotX = const_cast<float*>(&m_RotX[key]);
+  pose.m_RotY = const_cast<float*>(&m_RotY[key]);
+  pose.m_RotZ = const_cast<float*>(&m_RotZ[key]);
+  pose.m_RotW = const_cast<float*>(&m_RotW[key]);
+  pose.m_TransX = const_cast<float*>(&m_TransX[key]);
+  pose.m_TransY = const_cast<float*>(&m_TransY[key]);
+  pose.m_TransZ = const_cast<float*>(&m_TransZ[key]);
+  pose.m_NumBones = m_NumBones;
+  return pose;
+}
+
+void Animation::SampleCompressed(float inTime, LocalPose& outA, LocalPose& outB
+  , float* outT) const
+{
+  float frame = Math::Clamp(inTime / m_FrameDuration, 0.0f, static_cast<float>(m_NumFrames - 1));
+  uint16_t whole = static_cast<uint16_t>(frame);
+
+  for (size_t bone = 0; bone < m_BoneStride; ++bone)
+  {
+    if (bone >= m_NumBones)
+    {
+      // padding lanes, keep them finite
+      outA.m_RotX[bone] = outA.m_RotY[bone] = outA.m_RotZ[bone] = 0.0f;
+      outB.m_RotX[bone] = outB.m_RotY[bone] = outB.m_RotZ[bone] = 0.0f;
+      outA.m_RotW[bone] = outB.m_RotW[bone] = 1.0f;
+      outA.m_TransX[bone] = outA.m_TransY[bone] = outA.m_TransZ[bone] = 0.0f;
+      outB.m_TransX[bone] = outB.m_TransY[bone] = outB.m_TransZ[bone] = 0.0f;
+      outT[bone] = 0.0f;
+      continue;
+    }
+    const CompressedTrack& track = m_Tracks[bone];
+    size_t keyA = track.m_FirstKey;
+    size_t keyB = keyA;
+    outT[bone] = 0.0f;
+
+    if (track.m_NumKeys > 1)
+    {
+      // last kept key at or before this frame
+      const uint16_t* frames = &m_KeyFrames[track.m_FirstKey];
+      size_t i = std::upper_bound(frames, frames + track.m_NumKeys, whole) - frames;
+      i = Math::Clamp<size_t>(i, 1, track.m_NumKeys - 1) - 1;
+
+      keyA = track.m_FirstKey + i;
+      keyB = keyA + 1;
+      float f0 = frames[i];
+      float f1 = frames[i + 1];
+      outT[bone] = Math::Clamp((frame - f0) / (f1 - f0), 0.0f, 1.0f);
+    }
+
+    DecodeRotation(&m_KeyRotations[keyA * 3]
+      , outA.m_RotX[bone], outA.m_RotY[bone], outA.m_RotZ[bone], outA.m_RotW[bone]);
+    DecodeRotation(&m_KeyRotations[keyB * 3]
+      , outB.m_RotX[bone], outB.m_RotY[bone], outB.m_RotZ[bone], outB.m_RotW[bone]);
+
+    const uint16_t* ta = &m_KeyTranslations[keyA * 3];
+    const uint16_t* tb = &m_KeyTranslations[keyB * 3];
+    outA.m_TransX[bone] = track.m_TransMin.x + ta[0] * track.m_TransScale.x;
+    outA.m_TransY[bone] = track.m_TransMin.y + ta[1] * track.m_TransScale.y;
+    outA.m_TransZ[bone] = track.m_TransMin.z + ta[2] * track.m_TransScale.z;
+    outB.m_TransX[bone] = track.m_TransMin.x + tb[0] * track.m_TransScale.x;
+    outB.m_TransY[bone] = track.m_TransMin.y + tb[1] * track.m_TransScale.y;
+    outB.m_TransZ[bone] = track.m_TransMin.z + tb[2] * track.m_TransScale.z;
+  }
+}
+
+bool Animation::SpanFits(size_t bone, size_t start, size_t end
+  , float rotTolerance, float transTolerance) const
+{
+  const size_t ks = start * m_BoneStride + bone;
+  const size_t ke = end * m_BoneStride + bone;
+  Quaternion qs(m_RotX[ks], m_RotY[ks], m_RotZ[ks], m_RotW[ks]);
+  Quaternion qe(m_RotX[ke], m_RotY[ke], m_RotZ[ke], m_RotW[ke]);
+  Vector3 ps(m_TransX[ks], m_TransY[ks], m_TransZ[ks]);
+  Vector3 pe(m_TransX[ke], m_TransY[ke], m_TransZ[ke]);
+
+  // cos of half the allowed angle, compared against |dot| of the quaternions
+  const float minDot = Math::Cos(rotTolerance * 0.5f);
+  const float maxDistSq = transTolerance * transTolerance;
+
+  for (size_t frame = start + 1; frame < end; ++frame)
+  {
+    float t = static_cast<float>(frame - start) / (end - start);
+    const size_t k = frame * m_BoneStride + bone;
+
+    Quaternion q = LocalPose::Nlerp(qs, qe, t);
+    Quaternion actual(m_RotX[k], m_RotY[k], m_RotZ[k], m_RotW[k]);
+    if (Math::Abs(Quaternion::Dot(q, actual)) < minDot)
+    {
+      return false;
+    }
+
+    Vector3 p = Vector3::Lerp(ps, pe, t);
+    Vector3 actualP(m_TransX[k], m_TransY[k], m_TransZ[k]);
+    if ((p - actualP).LengthSq() > maxDistSq)
+    {
+      return false;
+    }
+  }
+  return true;
+}
+
+bool Animation::IsTrackStatic(size_t bone, float rotTolerance, float transTolerance) const
+{
+  Quaternion q0(m_RotX[bone], m_RotY[bone], m_RotZ[bone], m_RotW[bone]);
+  Vector3 p0(m_TransX[bone], m_TransY[bone], m_TransZ[bone]);
+  const float minDot = Math::Cos(rotTolerance * 0.5f);
+  const float maxDistSq = transTolerance * transTolerance;
+
+  for (size_t frame = 1; frame < m_NumFrames; ++frame)
   {
-  	if (outPoses.size() != m_NumBones)
-  	{
-  		outPoses.resize(m_NumBones);
-  	}
-
-  	// Figure out the current frame index and next frame
-  	// (This assumes inTime is bounded by [0, AnimDuration]
-  	size_t frame = static_cast<size_t>(inTime / m_FrameDuration);
-  	size_t nextFrame = frame + 1;
-  	// Calculate fractional value between frame and next frame
-  	float pct = inTime / m_FrameDuration - frame;
-
-  	// Setup the pose for the root
-  	if (m_Tracks[0].size() > 0)
-  	{
-  		// Interpolate between the current frame's pose and the next frame
-  		BoneTransform interp = BoneTransform::Interpolate(m_Tracks[0][frame],
-  			m_Tracks[0][nextFrame], pct);
-  		outPoses[0] = interp.ToMatrix();
-  	}
-  	else
-  	{
-  		outPoses[0] = Matrix4::Identity;
-  	}
-
-  	const std::vector<Skeleton::Bone>& bones = inSkeleton->GetBones();
-  	// Now setup the poses for the rest
-  	for (size_t bone = 1; bone < m_NumBones; bone++)
-  	{
-  		Matrix4 localMat; // (Defaults to identity)
-  		if (m_Tracks[bone].size() > 0)
-  		{
-  			BoneTransform interp = BoneTransform::Interpolate(m_Tracks[bone][frame],
-  				m_Tracks[bone][nextFrame], pct);
-  			localMat = interp.ToMatrix();
-  		}
-
-  		outPoses[bone] = localMat * outPoses[bones[bone].m_Parent];
-  	}
+    const size_t k = frame * m_BoneStride + bone;
+    Quaternion q(m_RotX[k], m_RotY[k], m_RotZ[k], m_RotW[k]);
+    Vector3 p(m_TransX[k], m_TransY[k], m_TransZ[k]);
+    if (Math::Abs(Quaternion::Dot(q0, q)) < minDot
+      || (p - p0).LengthSq() > maxDistSq)
+    {
+      return false;
+    }
   }
+  return true;
+}
+
+void Animation::Compress(float rotTolerance, float transTolerance)
+{
+  if (m_IsCompressed || m_NumFrames < 2) { return; }
+
+  m_Tracks.resize(m_NumBones);
+  m_KeyFrames.clear();
+  m_KeyRotations.clear();
+  m_KeyTranslations.clear();
+
+  std::vector<size_t> keys;
+  for (size_t bone = 0; bone < m_NumBones; ++bone)
+  {
+    // greedily extend each span while its inner frames can be rebuilt
+    // from the two ends, then start a new span at the last good frame.
+    // a bone that never moves keeps just one key
+    keys.clear();
+    keys.emplace_back(0);
+    if (!IsTrackStatic(bone, rotTolerance, transTolerance))
+    {
+      size_t start = 0;
+      for (size_t end = start + 2; end < m_NumFrames; ++end)
+      {
+        if (!SpanFits(bone, start, end, rotTolerance, transTolerance))
+        {
+          start = end - 1;
+          keys.emplace_back(start);
+        }
+      }
+      keys.emplace_back(m_NumFrames - 1);
+    }
+
+    // translation range of this track for quantizing
+    Vector3 minT = Vector3::Infinity;
+    Vector3 maxT = Vector3::NegInfinity;
+    for (size_t frame = 0; frame < m_NumFrames; ++frame)
+    {
+      const size_t k = frame * m_BoneStride + bone;
+      minT.x = Math::Min(minT.x, m_TransX[k]);
+      minT.y = Math::Min(minT.y, m_TransY[k]);
+      minT.z = Math::Min(minT.z, m_TransZ[k]);
+      maxT.x = Math::Max(maxT.x, m_TransX[k]);
+      maxT.y = Math::Max(maxT.y, m_TransY[k]);
+      maxT.z = Math::Max(maxT.z, m_TransZ[k]);
+    }
+    Vector3 range = maxT - minT;
+
+    CompressedTrack& track = m_Tracks[bone];
+    track.m_FirstKey = static_cast<uint32_t>(m_KeyFrames.size());
+    track.m_NumKeys = static_cast<uint32_t>(keys.size());
+    track.m_TransMin = minT;
+    track.m_TransScale = range * (1.0f / TransQuantScale);
+
+    for (size_t frame : keys)
+    {
+      const size_t k = frame * m_BoneStride + bone;
+      m_KeyFrames.emplace_back(static_cast<uint16_t>(frame));
+
+      uint16_t rot[3];
+      EncodeRotation(Quaternion(m_RotX[k], m_RotY[k], m_RotZ[k], m_RotW[k]), rot);
+      m_KeyRotations.insert(m_KeyRotations.end(), rot, rot + 3);
+
+      float tx = Math::NearZero(range.x, 1e-6f) ? 0.0f : (m_TransX[k] - minT.x) / range.x;
+      float ty = Math::NearZero(range.y, 1e-6f) ? 0.0f : (m_TransY[k] - minT.y) / range.y;
+      float tz = Math::NearZero(range.z, 1e-6f) ? 0.0f : (m_TransZ[k] - minT.z) / range.z;
+      m_KeyTranslations.emplace_back(static_cast<uint16_t>(tx * TransQuantScale + 0.5f));
+      m_KeyTranslations.emplace_back(static_cast<uint16_t>(ty * TransQuantScale + 0.5f));
+      m_KeyTranslations.emplace_back(static_cast<uint16_t>(tz * TransQuantScale + 0.5f));
+    }
+  }
+
+  // release the raw keys
+  std::vector<float>().swap(m_RotX);
+  std::vector<float>().swap(m_RotY);
+  std::vector<float>().swap(m_RotZ);
+  std::vector<float>().swap(m_RotW);
+  std::vector<float>().swap(m_TransX);
+  std::vector<float>().swap(m_TransY);
+  std::vector<float>().swap(m_TransZ);
+
+  m_KeyFrames.shrink_to_fit();
+  m_KeyRotations.shrink_to_fit();
+  m_KeyTranslations.shrink_to_fit();
+  m_IsCompressed = true;
+}
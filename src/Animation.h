@@ -2,6 +2,7 @@
 
 #include "Math.h"
 #include "BoneTransform.h"
+#include <cstdint>
 #include <string>
 #include <vector>
 
@@ -20,13 +21,72 @@ public:
   // for each bone at the specified time in the animation
   void GetGlobalPoseAtTime(std::vector<Matrix4>& outPoses, const class Skeleton* inSkeleton, float inTime) const;
 
+  // samples the local pose of every bone at inTime (for blending),
+  // outPose must have storage for GetNumBones() bones
+  void SampleLocalPose(float inTime, class LocalPose& outPose) const;
+
+  // compresses the clip in place: drops keys that can be rebuilt by
+  // interpolating their neighbours within the given tolerances
+  // (radians / world units), stores rotations as 48-bit smallest-three and
+  // translations as 16-bit per axis in each bone's range.
+  // the uncompressed key data is freed afterwards
+  void Compress(float rotTolerance = 0.001f, float transTolerance = 0.01f);
+  bool IsCompressed() const;
+
+  // bytes used by key data (for memory budgets)
+  size_t GetKeyDataSize() const;
+
 private:
+  // view of one frame of the uncompressed keys
+  class LocalPose GetFrame(size_t frame) const;
+
+  // decodes the two keys bracketing inTime for every bone into outA/outB
+  // plus a per-bone blend factor between them
+  void SampleCompressed(float inTime, class LocalPose& outA, class LocalPose& outB, float* outT) const;
+
+  // can frames [start, end] of bone's uncompressed track be
+  // represented by interpolating just the two end keys?
+  bool SpanFits(size_t bone, size_t start, size_t end
+    , float rotTolerance, float transTolerance) const;
+  // does bone stay within tolerance of its first key for the whole clip?
+  bool IsTrackStatic(size_t bone, float rotTolerance, float transTolerance) const;
+
   size_t m_NumBones;
   size_t m_NumFrames;
   float m_Duration;
   float m_FrameDuration;
 
-  // transform info for each frame on the track
-  // each index in the outer vector is a bone, inner vector is a frame
-  std::vector<std::vector<BoneTransform>> m_Tracks;
+  // bones per frame rounded up to a multiple of 4 (one SIMD register)
+  size_t m_BoneStride;
+
+  // key data stored frame-major as structure of arrays,
+  // bone b of frame f is at index f * m_BoneStride + b.
+  // bones without a track (and padding) hold the identity transform
+  std::vector<float> m_RotX;
+  std::vector<float> m_RotY;
+  std::vector<float> m_RotZ;
+  std::vector<float> m_RotW;
+  std::vector<float> m_TransX;
+  std::vector<float> m_TransY;
+  std::vector<float> m_TransZ;
+
+  // compressed key data (after Compress), one track per bone
+  struct CompressedTrack
+  {
+    // range of this track's keys in the shared key arrays
+    uint32_t m_FirstKey;
+    uint32_t m_NumKeys;
+    // translation quantization range
+    Vector3 m_TransMin;
+    Vector3 m_TransScale;
+  };
+  std::vector<CompressedTrack> m_Tracks;
+  // frame index of each kept key
+  std::vector<uint16_t> m_KeyFrames;
+  // 3 x 16 bits per key: smallest three components, index of the
+  // dropped (largest) component packed in the top bits of the first two
+  std::vector<uint16_t> m_KeyRotations;
+  // 3 x 16 bits per key, range quantized per track
+  std::vector<uint16_t> m_KeyTranslations;
+  bool m_IsCompressed;
 };
@@ -0,0 +1,129 @@
+#include "AnimationSystem.h"
+#include "SkeletalMeshComponent.h"
+#include "Animation.h"
+#include "Game.h"
+#include "JobSystem.h"
+#include "Math.h"
+
+#include <algorithm>
+#include <functional>
+
+namespace
+{
+  // m_MeshJob entry for meshes with nothing playing
+  const size_t NoJob = static_cast<size_t>(-1);
+}
+
+AnimationSystem::AnimationSystem(Game* game)
+  :m_Game(game)
+  , m_Arenas(game->GetJobSystem()->GetNumThreads())
+  , m_CacheTimeStep(1.0f / 60.0f)
+{}
+
+size_t AnimationSystem::PoseKeyHash::operator()(const PoseKey& key) const
+{
+  size_t h = std::hash<const void*>()(key.m_Animation);
+  h ^= std::hash<const void*>()(key.m_Skeleton) + 0x9e3779b9 + (h << 6) + (h >> 2);
+  h ^= std::hash<long>()(key.m_Sample) + 0x9e3779b9 + (h << 6) + (h >> 2);
+  return h;
+}
+
+void AnimationSystem::Update()
+{
+  m_Jobs.clear();
+  m_JobLookup.clear();
+  m_MeshJob.resize(m_SkeletalMeshes.size());
+  for (ScratchArena& arena : m_Arenas)
+  {
+    arena.Reset();
+  }
+
+  // step 1: find the unique poses we need this frame (main thread)
+  for (size_t i = 0; i < m_SkeletalMeshes.size(); ++i)
+  {
+    SkeletalMeshComponent* sk = m_SkeletalMeshes[i];
+    const Animation* anim = sk->GetAnimation();
+    if (!anim || !sk->GetSkeleton())
+    {
+      m_MeshJob[i] = NoJob;
+      continue;
+    }
+
+    float time = sk->GetAnimTime();
+    // blended poses depend on more than one clip/time, never shared
+    if (m_CacheTimeStep > 0.0f && !sk->IsBlending())
+    {
+      // snap to the cache step so instances close in time share a pose
+      PoseKey key;
+      key.m_Animation = anim;
+      key.m_Skeleton = sk->GetSkeleton();
+      key.m_Sample = static_cast<long>(time / m_CacheTimeStep + 0.5f);
+
+      auto it = m_JobLookup.find(key);
+      if (it != m_JobLookup.end())
+      {
+        m_MeshJob[i] = it->second;
+        continue;
+      }
+
+      time = Math::Min(key.m_Sample * m_CacheTimeStep, anim->GetDuration());
+      m_JobLookup.emplace(key, m_Jobs.size());
+    }
+
+    PoseJob job;
+    job.m_Owner = sk;
+    job.m_Time = time;
+    m_MeshJob[i] = m_Jobs.size();
+    m_Jobs.emplace_back(job);
+  }
+
+  JobSystem* jobs = m_Game->GetJobSystem();
+
+  // step 2: evaluate each unique pose into its owner's palette
+  jobs->ParallelFor(m_Jobs.size(), 4, [this](size_t begin, size_t end)
+  {
+    for (size_t i = begin; i < end; ++i)
+    {
+      m_Jobs[i].m_Owner->ComputeMatrixPalette(m_Jobs[i].m_Time);
+    }
+  });
+
+  // step 3: instances that shared a pose copy it from the owner
+  jobs->ParallelFor(m_SkeletalMeshes.size(), 16, [this](size_t begin, size_t end)
+  {
+    for (size_t i = begin; i < end; ++i)
+    {
+      if (m_MeshJob[i] == NoJob) { continue; }
+      const SkeletalMeshComponent* owner = m_Jobs[m_MeshJob[i]].m_Owner;
+      if (owner != m_SkeletalMeshes[i])
+      {
+        m_SkeletalMeshes[i]->CopyPalette(*owner);
+      }
+    }
+  });
+}
+
+void AnimationSystem::AddSkeletalMesh(SkeletalMeshComponent* sk)
+{
+  m_SkeletalMeshes.emplace_back(sk);
+}
+
+void AnimationSystem::RemoveSkeletalMesh(SkeletalMeshComponent* sk)
+{
+  auto iter = std::find(m_SkeletalMeshes.begin(), m_SkeletalMeshes.end(), sk);
+  if (iter != m_SkeletalMeshes.end())
+  {
+    // swap to end of vector and pop off (avoid erase copies)
+    std::iter_swap(iter, m_SkeletalMeshes.end() - 1);
+    m_SkeletalMeshes.pop_back();
+  }
+}
+
+void AnimationSystem::SetCacheTimeStep(float step) { m_CacheTimeStep = step; }
+float AnimationSystem::GetCacheTimeStep() const { return m_CacheTimeStep; }
+size_t AnimationSystem::GetNumEvaluatedPoses() const { return m_Jobs.size(); }
+
+ScratchArena& AnimationSystem::GetScratchArena()
+{
+  return m_Arenas[JobSystem::GetThreadIndex()];
+}
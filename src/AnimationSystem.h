@@ -0,0 +1,74 @@
+#pragma once
+
+#include "ScratchArena.h"
+#include <cstddef>
+#include <unordered_map>
+#include <vector>
+
+// evaluates every playing SkeletalMeshComponent once per frame as a batch
+// spread over the job system. Instances playing the same clip on the same
+// skeleton at the same quantized time share one evaluated palette
+class AnimationSystem
+{
+public:
+  AnimationSystem(class Game* game);
+
+  // called by Game after all actors have updated (anim times advanced)
+  void Update();
+
+  void AddSkeletalMesh(class SkeletalMeshComponent* sk);
+  void RemoveSkeletalMesh(class SkeletalMeshComponent* sk);
+
+  // time step poses are snapped to when sharing between instances,
+  // 0 disables sharing (every instance evaluated at its exact time)
+  void SetCacheTimeStep(float step);
+  float GetCacheTimeStep() const;
+
+  // number of unique poses evaluated last update (for profiling)
+  size_t GetNumEvaluatedPoses() const;
+
+  // per-frame scratch memory for the calling thread (intermediate blend poses)
+  ScratchArena& GetScratchArena();
+
+private:
+  // identifies a pose that can be shared between instances
+  struct PoseKey
+  {
+    const class Animation* m_Animation;
+    const class Skeleton* m_Skeleton;
+    long m_Sample;
+
+    bool operator==(const PoseKey& other) const
+    {
+      return m_Animation == other.m_Animation
+        && m_Skeleton == other.m_Skeleton
+        && m_Sample == other.m_Sample;
+    }
+  };
+
+  struct PoseKeyHash
+  {
+    size_t operator()(const PoseKey& key) const;
+  };
+
+  // one unique pose to evaluate, written into m_Owner's palette
+  struct PoseJob
+  {
+    class SkeletalMeshComponent* m_Owner;
+    float m_Time;
+  };
+
+  class Game* m_Game;
+
+  std::vector<class SkeletalMeshComponent*> m_SkeletalMeshes;
+
+  // rebuilt each update, kept as members so capacity is reused
+  std::vector<PoseJob> m_Jobs;
+  std::vector<size_t> m_MeshJob; // job index for each entry in m_SkeletalMeshes
+  std::unordered_map<PoseKey, size_t, PoseKeyHash> m_JobLookup;
+
+  // one per job system thread, indexed by JobSystem::GetThreadIndex
+  std::vector<ScratchArena> m_Arenas;
+
+  float m_CacheTimeStep;
+};
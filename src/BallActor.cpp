@@ -4,6 +4,8 @@
 #include "BallMoveComp.h"
 #include "Mesh.h"
 #include "Renderer.h"
+#include "BoxComponent.h"
+#include "Constants.h"
 
 BallActor::BallActor(Game* game)
   :Actor(game)
@@ -16,6 +18,15 @@ BallActor::BallActor(Game* game)
   mc->SetMesh(mesh);
   m_MyMove = new BallMoveComp(this);
   m_MyMove->SetForwardSpeed(1500.0f);
+
+  // swept over each frame's move so fast balls can't skip through walls
+  BoxComponent* bc = new BoxComponent(this);
+  bc->SetObjectBox(mesh->GetBox());
+  bc->SetLayer(COLLISION_LAYER_PROJECTILE);
+  // passes through the player and other balls
+  bc->SetCollisionMask(COLLISION_LAYER_ALL & ~(COLLISION_LAYER_PLAYER | COLLISION_LAYER_PROJECTILE));
+  bc->SetCollisionMode(BoxComponent::E_ContinuousSphere);
+  m_MyMove->SetBox(bc);
 }
 
 void BallActor::UpdateActor(float deltaTime)
@@ -2,47 +2,55 @@
 #include "Actor.h"
 #include "Game.h"
 #include "PhysWorld.h"
-#include "TargetActor.h"
+#include "BoxComponent.h"
 #include "BallActor.h"
+#include "Constants.h"
 
 BallMoveComp::BallMoveComp(Actor* owner)
 	:MoveComponent(owner)
+	, m_Player(nullptr)
+	, m_Box(nullptr)
 {
 }
 
 void BallMoveComp::Update(float deltaTime)
 {
-	// Construct segment in direction of travel
-	const float segmentLength = 30.0f;
-	Vector3 start = m_Owner->GetPosition();
-	Vector3 dir = m_Owner->GetForward();
-	Vector3 end = start + dir * segmentLength;
-
-	// Create line segment
-	LineSegment l(start, end);
-
-	// Test segment vs world
 	PhysWorld* phys = m_Owner->GetGame()->GetPhysWorld();
-	PhysWorld::CollisionInfo info;
-	// (Don't collide vs player)
-	if (phys->SegmentCast(l, info) && info.m_Actor != m_Player)
+
+	// last frame's move was swept in PhysWorld's batch, which stopped us
+	// short of anything in the way
+	const PhysWorld::SweepResult* result = phys->GetSweepResult(m_SweepTicket);
+	if (result && result->m_Hit.m_Box)
 	{
 		// If we collided, reflect the ball about the normal
-		dir = Vector3::Reflect(dir, info.m_Normal);
+		Vector3 dir = Vector3::Reflect(m_Owner->GetForward(), result->m_Hit.m_Normal);
 		m_Owner->RotateToNewForward(dir);
 		// Did we hit a target?
-		TargetActor* target = dynamic_cast<TargetActor*>(info.m_Actor);
-		if (target)
+		if (result->m_Hit.m_Box->GetTag() == COLLISION_TAG_TARGET)
 		{
 			static_cast<BallActor*>(m_Owner)->HitTarget();
 		}
 	}
 
-	// Base class update moves based on forward speed
-	MoveComponent::Update(deltaTime);
+	// turning, gravity and the rest apply straight away as they always
+	// did, only the forward move is swept (it's what used to be ray cast).
+	// The sweep moves us, our box's collision mask keeps us off the player
+	// and other balls
+	Vector3 forward;
+	Vector3 other;
+	ComputeMove(deltaTime, forward, other);
+	m_Owner->SetPosition(m_Owner->GetPosition() + other);
+
+	PhysWorld::SweepQuery query{ m_Box, forward, COLLISION_LAYER_ALL, m_Player };
+	m_SweepTicket = phys->QueueSweep(query);
 }
 
 void BallMoveComp::SetPlayer(Actor* player)
 {
   m_Player = player;
 }
+
+void BallMoveComp::SetBox(BoxComponent* box)
+{
+  m_Box = box;
+}
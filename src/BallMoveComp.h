@@ -1,5 +1,6 @@
 #pragma once
 #include "MoveComponent.h"
+#include "PhysWorld.h"
 
 class BallMoveComp : public MoveComponent
 {
@@ -7,7 +8,11 @@ public:
 	BallMoveComp(class Actor* owner);
 
 	void SetPlayer(Actor* player);
+	void SetBox(class BoxComponent* box);
 	void Update(float deltaTime) override;
 protected:
 	class Actor* m_Player;
+	class BoxComponent* m_Box;
+	// last update's move, PhysWorld sweeps it after every actor has updated
+	PhysWorld::SweepTicket m_SweepTicket;
 };
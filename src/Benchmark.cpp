@@ -0,0 +1,703 @@
+#include "Benchmark.h"
+#include "Actor.h"
+#include "Animation.h"
+#include "BoneTransform.h"
+#include "BoxComponent.h"
+#include "Collision.h"
+#include "CollisionSIMD.h"
+#include "CpuSkinning.h"
+#include "Game.h"
+#include "JobSystem.h"
+#include "LocalPose.h"
+#include "MatrixPalette.h"
+#include "PhysWorld.h"
+#include "Skeleton.h"
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <random>
+#include <utility>
+#include <vector>
+#include <SDL2/SDL.h>
+
+namespace
+{
+  const size_t BENCH_NUM_BOXES = 4096;
+  const size_t BENCH_NUM_QUERIES = 1024;
+  const size_t BENCH_NUM_BONES = 68;
+  const size_t BENCH_NUM_VERTS = 20000;
+  // meshes skinned together by SkinBatch, each with its own output
+  const size_t BENCH_NUM_MESHES = 16;
+  // narrowphase: random shape pairs, close enough that most overlap
+  const size_t BENCH_NUM_SHAPE_PAIRS = 4096;
+  // broadphase: boxes in a cube this big, frames timed
+  const size_t BENCH_NUM_PHYS_BOXES = 2000;
+  const float BENCH_PHYS_WORLD_SIZE = 4000.0f;
+  const int BENCH_PHYS_FRAMES = 30;
+  // poses sampled evenly over the clip
+  const size_t BENCH_NUM_POSES = 1000;
+  // each timing is the best of this many runs, the first ones warm caches
+  const int BENCH_RUNS = 5;
+
+  double Seconds(Uint64 start)
+  {
+    return static_cast<double>(SDL_GetPerformanceCounter() - start)
+      / static_cast<double>(SDL_GetPerformanceFrequency());
+  }
+
+  OBB RandomOBB(std::mt19937& rng)
+  {
+    std::uniform_real_distribution<float> pos(0.0f, 200.0f);
+    std::uniform_real_distribution<float> size(10.0f, 80.0f);
+    std::uniform_real_distribution<float> unit(-1.0f, 1.0f);
+    std::uniform_real_distribution<float> angle(-Math::Pi, Math::Pi);
+    OBB box;
+    box.m_Center = Vector3(pos(rng), pos(rng), pos(rng));
+    box.m_Rotation = Quaternion(Vector3::Normalize(Vector3(unit(rng), unit(rng), unit(rng))), angle(rng));
+    box.m_Extents = Vector3(size(rng), size(rng), size(rng));
+    return box;
+  }
+
+  // world box around an OBB, what the broadphase works with
+  AABB BoundingBox(const OBB& box)
+  {
+    AABB bounds(box.m_Extents * -1.0f, box.m_Extents);
+    bounds.Rotate(box.m_Rotation);
+    bounds.m_Min += box.m_Center;
+    bounds.m_Max += box.m_Center;
+    return bounds;
+  }
+
+  // Intersect(LineSegment, AABB) as it was before the slab test: every
+  // face plane the segment crosses goes in a heap allocated vector, which
+  // is sorted, then each crossing point is checked against the box
+  bool OldTestSidePlane(float start, float end, float negd, const Vector3& norm,
+    std::vector<std::pair<float, Vector3>>& out)
+  {
+    float denom = end - start;
+    if (Math::NearZero(denom))
+    {
+      return false;
+    }
+    float t = (-start + negd) / denom;
+    if (t >= 0.0f && t <= 1.0f)
+    {
+      out.emplace_back(t, norm);
+      return true;
+    }
+    return false;
+  }
+
+  bool OldIntersect(const LineSegment& l, const AABB& b, float& outT, Vector3& outNorm)
+  {
+    std::vector<std::pair<float, Vector3>> tValues;
+    OldTestSidePlane(l.m_Start.x, l.m_End.x, b.m_Min.x, Vector3::NegUnitX, tValues);
+    OldTestSidePlane(l.m_Start.x, l.m_End.x, b.m_Max.x, Vector3::UnitX, tValues);
+    OldTestSidePlane(l.m_Start.y, l.m_End.y, b.m_Min.y, Vector3::NegUnitY, tValues);
+    OldTestSidePlane(l.m_Start.y, l.m_End.y, b.m_Max.y, Vector3::UnitY, tValues);
+    OldTestSidePlane(l.m_Start.z, l.m_End.z, b.m_Min.z, Vector3::NegUnitZ, tValues);
+    OldTestSidePlane(l.m_Start.z, l.m_End.z, b.m_Max.z, Vector3::UnitZ, tValues);
+
+    std::sort(tValues.begin(), tValues.end(), [](
+      const std::pair<float, Vector3>& a,
+      const std::pair<float, Vector3>& b) {
+      return a.first < b.first;
+    });
+    for (auto& t : tValues)
+    {
+      if (b.Contains(l.PointOnSegment(t.first)))
+      {
+        outT = t.first;
+        outNorm = t.second;
+        return true;
+      }
+    }
+    return false;
+  }
+
+  AABB RandomBox(std::mt19937& rng)
+  {
+    std::uniform_real_distribution<float> pos(-5000.0f, 5000.0f);
+    std::uniform_real_distribution<float> size(10.0f, 400.0f);
+    Vector3 min(pos(rng), pos(rng), pos(rng));
+    return AABB(min, min + Vector3(size(rng), size(rng), size(rng)));
+  }
+
+  // how Animation::GetGlobalPoseAtTime worked before the SoA keys: a
+  // vector of keys per bone, slerp, then rotation * translation matrices
+  void OldGlobalPoseAtTime(const std::vector<std::vector<BoneTransform>>& tracks
+    , const Skeleton* skeleton, float frameDuration, float inTime, std::vector<Matrix4>& outPoses)
+  {
+    size_t frame = static_cast<size_t>(inTime / frameDuration);
+    size_t nextFrame = frame + 1;
+    float pct = inTime / frameDuration - frame;
+
+    const std::vector<Skeleton::Bone>& bones = skeleton->GetBones();
+    for (size_t bone = 0; bone < tracks.size(); bone++)
+    {
+      Matrix4 localMat;
+      if (tracks[bone].size() > 0)
+      {
+        BoneTransform interp = BoneTransform::Interpolate(tracks[bone][frame], tracks[bone][nextFrame], pct);
+        localMat = Matrix4::CreateFromQuaternion(interp.m_Rotation)
+          * Matrix4::CreateTranslation(interp.m_Translation);
+      }
+      outPoses[bone] = bone == 0 ? localMat : localMat * outPoses[bones[bone].m_Parent];
+    }
+  }
+}
+
+bool Benchmark::Run(const std::string& name)
+{
+  bool found = false;
+  bool ok = true;
+  if (name.empty() || name == "collision")
+  {
+    found = true;
+    ok = Collision() && ok;
+  }
+  if (name.empty() || name == "narrowphase")
+  {
+    found = true;
+    ok = Narrowphase() && ok;
+  }
+  if (name.empty() || name == "broadphase")
+  {
+    found = true;
+    ok = Broadphase() && ok;
+  }
+  if (name.empty() || name == "animation")
+  {
+    found = true;
+    ok = Animation() && ok;
+  }
+  if (name.empty() || name == "skinning")
+  {
+    found = true;
+    ok = Skinning() && ok;
+  }
+  if (!found)
+  {
+    SDL_Log("Unknown benchmark %s", name.c_str());
+    return false;
+  }
+  return ok;
+}
+
+bool Benchmark::Collision()
+{
+  std::mt19937 rng(1234);
+  std::vector<AABB> boxes;
+  AABBArray boxArray;
+  boxes.reserve(BENCH_NUM_BOXES);
+  boxArray.Reserve(BENCH_NUM_BOXES);
+  for (size_t i = 0; i < BENCH_NUM_BOXES; ++i)
+  {
+    boxes.emplace_back(RandomBox(rng));
+    boxArray.Add(boxes.back());
+  }
+
+  std::vector<AABB> queryBoxes;
+  std::vector<LineSegment> segments;
+  std::uniform_real_distribution<float> pos(-5000.0f, 5000.0f);
+  for (size_t i = 0; i < BENCH_NUM_QUERIES; ++i)
+  {
+    queryBoxes.emplace_back(RandomBox(rng));
+    segments.emplace_back(Vector3(pos(rng), pos(rng), pos(rng)), Vector3(pos(rng), pos(rng), pos(rng)));
+  }
+
+  double boxTests = static_cast<double>(BENCH_NUM_BOXES * BENCH_NUM_QUERIES);
+  std::vector<int> hits(BENCH_NUM_BOXES);
+  bool ok = true;
+
+  // box against every box
+  double single = 1e9;
+  double batch = 1e9;
+  size_t singleCount = 0;
+  size_t batchCount = 0;
+  for (int run = 0; run < BENCH_RUNS; ++run)
+  {
+    Uint64 start = SDL_GetPerformanceCounter();
+    singleCount = 0;
+    for (const AABB& query : queryBoxes)
+    {
+      for (const AABB& box : boxes)
+      {
+        singleCount += Intersect(query, box) ? 1 : 0;
+      }
+    }
+    single = std::min(single, Seconds(start));
+
+    start = SDL_GetPerformanceCounter();
+    batchCount = 0;
+    for (const AABB& query : queryBoxes)
+    {
+      batchCount += CollisionSIMD::IntersectBox(query, boxArray, hits.data());
+    }
+    batch = std::min(batch, Seconds(start));
+  }
+  if (singleCount != batchCount)
+  {
+    SDL_Log("IntersectBox found %d overlaps, Intersect found %d"
+      , static_cast<int>(batchCount), static_cast<int>(singleCount));
+    ok = false;
+  }
+  SDL_Log("IntersectBox: %.1f M boxes/s, per box Intersect %.1f M boxes/s (%.2fx)"
+    , boxTests / batch * 1e-6, boxTests / single * 1e-6, single / batch);
+
+  // closest hit along a segment, the original allocating test is the baseline
+  double old = 1e9;
+  single = 1e9;
+  batch = 1e9;
+  int mismatches = 0;
+  int oldMismatches = 0;
+  for (int run = 0; run < BENCH_RUNS; ++run)
+  {
+    std::vector<int> oldHits(BENCH_NUM_QUERIES, -1);
+    Uint64 start = SDL_GetPerformanceCounter();
+    for (size_t q = 0; q < BENCH_NUM_QUERIES; ++q)
+    {
+      float closestT = Math::Infinity;
+      for (size_t i = 0; i < BENCH_NUM_BOXES; ++i)
+      {
+        float t;
+        Vector3 norm;
+        if (OldIntersect(segments[q], boxes[i], t, norm) && t < closestT)
+        {
+          closestT = t;
+          oldHits[q] = static_cast<int>(i);
+        }
+      }
+    }
+    old = std::min(old, Seconds(start));
+
+    std::vector<int> singleHits(BENCH_NUM_QUERIES, -1);
+    start = SDL_GetPerformanceCounter();
+    for (size_t q = 0; q < BENCH_NUM_QUERIES; ++q)
+    {
+      float closestT = Math::Infinity;
+      for (size_t i = 0; i < BENCH_NUM_BOXES; ++i)
+      {
+        float t;
+        Vector3 norm;
+        if (Intersect(segments[q], boxes[i], t, norm) && t < closestT)
+        {
+          closestT = t;
+          singleHits[q] = static_cast<int>(i);
+        }
+      }
+    }
+    single = std::min(single, Seconds(start));
+
+    std::vector<int> batchHits(BENCH_NUM_QUERIES);
+    start = SDL_GetPerformanceCounter();
+    for (size_t q = 0; q < BENCH_NUM_QUERIES; ++q)
+    {
+      float t;
+      Vector3 norm;
+      batchHits[q] = CollisionSIMD::IntersectSegment(segments[q], boxArray, t, norm);
+    }
+    batch = std::min(batch, Seconds(start));
+
+    mismatches = 0;
+    oldMismatches = 0;
+    for (size_t q = 0; q < BENCH_NUM_QUERIES; ++q)
+    {
+      mismatches += singleHits[q] != batchHits[q] ? 1 : 0;
+      oldMismatches += oldHits[q] != batchHits[q] ? 1 : 0;
+    }
+  }
+  if (mismatches > 0)
+  {
+    SDL_Log("IntersectSegment picked a different box for %d of %d segments"
+      , mismatches, static_cast<int>(BENCH_NUM_QUERIES));
+    ok = false;
+  }
+  // not a failure: the old test checks each crossing point against the
+  // box, and rounding puts some points on a face just outside it
+  if (oldMismatches > 0)
+  {
+    SDL_Log("The old Intersect missed the closest box for %d of %d segments"
+      , oldMismatches, static_cast<int>(BENCH_NUM_QUERIES));
+  }
+  SDL_Log("IntersectSegment: %.1f M boxes/s, per box Intersect %.1f M boxes/s, old per box Intersect %.1f M boxes/s (%.2fx, %.2fx)"
+    , boxTests / batch * 1e-6, boxTests / single * 1e-6, boxTests / old * 1e-6, old / batch, old / single);
+
+  return ok;
+}
+
+bool Benchmark::Narrowphase()
+{
+  std::mt19937 rng(1234);
+  std::uniform_real_distribution<float> offset(-60.0f, 60.0f);
+  std::uniform_real_distribution<float> radius(5.0f, 40.0f);
+  std::vector<OBB> a;
+  std::vector<OBB> b;
+  std::vector<AABB> boundsA;
+  std::vector<AABB> boundsB;
+  std::vector<Capsule> capsules;
+  for (size_t i = 0; i < BENCH_NUM_SHAPE_PAIRS; ++i)
+  {
+    a.emplace_back(RandomOBB(rng));
+    b.emplace_back(RandomOBB(rng));
+    boundsA.emplace_back(BoundingBox(a.back()));
+    boundsB.emplace_back(BoundingBox(b.back()));
+    Vector3 center = b.back().m_Center;
+    Vector3 start = center + Vector3(offset(rng), offset(rng), offset(rng));
+    Vector3 end = center + Vector3(offset(rng), offset(rng), offset(rng));
+    capsules.emplace_back(Capsule{ LineSegment(start, end), radius(rng) });
+  }
+
+  // 0 world boxes, 1 OBB SAT, 2 OBB manifold, 3 capsule, 4 capsule manifold
+  const int numTests = 5;
+  double times[numTests];
+  size_t hits[numTests];
+  std::fill(times, times + numTests, 1e9);
+  ContactManifold manifold;
+  for (int run = 0; run < BENCH_RUNS; ++run)
+  {
+    for (int test = 0; test < numTests; ++test)
+    {
+      hits[test] = 0;
+      Uint64 start = SDL_GetPerformanceCounter();
+      for (size_t i = 0; i < BENCH_NUM_SHAPE_PAIRS; ++i)
+      {
+        bool hit = false;
+        switch (test)
+        {
+        case 0: hit = Intersect(boundsA[i], boundsB[i]); break;
+        case 1: hit = Intersect(a[i], b[i]); break;
+        case 2: hit = Intersect(a[i], b[i], manifold); break;
+        case 3: hit = Intersect(capsules[i], b[i]); break;
+        default: hit = Intersect(capsules[i], b[i], manifold); break;
+        }
+        hits[test] += hit ? 1 : 0;
+      }
+      times[test] = std::min(times[test], Seconds(start));
+    }
+  }
+
+  bool ok = true;
+  if (hits[1] != hits[2] || hits[3] != hits[4] || hits[1] > hits[0])
+  {
+    SDL_Log("Narrowphase results disagree: world boxes %d, OBB %d / %d with manifold, capsule %d / %d with manifold"
+      , static_cast<int>(hits[0]), static_cast<int>(hits[1]), static_cast<int>(hits[2])
+      , static_cast<int>(hits[3]), static_cast<int>(hits[4]));
+    ok = false;
+  }
+
+  double pairs = static_cast<double>(BENCH_NUM_SHAPE_PAIRS);
+  SDL_Log("World boxes: %.1f M tests/s, %d of %d pairs overlap", pairs / times[0] * 1e-6
+    , static_cast<int>(hits[0]), static_cast<int>(BENCH_NUM_SHAPE_PAIRS));
+  SDL_Log("OBB SAT: %.1f M tests/s, %.1f M tests/s with manifold, %d overlap (%d world box overlaps rejected)"
+    , pairs / times[1] * 1e-6, pairs / times[2] * 1e-6, static_cast<int>(hits[1])
+    , static_cast<int>(hits[0] - hits[1]));
+  SDL_Log("Capsule vs OBB: %.1f M tests/s, %.1f M tests/s with manifold, %d overlap"
+    , pairs / times[3] * 1e-6, pairs / times[4] * 1e-6, static_cast<int>(hits[3]));
+  return ok;
+}
+
+bool Benchmark::Broadphase()
+{
+  Game game;
+  game.InitializeHeadless();
+  PhysWorld* phys = game.GetPhysWorld();
+
+  std::mt19937 rng(1234);
+  std::uniform_real_distribution<float> pos(0.0f, BENCH_PHYS_WORLD_SIZE);
+  std::uniform_real_distribution<float> size(20.0f, 150.0f);
+  std::uniform_real_distribution<float> step(-20.0f, 20.0f);
+  std::vector<Actor*> actors;
+  for (size_t i = 0; i < BENCH_NUM_PHYS_BOXES; ++i)
+  {
+    Actor* actor = new Actor(&game);
+    actor->SetPosition(Vector3(pos(rng), pos(rng), pos(rng)));
+    BoxComponent* box = new BoxComponent(actor);
+    Vector3 half(size(rng), size(rng), size(rng));
+    box->SetObjectBox(AABB(half * -0.5f, half * 0.5f));
+    actor->ComputeWorldTransform();
+    actors.emplace_back(actor);
+  }
+
+  // one warm up call each, so the incremental ones start from a full set
+  phys->TestPairwise();
+  phys->TestSweepAndPrune();
+  phys->TestTree();
+
+  double times[3] = {};
+  bool ok = true;
+  for (int frame = 0; frame < BENCH_PHYS_FRAMES; ++frame)
+  {
+    for (size_t i = frame % 4; i < actors.size(); i += 4)
+    {
+      actors[i]->SetPosition(actors[i]->GetPosition() + Vector3(step(rng), step(rng), step(rng)));
+      actors[i]->ComputeWorldTransform();
+    }
+
+    // every method sees the same boxes, so each finds the same touching pairs
+    size_t touching[3];
+    for (int method = 0; method < 3; ++method)
+    {
+      Uint64 start = SDL_GetPerformanceCounter();
+      if (method == 0) { phys->TestPairwise(); }
+      else if (method == 1) { phys->TestSweepAndPrune(); }
+      else { phys->TestTree(); }
+      times[method] += Seconds(start);
+
+      size_t begins;
+      size_t stays;
+      phys->GetContactEvents(PhysWorld::ContactEvent::E_Begin, begins);
+      phys->GetContactEvents(PhysWorld::ContactEvent::E_Stay, stays);
+      touching[method] = begins + stays;
+    }
+    if (touching[0] != touching[1] || touching[0] != touching[2])
+    {
+      SDL_Log("Frame %d touching pairs: pairwise %d, sweep and prune %d, tree %d", frame
+        , static_cast<int>(touching[0]), static_cast<int>(touching[1]), static_cast<int>(touching[2]));
+      ok = false;
+    }
+  }
+
+  size_t numEvents = phys->GetContactEvents().size();
+  SDL_Log("%d boxes, %d contact events: TestPairwise %.3f ms/frame, TestSweepAndPrune %.3f ms/frame, TestTree %.3f ms/frame"
+    , static_cast<int>(BENCH_NUM_PHYS_BOXES), static_cast<int>(numEvents)
+    , times[0] / BENCH_PHYS_FRAMES * 1e3, times[1] / BENCH_PHYS_FRAMES * 1e3, times[2] / BENCH_PHYS_FRAMES * 1e3);
+
+  // deleting the actors takes their boxes out of PhysWorld
+  game.ShutDown();
+  return ok;
+}
+
+bool Benchmark::Skinning()
+{
+  std::mt19937 rng(1234);
+  std::uniform_real_distribution<float> unit(-1.0f, 1.0f);
+  std::uniform_real_distribution<float> angle(-Math::Pi, Math::Pi);
+
+  std::vector<Matrix4> palette(BENCH_NUM_BONES);
+  for (Matrix4& m : palette)
+  {
+    Quaternion rot(Vector3::Normalize(Vector3(unit(rng), unit(rng), unit(rng))), angle(rng));
+    m = Matrix4::CreateFromQuaternion(rot)
+      * Matrix4::CreateTranslation(Vector3(unit(rng), unit(rng), unit(rng)) * 100.0f);
+  }
+
+  // PosNormSkinTex vertices, most weighted to 2-4 bones like a real rig
+  std::vector<float> vertices(BENCH_NUM_VERTS * SKIN_VERTEX_SIZE);
+  std::uniform_int_distribution<int> bone(0, static_cast<int>(BENCH_NUM_BONES) - 1);
+  std::uniform_int_distribution<int> numWeights(1, 4);
+  for (size_t i = 0; i < BENCH_NUM_VERTS; ++i)
+  {
+    float* v = &vertices[i * SKIN_VERTEX_SIZE];
+    Vector3 normal = Vector3::Normalize(Vector3(unit(rng), unit(rng), unit(rng)));
+    v[0] = unit(rng) * 100.0f;
+    v[1] = unit(rng) * 100.0f;
+    v[2] = unit(rng) * 100.0f;
+    v[3] = normal.x;
+    v[4] = normal.y;
+    v[5] = normal.z;
+    uint8_t bones[4] = { 0, 0, 0, 0 };
+    uint8_t weights[4] = { 0, 0, 0, 0 };
+    int count = numWeights(rng);
+    int left = 255;
+    for (int b = 0; b < count; ++b)
+    {
+      bones[b] = static_cast<uint8_t>(bone(rng));
+      weights[b] = static_cast<uint8_t>(b == count - 1 ? left : left / 2);
+      left -= weights[b];
+    }
+    memcpy(&v[6], bones, 4);
+    memcpy(&v[7], weights, 4);
+    v[8] = 0.0f;
+    v[9] = 0.0f;
+  }
+
+  std::vector<Vector3> positions(BENCH_NUM_VERTS);
+  std::vector<Vector3> normals(BENCH_NUM_VERTS);
+  double withNormals = 1e9;
+  double positionsOnly = 1e9;
+  for (int run = 0; run < BENCH_RUNS; ++run)
+  {
+    Uint64 start = SDL_GetPerformanceCounter();
+    CpuSkinning::SkinVertices(vertices.data(), BENCH_NUM_VERTS, palette.data()
+      , positions.data(), normals.data());
+    withNormals = std::min(withNormals, Seconds(start));
+
+    start = SDL_GetPerformanceCounter();
+    CpuSkinning::SkinVertices(vertices.data(), BENCH_NUM_VERTS, palette.data()
+      , positions.data(), nullptr);
+    positionsOnly = std::min(positionsOnly, Seconds(start));
+  }
+
+  // check against the plain Vector3::Transform blend Skinned.vert does
+  bool ok = true;
+  float maxError = 0.0f;
+  for (size_t i = 0; i < BENCH_NUM_VERTS; ++i)
+  {
+    const float* v = &vertices[i * SKIN_VERTEX_SIZE];
+    uint8_t bones[4];
+    uint8_t weights[4];
+    memcpy(bones, &v[6], 4);
+    memcpy(weights, &v[7], 4);
+    Vector3 pos(0.0f, 0.0f, 0.0f);
+    for (int b = 0; b < 4; ++b)
+    {
+      pos += (weights[b] / 255.0f) * Vector3::Transform(Vector3(v[0], v[1], v[2]), palette[bones[b]], 1.0f);
+    }
+    maxError = std::max(maxError, (pos - positions[i]).Length());
+  }
+  if (maxError > 0.01f)
+  {
+    SDL_Log("SkinVertices is off by up to %f from the reference blend", maxError);
+    ok = false;
+  }
+
+  double verts = static_cast<double>(BENCH_NUM_VERTS);
+  SDL_Log("SkinVertices: %.1f M verts/s with normals, %.1f M verts/s positions only"
+    , verts / withNormals * 1e-6, verts / positionsOnly * 1e-6);
+
+  // many meshes, one after another and then spread over the job system
+  JobSystem jobs;
+  jobs.Initialize();
+  std::vector<std::vector<Vector3>> meshPositions(BENCH_NUM_MESHES, std::vector<Vector3>(BENCH_NUM_VERTS));
+  std::vector<std::vector<Vector3>> meshNormals(BENCH_NUM_MESHES, std::vector<Vector3>(BENCH_NUM_VERTS));
+  std::vector<CpuSkinning::Job> batch(BENCH_NUM_MESHES);
+  for (size_t i = 0; i < BENCH_NUM_MESHES; ++i)
+  {
+    batch[i] = CpuSkinning::Job{ vertices.data(), BENCH_NUM_VERTS, palette.data()
+      , meshPositions[i].data(), meshNormals[i].data() };
+  }
+  double serial = 1e9;
+  double batched = 1e9;
+  for (int run = 0; run < BENCH_RUNS; ++run)
+  {
+    Uint64 start = SDL_GetPerformanceCounter();
+    for (const CpuSkinning::Job& job : batch)
+    {
+      CpuSkinning::SkinVertices(job.m_Vertices, job.m_NumVerts, job.m_Palette
+        , job.m_OutPositions, job.m_OutNormals);
+    }
+    serial = std::min(serial, Seconds(start));
+
+    start = SDL_GetPerformanceCounter();
+    CpuSkinning::SkinBatch(&jobs, batch.data(), batch.size());
+    batched = std::min(batched, Seconds(start));
+  }
+  for (size_t i = 0; i < BENCH_NUM_MESHES; ++i)
+  {
+    if (memcmp(meshPositions[i].data(), positions.data(), BENCH_NUM_VERTS * sizeof(Vector3)) != 0)
+    {
+      SDL_Log("SkinBatch mesh %d doesn't match SkinVertices", static_cast<int>(i));
+      ok = false;
+      break;
+    }
+  }
+  SDL_Log("SkinBatch: %d meshes on %u threads %.1f M verts/s, one by one %.1f M verts/s (%.2fx)"
+    , static_cast<int>(BENCH_NUM_MESHES), jobs.GetNumThreads()
+    , verts * BENCH_NUM_MESHES / batched * 1e-6, verts * BENCH_NUM_MESHES / serial * 1e-6, serial / batched);
+  jobs.ShutDown();
+  return ok;
+}
+
+bool Benchmark::Animation()
+{
+  Skeleton skeleton;
+  ::Animation soa;
+  ::Animation compressed;
+  if (!skeleton.Load("assets/CatWarrior.gpskel") || !soa.Load("assets/CatRunSprint.gpanim")
+    || !compressed.Load("assets/CatRunSprint.gpanim"))
+  {
+    return false;
+  }
+  compressed.Compress();
+  size_t numBones = soa.GetNumBones();
+  if (numBones != skeleton.GetNumBones())
+  {
+    SDL_Log("CatRunSprint has %d bones, the skeleton %d", static_cast<int>(numBones)
+      , static_cast<int>(skeleton.GetNumBones()));
+    return false;
+  }
+
+  // the old per bone key vectors, read back from the SoA keys on each frame
+  size_t numFrames = static_cast<size_t>(soa.GetDuration() / soa.GetFrameDuration() + 0.5f) + 1;
+  std::vector<std::vector<BoneTransform>> tracks(numBones);
+  alignas(16) float storage[7 * MAX_SKELETON_BONES];
+  LocalPose key;
+  key.Attach(storage, numBones);
+  for (size_t frame = 0; frame < numFrames; ++frame)
+  {
+    soa.SampleLocalPose(frame * soa.GetFrameDuration(), key);
+    for (size_t bone = 0; bone < numBones; ++bone)
+    {
+      BoneTransform transform;
+      transform.m_Rotation = Quaternion(key.m_RotX[bone], key.m_RotY[bone], key.m_RotZ[bone], key.m_RotW[bone]);
+      transform.m_Translation = Vector3(key.m_TransX[bone], key.m_TransY[bone], key.m_TransZ[bone]);
+      tracks[bone].emplace_back(transform);
+    }
+  }
+
+  // stays short of the last frame, the old path reads the next frame's keys
+  std::vector<float> times(BENCH_NUM_POSES);
+  for (size_t i = 0; i < BENCH_NUM_POSES; ++i)
+  {
+    times[i] = soa.GetFrameDuration() * (numFrames - 1) * i / BENCH_NUM_POSES;
+  }
+
+  std::vector<Matrix4> oldPoses(numBones);
+  std::vector<Matrix4> soaPoses(numBones);
+  std::vector<Matrix4> compressedPoses(numBones);
+  double oldTime = 1e9;
+  double soaTime = 1e9;
+  double compressedTime = 1e9;
+  float soaError = 0.0f;
+  float compressedError = 0.0f;
+  for (int run = 0; run < BENCH_RUNS; ++run)
+  {
+    Uint64 start = SDL_GetPerformanceCounter();
+    for (float t : times)
+    {
+      OldGlobalPoseAtTime(tracks, &skeleton, soa.GetFrameDuration(), t, oldPoses);
+    }
+    oldTime = std::min(oldTime, Seconds(start));
+
+    start = SDL_GetPerformanceCounter();
+    for (float t : times)
+    {
+      soa.GetGlobalPoseAtTime(soaPoses, &skeleton, t);
+    }
+    soaTime = std::min(soaTime, Seconds(start));
+
+    start = SDL_GetPerformanceCounter();
+    for (float t : times)
+    {
+      compressed.GetGlobalPoseAtTime(compressedPoses, &skeleton, t);
+    }
+    compressedTime = std::min(compressedTime, Seconds(start));
+  }
+
+  // bone positions against the old path over the whole clip
+  for (float t : times)
+  {
+    OldGlobalPoseAtTime(tracks, &skeleton, soa.GetFrameDuration(), t, oldPoses);
+    soa.GetGlobalPoseAtTime(soaPoses, &skeleton, t);
+    compressed.GetGlobalPoseAtTime(compressedPoses, &skeleton, t);
+    for (size_t bone = 0; bone < numBones; ++bone)
+    {
+      Vector3 oldPos = oldPoses[bone].GetTranslation();
+      soaError = std::max(soaError, (soaPoses[bone].GetTranslation() - oldPos).Length());
+      compressedError = std::max(compressedError, (compressedPoses[bone].GetTranslation() - oldPos).Length());
+    }
+  }
+
+  double poses = static_cast<double>(BENCH_NUM_POSES);
+  SDL_Log("GetGlobalPoseAtTime: per bone slerp %.2f us/pose, SoA %.2f us/pose (%.2fx), compressed %.2f us/pose (%.2fx)"
+    , oldTime / poses * 1e6, soaTime / poses * 1e6, oldTime / soaTime
+    , compressedTime / poses * 1e6, oldTime / compressedTime);
+  SDL_Log("Bone positions differ from per bone slerp by up to %f (SoA), %f (compressed)"
+    , soaError, compressedError);
+  SDL_Log("Key data: %d bytes SoA, %d bytes compressed", static_cast<int>(soa.GetKeyDataSize())
+    , static_cast<int>(compressed.GetKeyDataSize()));
+  return true;
+}
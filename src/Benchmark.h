@@ -0,0 +1,38 @@
+#pragma once
+
+#include <string>
+
+// micro benchmarks for the batch kernels, run from the command line with
+// --bench, no window is opened. Each one checks the batch results against
+// the plain version before logging throughput
+class Benchmark
+{
+public:
+  // name picks one ("collision", "narrowphase", "broadphase",
+  // "skinning", "animation"), empty runs them all. False when the
+  // name is unknown or results didn't match
+  static bool Run(const std::string& name);
+
+  // CollisionSIMD box / segment tests against the Collision.h versions
+  // called once per box, in boxes tested per second. Segments are also
+  // timed with the original allocating Intersect, as the baseline
+  static bool Collision();
+
+  // PhysWorld::TestPairwise, TestSweepAndPrune and TestTree on the same
+  // boxes, a quarter of them moving each frame, in ms per frame
+  static bool Broadphase();
+
+  // SAT OBB / capsule tests with and without contact manifolds, in tests
+  // per second, and how many world box overlaps the OBB test rejects
+  static bool Narrowphase();
+
+  // CpuSkinning::SkinVertices on a made up 68 bone mesh, in vertices
+  // skinned per second with and without normals, then SkinBatch over
+  // several copies of it against skinning them one by one
+  static bool Skinning();
+
+  // CatRunSprint on the CatWarrior skeleton, global poses per second from
+  // the frame-major SoA keys and the compressed keys, against the
+  // per-bone slerp and matrix multiplies the clips used before
+  static bool Animation();
+};
@@ -0,0 +1,50 @@
+#include "BoneMask.h"
+#include "Skeleton.h"
+#include "LocalPose.h"
+
+#include <algorithm>
+
+BoneMask::BoneMask()
+  :m_Skeleton(nullptr)
+{}
+
+void BoneMask::Reset(const Skeleton* skeleton, float weight)
+{
+  m_Skeleton = skeleton;
+  size_t numBones = skeleton ? skeleton->GetNumBones() : 0;
+  m_Weights.assign(LocalPose::GetStride(numBones), 0.0f);
+  std::fill(m_Weights.begin(), m_Weights.begin() + numBones, weight);
+}
+
+bool BoneMask::SetSubtreeWeight(const std::string& boneName, float weight)
+{
+  if (!m_Skeleton) { return false; }
+
+  const std::vector<Skeleton::Bone>& bones = m_Skeleton->GetBones();
+  size_t root = 0;
+  while (root < bones.size() && bones[root].m_Name != boneName)
+  {
+    ++root;
+  }
+  if (root == bones.size()) { return false; }
+
+  // level order has parents before children, so one pass marks the whole subtree
+  std::vector<bool> inSubtree(bones.size(), false);
+  inSubtree[root] = true;
+  m_Weights[root] = weight;
+  for (size_t i : m_Skeleton->GetLevelOrder())
+  {
+    int parent = bones[i].m_Parent;
+    if (parent >= 0 && inSubtree[parent])
+    {
+      inSubtree[i] = true;
+      m_Weights[i] = weight;
+    }
+  }
+  return true;
+}
+
+const float* BoneMask::GetWeights() const
+{
+  return m_Weights.empty() ? nullptr : m_Weights.data();
+}
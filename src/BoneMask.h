@@ -0,0 +1,26 @@
+#pragma once
+
+#include <string>
+#include <vector>
+
+// per bone weights for an animation layer (1 = the layer fully
+// replaces/adds to the bone, 0 = untouched), set per subtree by bone name
+// e.g. an upper body mask is Reset(sk) + SetSubtreeWeight("Spine", 1.0f)
+class BoneMask
+{
+public:
+  BoneMask();
+
+  // sets every bone of the skeleton to weight
+  void Reset(const class Skeleton* skeleton, float weight = 0.0f);
+
+  // sets the named bone and everything below it, false if there's no such bone
+  bool SetSubtreeWeight(const std::string& boneName, float weight);
+
+  // one weight per bone, padded to the pose stride (padding is 0)
+  const float* GetWeights() const;
+
+private:
+  const class Skeleton* m_Skeleton;
+  std::vector<float> m_Weights;
+};
@@ -2,10 +2,13 @@
 
 Matrix4 BoneTransform::ToMatrix() const
 {
-  Matrix4 rot   = Matrix4::CreateFromQuaternion(m_Rotation);
-  Matrix4 trans = Matrix4::CreateTranslation(m_Translation);
-
-  return rot * trans;
+  // rotation followed by translation is just the rotation matrix
+  // with the translation in the bottom row, no need to multiply
+  Matrix4 retVal = Matrix4::CreateFromQuaternion(m_Rotation);
+  retVal.mat[3][0] = m_Translation.x;
+  retVal.mat[3][1] = m_Translation.y;
+  retVal.mat[3][2] = m_Translation.z;
+  return retVal;
 }
 
 BoneTransform BoneTransform::Interpolate(const BoneTransform& a, const BoneTransform& b, float f)
@@ -2,12 +2,23 @@
 #include "Game.h"
 #include "Actor.h"
 #include "PhysWorld.h"
+#include "Constants.h"
 
 BoxComponent::BoxComponent(class Actor* owner, int updateOrder)
   :Component(owner, updateOrder)
   , m_ObjectBox(Vector3::Zero, Vector3::Zero)
   , m_WorldBox(Vector3::Zero, Vector3::Zero)
+  , m_WorldOBB{ Vector3::Zero, Quaternion::Identity, Vector3::Zero }
+  , m_Rotated(false)
   , m_ShouldRotate(true)
+  , m_Layer(COLLISION_LAYER_WORLD)
+  , m_CollisionMask(COLLISION_LAYER_ALL)
+  , m_Tag(COLLISION_TAG_NONE)
+  , m_Static(false)
+  , m_CollisionMode(E_Discrete)
+  , m_ProxyId(-1)
+  , m_ProxyMoved(false)
+  , m_BoxIndex(-1)
 {
   m_Owner->GetGame()->GetPhysWorld()->AddBox(this);
 }
@@ -19,6 +30,8 @@ BoxComponent::~BoxComponent()
 
 void BoxComponent::OnUpdateWorldTransform()
 {
+  Vector3 oldCenter = (m_WorldBox.m_Min + m_WorldBox.m_Max) * 0.5f;
+
   // reset to object space box
   m_WorldBox = m_ObjectBox;
 
@@ -35,6 +48,27 @@ void BoxComponent::OnUpdateWorldTransform()
   // translate
   m_WorldBox.m_Min += m_Owner->GetPosition();
   m_WorldBox.m_Max += m_Owner->GetPosition();
+
+  // same steps for the OBB, on its center
+  Vector3 center = (m_ObjectBox.m_Min + m_ObjectBox.m_Max) * (0.5f * m_Owner->GetScale());
+  m_WorldOBB.m_Rotation = m_ShouldRotate ? m_Owner->GetRotation() : Quaternion::Identity;
+  m_WorldOBB.m_Center = Vector3::Transform(center, m_WorldOBB.m_Rotation) + m_Owner->GetPosition();
+  m_WorldOBB.m_Extents = (m_ObjectBox.m_Max - m_ObjectBox.m_Min) * (0.5f * m_Owner->GetScale());
+
+  // quarter turns leave every local axis along a world axis, the world
+  // box is then as tight as the OBB
+  Vector3 axes[3];
+  m_WorldOBB.GetAxes(axes);
+  m_Rotated = false;
+  for (const Vector3& axis : axes)
+  {
+    float largest = Math::Max(Math::Abs(axis.x), Math::Max(Math::Abs(axis.y), Math::Abs(axis.z)));
+    m_Rotated = m_Rotated || largest < 0.99999f;
+  }
+
+  // refit the broadphase proxy, moving along keeps the fat box ahead of it
+  Vector3 displacement = (m_WorldBox.m_Min + m_WorldBox.m_Max) * 0.5f - oldCenter;
+  m_Owner->GetGame()->GetPhysWorld()->UpdateBox(this, displacement);
 }
 
 void BoxComponent::SetObjectBox(const AABB& model)
@@ -47,7 +81,78 @@ const AABB& BoxComponent::GetWorldBox() const
   return m_WorldBox;
 }
 
+const OBB& BoxComponent::GetWorldOBB() const
+{
+  return m_WorldOBB;
+}
+
+bool BoxComponent::IsRotated() const
+{
+  // quarter turns have a tight world box too, the OBB test is just wasted there
+  return m_Rotated;
+}
+
 void BoxComponent::SetShouldRotate(bool value)
 {
   m_ShouldRotate = value;
 }
+
+void BoxComponent::SetLayer(uint32_t layer)
+{
+  m_Layer = layer;
+  m_Owner->GetGame()->GetPhysWorld()->RefilterBox(this);
+}
+
+uint32_t BoxComponent::GetLayer() const
+{
+  return m_Layer;
+}
+
+void BoxComponent::SetCollisionMask(uint32_t mask)
+{
+  m_CollisionMask = mask;
+  m_Owner->GetGame()->GetPhysWorld()->RefilterBox(this);
+}
+
+uint32_t BoxComponent::GetCollisionMask() const
+{
+  return m_CollisionMask;
+}
+
+void BoxComponent::SetTag(uint32_t tag)
+{
+  m_Tag = tag;
+}
+
+uint32_t BoxComponent::GetTag() const
+{
+  return m_Tag;
+}
+
+void BoxComponent::SetStatic(bool value)
+{
+  m_Static = value;
+  m_Owner->GetGame()->GetPhysWorld()->RefilterBox(this);
+}
+
+bool BoxComponent::IsStatic() const
+{
+  return m_Static;
+}
+
+void BoxComponent::SetCollisionMode(CollisionMode mode)
+{
+  m_CollisionMode = mode;
+}
+
+BoxComponent::CollisionMode BoxComponent::GetCollisionMode() const
+{
+  return m_CollisionMode;
+}
+
+int BoxComponent::GetProxyId() const { return m_ProxyId; }
+void BoxComponent::SetProxyId(int proxy) { m_ProxyId = proxy; }
+bool BoxComponent::IsProxyMoved() const { return m_ProxyMoved; }
+void BoxComponent::SetProxyMoved(bool value) { m_ProxyMoved = value; }
+int BoxComponent::GetBoxIndex() const { return m_BoxIndex; }
+void BoxComponent::SetBoxIndex(int index) { m_BoxIndex = index; }
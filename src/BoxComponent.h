@@ -2,18 +2,68 @@
 
 #include "Component.h"
 #include "Collision.h"
+#include <cstdint>
 
 class BoxComponent : public Component
 {
 public:
+  // how PhysWorld::QueueSweep moves the box: discrete boxes jump straight
+  // to the end, continuous ones stop at the first thing in the way
+  enum CollisionMode { E_Discrete, E_ContinuousBox, E_ContinuousSphere };
+
   BoxComponent(class Actor* owner, int updateOrder = 100);
   ~BoxComponent();
   void OnUpdateWorldTransform() override;
   void SetObjectBox(const AABB& model);
   const AABB& GetWorldBox() const;
+  // tight box for rotated owners, the world box is the loose AABB around it
+  const OBB& GetWorldOBB() const;
+  // the world box is looser than the OBB, pairs need the OBB test
+  bool IsRotated() const;
   void SetShouldRotate(bool value);
+
+  // one of the COLLISION_LAYER_ bits, queries skip boxes not in their mask
+  void SetLayer(uint32_t layer);
+  uint32_t GetLayer() const;
+  // layers this box collides with, both boxes of a pair have to have the
+  // other's layer in their mask. Contact events, sweeps and pushing out of
+  // static boxes all check it, defaults to every layer
+  void SetCollisionMask(uint32_t mask);
+  uint32_t GetCollisionMask() const;
+
+  // one of the COLLISION_TAG_ values, for whoever handles hits on this box
+  void SetTag(uint32_t tag);
+  uint32_t GetTag() const;
+
+  // static boxes (level geometry) go in the static cells of the PhysWorld
+  // grid, taking effect at the next world transform update
+  void SetStatic(bool value);
+  bool IsStatic() const;
+
+  void SetCollisionMode(CollisionMode mode);
+  CollisionMode GetCollisionMode() const;
+
+  // broadphase bookkeeping, owned by PhysWorld
+  int GetProxyId() const;
+  void SetProxyId(int proxy);
+  bool IsProxyMoved() const;
+  void SetProxyMoved(bool value);
+  // slot in PhysWorld's box list, -1 once it's out of the world
+  int GetBoxIndex() const;
+  void SetBoxIndex(int index);
 private:
   AABB m_ObjectBox;
   AABB m_WorldBox;
+  OBB m_WorldOBB;
+  // some local axis isn't along a world axis, set with the world OBB
+  bool m_Rotated;
   bool m_ShouldRotate;
+  uint32_t m_Layer;
+  uint32_t m_CollisionMask;
+  uint32_t m_Tag;
+  bool m_Static;
+  CollisionMode m_CollisionMode;
+  int m_ProxyId;
+  bool m_ProxyMoved;
+  int m_BoxIndex;
 };
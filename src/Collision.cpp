@@ -1,5 +1,4 @@
 #include "Collision.h"
-#include <array>
 
 #include <iostream> // todo remove
 
@@ -118,6 +117,68 @@ float LineSegment::MinDistSq(const LineSegment& s1, const LineSegment& s2)
 	return dP.LengthSq();   // return the closest distance squared
 }
 
+Vector3 LineSegment::ClosestPoint(const Vector3& point) const
+{
+  Vector3 ab = m_End - m_Start;
+  float lengthSq = ab.LengthSq();
+  if (lengthSq <= 1e-12f)
+  {
+    return m_Start;
+  }
+  float t = Math::Clamp(Vector3::Dot(point - m_Start, ab) / lengthSq, 0.0f, 1.0f);
+  return m_Start + ab * t;
+}
+
+void LineSegment::ClosestPoints(const LineSegment& s1, const LineSegment& s2, Vector3& outP1, Vector3& outP2)
+{
+  // Ericson, Real-Time Collision Detection 5.1.9
+  Vector3 d1 = s1.m_End - s1.m_Start;
+  Vector3 d2 = s2.m_End - s2.m_Start;
+  Vector3 r = s1.m_Start - s2.m_Start;
+  float a = d1.LengthSq();
+  float e = d2.LengthSq();
+  float f = Vector3::Dot(d2, r);
+  float s = 0.0f;
+  float t = 0.0f;
+
+  if (a <= 1e-12f && e <= 1e-12f)
+  {
+    // both are points
+  }
+  else if (a <= 1e-12f)
+  {
+    t = Math::Clamp(f / e, 0.0f, 1.0f);
+  }
+  else
+  {
+    float c = Vector3::Dot(d1, r);
+    if (e <= 1e-12f)
+    {
+      s = Math::Clamp(-c / a, 0.0f, 1.0f);
+    }
+    else
+    {
+      float b = Vector3::Dot(d1, d2);
+      float denom = a * e - b * b;
+      // parallel, any s will do
+      s = denom > 1e-12f ? Math::Clamp((b * f - c * e) / denom, 0.0f, 1.0f) : 0.0f;
+      t = (b * s + f) / e;
+      if (t < 0.0f)
+      {
+        t = 0.0f;
+        s = Math::Clamp(-c / a, 0.0f, 1.0f);
+      }
+      else if (t > 1.0f)
+      {
+        t = 1.0f;
+        s = Math::Clamp((b - c) / a, 0.0f, 1.0f);
+      }
+    }
+  }
+  outP1 = s1.m_Start + d1 * s;
+  outP2 = s2.m_Start + d2 * t;
+}
+
 //*****************************//
 //          PLANE              //
 //*****************************//
@@ -185,34 +246,52 @@ void AABB::UpdateMinMax(const Vector3& point)
   m_Max.z = Math::Max(m_Max.z, point.z);
 }
 
+namespace
+{
+  // center +- extents through v * m + translation, where m's rows are
+  // where the x, y and z axes go. Each extent can only spread along a
+  // world axis by |m|, so the abs matrix gives the tight box straight away
+  void TransformCenterExtents(AABB& box, const float m[][4], const Vector3& translation)
+  {
+    Vector3 c = (box.m_Min + box.m_Max) * 0.5f;
+    Vector3 e = (box.m_Max - box.m_Min) * 0.5f;
+
+    Vector3 center(
+      c.x * m[0][0] + c.y * m[1][0] + c.z * m[2][0] + translation.x,
+      c.x * m[0][1] + c.y * m[1][1] + c.z * m[2][1] + translation.y,
+      c.x * m[0][2] + c.y * m[1][2] + c.z * m[2][2] + translation.z);
+    Vector3 extents(
+      e.x * Math::Abs(m[0][0]) + e.y * Math::Abs(m[1][0]) + e.z * Math::Abs(m[2][0]),
+      e.x * Math::Abs(m[0][1]) + e.y * Math::Abs(m[1][1]) + e.z * Math::Abs(m[2][1]),
+      e.x * Math::Abs(m[0][2]) + e.y * Math::Abs(m[1][2]) + e.z * Math::Abs(m[2][2]));
+
+    box.m_Min = center - extents;
+    box.m_Max = center + extents;
+  }
+}
+
 void AABB::Rotate(const Quaternion& q)
 {
-	// Construct the 8 points for the corners of the box
-	std::array<Vector3, 8> points;
-	// Min point is always a corner
-	points[0] = m_Min;
-	// Permutations with 2 min and 1 max
-	points[1] = Vector3(m_Max.x, m_Min.y, m_Min.z);
-	points[2] = Vector3(m_Min.x, m_Max.y, m_Min.z);
-	points[3] = Vector3(m_Min.x, m_Min.y, m_Max.z);
-	// Permutations with 2 max and 1 min
-	points[4] = Vector3(m_Min.x, m_Max.y, m_Max.z);
-	points[5] = Vector3(m_Max.x, m_Min.y, m_Max.z);
-	points[6] = Vector3(m_Max.x, m_Max.y, m_Min.z);
-	// Max point corner
-	points[7] = Vector3(m_Max);
-
-	// Rotate first point
-	Vector3 p = Vector3::Transform(points[0], q);
-	// Reset min/max to first point rotated
-	m_Min = p;
-	m_Max = p;
-	// Update min/max based on remaining points, rotated
-	for (size_t i = 1; i < points.size(); i++)
-	{
-		p = Vector3::Transform(points[i], q);
-		UpdateMinMax(p);
-	}
+  // same rows as Matrix4::CreateFromQuaternion, without the 4th row/column
+  float m[3][4];
+  m[0][0] = 1.0f - 2.0f * q.y * q.y - 2.0f * q.z * q.z;
+  m[0][1] = 2.0f * q.x * q.y + 2.0f * q.w * q.z;
+  m[0][2] = 2.0f * q.x * q.z - 2.0f * q.w * q.y;
+
+  m[1][0] = 2.0f * q.x * q.y - 2.0f * q.w * q.z;
+  m[1][1] = 1.0f - 2.0f * q.x * q.x - 2.0f * q.z * q.z;
+  m[1][2] = 2.0f * q.y * q.z + 2.0f * q.w * q.x;
+
+  m[2][0] = 2.0f * q.x * q.z + 2.0f * q.w * q.y;
+  m[2][1] = 2.0f * q.y * q.z - 2.0f * q.w * q.x;
+  m[2][2] = 1.0f - 2.0f * q.x * q.x - 2.0f * q.y * q.y;
+
+  TransformCenterExtents(*this, m, Vector3::Zero);
+}
+
+void AABB::Transform(const Matrix4& mat)
+{
+  TransformCenterExtents(*this, mat.mat, Vector3(mat.mat[3][0], mat.mat[3][1], mat.mat[3][2]));
 }
 
 bool AABB::Contains(const Vector3& point) const
@@ -245,10 +324,27 @@ float AABB::MinDistSq(const Vector3& point) const
   return dx * dx + dy * dy + dz * dz;
 }
 
+void TransformBoxes(const AABB* boxes, const Matrix4* transforms, AABB* outBoxes, size_t count)
+{
+  for (size_t i = 0; i < count; ++i)
+  {
+    const float (*m)[4] = transforms[i].mat;
+    AABB box = boxes[i];
+    TransformCenterExtents(box, m, Vector3(m[3][0], m[3][1], m[3][2]));
+    outBoxes[i] = box;
+  }
+}
+
 //*****************************//
 //          OBB                //
 //*****************************//
 
+void OBB::GetAxes(Vector3 outAxes[3]) const
+{
+  outAxes[0] = Vector3::Transform(Vector3::UnitX, m_Rotation);
+  outAxes[1] = Vector3::Transform(Vector3::UnitY, m_Rotation);
+  outAxes[2] = Vector3::Transform(Vector3::UnitZ, m_Rotation);
+}
 
 //*****************************//
 //        Capsule              //
@@ -377,45 +473,77 @@ bool Intersect(const LineSegment& l, const Plane& p, float& outT)
 
 bool Intersect(const LineSegment& l, const AABB& b, float& outT, Vector3& outNorm)
 {
-	// Vector to save all possible t values, and normals for those sides
-	std::vector<std::pair<float, Vector3>> tValues;
-	// Test the x planes
-	TestSidePlane(l.m_Start.x, l.m_End.x, b.m_Min.x, Vector3::NegUnitX,
-		tValues);
-	TestSidePlane(l.m_Start.x, l.m_End.x, b.m_Max.x, Vector3::UnitX,
-		tValues);
-	// Test the y planes
-	TestSidePlane(l.m_Start.y, l.m_End.y, b.m_Min.y, Vector3::NegUnitY,
-		tValues);
-	TestSidePlane(l.m_Start.y, l.m_End.y, b.m_Max.y, Vector3::UnitY,
-		tValues);
-	// Test the z planes
-	TestSidePlane(l.m_Start.z, l.m_End.z, b.m_Min.z, Vector3::NegUnitZ,
-		tValues);
-	TestSidePlane(l.m_Start.z, l.m_End.z, b.m_Max.z, Vector3::UnitZ,
-		tValues);
-
-	// Sort the t values in ascending order
-	std::sort(tValues.begin(), tValues.end(), [](
-		const std::pair<float, Vector3>& a,
-		const std::pair<float, Vector3>& b) {
-		return a.first < b.first;
-	});
-	// Test if the box contains any of these points of intersection
-	Vector3 point;
-	for (auto& t : tValues)
+	// slab test: the segment is inside the box between the last plane it
+	// crosses going in and the first plane it crosses going out
+	Vector3 dir = l.m_End - l.m_Start;
+	const float* start = l.m_Start.GetAsFloatPtr();
+	const float* delta = dir.GetAsFloatPtr();
+	const float* boxMin = b.m_Min.GetAsFloatPtr();
+	const float* boxMax = b.m_Max.GetAsFloatPtr();
+
+	float tEnter = Math::NegInfinity;
+	float tExit = Math::Infinity;
+	// axis of the entry/exit plane, and whether it's the min plane
+	int enterAxis = -1;
+	int exitAxis = -1;
+	bool enterMin = false;
+	bool exitMin = false;
+	for (int axis = 0; axis < 3; ++axis)
 	{
-		point = l.PointOnSegment(t.first);
-		if (b.Contains(point))
+		// parallel to this slab, either always inside it or never
+		if (Math::NearZero(delta[axis], 1e-12f))
 		{
-			outT = t.first;
-			outNorm = t.second;
-			return true;
+			if (start[axis] < boxMin[axis] || start[axis] > boxMax[axis])
+			{
+				return false;
+			}
+			continue;
 		}
+
+		float inv = 1.0f / delta[axis];
+		float tMin = (boxMin[axis] - start[axis]) * inv;
+		float tMax = (boxMax[axis] - start[axis]) * inv;
+		bool minIsNear = tMin <= tMax;
+		float tNear = minIsNear ? tMin : tMax;
+		float tFar = minIsNear ? tMax : tMin;
+		if (tNear > tEnter)
+		{
+			tEnter = tNear;
+			enterAxis = axis;
+			enterMin = minIsNear;
+		}
+		if (tFar < tExit)
+		{
+			tExit = tFar;
+			exitAxis = axis;
+			exitMin = !minIsNear;
+		}
+	}
+
+	if (enterAxis < 0 || tEnter > tExit)
+	{
+		return false;
+	}
+
+	// hit where it goes in, or where it comes out if it starts inside
+	int axis = enterAxis;
+	bool isMin = enterMin;
+	outT = tEnter;
+	if (tEnter < 0.0f)
+	{
+		axis = exitAxis;
+		isMin = exitMin;
+		outT = tExit;
+	}
+	if (outT < 0.0f || outT > 1.0f)
+	{
+		return false;
 	}
 
-	//None of the intersections are within bounds of box
-	return false;
+	float norm[3] = { 0.0f, 0.0f, 0.0f };
+	norm[axis] = isMin ? -1.0f : 1.0f;
+	outNorm = Vector3(norm[0], norm[1], norm[2]);
+	return true;
 }
 
 // FOR DYNAMIC COLLISIONS
@@ -431,7 +559,8 @@ bool SweptSphere(const Sphere& P0, const Sphere& P1, const Sphere& Q0, const Sph
 	float c = Vector3::Dot(X, X) - sumRadii * sumRadii;
 	// Solve discriminant
 	float disc = b * b - 4.0f * a * c;
-	if (disc < 0.0f)
+	// no relative motion, they never start touching
+	if (Math::NearZero(a, 1e-12f) || disc < 0.0f)
 	{
 		return false;
 	}
@@ -440,7 +569,7 @@ bool SweptSphere(const Sphere& P0, const Sphere& P1, const Sphere& Q0, const Sph
 		disc = Math::Sqrt(disc);
 		// We only care about the smaller solution
 		outT = (-b - disc) / (2.0f * a);
-		if (outT >= 0.0f && outT <= 0.0f)
+		if (outT >= 0.0f && outT <= 1.0f)
 		{
 			return true;
 		}
@@ -451,27 +580,635 @@ bool SweptSphere(const Sphere& P0, const Sphere& P1, const Sphere& Q0, const Sph
 	}
 }
 
-bool TestSidePlane(float start, float end, float negd, const Vector3& norm,
-	std::vector<std::pair<float, Vector3>>& out)
+namespace
 {
-	float denom = end - start;
-	if (Math::NearZero(denom))
+	// center of the moving shape against b grown by its half size
+	bool SweptExtents(const Vector3& center, const Vector3& extents, const Vector3& displacement
+		, const AABB& b, float& outT, Vector3& outNorm)
 	{
-		return false;
-	}
-	else
-	{
-		float numer = -start + negd;
-		float t = numer / denom;
-		// Test that t is within bounds
-		if (t >= 0.0f && t <= 1.0f)
-		{
-			out.emplace_back(t, norm);
-			return true;
-		}
-		else
+		AABB grown(b.m_Min - extents, b.m_Max + extents);
+		if (grown.Contains(center))
 		{
 			return false;
 		}
+		return Intersect(LineSegment(center, center + displacement), grown, outT, outNorm);
 	}
 }
+
+bool SweptAABB(const AABB& a, const Vector3& displacement, const AABB& b, float& outT, Vector3& outNorm)
+{
+	Vector3 center = (a.m_Min + a.m_Max) * 0.5f;
+	Vector3 extents = (a.m_Max - a.m_Min) * 0.5f;
+	return SweptExtents(center, extents, displacement, b, outT, outNorm);
+}
+
+bool SweptSphere(const Sphere& s, const Vector3& displacement, const AABB& b, float& outT, Vector3& outNorm)
+{
+	Vector3 extents(s.m_Radius, s.m_Radius, s.m_Radius);
+	return SweptExtents(s.m_Center, extents, displacement, b, outT, outNorm);
+}
+
+//*****************************//
+//   OBB AND CAPSULE TESTS     //
+//*****************************//
+
+namespace
+{
+  float AxisOf(const Vector3& v, int axis)
+  {
+    return v.GetAsFloatPtr()[axis];
+  }
+
+  OBB ToOBB(const AABB& box)
+  {
+    return OBB{ (box.m_Min + box.m_Max) * 0.5f, Quaternion::Identity, (box.m_Max - box.m_Min) * 0.5f };
+  }
+
+  Quaternion Inverse(const Quaternion& q)
+  {
+    Quaternion inv = q;
+    inv.Conjugate();
+    return inv;
+  }
+
+  // half length of the box's shadow on axis
+  float ProjectedRadius(const Vector3 axes[3], const Vector3& extents, const Vector3& axis)
+  {
+    return Math::Abs(Vector3::Dot(axes[0], axis)) * extents.x
+      + Math::Abs(Vector3::Dot(axes[1], axis)) * extents.y
+      + Math::Abs(Vector3::Dot(axes[2], axis)) * extents.z;
+  }
+
+  // the segment's bounds grown by reach miss the box (box space), cheap
+  // reject before the closest point search
+  bool SegmentBoundsMiss(const Vector3& start, const Vector3& end, const Vector3& extents, float reach)
+  {
+    for (int axis = 0; axis < 3; ++axis)
+    {
+      float lo = Math::Min(AxisOf(start, axis), AxisOf(end, axis)) - reach;
+      float hi = Math::Max(AxisOf(start, axis), AxisOf(end, axis)) + reach;
+      if (lo > AxisOf(extents, axis) || hi < -AxisOf(extents, axis)) { return true; }
+    }
+    return false;
+  }
+
+  // closest points between a segment and a box centered on the origin
+  // (in box space). They're an end of the segment against the box or the
+  // segment against one of the 12 edges, unless the segment goes through
+  // the box. Returns the distance squared
+  float SegmentBoxClosest(const Vector3& start, const Vector3& end, const Vector3& extents
+    , Vector3& outOnSegment, Vector3& outOnBox)
+  {
+    // through the box, slab test
+    Vector3 d = end - start;
+    float tMin = 0.0f;
+    float tMax = 1.0f;
+    for (int axis = 0; axis < 3 && tMin <= tMax; ++axis)
+    {
+      float inv = SlabInverse(AxisOf(d, axis));
+      float t0 = (-AxisOf(extents, axis) - AxisOf(start, axis)) * inv;
+      float t1 = (AxisOf(extents, axis) - AxisOf(start, axis)) * inv;
+      tMin = Math::Max(tMin, Math::Min(t0, t1));
+      tMax = Math::Min(tMax, Math::Max(t0, t1));
+    }
+    if (tMin <= tMax)
+    {
+      outOnSegment = start + d * tMin;
+      outOnBox = outOnSegment;
+      return 0.0f;
+    }
+
+    float bestDistSq = Math::Infinity;
+    const Vector3* ends[2] = { &start, &end };
+    for (int i = 0; i < 2; ++i)
+    {
+      const Vector3& p = *ends[i];
+      Vector3 clamped(Math::Clamp(p.x, -extents.x, extents.x), Math::Clamp(p.y, -extents.y, extents.y)
+        , Math::Clamp(p.z, -extents.z, extents.z));
+      float distSq = (p - clamped).LengthSq();
+      if (distSq < bestDistSq)
+      {
+        bestDistSq = distSq;
+        outOnSegment = p;
+        outOnBox = clamped;
+      }
+    }
+
+    LineSegment segment(start, end);
+    for (int axis = 0; axis < 3; ++axis)
+    {
+      int axis1 = (axis + 1) % 3;
+      int axis2 = (axis + 2) % 3;
+      for (int corner = 0; corner < 4; ++corner)
+      {
+        float edgeStart[3];
+        edgeStart[axis] = -AxisOf(extents, axis);
+        edgeStart[axis1] = (corner & 1) ? AxisOf(extents, axis1) : -AxisOf(extents, axis1);
+        edgeStart[axis2] = (corner & 2) ? AxisOf(extents, axis2) : -AxisOf(extents, axis2);
+        Vector3 edgeFrom(edgeStart[0], edgeStart[1], edgeStart[2]);
+        edgeStart[axis] = AxisOf(extents, axis);
+        Vector3 edgeTo(edgeStart[0], edgeStart[1], edgeStart[2]);
+
+        Vector3 onSegment;
+        Vector3 onEdge;
+        LineSegment::ClosestPoints(segment, LineSegment(edgeFrom, edgeTo), onSegment, onEdge);
+        float distSq = (onSegment - onEdge).LengthSq();
+        if (distSq < bestDistSq)
+        {
+          bestDistSq = distSq;
+          outOnSegment = onSegment;
+          outOnBox = onEdge;
+        }
+      }
+    }
+    return bestDistSq;
+  }
+
+  // contacts for a face of the reference box against the incident box: the
+  // incident face most against normal, clipped to the sides of the reference
+  // face. normal is out of the reference face towards the incident box
+  int ClipFace(const Vector3& refCenter, const Vector3 refAxes[3], const Vector3& refExtents, int refAxis
+    , const Vector3& normal, const Vector3& incCenter, const Vector3 incAxes[3], const Vector3& incExtents
+    , float margin, int featureBase, ContactManifold::Point* outPoints)
+  {
+    int incAxis = 0;
+    float bestDot = -1.0f;
+    for (int i = 0; i < 3; ++i)
+    {
+      float dot = Math::Abs(Vector3::Dot(incAxes[i], normal));
+      if (dot > bestDot)
+      {
+        bestDot = dot;
+        incAxis = i;
+      }
+    }
+    float side = Vector3::Dot(incAxes[incAxis], normal) > 0.0f ? -1.0f : 1.0f;
+    Vector3 faceCenter = incCenter + incAxes[incAxis] * (side * AxisOf(incExtents, incAxis));
+    int inc1 = (incAxis + 1) % 3;
+    int inc2 = (incAxis + 2) % 3;
+    Vector3 u = incAxes[inc1] * AxisOf(incExtents, inc1);
+    Vector3 v = incAxes[inc2] * AxisOf(incExtents, inc2);
+
+    // ping pong between two buffers, each of the 4 clips adds at most one point
+    Vector3 points[2][ContactManifold::MaxPoints];
+    int ids[2][ContactManifold::MaxPoints];
+    points[0][0] = faceCenter + u + v;
+    points[0][1] = faceCenter - u + v;
+    points[0][2] = faceCenter - u - v;
+    points[0][3] = faceCenter + u - v;
+    for (int i = 0; i < 4; ++i)
+    {
+      ids[0][i] = i;
+    }
+    int count = 4;
+    int current = 0;
+
+    for (int plane = 0; plane < 4 && count > 0; ++plane)
+    {
+      int sideAxis = (refAxis + 1 + plane / 2) % 3;
+      Vector3 planeNormal = (plane & 1) ? -1.0f * refAxes[sideAxis] : refAxes[sideAxis];
+      // sides pushed out by the margin too, so the corners of a box sitting
+      // flush on a same size box aren't clipped on and off as it wobbles
+      float offset = AxisOf(refExtents, sideAxis) + margin;
+
+      const Vector3* in = points[current];
+      const int* inIds = ids[current];
+      Vector3* out = points[1 - current];
+      int* outIds = ids[1 - current];
+      int outCount = 0;
+      for (int i = 0; i < count; ++i)
+      {
+        int next = (i + 1) % count;
+        float distCur = Vector3::Dot(in[i] - refCenter, planeNormal) - offset;
+        float distNext = Vector3::Dot(in[next] - refCenter, planeNormal) - offset;
+        if (distCur <= 0.0f)
+        {
+          out[outCount] = in[i];
+          outIds[outCount++] = inIds[i];
+        }
+        if ((distCur <= 0.0f) != (distNext <= 0.0f))
+        {
+          out[outCount] = in[i] + (in[next] - in[i]) * (distCur / (distCur - distNext));
+          outIds[outCount++] = 4 + plane * 4 + (inIds[i] & 3);
+        }
+      }
+      count = outCount;
+      current = 1 - current;
+    }
+
+    Vector3 faceOnRef = refCenter + normal * AxisOf(refExtents, refAxis);
+    int numPoints = 0;
+    for (int i = 0; i < count; ++i)
+    {
+      float separation = Vector3::Dot(points[current][i] - faceOnRef, normal);
+      if (separation <= margin)
+      {
+        ContactManifold::Point& point = outPoints[numPoints++];
+        point.m_Position = points[current][i];
+        point.m_Depth = -separation;
+        point.m_Feature = featureBase | (refAxis << 5) | ids[current][i];
+      }
+    }
+    return numPoints;
+  }
+}
+
+bool Intersect(const OBB& a, const OBB& b)
+{
+  // Ericson, Real-Time Collision Detection 4.4.1: b's axes and the offset
+  // in a's frame, 15 axes
+  Vector3 axesA[3];
+  Vector3 axesB[3];
+  a.GetAxes(axesA);
+  b.GetAxes(axesB);
+  const float* extA = a.m_Extents.GetAsFloatPtr();
+  const float* extB = b.m_Extents.GetAsFloatPtr();
+
+  float r[3][3];
+  float absR[3][3];
+  for (int i = 0; i < 3; ++i)
+  {
+    for (int j = 0; j < 3; ++j)
+    {
+      r[i][j] = Vector3::Dot(axesA[i], axesB[j]);
+      // epsilon keeps near parallel edge axes (cross ~0) from false negatives
+      absR[i][j] = Math::Abs(r[i][j]) + 1e-6f;
+    }
+  }
+  Vector3 d = b.m_Center - a.m_Center;
+  float t[3] = { Vector3::Dot(d, axesA[0]), Vector3::Dot(d, axesA[1]), Vector3::Dot(d, axesA[2]) };
+
+  for (int i = 0; i < 3; ++i)
+  {
+    float rb = extB[0] * absR[i][0] + extB[1] * absR[i][1] + extB[2] * absR[i][2];
+    if (Math::Abs(t[i]) > extA[i] + rb) { return false; }
+  }
+  for (int j = 0; j < 3; ++j)
+  {
+    float ra = extA[0] * absR[0][j] + extA[1] * absR[1][j] + extA[2] * absR[2][j];
+    float dist = t[0] * r[0][j] + t[1] * r[1][j] + t[2] * r[2][j];
+    if (Math::Abs(dist) > ra + extB[j]) { return false; }
+  }
+  for (int i = 0; i < 3; ++i)
+  {
+    int i1 = (i + 1) % 3;
+    int i2 = (i + 2) % 3;
+    for (int j = 0; j < 3; ++j)
+    {
+      int j1 = (j + 1) % 3;
+      int j2 = (j + 2) % 3;
+      float ra = extA[i1] * absR[i2][j] + extA[i2] * absR[i1][j];
+      float rb = extB[j1] * absR[i][j2] + extB[j2] * absR[i][j1];
+      float dist = t[i2] * r[i1][j] - t[i1] * r[i2][j];
+      if (Math::Abs(dist) > ra + rb) { return false; }
+    }
+  }
+  return true;
+}
+
+bool Intersect(const OBB& a, const AABB& b)
+{
+  return Intersect(a, ToOBB(b));
+}
+
+bool Intersect(const Capsule& c, const OBB& box)
+{
+  Quaternion inv = Inverse(box.m_Rotation);
+  Vector3 start = Vector3::Transform(c.m_Segment.m_Start - box.m_Center, inv);
+  Vector3 end = Vector3::Transform(c.m_Segment.m_End - box.m_Center, inv);
+  if (SegmentBoundsMiss(start, end, box.m_Extents, c.m_Radius)) { return false; }
+  Vector3 onSegment;
+  Vector3 onBox;
+  return SegmentBoxClosest(start, end, box.m_Extents, onSegment, onBox) <= c.m_Radius * c.m_Radius;
+}
+
+bool Intersect(const Capsule& c, const AABB& box)
+{
+  return Intersect(c, ToOBB(box));
+}
+
+bool Intersect(const OBB& a, const OBB& b, ContactManifold& outManifold, float margin)
+{
+  outManifold.m_NumPoints = 0;
+  Vector3 axesA[3];
+  Vector3 axesB[3];
+  a.GetAxes(axesA);
+  b.GetAxes(axesB);
+  Vector3 d = b.m_Center - a.m_Center;
+
+  // separation along every axis, the largest is the way out
+  int faceA = 0;
+  float separationA = Math::NegInfinity;
+  for (int i = 0; i < 3; ++i)
+  {
+    float separation = Math::Abs(Vector3::Dot(d, axesA[i])) - AxisOf(a.m_Extents, i)
+      - ProjectedRadius(axesB, b.m_Extents, axesA[i]);
+    if (separation > margin) { return false; }
+    if (separation > separationA)
+    {
+      separationA = separation;
+      faceA = i;
+    }
+  }
+  int faceB = 0;
+  float separationB = Math::NegInfinity;
+  for (int i = 0; i < 3; ++i)
+  {
+    float separation = Math::Abs(Vector3::Dot(d, axesB[i])) - AxisOf(b.m_Extents, i)
+      - ProjectedRadius(axesA, a.m_Extents, axesB[i]);
+    if (separation > margin) { return false; }
+    if (separation > separationB)
+    {
+      separationB = separation;
+      faceB = i;
+    }
+  }
+  int edgeA = 0;
+  int edgeB = 0;
+  float separationEdge = Math::NegInfinity;
+  Vector3 edgeAxis = Vector3::Zero;
+  for (int i = 0; i < 3; ++i)
+  {
+    for (int j = 0; j < 3; ++j)
+    {
+      Vector3 axis = Vector3::Cross(axesA[i], axesB[j]);
+      float lengthSq = axis.LengthSq();
+      // parallel edges, covered by the face axes
+      if (lengthSq < 1e-6f) { continue; }
+      axis *= 1.0f / Math::Sqrt(lengthSq);
+      float separation = Math::Abs(Vector3::Dot(d, axis)) - ProjectedRadius(axesA, a.m_Extents, axis)
+        - ProjectedRadius(axesB, b.m_Extents, axis);
+      if (separation > margin) { return false; }
+      if (separation > separationEdge)
+      {
+        separationEdge = separation;
+        edgeA = i;
+        edgeB = j;
+        edgeAxis = axis;
+      }
+    }
+  }
+
+  // faces win near ties, they give a full manifold and don't flicker
+  // between axes as a resting box jitters
+  // (for aligned boxes some edge axes are the face axes again)
+  bool faceIsB = separationB > separationA + 0.02f * Math::Abs(separationA) + 0.001f;
+  float separationFace = faceIsB ? separationB : separationA;
+  if (separationEdge > separationFace + 0.05f * Math::Abs(separationFace) + 0.01f)
+  {
+    // edge on edge, one point between the closest points of the two edges
+    // that reach furthest towards each other
+    if (Vector3::Dot(d, edgeAxis) < 0.0f)
+    {
+      edgeAxis = -1.0f * edgeAxis;
+    }
+    Vector3 onA = a.m_Center;
+    Vector3 onB = b.m_Center;
+    for (int k = 0; k < 3; ++k)
+    {
+      if (k != edgeA)
+      {
+        float sign = Vector3::Dot(axesA[k], edgeAxis) >= 0.0f ? 1.0f : -1.0f;
+        onA += axesA[k] * (sign * AxisOf(a.m_Extents, k));
+      }
+      if (k != edgeB)
+      {
+        float sign = Vector3::Dot(axesB[k], edgeAxis) >= 0.0f ? 1.0f : -1.0f;
+        onB -= axesB[k] * (sign * AxisOf(b.m_Extents, k));
+      }
+    }
+    Vector3 halfA = axesA[edgeA] * AxisOf(a.m_Extents, edgeA);
+    Vector3 halfB = axesB[edgeB] * AxisOf(b.m_Extents, edgeB);
+    Vector3 closestA;
+    Vector3 closestB;
+    LineSegment::ClosestPoints(LineSegment(onA - halfA, onA + halfA), LineSegment(onB - halfB, onB + halfB)
+      , closestA, closestB);
+
+    outManifold.m_Normal = edgeAxis;
+    ContactManifold::Point& point = outManifold.m_Points[0];
+    point.m_Position = (closestA + closestB) * 0.5f;
+    point.m_Depth = -separationEdge;
+    point.m_Feature = 256 | (edgeA * 3 + edgeB);
+    outManifold.m_NumPoints = 1;
+    return true;
+  }
+
+  if (faceIsB)
+  {
+    Vector3 normal = axesB[faceB];
+    if (Vector3::Dot(d, normal) > 0.0f)
+    {
+      normal = -1.0f * normal;
+    }
+    outManifold.m_NumPoints = ClipFace(b.m_Center, axesB, b.m_Extents, faceB, normal
+      , a.m_Center, axesA, a.m_Extents, margin, 128, outManifold.m_Points);
+    outManifold.m_Normal = -1.0f * normal;
+  }
+  else
+  {
+    Vector3 normal = axesA[faceA];
+    if (Vector3::Dot(d, normal) < 0.0f)
+    {
+      normal = -1.0f * normal;
+    }
+    outManifold.m_NumPoints = ClipFace(a.m_Center, axesA, a.m_Extents, faceA, normal
+      , b.m_Center, axesB, b.m_Extents, margin, 0, outManifold.m_Points);
+    outManifold.m_Normal = normal;
+  }
+  return outManifold.m_NumPoints > 0;
+}
+
+bool Intersect(const OBB& a, const AABB& b, ContactManifold& outManifold, float margin)
+{
+  return Intersect(a, ToOBB(b), outManifold, margin);
+}
+
+bool Intersect(const Capsule& c, const OBB& box, ContactManifold& outManifold, float margin)
+{
+  outManifold.m_NumPoints = 0;
+
+  // in box space
+  Quaternion inv = Inverse(box.m_Rotation);
+  Vector3 start = Vector3::Transform(c.m_Segment.m_Start - box.m_Center, inv);
+  Vector3 end = Vector3::Transform(c.m_Segment.m_End - box.m_Center, inv);
+  const Vector3& e = box.m_Extents;
+  float radius = c.m_Radius;
+  if (SegmentBoundsMiss(start, end, e, radius + margin)) { return false; }
+
+  Vector3 onSegment;
+  Vector3 onBox;
+  float distSq = SegmentBoxClosest(start, end, e, onSegment, onBox);
+  float reach = radius + margin;
+  if (distSq > reach * reach) { return false; }
+
+  // out of the box towards the capsule. Against a face both ends of the
+  // capsule can rest on it, otherwise it's one point on an edge or corner
+  int faceAxis = -1;
+  float faceSign = 1.0f;
+  Vector3 normal;
+  if (distSq > 1e-8f)
+  {
+    normal = (onSegment - onBox) * (1.0f / Math::Sqrt(distSq));
+    for (int axis = 0; axis < 3; ++axis)
+    {
+      if (Math::Abs(AxisOf(normal, axis)) > 0.9999f)
+      {
+        faceAxis = axis;
+        faceSign = AxisOf(normal, axis) > 0.0f ? 1.0f : -1.0f;
+      }
+    }
+  }
+  else
+  {
+    // the segment is in the box, push out the shortest way
+    float bestPush = Math::Infinity;
+    for (int axis = 0; axis < 3; ++axis)
+    {
+      float lo = Math::Min(AxisOf(start, axis), AxisOf(end, axis));
+      float hi = Math::Max(AxisOf(start, axis), AxisOf(end, axis));
+      float pushUp = AxisOf(e, axis) + radius - lo;
+      float pushDown = AxisOf(e, axis) + radius + hi;
+      if (pushUp < bestPush)
+      {
+        bestPush = pushUp;
+        faceAxis = axis;
+        faceSign = 1.0f;
+      }
+      if (pushDown < bestPush)
+      {
+        bestPush = pushDown;
+        faceAxis = axis;
+        faceSign = -1.0f;
+      }
+    }
+  }
+
+  if (faceAxis >= 0)
+  {
+    float n[3] = { 0.0f, 0.0f, 0.0f };
+    n[faceAxis] = faceSign;
+    normal = Vector3(n[0], n[1], n[2]);
+
+    // the part of the segment over the face. When the segment is inside
+    // the box keep all of it, the ends decide how far it has to be pushed
+    Vector3 d = end - start;
+    float tMin = 0.0f;
+    float tMax = 1.0f;
+    for (int axis = 0; axis < 3 && distSq > 1e-8f; ++axis)
+    {
+      if (axis == faceAxis) { continue; }
+      float inv = SlabInverse(AxisOf(d, axis));
+      float t0 = (-AxisOf(e, axis) - AxisOf(start, axis)) * inv;
+      float t1 = (AxisOf(e, axis) - AxisOf(start, axis)) * inv;
+      tMin = Math::Max(tMin, Math::Min(t0, t1));
+      tMax = Math::Min(tMax, Math::Max(t0, t1));
+    }
+    if (tMin <= tMax)
+    {
+      float ts[2] = { tMin, tMax };
+      int numEnds = tMax - tMin > 1e-4f ? 2 : 1;
+      for (int i = 0; i < numEnds; ++i)
+      {
+        Vector3 p = start + d * ts[i];
+        float separation = faceSign * AxisOf(p, faceAxis) - AxisOf(e, faceAxis) - radius;
+        if (separation > margin) { continue; }
+        ContactManifold::Point& point = outManifold.m_Points[outManifold.m_NumPoints++];
+        // on the capsule's surface
+        point.m_Position = box.m_Center + Vector3::Transform(p - normal * radius, box.m_Rotation);
+        point.m_Depth = -separation;
+        point.m_Feature = i;
+      }
+    }
+  }
+
+  if (outManifold.m_NumPoints == 0)
+  {
+    if (distSq <= 1e-8f) { return false; }
+    ContactManifold::Point& point = outManifold.m_Points[0];
+    point.m_Position = box.m_Center + Vector3::Transform(onBox, box.m_Rotation);
+    point.m_Depth = radius - Math::Sqrt(distSq);
+    point.m_Feature = 2;
+    outManifold.m_NumPoints = 1;
+  }
+  // from the capsule to the box
+  outManifold.m_Normal = -1.0f * Vector3::Transform(normal, box.m_Rotation);
+  return true;
+}
+
+bool Intersect(const Capsule& c, const AABB& box, ContactManifold& outManifold, float margin)
+{
+  return Intersect(c, ToOBB(box), outManifold, margin);
+}
+
+bool Intersect(const LineSegment& l, const OBB& b, float& outT, Vector3& outNorm)
+{
+  // slab test in box space
+  Quaternion inv = Inverse(b.m_Rotation);
+  LineSegment local(Vector3::Transform(l.m_Start - b.m_Center, inv), Vector3::Transform(l.m_End - b.m_Center, inv));
+  Vector3 localNorm;
+  if (!Intersect(local, AABB(-1.0f * b.m_Extents, b.m_Extents), outT, localNorm))
+  {
+    return false;
+  }
+  outNorm = Vector3::Transform(localNorm, b.m_Rotation);
+  return true;
+}
+
+bool Intersect(const LineSegment& l, const Capsule& c, float& outT, Vector3& outNorm)
+{
+  // false if it starts inside, same as the swept tests
+  if (c.Contains(l.m_Start)) { return false; }
+
+  // first hit on the capsule is the first on the side or either end sphere
+  float best = Math::Infinity;
+  const Vector3* ends[2] = { &c.m_Segment.m_Start, &c.m_Segment.m_End };
+  for (int i = 0; i < 2; ++i)
+  {
+    float t;
+    Sphere cap{ *ends[i], c.m_Radius };
+    if (Intersect(l, cap, t) && t < best)
+    {
+      best = t;
+      outNorm = Vector3::Normalize(l.PointOnSegment(t) - *ends[i]);
+    }
+  }
+
+  // side, Ericson 5.3.7 against the infinite cylinder, kept between the ends
+  Vector3 axis = c.m_Segment.m_End - c.m_Segment.m_Start;
+  Vector3 m = l.m_Start - c.m_Segment.m_Start;
+  Vector3 n = l.m_End - l.m_Start;
+  float md = Vector3::Dot(m, axis);
+  float nd = Vector3::Dot(n, axis);
+  float dd = Vector3::Dot(axis, axis);
+  float nn = Vector3::Dot(n, n);
+  float a = dd * nn - nd * nd;
+  // parallel to the axis only the ends can be hit first
+  if (a > 1e-6f * dd * nn)
+  {
+    float mn = Vector3::Dot(m, n);
+    float k = Vector3::Dot(m, m) - c.m_Radius * c.m_Radius;
+    float cc = dd * k - md * md;
+    float b = dd * mn - nd * md;
+    float disc = b * b - a * cc;
+    if (disc >= 0.0f)
+    {
+      float t = (-b - Math::Sqrt(disc)) / a;
+      float along = md + t * nd;
+      if (t >= 0.0f && t <= 1.0f && along >= 0.0f && along <= dd && t < best)
+      {
+        best = t;
+        Vector3 onAxis = c.m_Segment.m_Start + axis * (along / dd);
+        outNorm = Vector3::Normalize(l.PointOnSegment(t) - onAxis);
+      }
+    }
+  }
+
+  if (best == Math::Infinity) { return false; }
+  outT = best;
+  return true;
+}
+
+float SlabInverse(float d)
+{
+	return Math::NearZero(d, 1e-12f) ? 1e30f : 1.0f / d;
+}
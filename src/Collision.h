@@ -14,6 +14,10 @@ struct LineSegment
   float MinDistSq(const Vector3& point) const;
   // get min dist sq between 2 line segments
   static float MinDistSq(const LineSegment& s1, const LineSegment& s2);
+  // closest point on the segment to point
+  Vector3 ClosestPoint(const Vector3& point) const;
+  // closest points between 2 line segments, one on each
+  static void ClosestPoints(const LineSegment& s1, const LineSegment& s2, Vector3& outP1, Vector3& outP2);
 };
 
 struct Plane
@@ -45,7 +49,12 @@ struct AABB
   Vector3 m_Max;
   AABB(const Vector3& min, const Vector3& max);
   void UpdateMinMax(const Vector3& point);
+  // rotate about the origin and refit, done on the center and extents
+  // with the absolute rotation matrix rather than rotating all 8 corners
   void Rotate(const Quaternion& quat);
+  // refit around the box moved by mat (scale, rotate then translate),
+  // e.g. a mesh's object space box by its actor's world transform
+  void Transform(const Matrix4& mat);
   bool Contains(const Vector3& point) const;
   float MinDistSq(const Vector3& point) const;
 };
@@ -56,7 +65,9 @@ struct OBB
   // BUT collision computations are much more expensive than with AABBs
   Vector3 m_Center;
   Quaternion m_Rotation;
-  Vector3 m_Extents;
+  Vector3 m_Extents; // half size along each local axis
+  // local x, y, z in world space
+  void GetAxes(Vector3 outAxes[3]) const;
 };
 
 struct Capsule
@@ -66,6 +77,25 @@ struct Capsule
   bool Contains(const Vector3& point) const;
 };
 
+// where two shapes touch, all points share one normal
+struct ContactManifold
+{
+  static const int MaxPoints = 8;
+  struct Point
+  {
+    Vector3 m_Position;
+    // negative while the shapes are still apart (within the margin)
+    float m_Depth;
+    // same id for the same features touching from frame to frame, so
+    // solvers can carry impulses over
+    int m_Feature;
+  };
+  // from the first shape to the second
+  Vector3 m_Normal;
+  Point m_Points[MaxPoints];
+  int m_NumPoints;
+};
+
 //*************************//
 //   INTERSECTION FUNCS    //
 //*************************//
@@ -74,13 +104,38 @@ bool Intersect(const Sphere& a, const Sphere& b);
 bool Intersect(const AABB& a, const AABB& b);
 bool Intersect(const Capsule& a, const Capsule& b);
 bool Intersect(const Sphere& s, const AABB& box);
+// separating axis tests
+bool Intersect(const OBB& a, const OBB& b);
+bool Intersect(const OBB& a, const AABB& b);
+bool Intersect(const Capsule& c, const OBB& box);
+bool Intersect(const Capsule& c, const AABB& box);
+
+// same tests filling in a manifold. Shapes up to margin apart still count,
+// with negative depths, so solvers can catch contacts a step early
+bool Intersect(const OBB& a, const OBB& b, ContactManifold& outManifold, float margin = 0.0f);
+bool Intersect(const OBB& a, const AABB& b, ContactManifold& outManifold, float margin = 0.0f);
+bool Intersect(const Capsule& c, const OBB& box, ContactManifold& outManifold, float margin = 0.0f);
+bool Intersect(const Capsule& c, const AABB& box, ContactManifold& outManifold, float margin = 0.0f);
 
 bool Intersect(const LineSegment& l, const Sphere& s, float& outT);
 bool Intersect(const LineSegment& l, const Plane& p, float& outT);
 bool Intersect(const LineSegment& l, const AABB& b, float& outT, Vector3& outNorm);
+bool Intersect(const LineSegment& l, const OBB& b, float& outT, Vector3& outNorm);
+bool Intersect(const LineSegment& l, const Capsule& c, float& outT, Vector3& outNorm);
+
+// outBoxes[i] = boxes[i] refit by transforms[i] as in AABB::Transform,
+// for updating many bounds in one pass. outBoxes may be boxes
+void TransformBoxes(const AABB* boxes, const Matrix4* transforms, AABB* outBoxes, size_t count);
 
 bool SweptSphere(const Sphere& P0, const Sphere& P1, const Sphere& Q0, const Sphere& Q1, float& outT);
+// box a moving by displacement against a still box b. outT is the fraction
+// of the displacement before they touch, false if they already overlap
+bool SweptAABB(const AABB& a, const Vector3& displacement, const AABB& b, float& outT, Vector3& outNorm);
+// same for a sphere, tested against b grown by the radius so edge and
+// corner hits come a little early
+bool SweptSphere(const Sphere& s, const Vector3& displacement, const AABB& b, float& outT, Vector3& outNorm);
 
 // helper
-bool TestSidePlane(float start, float end, float negd, const Vector3& norm,
-	std::vector<std::pair<float, Vector3>>& out);
+// 1 / d for slab tests, a huge finite value when d is ~0 so a segment
+// parallel to a slab never produces inf * 0 NaNs
+float SlabInverse(float d);
@@ -0,0 +1,319 @@
+#include "CollisionSIMD.h"
+#include "SIMD.h"
+
+AABBArray::AABBArray()
+  :m_Size(0)
+{}
+
+void AABBArray::Clear()
+{
+  m_MinX.clear();
+  m_MinY.clear();
+  m_MinZ.clear();
+  m_MaxX.clear();
+  m_MaxY.clear();
+  m_MaxZ.clear();
+  m_Size = 0;
+}
+
+void AABBArray::Reserve(size_t count)
+{
+  size_t padded = (count + 3) & ~static_cast<size_t>(3);
+  m_MinX.reserve(padded);
+  m_MinY.reserve(padded);
+  m_MinZ.reserve(padded);
+  m_MaxX.reserve(padded);
+  m_MaxY.reserve(padded);
+  m_MaxZ.reserve(padded);
+}
+
+void AABBArray::Add(const AABB& box)
+{
+  // start a new group of 4 when the last one is full
+  if (m_Size == m_MinX.size())
+  {
+    size_t padded = m_Size + 4;
+    m_MinX.resize(padded, 0.0f);
+    m_MinY.resize(padded, 0.0f);
+    m_MinZ.resize(padded, 0.0f);
+    m_MaxX.resize(padded, 0.0f);
+    m_MaxY.resize(padded, 0.0f);
+    m_MaxZ.resize(padded, 0.0f);
+  }
+  Set(m_Size++, box);
+}
+
+void AABBArray::Set(size_t index, const AABB& box)
+{
+  m_MinX[index] = box.m_Min.x;
+  m_MinY[index] = box.m_Min.y;
+  m_MinZ[index] = box.m_Min.z;
+  m_MaxX[index] = box.m_Max.x;
+  m_MaxY[index] = box.m_Max.y;
+  m_MaxZ[index] = box.m_Max.z;
+}
+
+AABB AABBArray::Get(size_t index) const
+{
+  return AABB(Vector3(m_MinX[index], m_MinY[index], m_MinZ[index])
+    , Vector3(m_MaxX[index], m_MaxY[index], m_MaxZ[index]));
+}
+
+size_t AABBArray::GetSize() const
+{
+  return m_Size;
+}
+
+namespace
+{
+#if USE_SSE
+  // lanes of the group starting at i that hold real boxes
+  inline int ValidLanes(size_t i, size_t size)
+  {
+    size_t remaining = size - i;
+    return remaining >= 4 ? 0xF : (1 << remaining) - 1;
+  }
+
+  inline __m128 Select(__m128 mask, __m128 a, __m128 b)
+  {
+    return _mm_or_ps(_mm_and_ps(mask, a), _mm_andnot_ps(mask, b));
+  }
+#endif
+}
+
+int CollisionSIMD::IntersectSegment(const LineSegment& l, const AABBArray& boxes
+  , float& outT, Vector3& outNorm)
+{
+  Vector3 dir = l.m_End - l.m_Start;
+  float invX = SlabInverse(dir.x);
+  float invY = SlabInverse(dir.y);
+  float invZ = SlabInverse(dir.z);
+
+  int best = -1;
+  float bestT = Math::Infinity;
+  size_t size = boxes.GetSize();
+
+#if USE_SSE
+  __m128 startX = _mm_set1_ps(l.m_Start.x);
+  __m128 startY = _mm_set1_ps(l.m_Start.y);
+  __m128 startZ = _mm_set1_ps(l.m_Start.z);
+  __m128 inverseX = _mm_set1_ps(invX);
+  __m128 inverseY = _mm_set1_ps(invY);
+  __m128 inverseZ = _mm_set1_ps(invZ);
+  __m128 zero = _mm_setzero_ps();
+  __m128 one = _mm_set1_ps(1.0f);
+
+  // per lane closest t and its box index (as a float, exact below 2^24)
+  __m128 laneT = _mm_set1_ps(Math::Infinity);
+  __m128 laneIndex = _mm_set1_ps(-1.0f);
+  __m128 index = _mm_setr_ps(0.0f, 1.0f, 2.0f, 3.0f);
+  __m128 four = _mm_set1_ps(4.0f);
+  __m128 count = _mm_set1_ps(static_cast<float>(size));
+
+  for (size_t i = 0; i < size; i += 4)
+  {
+    __m128 t1 = _mm_mul_ps(_mm_sub_ps(_mm_loadu_ps(boxes.GetMinX() + i), startX), inverseX);
+    __m128 t2 = _mm_mul_ps(_mm_sub_ps(_mm_loadu_ps(boxes.GetMaxX() + i), startX), inverseX);
+    __m128 tNear = _mm_min_ps(t1, t2);
+    __m128 tFar = _mm_max_ps(t1, t2);
+
+    t1 = _mm_mul_ps(_mm_sub_ps(_mm_loadu_ps(boxes.GetMinY() + i), startY), inverseY);
+    t2 = _mm_mul_ps(_mm_sub_ps(_mm_loadu_ps(boxes.GetMaxY() + i), startY), inverseY);
+    tNear = _mm_max_ps(tNear, _mm_min_ps(t1, t2));
+    tFar = _mm_min_ps(tFar, _mm_max_ps(t1, t2));
+
+    t1 = _mm_mul_ps(_mm_sub_ps(_mm_loadu_ps(boxes.GetMinZ() + i), startZ), inverseZ);
+    t2 = _mm_mul_ps(_mm_sub_ps(_mm_loadu_ps(boxes.GetMaxZ() + i), startZ), inverseZ);
+    tNear = _mm_max_ps(tNear, _mm_min_ps(t1, t2));
+    tFar = _mm_min_ps(tFar, _mm_max_ps(t1, t2));
+
+    // enters at tNear, or leaves at tFar if it starts inside
+    __m128 t = Select(_mm_cmpge_ps(tNear, zero), tNear, tFar);
+    __m128 hit = _mm_and_ps(_mm_cmple_ps(tNear, tFar), _mm_cmpge_ps(t, zero));
+    hit = _mm_and_ps(hit, _mm_and_ps(_mm_cmple_ps(t, one), _mm_cmplt_ps(t, laneT)));
+    // padding lanes past the last box never hit
+    hit = _mm_and_ps(hit, _mm_cmplt_ps(index, count));
+
+    laneT = Select(hit, t, laneT);
+    laneIndex = Select(hit, index, laneIndex);
+    index = _mm_add_ps(index, four);
+  }
+
+  alignas(16) float ts[4];
+  alignas(16) float indices[4];
+  _mm_store_ps(ts, laneT);
+  _mm_store_ps(indices, laneIndex);
+  for (int lane = 0; lane < 4; ++lane)
+  {
+    int laneBest = static_cast<int>(indices[lane]);
+    // ties go to the lower index, same as the scalar loop
+    if (laneBest >= 0 && (ts[lane] < bestT || (ts[lane] == bestT && laneBest < best)))
+    {
+      bestT = ts[lane];
+      best = laneBest;
+    }
+  }
+#else
+  for (size_t i = 0; i < size; ++i)
+  {
+    float t1 = (boxes.GetMinX()[i] - l.m_Start.x) * invX;
+    float t2 = (boxes.GetMaxX()[i] - l.m_Start.x) * invX;
+    float tNear = Math::Min(t1, t2);
+    float tFar = Math::Max(t1, t2);
+
+    t1 = (boxes.GetMinY()[i] - l.m_Start.y) * invY;
+    t2 = (boxes.GetMaxY()[i] - l.m_Start.y) * invY;
+    tNear = Math::Max(tNear, Math::Min(t1, t2));
+    tFar = Math::Min(tFar, Math::Max(t1, t2));
+
+    t1 = (boxes.GetMinZ()[i] - l.m_Start.z) * invZ;
+    t2 = (boxes.GetMaxZ()[i] - l.m_Start.z) * invZ;
+    tNear = Math::Max(tNear, Math::Min(t1, t2));
+    tFar = Math::Min(tFar, Math::Max(t1, t2));
+
+    float t = tNear >= 0.0f ? tNear : tFar;
+    if (tNear <= tFar && t >= 0.0f && t <= 1.0f && t < bestT)
+    {
+      bestT = t;
+      best = static_cast<int>(i);
+    }
+  }
+#endif
+
+  if (best < 0)
+  {
+    return -1;
+  }
+
+  // normal (and the exact same t) from the single box test
+  if (!Intersect(l, boxes.Get(best), outT, outNorm))
+  {
+    outT = bestT;
+    outNorm = Vector3::Zero;
+  }
+  return best;
+}
+
+size_t CollisionSIMD::IntersectBox(const AABB& box, const AABBArray& boxes, int* outIndices)
+{
+  size_t count = 0;
+  size_t size = boxes.GetSize();
+
+#if USE_SSE
+  __m128 minX = _mm_set1_ps(box.m_Min.x);
+  __m128 minY = _mm_set1_ps(box.m_Min.y);
+  __m128 minZ = _mm_set1_ps(box.m_Min.z);
+  __m128 maxX = _mm_set1_ps(box.m_Max.x);
+  __m128 maxY = _mm_set1_ps(box.m_Max.y);
+  __m128 maxZ = _mm_set1_ps(box.m_Max.z);
+
+  for (size_t i = 0; i < size; i += 4)
+  {
+    // separated on any axis = no intersection
+    __m128 apart = _mm_or_ps(_mm_cmplt_ps(maxX, _mm_loadu_ps(boxes.GetMinX() + i))
+      , _mm_cmplt_ps(_mm_loadu_ps(boxes.GetMaxX() + i), minX));
+    apart = _mm_or_ps(apart, _mm_cmplt_ps(maxY, _mm_loadu_ps(boxes.GetMinY() + i)));
+    apart = _mm_or_ps(apart, _mm_cmplt_ps(_mm_loadu_ps(boxes.GetMaxY() + i), minY));
+    apart = _mm_or_ps(apart, _mm_cmplt_ps(maxZ, _mm_loadu_ps(boxes.GetMinZ() + i)));
+    apart = _mm_or_ps(apart, _mm_cmplt_ps(_mm_loadu_ps(boxes.GetMaxZ() + i), minZ));
+
+    int mask = ~_mm_movemask_ps(apart) & ValidLanes(i, size);
+    for (int lane = 0; mask; ++lane, mask >>= 1)
+    {
+      if (mask & 1)
+      {
+        outIndices[count++] = static_cast<int>(i) + lane;
+      }
+    }
+  }
+#else
+  for (size_t i = 0; i < size; ++i)
+  {
+    bool apart = box.m_Max.x < boxes.GetMinX()[i] || boxes.GetMaxX()[i] < box.m_Min.x
+      || box.m_Max.y < boxes.GetMinY()[i] || boxes.GetMaxY()[i] < box.m_Min.y
+      || box.m_Max.z < boxes.GetMinZ()[i] || boxes.GetMaxZ()[i] < box.m_Min.z;
+    if (!apart)
+    {
+      outIndices[count++] = static_cast<int>(i);
+    }
+  }
+#endif
+  return count;
+}
+
+size_t CollisionSIMD::IntersectSphere(const Sphere& sphere, const AABBArray& boxes, int* outIndices)
+{
+  size_t count = 0;
+  size_t size = boxes.GetSize();
+  float radiusSq = sphere.m_Radius * sphere.m_Radius;
+
+#if USE_SSE
+  __m128 centerX = _mm_set1_ps(sphere.m_Center.x);
+  __m128 centerY = _mm_set1_ps(sphere.m_Center.y);
+  __m128 centerZ = _mm_set1_ps(sphere.m_Center.z);
+  __m128 radius = _mm_set1_ps(radiusSq);
+  __m128 zero = _mm_setzero_ps();
+
+  for (size_t i = 0; i < size; i += 4)
+  {
+    // distance outside the box along each axis (0 when within the slab)
+    __m128 dx = _mm_max_ps(_mm_sub_ps(_mm_loadu_ps(boxes.GetMinX() + i), centerX)
+      , _mm_sub_ps(centerX, _mm_loadu_ps(boxes.GetMaxX() + i)));
+    __m128 dy = _mm_max_ps(_mm_sub_ps(_mm_loadu_ps(boxes.GetMinY() + i), centerY)
+      , _mm_sub_ps(centerY, _mm_loadu_ps(boxes.GetMaxY() + i)));
+    __m128 dz = _mm_max_ps(_mm_sub_ps(_mm_loadu_ps(boxes.GetMinZ() + i), centerZ)
+      , _mm_sub_ps(centerZ, _mm_loadu_ps(boxes.GetMaxZ() + i)));
+    dx = _mm_max_ps(dx, zero);
+    dy = _mm_max_ps(dy, zero);
+    dz = _mm_max_ps(dz, zero);
+
+    __m128 distSq = _mm_add_ps(_mm_add_ps(_mm_mul_ps(dx, dx), _mm_mul_ps(dy, dy)), _mm_mul_ps(dz, dz));
+    int mask = _mm_movemask_ps(_mm_cmple_ps(distSq, radius)) & ValidLanes(i, size);
+    for (int lane = 0; mask; ++lane, mask >>= 1)
+    {
+      if (mask & 1)
+      {
+        outIndices[count++] = static_cast<int>(i) + lane;
+      }
+    }
+  }
+#else
+  for (size_t i = 0; i < size; ++i)
+  {
+    if (boxes.Get(i).MinDistSq(sphere.m_Center) <= radiusSq)
+    {
+      outIndices[count++] = static_cast<int>(i);
+    }
+  }
+#endif
+  return count;
+}
+
+void CollisionSIMD::IntersectPairs(const AABBArray& a, const AABBArray& b, unsigned char* outOverlap)
+{
+  size_t size = Math::Min(a.GetSize(), b.GetSize());
+
+#if USE_SSE
+  for (size_t i = 0; i < size; i += 4)
+  {
+    __m128 apart = _mm_or_ps(_mm_cmplt_ps(_mm_loadu_ps(a.GetMaxX() + i), _mm_loadu_ps(b.GetMinX() + i))
+      , _mm_cmplt_ps(_mm_loadu_ps(b.GetMaxX() + i), _mm_loadu_ps(a.GetMinX() + i)));
+    apart = _mm_or_ps(apart, _mm_cmplt_ps(_mm_loadu_ps(a.GetMaxY() + i), _mm_loadu_ps(b.GetMinY() + i)));
+    apart = _mm_or_ps(apart, _mm_cmplt_ps(_mm_loadu_ps(b.GetMaxY() + i), _mm_loadu_ps(a.GetMinY() + i)));
+    apart = _mm_or_ps(apart, _mm_cmplt_ps(_mm_loadu_ps(a.GetMaxZ() + i), _mm_loadu_ps(b.GetMinZ() + i)));
+    apart = _mm_or_ps(apart, _mm_cmplt_ps(_mm_loadu_ps(b.GetMaxZ() + i), _mm_loadu_ps(a.GetMinZ() + i)));
+
+    int mask = ~_mm_movemask_ps(apart);
+    size_t lanes = Math::Min(size - i, static_cast<size_t>(4));
+    for (size_t lane = 0; lane < lanes; ++lane)
+    {
+      outOverlap[i + lane] = (mask >> lane) & 1;
+    }
+  }
+#else
+  for (size_t i = 0; i < size; ++i)
+  {
+    outOverlap[i] = Intersect(a.Get(i), b.Get(i)) ? 1 : 0;
+  }
+#endif
+}
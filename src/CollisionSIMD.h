@@ -0,0 +1,59 @@
+#pragma once
+
+#include "Collision.h"
+#include <cstddef>
+#include <vector>
+
+// boxes stored as separate min/max component arrays so the batch tests
+// below can load 4 boxes per SIMD register. Arrays are padded to a
+// multiple of 4, kernels ignore the padding
+class AABBArray
+{
+public:
+  AABBArray();
+
+  void Clear();
+  void Reserve(size_t count);
+  void Add(const AABB& box);
+  void Set(size_t index, const AABB& box);
+  AABB Get(size_t index) const;
+
+  size_t GetSize() const;
+
+  const float* GetMinX() const { return m_MinX.data(); }
+  const float* GetMinY() const { return m_MinY.data(); }
+  const float* GetMinZ() const { return m_MinZ.data(); }
+  const float* GetMaxX() const { return m_MaxX.data(); }
+  const float* GetMaxY() const { return m_MaxY.data(); }
+  const float* GetMaxZ() const { return m_MaxZ.data(); }
+
+private:
+  std::vector<float> m_MinX;
+  std::vector<float> m_MinY;
+  std::vector<float> m_MinZ;
+  std::vector<float> m_MaxX;
+  std::vector<float> m_MaxY;
+  std::vector<float> m_MaxZ;
+  size_t m_Size;
+};
+
+// one-against-many and many-pairs versions of the Collision.h tests,
+// 4 boxes per SSE pass with a scalar path for other targets. Results
+// match the single versions (touching counts as intersecting)
+class CollisionSIMD
+{
+public:
+  // closest box the segment hits, -1 for none. outT/outNorm as in
+  // Intersect(LineSegment, AABB) (a segment starting inside hits where it leaves)
+  static int IntersectSegment(const LineSegment& l, const AABBArray& boxes
+    , float& outT, Vector3& outNorm);
+
+  // writes the index of every box overlapping box, returns the count
+  static size_t IntersectBox(const AABB& box, const AABBArray& boxes, int* outIndices);
+
+  // writes the index of every box overlapping the sphere, returns the count
+  static size_t IntersectSphere(const Sphere& sphere, const AABBArray& boxes, int* outIndices);
+
+  // outOverlap[i] = Intersect(a[i], b[i]) for every i in both arrays
+  static void IntersectPairs(const AABBArray& a, const AABBArray& b, unsigned char* outOverlap);
+};
@@ -1,5 +1,7 @@
 #pragma once
 
+#include <cstdint>
+
 const int MAP_SIZE = 15;
 
 const float FOX_SPEED = 200.0f;
@@ -16,5 +18,65 @@ const float ENEMY_HUNT_DISTANCE   = 400.0f;
 const float PLAYER_SHOOT_TIMER = 0.4f;
 const float BULLET_SPEED = 20.0f;
 
+// broadphase tree boxes are grown by this (world units) so small moves
+// don't need a reinsert
+const float PHYS_BROADPHASE_MARGIN = 5.0f;
+
+// spatial grid cell size, about one floor tile
+const float PHYS_GRID_CELL_SIZE = 250.0f;
+
+// continuous sweeps stop this far (world units) short of what they hit,
+// so the next sweep doesn't start touching it
+const float PHYS_CCD_SKIN = 0.5f;
+
+// rigid bodies: gravity along z (world units/s^2), solver passes per step,
+// and how far apart (world units) contacts are picked up ahead of touching
+const float PHYS_GRAVITY = -980.0f;
+const int PHYS_SOLVER_ITERATIONS = 10;
+const float PHYS_CONTACT_MARGIN = 1.0f;
+
+// fixed physics tick (seconds), rigid body steps per tick, and the most
+// ticks run in one frame before PhysWorld gives up catching up
+const float PHYS_TICK = 1.0f / 60.0f;
+const int PHYS_SUBSTEPS = 2;
+const int PHYS_MAX_TICKS = 4;
+
+// collision layers, each BoxComponent is on one and queries take a mask
+const uint32_t COLLISION_LAYER_WORLD      = 1 << 0;
+const uint32_t COLLISION_LAYER_PLAYER     = 1 << 1;
+const uint32_t COLLISION_LAYER_TARGET     = 1 << 2;
+const uint32_t COLLISION_LAYER_PROJECTILE = 1 << 3;
+const uint32_t COLLISION_LAYER_ALL        = 0xffffffff;
+
+// what a BoxComponent is, so hit handling can tell without a dynamic_cast
+const uint32_t COLLISION_TAG_NONE   = 0;
+const uint32_t COLLISION_TAG_TARGET = 1;
+
+// scene loading: seconds per frame spent creating / deleting streamed
+// actors
+const float SCENE_LOAD_BUDGET = 0.002f;
+
+// world partition, in cells around the player: loaded within the load
+// radius, unloaded beyond the unload radius. Cells around where the
+// player will be this many seconds ahead are loaded too
+const int SCENE_LOAD_RADIUS = 1;
+const int SCENE_UNLOAD_RADIUS = 2;
+const float SCENE_PREFETCH_TIME = 1.0f;
+
+// mesh LODs: how many pixels of error a LOD may show before a finer one
+// is drawn (used when generating them), and how far (as a fraction of a
+// LOD's screen size) an object must go past a switch point before it
+// switches back, so LODs don't pop back and forth at the boundary
+const float MESH_LOD_PIXEL_ERROR = 1.0f;
+const float MESH_LOD_HYSTERESIS = 0.15f;
+
+// mesh optimizer: entries in the FIFO vertex cache ACMR is measured with,
+// and how much worse than the cache order the overdraw order may be
+const int MESH_VERTEX_CACHE_SIZE = 16;
+const float MESH_OVERDRAW_THRESHOLD = 1.05f;
+
+// cross-fade time between player idle/run clips
+const float ANIM_BLEND_TIME = 0.2f;
+
 const int SCREEN_WIDTH  = 1024;
 const int SCREEN_HEIGHT = 768;
@@ -0,0 +1,101 @@
+#include "CpuSkinning.h"
+#include "JobSystem.h"
+#include "SIMD.h"
+
+#include <cstdint>
+#include <cstring>
+
+namespace
+{
+  // the skin words hold raw bytes, read them back without aliasing issues
+  inline void ReadBytes(const float* word, uint8_t* out)
+  {
+    memcpy(out, word, 4);
+  }
+}
+
+void CpuSkinning::SkinVertices(const float* vertices, size_t numVerts, const Matrix4* palette
+  , Vector3* outPositions, Vector3* outNormals)
+{
+#if USE_SSE
+  for (size_t i = 0; i < numVerts; ++i)
+  {
+    const float* v = vertices + i * SKIN_VERTEX_SIZE;
+    uint8_t bones[4];
+    uint8_t weights[4];
+    ReadBytes(v + 6, bones);
+    ReadBytes(v + 7, weights);
+
+    // weighted sum of the bone matrices, rows 0-2 rotate/scale and
+    // row 3 translates (row vectors), the 4th column is never needed
+    __m128 r0 = _mm_setzero_ps();
+    __m128 r1 = _mm_setzero_ps();
+    __m128 r2 = _mm_setzero_ps();
+    __m128 r3 = _mm_setzero_ps();
+    for (int b = 0; b < 4; ++b)
+    {
+      if (weights[b] == 0) { continue; }
+      __m128 w = _mm_set1_ps(weights[b] * (1.0f / 255.0f));
+      const Matrix4& m = palette[bones[b]];
+      r0 = _mm_add_ps(r0, _mm_mul_ps(w, _mm_loadu_ps(m.mat[0])));
+      r1 = _mm_add_ps(r1, _mm_mul_ps(w, _mm_loadu_ps(m.mat[1])));
+      r2 = _mm_add_ps(r2, _mm_mul_ps(w, _mm_loadu_ps(m.mat[2])));
+      r3 = _mm_add_ps(r3, _mm_mul_ps(w, _mm_loadu_ps(m.mat[3])));
+    }
+
+    __m128 pos = _mm_add_ps(
+      _mm_add_ps(_mm_mul_ps(_mm_set1_ps(v[0]), r0), _mm_mul_ps(_mm_set1_ps(v[1]), r1))
+      , _mm_add_ps(_mm_mul_ps(_mm_set1_ps(v[2]), r2), r3));
+    // write xyz only, the next vertex follows straight after
+    _mm_storel_pi(reinterpret_cast<__m64*>(&outPositions[i].x), pos);
+    _mm_store_ss(&outPositions[i].z, _mm_movehl_ps(pos, pos));
+
+    if (outNormals)
+    {
+      __m128 n = _mm_add_ps(
+        _mm_add_ps(_mm_mul_ps(_mm_set1_ps(v[3]), r0), _mm_mul_ps(_mm_set1_ps(v[4]), r1))
+        , _mm_mul_ps(_mm_set1_ps(v[5]), r2));
+      _mm_storel_pi(reinterpret_cast<__m64*>(&outNormals[i].x), n);
+      _mm_store_ss(&outNormals[i].z, _mm_movehl_ps(n, n));
+    }
+  }
+#else
+  for (size_t i = 0; i < numVerts; ++i)
+  {
+    const float* v = vertices + i * SKIN_VERTEX_SIZE;
+    uint8_t bones[4];
+    uint8_t weights[4];
+    ReadBytes(v + 6, bones);
+    ReadBytes(v + 7, weights);
+
+    Vector3 pos(0.0f, 0.0f, 0.0f);
+    Vector3 normal(0.0f, 0.0f, 0.0f);
+    for (int b = 0; b < 4; ++b)
+    {
+      if (weights[b] == 0) { continue; }
+      float w = weights[b] * (1.0f / 255.0f);
+      const Matrix4& m = palette[bones[b]];
+      pos += w * Vector3::Transform(Vector3(v[0], v[1], v[2]), m, 1.0f);
+      normal += w * Vector3::Transform(Vector3(v[3], v[4], v[5]), m, 0.0f);
+    }
+    outPositions[i] = pos;
+    if (outNormals)
+    {
+      outNormals[i] = normal;
+    }
+  }
+#endif
+}
+
+void CpuSkinning::SkinBatch(JobSystem* jobs, const Job* batch, size_t count)
+{
+  jobs->ParallelFor(count, 1, [batch](size_t begin, size_t end)
+  {
+    for (size_t i = begin; i < end; ++i)
+    {
+      const Job& job = batch[i];
+      SkinVertices(job.m_Vertices, job.m_NumVerts, job.m_Palette
+        , job.m_OutPositions, job.m_OutNormals);
+    }
+  });
+}
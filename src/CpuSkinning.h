@@ -0,0 +1,35 @@
+#pragma once
+
+#include "Math.h"
+#include <cstddef>
+#include <vector>
+
+// words (floats) per vertex in the PosNormSkinTex layout Mesh::Load builds:
+// position(3), normal(3), 4 bone indices (bytes), 4 weights (unorm bytes), uv(2)
+const size_t SKIN_VERTEX_SIZE = 10;
+
+// skins vertices on the CPU with the same math as Skinned.vert,
+// for headless validation, software rendering and hit tests against
+// animated meshes. One vertex is processed per SIMD pass (the four bone
+// matrices are blended as rows, then applied once)
+class CpuSkinning
+{
+public:
+  // one mesh worth of work for SkinBatch
+  struct Job
+  {
+    const float* m_Vertices;    // PosNormSkinTex vertex data
+    size_t m_NumVerts;
+    const Matrix4* m_Palette;   // inverse bind pose * current pose per bone
+    Vector3* m_OutPositions;    // m_NumVerts entries
+    Vector3* m_OutNormals;      // m_NumVerts entries or nullptr
+  };
+
+  // skins positions (and normals when outNormals isn't null) into
+  // object space, the same space Skinned.vert produces before uWorldTransform
+  static void SkinVertices(const float* vertices, size_t numVerts, const Matrix4* palette
+    , Vector3* outPositions, Vector3* outNormals);
+
+  // skins many meshes spread over the job system (one mesh per task)
+  static void SkinBatch(class JobSystem* jobs, const Job* batch, size_t count);
+};
@@ -6,7 +6,7 @@
 #include "FPSCamera.h"
 #include "MeshComponent.h"
 #include "BoxComponent.h"
-#include "PlaneActor.h"
+#include "PhysWorld.h"
 #include "Constants.h"
 #include "BallActor.h"
 
@@ -34,9 +34,13 @@ FPSActor::FPSActor(Game* game)
 	);
 	m_BoxComp->SetObjectBox(myBox);
 	m_BoxComp->SetShouldRotate(false);
+	m_BoxComp->SetLayer(COLLISION_LAYER_PLAYER);
 
 	// todo remove
 	SetPosition(Vector3(0.0f, 0.0f, 200.0f));
+
+	// the level streams in around us
+	game->SetPlayer(this);
 }
 
 void FPSActor::UpdateActor(float deltaTime)
@@ -138,56 +142,16 @@ void FPSActor::FixCollisions()
 	// recompute my world transform to update world box
 	ComputeWorldTransform();
 
-	const AABB& playerBox = m_BoxComp->GetWorldBox();
-	Vector3 pos = GetPosition();
-
-	m_MoveComp->SetIsGrounded(false); // gets set true if collision with top of AABB
-
-	auto& planeActors = GetGame()->GetPlaneActors();
-	for(auto plane : planeActors)
+	// push out of any level geometry overlapping us, found through the grid
+	Vector3 offset;
+	bool grounded = false;
+	if (GetGame()->GetPhysWorld()->ResolveBoxCollisions(m_BoxComp, COLLISION_LAYER_WORLD, offset, grounded))
 	{
-		// do we collide with this plane actor ?
-		const AABB& planeBox = plane->GetBox()->GetWorldBox();
-		if(Intersect(playerBox, planeBox))
-		{
-			// Calculate all our differences
-			float dx1 = planeBox.m_Max.x - playerBox.m_Min.x;
-			float dx2 = planeBox.m_Min.x - playerBox.m_Max.x;
-			float dy1 = planeBox.m_Max.y - playerBox.m_Min.y;
-			float dy2 = planeBox.m_Min.y - playerBox.m_Max.y;
-			float dz1 = planeBox.m_Max.z - playerBox.m_Min.z;
-			float dz2 = planeBox.m_Min.z - playerBox.m_Max.z;
-
-			// Set dx to whichever of dx1/dx2 have a lower abs (same for dy, dz)
-			float dx = Math::Abs(dx1) < Math::Abs(dx2) ? dx1 : dx2;
-			float dy = Math::Abs(dy1) < Math::Abs(dy2) ? dy1 : dy2;
-			float dz = Math::Abs(dz1) < Math::Abs(dz2) ? dz1 : dz2;
-
-			// Whichever is closest, adjust x/y position
-			if (Math::Abs(dx) <= Math::Abs(dy) && Math::Abs(dx) <= Math::Abs(dz))
-			{
-				pos.x += dx;
-			}
-			else if (Math::Abs(dy) <= Math::Abs(dx) && Math::Abs(dy) <= Math::Abs(dz))
-			{
-				pos.y += dy;
-			}
-			else
-			{
-				pos.z += dz;
-			}
-
-			// check if grounded (dz2 is top of plane)
-			if (dz2 < 0.0f)
-			{
-				m_MoveComp->SetIsGrounded(true);
-			}
-
-			// set position and update box component
-			SetPosition(pos);
-			m_BoxComp->OnUpdateWorldTransform();
-		}
+		// set position and update box component
+		SetPosition(GetPosition() + offset);
+		m_BoxComp->OnUpdateWorldTransform();
 	}
+	m_MoveComp->SetIsGrounded(grounded); // true if collision with top of AABB
 }
 
 void FPSActor::Shoot()
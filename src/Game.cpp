@@ -13,12 +13,41 @@
 #include "Skeleton.h"
 #include "Animation.h"
 #include "FollowActor.h"
+#include "JobSystem.h"
+#include "AnimationSystem.h"
+#include "SceneLoader.h"
+#include "WorldPartition.h"
 
 #include <GL/glew.h>
 #include <algorithm>
 
 #include <iostream> // remove
 
+namespace
+{
+  // every actor knows its slot in the list holding it, so removing one
+  // is a swap and pop without searching
+  void AddToList(std::vector<Actor*>& actors, Actor* actor)
+  {
+    actor->SetGameIndex(actors.size());
+    actors.emplace_back(actor);
+  }
+
+  // false if the actor isn't in this list
+  bool RemoveFromList(std::vector<Actor*>& actors, Actor* actor)
+  {
+    size_t index = actor->GetGameIndex();
+    if (index >= actors.size() || actors[index] != actor)
+    {
+      return false;
+    }
+    actors[index] = actors.back();
+    actors[index]->SetGameIndex(index);
+    actors.pop_back();
+    return true;
+  }
+}
+
 Game::Game()
   : m_Renderer(nullptr)
   , m_TicksCount(0)
@@ -26,6 +55,11 @@ Game::Game()
   , m_UpdatingActors(false)
   , m_InputSystem(nullptr)
   , m_PhysWorld(nullptr)
+  , m_JobSystem(nullptr)
+  , m_AnimationSystem(nullptr)
+  , m_SceneLoader(nullptr)
+  , m_WorldPartition(nullptr)
+  , m_Player(nullptr)
 {}
 
 bool Game::Initialize()
@@ -36,9 +70,16 @@ bool Game::Initialize()
     return false;
   }
 
+  // set up worker threads
+  m_JobSystem = new JobSystem();
+  m_JobSystem->Initialize();
+
   // set up physical world
   m_PhysWorld = new PhysWorld(this);
 
+  // set up animation evaluation
+  m_AnimationSystem = new AnimationSystem(this);
+
   // Create the renderer
   m_Renderer = new Renderer(this);
   if (!m_Renderer->Initialize((float) SCREEN_WIDTH, (float) SCREEN_HEIGHT))
@@ -61,6 +102,14 @@ bool Game::Initialize()
   return true;
 }
 
+bool Game::InitializeHeadless()
+{
+  m_JobSystem = new JobSystem();
+  m_JobSystem->Initialize();
+  m_PhysWorld = new PhysWorld(this);
+  return true;
+}
+
 void Game::RunLoop()
 {
   while(m_IsRunning)
@@ -138,10 +187,22 @@ void Game::UpdateGame()
   for(auto pending : m_PendingActors)
   {
     pending->ComputeWorldTransform();
-    m_Actors.emplace_back(pending);
+    AddToList(m_Actors, pending);
   }
   m_PendingActors.clear();
 
+  // stream the level around the player, new actors are placed right away
+  m_WorldPartition->Update(deltaTime);
+  m_SceneLoader->Update(SCENE_LOAD_BUDGET);
+
+  // rigid bodies on fixed ticks, then continuous moves queued by actors
+  // this frame, results are read next frame
+  m_PhysWorld->Simulate(deltaTime);
+  m_PhysWorld->ProcessSweeps();
+
+  // evaluate skeletal animation poses for all actors as one batch
+  m_AnimationSystem->Update();
+
   // add dead actors to temp vector
   std::vector<Actor*> deadActors;
   for(auto actor : m_Actors)
@@ -155,12 +216,8 @@ void Game::UpdateGame()
   // delete dead actors
   for(auto actor : deadActors)
   {
-    auto it = std::find(m_Actors.begin(), m_Actors.end(), actor);
-    if (it != m_Actors.end())
-    {
-      m_Actors.erase(it);
-      // delete actor // TODO
-    }
+    RemoveFromList(m_Actors, actor);
+    // delete actor // TODO
   }
 }
 
@@ -171,32 +228,23 @@ void Game::GenerateOutput()
 
 void Game::LoadData()
 {
-  // create FPS actor
-  // FPSActor* fpsActor = new FPSActor(this);
-
-  // set up follow actor
-  FollowActor* followActor = new FollowActor(this);
-
-	// Create scene actors
-	Actor* a = new Actor(this);
-	a->SetPosition(Vector3(200.0f, 75.0f, 0.0f));
-	a->SetScale(100.0f);
-	Quaternion q(Vector3::UnitY, -Math::PiOver2);
-	q = Quaternion::Concatenate(q, Quaternion(Vector3::UnitZ, Math::Pi + Math::Pi / 4.0f));
-	a->SetRotation(q);
-	MeshComponent* mc = new MeshComponent(a);
-	mc->SetMesh(m_Renderer->GetMesh("assets/Cube.gpmesh"));
-
-	a = new Actor(this);
-	a->SetPosition(Vector3(200.0f, -75.0f, 0.0f));
-	a->SetScale(3.0f);
-	mc = new MeshComponent(a);
-	mc->SetMesh(m_Renderer->GetMesh("assets/Sphere.gpmesh"));
-
+  // actors, meshes and lights all come from the scene file, a cooked
+  // Level.gpscenebin is used when it's there. The global section (player,
+  // HUD) and the cells around the player are in before the first frame,
+  // the world partition streams the rest as the player moves
+  m_SceneLoader = new SceneLoader(this);
+  m_WorldPartition = new WorldPartition(this, m_SceneLoader);
+  if (m_SceneLoader->Open("assets/Level.gpscene"))
+  {
+    m_SceneLoader->QueueSection(0);
+    m_SceneLoader->LoadQueued();
+    m_WorldPartition->Update(0.0f);
+    m_SceneLoader->LoadQueued();
+  }
 
   /*
   // Running in place cat actor (not moveable)
-  a = new Actor(this);
+  Actor* a = new Actor(this);
   a->SetPosition(Vector3(0.0f, 0.0f, 0.0f));
   a->SetScale(3.0f);
   SkeletalMeshComponent* sk = new SkeletalMeshComponent(a);
@@ -206,85 +254,25 @@ void Game::LoadData()
   std::string catAnim = "assets/CatRunSprint.gpanim";
   sk->PlayAnimation(GetAnimation(catAnim), 1.25f);
   */
+}
 
-	// Setup floor
-	const float start = -1250.0f;
-	const float size = 250.0f;
-	for (int i = 0; i < 10; i++)
-	{
-		for (int j = 0; j < 10; j++)
-		{
-			a = new PlaneActor(this);
-			a->SetPosition(Vector3(start + i * size, start + j * size, -100.0f));
-		}
-	}
-
-	// Left/right walls
-	q = Quaternion(Vector3::UnitX, Math::PiOver2);
-	for (int i = 0; i < 10; i++)
-	{
-		a = new PlaneActor(this);
-		a->SetPosition(Vector3(start + i * size, start - size, 0.0f));
-		a->SetRotation(q);
-
-		a = new PlaneActor(this);
-		a->SetPosition(Vector3(start + i * size, -start + size, 0.0f));
-		a->SetRotation(q);
-	}
-
-	q = Quaternion::Concatenate(q, Quaternion(Vector3::UnitZ, Math::PiOver2));
-	// Forward/back walls
-	for (int i = 0; i < 10; i++)
-	{
-		a = new PlaneActor(this);
-		a->SetPosition(Vector3(start - size, start + i * size, 0.0f));
-		a->SetRotation(q);
-
-		a = new PlaneActor(this);
-		a->SetPosition(Vector3(-start + size, start + i * size, 0.0f));
-		a->SetRotation(q);
-	}
-
-	// Setup lights
-  // direction light
-	m_Renderer->SetAmbientLight(Vector3(0.2f, 0.2f, 0.2f));
-	DirectionalLight& dir = m_Renderer->GetDirectionalLight();
-	dir.m_Direction = Vector3(0.0f, -0.707f, -0.707f);
-	dir.m_DiffuseColor = Vector3(0.78f, 0.88f, 1.0f);
-	dir.m_SpecColor = Vector3(0.8f, 0.8f, 0.8f);
-
-  // point lights
-  std::vector<PointLight*> pointLights = m_Renderer->GetPointLights();
-  // set up point light 0
-  pointLights.at(0)->m_Pos = Vector3(350.0f, -100.0f, 300.0f);
-  pointLights.at(0)->m_DiffuseColor = Vector3(0.0f, 0.5f, 1.0f);
-  pointLights.at(0)->m_SpecColor = Vector3(1.0f, 0.0f, 0.0f);
-  pointLights.at(0)->m_SpecPower = 0.5f;
-  pointLights.at(0)->m_RadiusInfluence = 1000;
-  // set up point light 1
-  pointLights.at(1)->m_Pos = Vector3(-200.0f, -175.0f, 500.0f);
-  pointLights.at(1)->m_DiffuseColor = Vector3(1.0f, 0.0f, 0.0f);
-  pointLights.at(1)->m_SpecColor = Vector3(0.0f, 1.0f, 0.0f);
-  pointLights.at(1)->m_SpecPower = 0.2f;
-  pointLights.at(1)->m_RadiusInfluence = 1000;
-
-	// UI elements
-	a = new Actor(this);
-	a->SetPosition(Vector3(-350.0f, -350.0f, 0.0f));
-	SpriteComponent* sc = new SpriteComponent(a);
-	sc->SetTexture(m_Renderer->GetTexture("assets/HealthBar.png"));
-
-	a = new Actor(this);
-	a->SetPosition(Vector3(375.0f, -275.0f, 0.0f));
-	a->SetScale(0.75f);
-	sc = new SpriteComponent(a);
-	sc->SetTexture(m_Renderer->GetTexture("assets/Radar.png"));
-
-  // crosshair
-  a = new Actor(this);
-  a->SetPosition(Vector3(0.0f, 0.0f, 0.0f));
-  sc = new SpriteComponent(a);
-  sc->SetTexture(m_Renderer->GetTexture("assets/Crosshair.png"));
+void Game::BuildStaticGeometry(const std::vector<Actor*>& actors)
+{
+  for (Actor* actor : actors)
+  {
+    if (!actor->IsStatic())
+    {
+      continue;
+    }
+    if (RemoveFromList(m_Actors, actor) || RemoveFromList(m_PendingActors, actor))
+    {
+      // last transform they'll get, this also places their boxes in PhysWorld
+      actor->ComputeWorldTransform();
+      AddToList(m_StaticActors, actor);
+    }
+  }
+
+  m_Renderer->BuildStaticBatch(actors);
 }
 
 void Game::UnloadData()
@@ -293,6 +281,10 @@ void Game::UnloadData()
   {
     delete m_Actors.back();
   }
+  while(!m_StaticActors.empty())
+  {
+    delete m_StaticActors.back();
+  }
 
   if(m_Renderer)
   {
@@ -305,28 +297,28 @@ void Game::AddActor(Actor* actor)
 {
   if (m_UpdatingActors)
   {
-    m_PendingActors.emplace_back(actor);
+    AddToList(m_PendingActors, actor);
   } else {
-    m_Actors.emplace_back(actor);
+    AddToList(m_Actors, actor);
   }
 }
 
 void Game::RemoveActor(Actor* actor)
 {
-  // check both pending and active actors
-  auto it = std::find(m_PendingActors.begin(), m_PendingActors.end(), actor);
-  if (it != m_PendingActors.end())
+  // it's in at most one of them
+  if (!RemoveFromList(m_PendingActors, actor) && !RemoveFromList(m_Actors, actor))
   {
-    // swap to end of vector and pop off (avoid erase copies)
-    std::iter_swap(it, m_PendingActors.end() -1);
-    m_PendingActors.pop_back();
+    RemoveFromList(m_StaticActors, actor);
   }
 
-  it = std::find(m_Actors.begin(), m_Actors.end(), actor);
-  if (it != m_Actors.end())
+  // streamed in actors are tracked per scene section
+  if (actor->GetSceneSection() >= 0 && m_SceneLoader)
+  {
+    m_SceneLoader->RemoveActor(actor);
+  }
+  if (actor == m_Player)
   {
-    std::iter_swap(it, m_Actors.end() -1);
-    m_Actors.pop_back();
+    m_Player = nullptr;
   }
 }
 
@@ -380,6 +372,8 @@ Animation* Game::GetAnimation(std::string& fileName)
     Animation* anim = new Animation();
     if (anim->Load(fileName))
     {
+      // keyframe reduction + quantization, clips are only ever sampled
+      anim->Compress();
       m_Animations.emplace(fileName, anim);
     } else
     {
@@ -400,22 +394,61 @@ PhysWorld* Game::GetPhysWorld()
   return m_PhysWorld;
 }
 
+JobSystem* Game::GetJobSystem()
+{
+  return m_JobSystem;
+}
+
+AnimationSystem* Game::GetAnimationSystem()
+{
+  return m_AnimationSystem;
+}
+
 std::vector<class PlaneActor*>& Game::GetPlaneActors()
 {
   return m_PlaneActors;
 }
 
+Actor* Game::GetPlayer()
+{
+  return m_Player;
+}
+
+void Game::SetPlayer(Actor* player)
+{
+  m_Player = player;
+}
+
 void Game::ShutDown()
 {
   UnloadData();
+  delete m_WorldPartition;
+  m_WorldPartition = nullptr;
+  delete m_SceneLoader;
+  m_SceneLoader = nullptr;
   if(m_Renderer)
   {
     m_Renderer->ShutDown();
   }
 
   // shut down input system
-  m_InputSystem->ShutDown();
-  delete m_InputSystem;
+  if (m_InputSystem)
+  {
+    m_InputSystem->ShutDown();
+    delete m_InputSystem;
+    m_InputSystem = nullptr;
+  }
+
+  delete m_AnimationSystem;
+  m_AnimationSystem = nullptr;
+
+  // stop worker threads
+  if (m_JobSystem)
+  {
+    m_JobSystem->ShutDown();
+    delete m_JobSystem;
+    m_JobSystem = nullptr;
+  }
 
   SDL_Quit();
 }
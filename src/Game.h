@@ -11,6 +11,8 @@ class Game {
 private:
   std::vector<class Actor*> m_Actors;
   std::vector<class Actor*> m_PendingActors;
+  // taken out of m_Actors by BuildStaticGeometry, never updated
+  std::vector<class Actor*> m_StaticActors;
   std::vector<class PlaneActor*> m_PlaneActors;
 
   class Renderer* m_Renderer;
@@ -21,6 +23,12 @@ private:
 
   class InputSystem* m_InputSystem;
   class PhysWorld* m_PhysWorld;
+  class JobSystem* m_JobSystem;
+  class AnimationSystem* m_AnimationSystem;
+  class SceneLoader* m_SceneLoader;
+  class WorldPartition* m_WorldPartition;
+  // the actor the level streams in around (FollowActor / FPSActor)
+  class Actor* m_Player;
 
   // map for loaded skeletons
   std::unordered_map<std::string, class Skeleton*> m_Skeletons;
@@ -31,6 +39,9 @@ private:
 public:
   Game();
   bool Initialize();
+  // just the job system and physics, no window, renderer, input or level.
+  // For the command line tools (--bench) that need actors and boxes
+  bool InitializeHeadless();
   void RunLoop();
   void ShutDown();
 
@@ -43,7 +54,16 @@ public:
 
   class Renderer* GetRenderer();
   class PhysWorld* GetPhysWorld();
+  class JobSystem* GetJobSystem();
+  class AnimationSystem* GetAnimationSystem();
   std::vector<class PlaneActor*>& GetPlaneActors();
+  class Actor* GetPlayer();
+  void SetPlayer(class Actor* player);
+
+  // moves the static ones of actors (a finished scene section) out of the
+  // per frame update and has the renderer merge their meshes, once their
+  // world transforms are computed
+  void BuildStaticGeometry(const std::vector<class Actor*>& actors);
 private:
   void ProcessInput();
   void UpdateGame();
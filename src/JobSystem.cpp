@@ -0,0 +1,151 @@
+#include "JobSystem.h"
+
+#include <memory>
+
+namespace
+{
+  thread_local unsigned s_ThreadIndex = 0;
+}
+
+JobSystem::JobSystem()
+  :m_Quit(false)
+{}
+
+bool JobSystem::Initialize(unsigned numWorkers)
+{
+  if (numWorkers == 0)
+  {
+    unsigned hw = std::thread::hardware_concurrency();
+    numWorkers = hw > 1 ? hw - 1 : 0;
+  }
+
+  m_Quit = false;
+  for (unsigned i = 0; i < numWorkers; ++i)
+  {
+    // main thread is index 0
+    m_Workers.emplace_back(&JobSystem::WorkerLoop, this, i + 1);
+  }
+  return true;
+}
+
+void JobSystem::ShutDown()
+{
+  {
+    std::lock_guard<std::mutex> lock(m_QueueMutex);
+    m_Quit = true;
+  }
+  m_QueueCondition.notify_all();
+
+  for (auto& worker : m_Workers)
+  {
+    worker.join();
+  }
+  m_Workers.clear();
+  m_Queue.clear();
+}
+
+void JobSystem::ParallelFor(size_t count, size_t grainSize
+  , const std::function<void(size_t, size_t)>& func)
+{
+  if (count == 0) { return; }
+  if (grainSize == 0) { grainSize = 1; }
+
+  size_t numChunks = (count + grainSize - 1) / grainSize;
+
+  // not worth waking anybody up
+  if (m_Workers.empty() || numChunks == 1)
+  {
+    func(0, count);
+    return;
+  }
+
+  // chunks are claimed through an atomic counter so fast threads take more
+  struct Batch
+  {
+    std::atomic<size_t> m_Next;
+    std::atomic<size_t> m_Done;
+  };
+  std::shared_ptr<Batch> batch = std::make_shared<Batch>();
+  batch->m_Next = 0;
+  batch->m_Done = 0;
+
+  // func outlives every chunk since we wait on m_Done below,
+  // late workers only touch the shared batch counters
+  const std::function<void(size_t, size_t)>* body = &func;
+  auto work = [batch, body, numChunks, grainSize, count]()
+  {
+    for (;;)
+    {
+      size_t chunk = batch->m_Next++;
+      if (chunk >= numChunks) { break; }
+
+      size_t begin = chunk * grainSize;
+      size_t end = begin + grainSize < count ? begin + grainSize : count;
+      (*body)(begin, end);
+      batch->m_Done++;
+    }
+  };
+
+  size_t numHelpers = m_Workers.size() < numChunks - 1 ? m_Workers.size() : numChunks - 1;
+  {
+    std::lock_guard<std::mutex> lock(m_QueueMutex);
+    for (size_t i = 0; i < numHelpers; ++i)
+    {
+      m_Queue.emplace_back(work);
+    }
+  }
+  m_QueueCondition.notify_all();
+
+  // calling thread works too, then waits for stragglers
+  work();
+  while (batch->m_Done.load() < numChunks)
+  {
+    std::this_thread::yield();
+  }
+}
+
+void JobSystem::Submit(std::function<void()> job)
+{
+  if (m_Workers.empty())
+  {
+    job();
+    return;
+  }
+
+  {
+    std::lock_guard<std::mutex> lock(m_QueueMutex);
+    m_Queue.emplace_back(std::move(job));
+  }
+  m_QueueCondition.notify_one();
+}
+
+unsigned JobSystem::GetNumThreads() const
+{
+  return static_cast<unsigned>(m_Workers.size()) + 1;
+}
+
+unsigned JobSystem::GetThreadIndex()
+{
+  return s_ThreadIndex;
+}
+
+void JobSystem::WorkerLoop(unsigned threadIndex)
+{
+  s_ThreadIndex = threadIndex;
+
+  for (;;)
+  {
+    std::function<void()> job;
+    {
+      std::unique_lock<std::mutex> lock(m_QueueMutex);
+      m_QueueCondition.wait(lock, [this]() { return m_Quit || !m_Queue.empty(); });
+      if (m_Quit && m_Queue.empty())
+      {
+        return;
+      }
+      job = std::move(m_Queue.front());
+      m_Queue.pop_front();
+    }
+    job();
+  }
+}
@@ -0,0 +1,47 @@
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// small worker thread pool used to spread per-frame work (animation,
+// physics queries, skinning) across cores
+class JobSystem
+{
+public:
+  JobSystem();
+
+  // numWorkers = 0 uses one worker per hardware thread minus the main thread
+  bool Initialize(unsigned numWorkers = 0);
+  void ShutDown();
+
+  // splits [0, count) into chunks of grainSize and calls func(begin, end)
+  // for each chunk across the workers, the calling thread helps out
+  // and this returns once every chunk has finished
+  void ParallelFor(size_t count, size_t grainSize
+    , const std::function<void(size_t, size_t)>& func);
+
+  // queues a job to run on a worker and returns straight away
+  void Submit(std::function<void()> job);
+
+  // workers + the main thread
+  unsigned GetNumThreads() const;
+
+  // index of the calling thread, 0 for the main thread and
+  // 1..GetNumThreads()-1 for workers (use for per-thread scratch buffers)
+  static unsigned GetThreadIndex();
+
+private:
+  void WorkerLoop(unsigned threadIndex);
+
+  std::vector<std::thread> m_Workers;
+  std::deque<std::function<void()>> m_Queue;
+  std::mutex m_QueueMutex;
+  std::condition_variable m_QueueCondition;
+  bool m_Quit;
+};
@@ -0,0 +1,584 @@
+#include "LocalPose.h"
+#include "Skeleton.h"
+#include "ScratchArena.h"
+#include "SIMD.h"
+#include "MatrixPalette.h"
+
+#include <algorithm>
+#include <limits>
+
+namespace
+{
+  // t adjusted by a cubic in |qa . qb| so nlerp tracks slerp closely
+  // (Kapoulkine's "approximating slerp") without any trig
+  inline float CorrectNlerpT(float t, float absDot)
+  {
+    float A = 1.0904f + absDot * (-3.2452f + absDot * (3.55645f - absDot * 1.43519f));
+    float B = 0.848013f + absDot * (-1.06021f + absDot * 0.215638f);
+    float k = A * (t - 0.5f) * (t - 0.5f) + B;
+    return t + t * (t - 0.5f) * (t - 1.0f) * k;
+  }
+
+  // builds the affine matrix (rotation then translation, row vectors)
+  // straight from a unit quaternion without going through two Matrix4s
+  inline void WriteAffineMatrix(Matrix4& m, float x, float y, float z, float w
+    , float tx, float ty, float tz)
+  {
+    m.mat[0][0] = 1.0f - 2.0f * y * y - 2.0f * z * z;
+    m.mat[0][1] = 2.0f * x * y + 2.0f * w * z;
+    m.mat[0][2] = 2.0f * x * z - 2.0f * w * y;
+    m.mat[0][3] = 0.0f;
+
+    m.mat[1][0] = 2.0f * x * y - 2.0f * w * z;
+    m.mat[1][1] = 1.0f - 2.0f * x * x - 2.0f * z * z;
+    m.mat[1][2] = 2.0f * y * z + 2.0f * w * x;
+    m.mat[1][3] = 0.0f;
+
+    m.mat[2][0] = 2.0f * x * z + 2.0f * w * y;
+    m.mat[2][1] = 2.0f * y * z - 2.0f * w * x;
+    m.mat[2][2] = 1.0f - 2.0f * x * x - 2.0f * y * y;
+    m.mat[2][3] = 0.0f;
+
+    m.mat[3][0] = tx;
+    m.mat[3][1] = ty;
+    m.mat[3][2] = tz;
+    m.mat[3][3] = 1.0f;
+  }
+}
+
+LocalPose::LocalPose()
+  :m_RotX(nullptr)
+  , m_RotY(nullptr)
+  , m_RotZ(nullptr)
+  , m_RotW(nullptr)
+  , m_TransX(nullptr)
+  , m_TransY(nullptr)
+  , m_TransZ(nullptr)
+  , m_NumBones(0)
+{}
+
+size_t LocalPose::GetStride(size_t numBones)
+{
+  return (numBones + 3) & ~static_cast<size_t>(3);
+}
+
+size_t LocalPose::GetStorageSize(size_t numBones)
+{
+  return 7 * GetStride(numBones);
+}
+
+void LocalPose::Attach(float* storage, size_t numBones)
+{
+  size_t stride = GetStride(numBones);
+  m_RotX = storage;
+  m_RotY = storage + stride;
+  m_RotZ = storage + stride * 2;
+  m_RotW = storage + stride * 3;
+  m_TransX = storage + stride * 4;
+  m_TransY = storage + stride * 5;
+  m_TransZ = storage + stride * 6;
+  m_NumBones = numBones;
+}
+
+bool LocalPose::Allocate(ScratchArena& arena, size_t numBones)
+{
+  float* storage = static_cast<float*>(arena.Allocate(GetStorageSize(numBones) * sizeof(float)));
+  if (!storage) { return false; }
+  Attach(storage, numBones);
+  return true;
+}
+
+void LocalPose::SetIdentity()
+{
+  size_t stride = GetStride(m_NumBones);
+  std::fill(m_RotX, m_RotX + stride, 0.0f);
+  std::fill(m_RotY, m_RotY + stride, 0.0f);
+  std::fill(m_RotZ, m_RotZ + stride, 0.0f);
+  std::fill(m_RotW, m_RotW + stride, 1.0f);
+  std::fill(m_TransX, m_TransX + stride, 0.0f);
+  std::fill(m_TransY, m_TransY + stride, 0.0f);
+  std::fill(m_TransZ, m_TransZ + stride, 0.0f);
+}
+
+Quaternion LocalPose::Nlerp(const Quaternion& a, const Quaternion& b, float t)
+{
+  float dot = Quaternion::Dot(a, b);
+  float ct = CorrectNlerpT(t, Math::Abs(dot));
+  float tb = dot < 0.0f ? -ct : ct;
+  float ta = 1.0f - ct;
+  Quaternion q(a.x * ta + b.x * tb, a.y * ta + b.y * tb
+    , a.z * ta + b.z * tb, a.w * ta + b.w * tb);
+  q.Normalize();
+  return q;
+}
+
+void LocalPose::Blend(const LocalPose& a, const LocalPose& b, float weight
+  , const float* boneWeights, LocalPose& out)
+{
+  const size_t numBones = a.m_NumBones;
+#if USE_SSE
+  const __m128 one = _mm_set1_ps(1.0f);
+  const __m128 half = _mm_set1_ps(0.5f);
+  const __m128 signMask = _mm_set1_ps(-0.0f);
+  const __m128 weightV = _mm_set1_ps(weight);
+
+  // padding lanes are processed too, they hold finite values
+  for (size_t bone = 0; bone < numBones; bone += 4)
+  {
+    __m128 ax = _mm_loadu_ps(a.m_RotX + bone);
+    __m128 ay = _mm_loadu_ps(a.m_RotY + bone);
+    __m128 az = _mm_loadu_ps(a.m_RotZ + bone);
+    __m128 aw = _mm_loadu_ps(a.m_RotW + bone);
+    __m128 bx = _mm_loadu_ps(b.m_RotX + bone);
+    __m128 by = _mm_loadu_ps(b.m_RotY + bone);
+    __m128 bz = _mm_loadu_ps(b.m_RotZ + bone);
+    __m128 bw = _mm_loadu_ps(b.m_RotW + bone);
+    __m128 tv = boneWeights ? _mm_mul_ps(weightV, _mm_loadu_ps(boneWeights + bone)) : weightV;
+
+    __m128 dot = _mm_add_ps(_mm_add_ps(_mm_mul_ps(ax, bx), _mm_mul_ps(ay, by))
+      , _mm_add_ps(_mm_mul_ps(az, bz), _mm_mul_ps(aw, bw)));
+    __m128 d = _mm_andnot_ps(signMask, dot);
+
+    // same correction as CorrectNlerpT, per lane
+    __m128 A = _mm_sub_ps(_mm_set1_ps(3.55645f), _mm_mul_ps(d, _mm_set1_ps(1.43519f)));
+    A = _mm_add_ps(_mm_set1_ps(-3.2452f), _mm_mul_ps(d, A));
+    A = _mm_add_ps(_mm_set1_ps(1.0904f), _mm_mul_ps(d, A));
+    __m128 B = _mm_add_ps(_mm_set1_ps(-1.06021f), _mm_mul_ps(d, _mm_set1_ps(0.215638f)));
+    B = _mm_add_ps(_mm_set1_ps(0.848013f), _mm_mul_ps(d, B));
+    __m128 tHalf = _mm_sub_ps(tv, half);
+    __m128 k = _mm_add_ps(_mm_mul_ps(A, _mm_mul_ps(tHalf, tHalf)), B);
+    __m128 tCubic = _mm_mul_ps(_mm_mul_ps(tv, tHalf), _mm_sub_ps(tv, one));
+    __m128 ct = _mm_add_ps(tv, _mm_mul_ps(tCubic, k));
+
+    // take the short way round: flip t's sign where the dot is negative
+    __m128 ta = _mm_sub_ps(one, ct);
+    __m128 tb = _mm_xor_ps(ct, _mm_and_ps(dot, signMask));
+
+    __m128 qx = _mm_add_ps(_mm_mul_ps(ax, ta), _mm_mul_ps(bx, tb));
+    __m128 qy = _mm_add_ps(_mm_mul_ps(ay, ta), _mm_mul_ps(by, tb));
+    __m128 qz = _mm_add_ps(_mm_mul_ps(az, ta), _mm_mul_ps(bz, tb));
+    __m128 qw = _mm_add_ps(_mm_mul_ps(aw, ta), _mm_mul_ps(bw, tb));
+
+    __m128 lenSq = _mm_add_ps(_mm_add_ps(_mm_mul_ps(qx, qx), _mm_mul_ps(qy, qy))
+      , _mm_add_ps(_mm_mul_ps(qz, qz), _mm_mul_ps(qw, qw)));
+    __m128 invLen = _mm_div_ps(one, _mm_sqrt_ps(lenSq));
+    _mm_storeu_ps(out.m_RotX + bone, _mm_mul_ps(qx, invLen));
+    _mm_storeu_ps(out.m_RotY + bone, _mm_mul_ps(qy, invLen));
+    _mm_storeu_ps(out.m_RotZ + bone, _mm_mul_ps(qz, invLen));
+    _mm_storeu_ps(out.m_RotW + bone, _mm_mul_ps(qw, invLen));
+
+    __m128 atx = _mm_loadu_ps(a.m_TransX + bone);
+    __m128 aty = _mm_loadu_ps(a.m_TransY + bone);
+    __m128 atz = _mm_loadu_ps(a.m_TransZ + bone);
+    _mm_storeu_ps(out.m_TransX + bone
+      , _mm_add_ps(atx, _mm_mul_ps(_mm_sub_ps(_mm_loadu_ps(b.m_TransX + bone), atx), tv)));
+    _mm_storeu_ps(out.m_TransY + bone
+      , _mm_add_ps(aty, _mm_mul_ps(_mm_sub_ps(_mm_loadu_ps(b.m_TransY + bone), aty), tv)));
+    _mm_storeu_ps(out.m_TransZ + bone
+      , _mm_add_ps(atz, _mm_mul_ps(_mm_sub_ps(_mm_loadu_ps(b.m_TransZ + bone), atz), tv)));
+  }
+#else
+  for (size_t bone = 0; bone < numBones; ++bone)
+  {
+    float t = boneWeights ? weight * boneWeights[bone] : weight;
+    Quaternion q = Nlerp(
+      Quaternion(a.m_RotX[bone], a.m_RotY[bone], a.m_RotZ[bone], a.m_RotW[bone])
+      , Quaternion(b.m_RotX[bone], b.m_RotY[bone], b.m_RotZ[bone], b.m_RotW[bone])
+      , t);
+    out.m_RotX[bone] = q.x;
+    out.m_RotY[bone] = q.y;
+    out.m_RotZ[bone] = q.z;
+    out.m_RotW[bone] = q.w;
+    out.m_TransX[bone] = Math::Lerp(a.m_TransX[bone], b.m_TransX[bone], t);
+    out.m_TransY[bone] = Math::Lerp(a.m_TransY[bone], b.m_TransY[bone], t);
+    out.m_TransZ[bone] = Math::Lerp(a.m_TransZ[bone], b.m_TransZ[bone], t);
+  }
+#endif
+}
+
+void LocalPose::Additive(const LocalPose& base, const LocalPose& pose
+  , const LocalPose& reference, float weight, const float* boneWeights, LocalPose& out)
+{
+  for (size_t bone = 0; bone < base.m_NumBones; ++bone)
+  {
+    float t = boneWeights ? weight * boneWeights[bone] : weight;
+
+    // delta = pose relative to reference (reference^-1 * pose)
+    Quaternion refInv(reference.m_RotX[bone], reference.m_RotY[bone]
+      , reference.m_RotZ[bone], reference.m_RotW[bone]);
+    refInv.Conjugate();
+    Quaternion delta = Quaternion::Concatenate(
+      Quaternion(pose.m_RotX[bone], pose.m_RotY[bone], pose.m_RotZ[bone], pose.m_RotW[bone])
+      , refInv);
+
+    // scale the delta by t (nlerp from identity, short way round)
+    if (delta.w < 0.0f)
+    {
+      delta = Quaternion(-delta.x, -delta.y, -delta.z, -delta.w);
+    }
+    delta = Quaternion(delta.x * t, delta.y * t, delta.z * t, 1.0f - t + delta.w * t);
+    delta.Normalize();
+
+    // apply the delta before the base rotation
+    Quaternion q = Quaternion::Concatenate(delta
+      , Quaternion(base.m_RotX[bone], base.m_RotY[bone], base.m_RotZ[bone], base.m_RotW[bone]));
+    out.m_RotX[bone] = q.x;
+    out.m_RotY[bone] = q.y;
+    out.m_RotZ[bone] = q.z;
+    out.m_RotW[bone] = q.w;
+
+    out.m_TransX[bone] = base.m_TransX[bone] + (pose.m_TransX[bone] - reference.m_TransX[bone]) * t;
+    out.m_TransY[bone] = base.m_TransY[bone] + (pose.m_TransY[bone] - reference.m_TransY[bone]) * t;
+    out.m_TransZ[bone] = base.m_TransZ[bone] + (pose.m_TransZ[bone] - reference.m_TransZ[bone]) * t;
+  }
+}
+
+namespace
+{
+  // a local transform counts as changed when any component moved more than this
+  const float PoseEpsilon = 1e-6f;
+
+#if USE_SSE
+  inline __m128 Gather(const float* arr, size_t i0, size_t i1, size_t i2, size_t i3)
+  {
+    return _mm_set_ps(arr[i3], arr[i2], arr[i1], arr[i0]);
+  }
+#endif
+
+  // global = parent * local for up to 4 independent bones
+  // (parents already computed, bones of one depth level)
+  void ComposeBones(const size_t* bones, size_t count, const int* parents
+    , const LocalPose& local, LocalPose& global)
+  {
+#if USE_SSE
+    // gather, padding lanes repeat the last bone
+    const size_t b0 = bones[0];
+    const size_t b1 = bones[count > 1 ? 1 : 0];
+    const size_t b2 = bones[count > 2 ? 2 : count - 1];
+    const size_t b3 = bones[count - 1];
+    const size_t p0 = static_cast<size_t>(parents[b0]);
+    const size_t p1 = static_cast<size_t>(parents[b1]);
+    const size_t p2 = static_cast<size_t>(parents[b2]);
+    const size_t p3 = static_cast<size_t>(parents[b3]);
+
+    __m128 bx = Gather(local.m_RotX, b0, b1, b2, b3);
+    __m128 by = Gather(local.m_RotY, b0, b1, b2, b3);
+    __m128 bz = Gather(local.m_RotZ, b0, b1, b2, b3);
+    __m128 bw = Gather(local.m_RotW, b0, b1, b2, b3);
+    __m128 ax = Gather(global.m_RotX, p0, p1, p2, p3);
+    __m128 ay = Gather(global.m_RotY, p0, p1, p2, p3);
+    __m128 az = Gather(global.m_RotZ, p0, p1, p2, p3);
+    __m128 aw = Gather(global.m_RotW, p0, p1, p2, p3);
+
+    // rotation: parent * local (Quaternion::Concatenate(local, parent))
+    __m128 qw = _mm_sub_ps(_mm_mul_ps(aw, bw), _mm_add_ps(_mm_add_ps(_mm_mul_ps(ax, bx)
+      , _mm_mul_ps(ay, by)), _mm_mul_ps(az, bz)));
+    __m128 qx = _mm_add_ps(_mm_add_ps(_mm_mul_ps(aw, bx), _mm_mul_ps(ax, bw))
+      , _mm_sub_ps(_mm_mul_ps(ay, bz), _mm_mul_ps(az, by)));
+    __m128 qy = _mm_add_ps(_mm_add_ps(_mm_mul_ps(aw, by), _mm_mul_ps(ay, bw))
+      , _mm_sub_ps(_mm_mul_ps(az, bx), _mm_mul_ps(ax, bz)));
+    __m128 qz = _mm_add_ps(_mm_add_ps(_mm_mul_ps(aw, bz), _mm_mul_ps(az, bw))
+      , _mm_sub_ps(_mm_mul_ps(ax, by), _mm_mul_ps(ay, bx)));
+
+    // translation: parent translation + local translation rotated by the
+    // parent, v + 2 * cross(u, cross(u, v) + w * v) like Vector3::Transform
+    __m128 vx = Gather(local.m_TransX, b0, b1, b2, b3);
+    __m128 vy = Gather(local.m_TransY, b0, b1, b2, b3);
+    __m128 vz = Gather(local.m_TransZ, b0, b1, b2, b3);
+    __m128 cx = _mm_add_ps(_mm_sub_ps(_mm_mul_ps(ay, vz), _mm_mul_ps(az, vy)), _mm_mul_ps(aw, vx));
+    __m128 cy = _mm_add_ps(_mm_sub_ps(_mm_mul_ps(az, vx), _mm_mul_ps(ax, vz)), _mm_mul_ps(aw, vy));
+    __m128 cz = _mm_add_ps(_mm_sub_ps(_mm_mul_ps(ax, vy), _mm_mul_ps(ay, vx)), _mm_mul_ps(aw, vz));
+    const __m128 two = _mm_set1_ps(2.0f);
+    __m128 tx = _mm_add_ps(_mm_add_ps(Gather(global.m_TransX, p0, p1, p2, p3), vx)
+      , _mm_mul_ps(two, _mm_sub_ps(_mm_mul_ps(ay, cz), _mm_mul_ps(az, cy))));
+    __m128 ty = _mm_add_ps(_mm_add_ps(Gather(global.m_TransY, p0, p1, p2, p3), vy)
+      , _mm_mul_ps(two, _mm_sub_ps(_mm_mul_ps(az, cx), _mm_mul_ps(ax, cz))));
+    __m128 tz = _mm_add_ps(_mm_add_ps(Gather(global.m_TransZ, p0, p1, p2, p3), vz)
+      , _mm_mul_ps(two, _mm_sub_ps(_mm_mul_ps(ax, cy), _mm_mul_ps(ay, cx))));
+
+    // scatter
+    alignas(16) float l[7][4];
+    _mm_store_ps(l[0], qx);
+    _mm_store_ps(l[1], qy);
+    _mm_store_ps(l[2], qz);
+    _mm_store_ps(l[3], qw);
+    _mm_store_ps(l[4], tx);
+    _mm_store_ps(l[5], ty);
+    _mm_store_ps(l[6], tz);
+    for (size_t lane = 0; lane < count; ++lane)
+    {
+      size_t b = bones[lane];
+      global.m_RotX[b] = l[0][lane];
+      global.m_RotY[b] = l[1][lane];
+      global.m_RotZ[b] = l[2][lane];
+      global.m_RotW[b] = l[3][lane];
+      global.m_TransX[b] = l[4][lane];
+      global.m_TransY[b] = l[5][lane];
+      global.m_TransZ[b] = l[6][lane];
+    }
+#else
+    for (size_t i = 0; i < count; ++i)
+    {
+      size_t b = bones[i];
+      size_t pb = static_cast<size_t>(parents[b]);
+      Quaternion parentRot(global.m_RotX[pb], global.m_RotY[pb], global.m_RotZ[pb], global.m_RotW[pb]);
+      Quaternion q = Quaternion::Concatenate(
+        Quaternion(local.m_RotX[b], local.m_RotY[b], local.m_RotZ[b], local.m_RotW[b]), parentRot);
+      Vector3 t = Vector3::Transform(
+        Vector3(local.m_TransX[b], local.m_TransY[b], local.m_TransZ[b]), parentRot);
+      global.m_RotX[b] = q.x;
+      global.m_RotY[b] = q.y;
+      global.m_RotZ[b] = q.z;
+      global.m_RotW[b] = q.w;
+      global.m_TransX[b] = t.x + global.m_TransX[pb];
+      global.m_TransY[b] = t.y + global.m_TransY[pb];
+      global.m_TransZ[b] = t.z + global.m_TransZ[pb];
+    }
+#endif
+  }
+}
+
+size_t LocalPose::ToGlobal(const Skeleton* skeleton, const LocalPose& local
+  , LocalPose& global, LocalPose* prevLocal, unsigned char* outDirty)
+{
+  const size_t numBones = local.m_NumBones;
+  if (numBones == 0) { return 0; }
+  const int* parents = skeleton->GetParentIndices().data();
+  const std::vector<size_t>& order = skeleton->GetLevelOrder();
+  const std::vector<size_t>& levelStarts = skeleton->GetLevelStarts();
+
+  // which bones' own local transform changed, 4 at a time
+  alignas(16) unsigned char dirty[MAX_SKELETON_BONES];
+
+  // bones whose own local transform changed also take it as their new
+  // reference in prevLocal (bones only dirtied by a parent keep theirs)
+  if (prevLocal)
+  {
+#if USE_SSE
+    const __m128 eps = _mm_set1_ps(PoseEpsilon);
+    const __m128 signMask = _mm_set1_ps(-0.0f);
+    const float* cur[7] = { local.m_RotX, local.m_RotY, local.m_RotZ, local.m_RotW
+      , local.m_TransX, local.m_TransY, local.m_TransZ };
+    float* prev[7] = { prevLocal->m_RotX, prevLocal->m_RotY, prevLocal->m_RotZ
+      , prevLocal->m_RotW, prevLocal->m_TransX, prevLocal->m_TransY, prevLocal->m_TransZ };
+    for (size_t bone = 0; bone < numBones; bone += 4)
+    {
+      // NaNs fail the <= so an invalidated cache is always dirty
+      __m128 c[7];
+      __m128 same = _mm_castsi128_ps(_mm_set1_epi32(-1));
+      for (int i = 0; i < 7; ++i)
+      {
+        c[i] = _mm_loadu_ps(cur[i] + bone);
+        __m128 diff = _mm_andnot_ps(signMask, _mm_sub_ps(c[i], _mm_loadu_ps(prev[i] + bone)));
+        same = _mm_and_ps(same, _mm_cmple_ps(diff, eps));
+      }
+      int mask = _mm_movemask_ps(same);
+      for (size_t lane = 0; lane < 4 && bone + lane < numBones; ++lane)
+      {
+        dirty[bone + lane] = (mask & (1 << lane)) ? 0 : 1;
+      }
+      if (mask == 0xf) { continue; }
+
+      for (int i = 0; i < 7; ++i)
+      {
+        __m128 p = _mm_loadu_ps(prev[i] + bone);
+        _mm_storeu_ps(prev[i] + bone, _mm_or_ps(_mm_and_ps(same, p), _mm_andnot_ps(same, c[i])));
+      }
+    }
+#else
+    for (size_t bone = 0; bone < numBones; ++bone)
+    {
+      bool same = Math::Abs(local.m_RotX[bone] - prevLocal->m_RotX[bone]) <= PoseEpsilon
+        && Math::Abs(local.m_RotY[bone] - prevLocal->m_RotY[bone]) <= PoseEpsilon
+        && Math::Abs(local.m_RotZ[bone] - prevLocal->m_RotZ[bone]) <= PoseEpsilon
+        && Math::Abs(local.m_RotW[bone] - prevLocal->m_RotW[bone]) <= PoseEpsilon
+        && Math::Abs(local.m_TransX[bone] - prevLocal->m_TransX[bone]) <= PoseEpsilon
+        && Math::Abs(local.m_TransY[bone] - prevLocal->m_TransY[bone]) <= PoseEpsilon
+        && Math::Abs(local.m_TransZ[bone] - prevLocal->m_TransZ[bone]) <= PoseEpsilon;
+      dirty[bone] = same ? 0 : 1;
+      if (!same)
+      {
+        prevLocal->CopyBone(local, bone);
+      }
+    }
+#endif
+  }
+  else
+  {
+    std::fill(dirty, dirty + numBones, static_cast<unsigned char>(1));
+  }
+
+  // roots (level 0) are just their local transform
+  size_t numDirty = 0;
+  for (size_t i = levelStarts[0]; i < levelStarts[1]; ++i)
+  {
+    size_t bone = order[i];
+    if (dirty[bone])
+    {
+      global.CopyBone(local, bone);
+      ++numDirty;
+    }
+  }
+
+  // every other level in batches of 4 dirty bones, a bone is dirty
+  // if its own transform changed or its parent was recomputed
+  size_t batch[4];
+  for (size_t level = 1; level + 1 < levelStarts.size(); ++level)
+  {
+    size_t batchSize = 0;
+    for (size_t i = levelStarts[level]; i < levelStarts[level + 1]; ++i)
+    {
+      size_t bone = order[i];
+      dirty[bone] |= dirty[parents[bone]];
+      if (!dirty[bone]) { continue; }
+
+      batch[batchSize++] = bone;
+      if (batchSize == 4)
+      {
+        ComposeBones(batch, batchSize, parents, local, global);
+        numDirty += batchSize;
+        batchSize = 0;
+      }
+    }
+    if (batchSize > 0)
+    {
+      ComposeBones(batch, batchSize, parents, local, global);
+      numDirty += batchSize;
+    }
+  }
+
+  if (outDirty)
+  {
+    std::copy(dirty, dirty + numBones, outDirty);
+  }
+  return numDirty;
+}
+
+void LocalPose::ToGlobalPoses(const Skeleton* skeleton, Matrix4* outPoses) const
+{
+  alignas(16) float storage[7 * MAX_SKELETON_BONES];
+  LocalPose global;
+  global.Attach(storage, m_NumBones);
+  ToGlobal(skeleton, *this, global, nullptr, nullptr);
+
+  for (size_t bone = 0; bone < m_NumBones; ++bone)
+  {
+    global.GetMatrix(bone, outPoses[bone]);
+  }
+}
+
+void LocalPose::ToPalette(const Skeleton* skeleton, const unsigned char* dirty
+  , Matrix4* outPalette) const
+{
+  const std::vector<Matrix4>& globalInvBindPoses = skeleton->GetGlobalInvBindPoses();
+#if USE_SSE
+  // 4 bones at a time: quaternions to rotation rows in SoA, transposed to
+  // a row per bone, then inverse bind pose * affine global as each output
+  // row being a sum of the global's rows scaled by the inverse bind row.
+  // A group with any dirty bone is done whole, the clean ones come out
+  // the same as they were
+  const __m128 one = _mm_set1_ps(1.0f);
+  const __m128 two = _mm_set1_ps(2.0f);
+  for (size_t group = 0; group < m_NumBones; group += 4)
+  {
+    size_t count = std::min<size_t>(4, m_NumBones - group);
+    if (dirty)
+    {
+      bool any = false;
+      for (size_t lane = 0; lane < count; ++lane)
+      {
+        any = any || dirty[group + lane];
+      }
+      if (!any) { continue; }
+    }
+
+    __m128 x = _mm_loadu_ps(m_RotX + group);
+    __m128 y = _mm_loadu_ps(m_RotY + group);
+    __m128 z = _mm_loadu_ps(m_RotZ + group);
+    __m128 w = _mm_loadu_ps(m_RotW + group);
+    __m128 x2 = _mm_mul_ps(two, x);
+    __m128 y2 = _mm_mul_ps(two, y);
+    __m128 z2 = _mm_mul_ps(two, z);
+    __m128 xx = _mm_mul_ps(x2, x), yy = _mm_mul_ps(y2, y), zz = _mm_mul_ps(z2, z);
+    __m128 xy = _mm_mul_ps(x2, y), xz = _mm_mul_ps(x2, z), yz = _mm_mul_ps(y2, z);
+    __m128 wx = _mm_mul_ps(x2, w), wy = _mm_mul_ps(y2, w), wz = _mm_mul_ps(z2, w);
+
+    __m128 rows[4][4];
+    rows[0][0] = _mm_sub_ps(_mm_sub_ps(one, yy), zz);
+    rows[0][1] = _mm_add_ps(xy, wz);
+    rows[0][2] = _mm_sub_ps(xz, wy);
+    rows[0][3] = _mm_setzero_ps();
+    rows[1][0] = _mm_sub_ps(xy, wz);
+    rows[1][1] = _mm_sub_ps(_mm_sub_ps(one, xx), zz);
+    rows[1][2] = _mm_add_ps(yz, wx);
+    rows[1][3] = _mm_setzero_ps();
+    rows[2][0] = _mm_add_ps(xz, wy);
+    rows[2][1] = _mm_sub_ps(yz, wx);
+    rows[2][2] = _mm_sub_ps(_mm_sub_ps(one, xx), yy);
+    rows[2][3] = _mm_setzero_ps();
+    rows[3][0] = _mm_loadu_ps(m_TransX + group);
+    rows[3][1] = _mm_loadu_ps(m_TransY + group);
+    rows[3][2] = _mm_loadu_ps(m_TransZ + group);
+    rows[3][3] = one;
+    // rows[r][c] now holds bone lane's (r, c), after this rows[r][lane]
+    // is bone lane's row r
+    for (int r = 0; r < 4; ++r)
+    {
+      _MM_TRANSPOSE4_PS(rows[r][0], rows[r][1], rows[r][2], rows[r][3]);
+    }
+
+    for (size_t lane = 0; lane < count; ++lane)
+    {
+      size_t bone = group + lane;
+      const Matrix4& inv = globalInvBindPoses[bone];
+      for (int row = 0; row < 4; ++row)
+      {
+        const float* a = inv.mat[row];
+        __m128 result = _mm_add_ps(
+          _mm_add_ps(_mm_mul_ps(_mm_set1_ps(a[0]), rows[0][lane]), _mm_mul_ps(_mm_set1_ps(a[1]), rows[1][lane]))
+          , _mm_add_ps(_mm_mul_ps(_mm_set1_ps(a[2]), rows[2][lane]), _mm_mul_ps(_mm_set1_ps(a[3]), rows[3][lane])));
+        _mm_storeu_ps(outPalette[bone].mat[row], result);
+      }
+    }
+  }
+#else
+  for (size_t bone = 0; bone < m_NumBones; ++bone)
+  {
+    if (dirty && !dirty[bone]) { continue; }
+
+    Matrix4 current;
+    GetMatrix(bone, current);
+    outPalette[bone] = globalInvBindPoses[bone] * current;
+  }
+#endif
+}
+
+void LocalPose::GetMatrix(size_t bone, Matrix4& outMatrix) const
+{
+  WriteAffineMatrix(outMatrix, m_RotX[bone], m_RotY[bone], m_RotZ[bone], m_RotW[bone]
+    , m_TransX[bone], m_TransY[bone], m_TransZ[bone]);
+}
+
+void LocalPose::CopyBone(const LocalPose& other, size_t bone)
+{
+  m_RotX[bone] = other.m_RotX[bone];
+  m_RotY[bone] = other.m_RotY[bone];
+  m_RotZ[bone] = other.m_RotZ[bone];
+  m_RotW[bone] = other.m_RotW[bone];
+  m_TransX[bone] = other.m_TransX[bone];
+  m_TransY[bone] = other.m_TransY[bone];
+  m_TransZ[bone] = other.m_TransZ[bone];
+}
+
+void LocalPose::Invalidate()
+{
+  const float nan = std::numeric_limits<float>::quiet_NaN();
+  size_t stride = GetStride(m_NumBones);
+  std::fill(m_RotX, m_RotX + stride, nan);
+  std::fill(m_RotY, m_RotY + stride, nan);
+  std::fill(m_RotZ, m_RotZ + stride, nan);
+  std::fill(m_RotW, m_RotW + stride, nan);
+  std::fill(m_TransX, m_TransX + stride, nan);
+  std::fill(m_TransY, m_TransY + stride, nan);
+  std::fill(m_TransZ, m_TransZ + stride, nan);
+}
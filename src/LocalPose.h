@@ -0,0 +1,78 @@
+#pragma once
+
+#include "Math.h"
+#include <cstddef>
+
+// local (parent relative) transform of every bone stored as structure of
+// arrays so poses can be sampled, blended and layered 4 bones at a time
+// before a single pass turns them into global matrices.
+// LocalPose doesn't own its storage, it points at a stack buffer,
+// a ScratchArena allocation or keys inside an Animation
+class LocalPose
+{
+public:
+  LocalPose();
+
+  // bones rounded up to a whole number of SIMD lanes
+  static size_t GetStride(size_t numBones);
+  // floats of storage a pose of numBones needs
+  static size_t GetStorageSize(size_t numBones);
+
+  // points the component arrays into storage (GetStorageSize floats, 16 byte aligned)
+  void Attach(float* storage, size_t numBones);
+  // takes storage from the arena, false if it's out of space
+  bool Allocate(class ScratchArena& arena, size_t numBones);
+
+  void SetIdentity();
+
+  // out = nlerp(a, b, weight * boneWeights[bone]) for rotations and a lerp
+  // for translations. boneWeights may be null (same weight for every bone),
+  // out may be a or b
+  static void Blend(const LocalPose& a, const LocalPose& b, float weight
+    , const float* boneWeights, LocalPose& out);
+
+  // the interpolation Blend does for a single bone
+  static Quaternion Nlerp(const Quaternion& a, const Quaternion& b, float t);
+
+  // layers the difference between pose and reference on top of base,
+  // scaled by weight * boneWeights[bone] (may be null), out may be base
+  static void Additive(const LocalPose& base, const LocalPose& pose
+    , const LocalPose& reference, float weight, const float* boneWeights, LocalPose& out);
+
+  // concatenates local down the hierarchy into global (model space rotation
+  // and translation per bone), one depth level at a time, 4 bones per SIMD pass.
+  // prevLocal (may be null) is the local pose global was last computed from:
+  // only bones whose local transform or an ancestor's changed since are
+  // recomputed (changed transforms are copied into prevLocal), outDirty[bone]
+  // (may be null) is set to 1 for those and 0 for the rest. Fill prevLocal with NaNs to force
+  // a full update. returns the number of bones recomputed
+  static size_t ToGlobal(const class Skeleton* skeleton, const LocalPose& local
+    , LocalPose& global, LocalPose* prevLocal, unsigned char* outDirty);
+
+  // builds the global matrix of every bone into outPoses (no caching)
+  void ToGlobalPoses(const class Skeleton* skeleton, Matrix4* outPoses) const;
+
+  // skinning palette from a global pose: global inverse bind pose * global
+  // matrix for each bone flagged in dirty (every bone when dirty is null)
+  void ToPalette(const class Skeleton* skeleton, const unsigned char* dirty
+    , Matrix4* outPalette) const;
+
+  // matrix of one bone's transform (local or global depending on the pose)
+  void GetMatrix(size_t bone, Matrix4& outMatrix) const;
+
+  // copies one bone's transform from other
+  void CopyBone(const LocalPose& other, size_t bone);
+
+  // sets every component to NaN so nothing compares equal to it
+  void Invalidate();
+
+  // for now, public (each GetStride(m_NumBones) long)
+  float* m_RotX;
+  float* m_RotY;
+  float* m_RotZ;
+  float* m_RotW;
+  float* m_TransX;
+  float* m_TransY;
+  float* m_TransZ;
+  size_t m_NumBones;
+};
@@ -1,7 +1,44 @@
 #include "Game.h"
+#include "SceneFile.h"
+#include "MeshSimplifier.h"
+#include "MeshOptimizer.h"
+#include "Benchmark.h"
+
+#include <cstdlib>
+#include <cstring>
 
 int main(int argc, char* args[]){
 
+  // --cook in.gpscene out.gpscenebin turns an authored scene into the
+  // binary the game loads, no window is opened
+  if (argc == 4 && strcmp(args[1], "--cook") == 0)
+  {
+    return SceneFile::Cook(args[2], args[3]) ? 0 : 1;
+  }
+
+  // --lods in.gpmesh out.gpmesh [count] adds simplified LODs to a mesh
+  if ((argc == 4 || argc == 5) && strcmp(args[1], "--lods") == 0)
+  {
+    int numLods = argc == 5 ? atoi(args[4]) : 3;
+    return MeshSimplifier::GenerateLods(args[2], args[3], numLods) ? 0 : 1;
+  }
+
+  // --optimize in.gpmesh out.gpmesh [--quantize] reorders a mesh for the
+  // vertex cache, overdraw and vertex fetch and logs ACMR before / after.
+  // --quantize has it loaded with packed normals / uvs
+  if ((argc == 4 || argc == 5) && strcmp(args[1], "--optimize") == 0)
+  {
+    bool quantize = argc == 5 && strcmp(args[4], "--quantize") == 0;
+    return MeshOptimizer::Optimize(args[2], args[3], quantize) ? 0 : 1;
+  }
+
+  // --bench [name] times the batch kernels against their plain versions
+  // and logs throughput, every benchmark when no name is given
+  if ((argc == 2 || argc == 3) && strcmp(args[1], "--bench") == 0)
+  {
+    return Benchmark::Run(argc == 3 ? args[2] : "") ? 0 : 1;
+  }
+
   Game game;
   
   if (game.Initialize())
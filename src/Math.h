@@ -109,6 +109,11 @@ namespace Math
 	{
 		return fmod(numer, denom);
 	}
+
+	inline float Floor(float value)
+	{
+		return floorf(value);
+	}
 }
 
 // 2D Vector
@@ -4,8 +4,11 @@
 #include "Game.h"
 #include "Renderer.h"
 #include "Math.h"
+#include "CpuSkinning.h"
+#include "MeshOptimizer.h"
 #include "include/rapidjson/document.h"
 
+#include <cstring>
 #include <fstream>
 #include <sstream>
 #include <SDL2/SDL_log.h>
@@ -84,7 +87,7 @@ bool Mesh::Load(const std::string & fileName, Renderer* renderer)
 
 	m_SpecPower = static_cast<float>(doc["specularPower"].GetDouble());
 
-	for (rapidjson::SizeType i = 0; i < textures.Size(); i++)
+	for (rapidjson::SizeType i = 0; renderer && i < textures.Size(); i++)
 	{
 		// Is this texture already loaded?
 		std::string texName = textures[i].GetString();
@@ -193,12 +196,92 @@ bool Mesh::Load(const std::string & fileName, Renderer* renderer)
 		indices.emplace_back(ind[2].GetUint());
 	}
 
+	m_Lods.clear();
+	m_Lods.emplace_back(MeshLod{ 0, static_cast<unsigned>(indices.size()), Math::Infinity });
+	std::vector<unsigned int> lodIndices;
+
+	// lower detail index lists made by MeshSimplifier, appended after the
+	// full mesh's in one index buffer
+	auto lodsIter = doc.FindMember("lods");
+	if (lodsIter != doc.MemberEnd() && lodsIter->value.IsArray() && layout == VertexArray::PosNormTex)
+	{
+		const rapidjson::Value& lods = lodsIter->value;
+		size_t numVerts = vertices.size() / vertSize;
+		for (rapidjson::SizeType i = 0; i < lods.Size(); i++)
+		{
+			const rapidjson::Value& lod = lods[i];
+			if (!lod.IsObject() || !lod.HasMember("indices") || !lod["indices"].IsArray()
+				|| !lod.HasMember("screenSize") || !lod["screenSize"].IsNumber())
+			{
+				SDL_Log("Mesh %s: lod %d is invalid", fileName.c_str(), i + 1);
+				break;
+			}
+			MeshLod meshLod;
+			meshLod.m_IndexOffset = static_cast<unsigned>(indices.size() + lodIndices.size());
+			meshLod.m_ScreenSize = static_cast<float>(lod["screenSize"].GetDouble());
+			const rapidjson::Value& lodInd = lod["indices"];
+			bool valid = true;
+			for (rapidjson::SizeType j = 0; valid && j < lodInd.Size(); j++)
+			{
+				const rapidjson::Value& ind = lodInd[j];
+				valid = ind.IsArray() && ind.Size() == 3
+					&& ind[0].GetUint() < numVerts && ind[1].GetUint() < numVerts && ind[2].GetUint() < numVerts;
+				if (valid)
+				{
+					lodIndices.emplace_back(ind[0].GetUint());
+					lodIndices.emplace_back(ind[1].GetUint());
+					lodIndices.emplace_back(ind[2].GetUint());
+				}
+			}
+			if (!valid)
+			{
+				SDL_Log("Mesh %s: lod %d has invalid indices", fileName.c_str(), i + 1);
+				lodIndices.resize(meshLod.m_IndexOffset - indices.size());
+				break;
+			}
+			meshLod.m_NumIndices = static_cast<unsigned>(lodIndices.size() + indices.size() - meshLod.m_IndexOffset);
+			m_Lods.emplace_back(meshLod);
+		}
+	}
+
+	// keep skinned meshes around on the CPU as well
+	if (layout == VertexArray::PosNormSkinTex)
+	{
+		m_SkinVertices.resize(vertices.size());
+		memcpy(m_SkinVertices.data(), vertices.data(), vertices.size() * sizeof(Vertex));
+		m_SkinIndices = indices;
+	}
+	else
+	{
+		m_Vertices.resize(vertices.size());
+		memcpy(m_Vertices.data(), vertices.data(), vertices.size() * sizeof(Vertex));
+		m_Indices = indices;
+	}
+
+	// meshes cooked with --optimize --quantize are uploaded packed, the
+	// CPU copy stays float
+	auto quantizeIter = doc.FindMember("quantize");
+	bool quantize = quantizeIter != doc.MemberEnd() && quantizeIter->value.IsBool()
+		&& quantizeIter->value.GetBool() && layout == VertexArray::PosNormTex;
+
 	// Now create a vertex array
-	m_VertexArray = new VertexArray(vertices.data()
-    , static_cast<unsigned>(vertices.size()) / vertSize
-    , indices.data()
-    , static_cast<unsigned>(indices.size())
-    , layout);
+	if (renderer)
+	{
+		indices.insert(indices.end(), lodIndices.begin(), lodIndices.end());
+		unsigned numVerts = static_cast<unsigned>(vertices.size() / vertSize);
+		if (quantize)
+		{
+			std::vector<uint8_t> packed;
+			MeshOptimizer::Quantize(m_Vertices, packed);
+			m_VertexArray = new VertexArray(packed.data(), numVerts, indices.data()
+				, static_cast<unsigned>(indices.size()), VertexArray::PosNormTexQuantized);
+		}
+		else
+		{
+			m_VertexArray = new VertexArray(vertices.data(), numVerts, indices.data()
+				, static_cast<unsigned>(indices.size()), layout);
+		}
+	}
 	return true;
 }
 
@@ -229,3 +312,17 @@ float Mesh::GetRadius() const { return m_Radius; }
 float Mesh::GetSpecPower() const { return m_SpecPower; }
 
 const AABB& Mesh::GetBox() const { return m_Box; }
+
+size_t Mesh::GetNumLods() const { return m_Lods.size(); }
+
+const MeshLod& Mesh::GetLod(size_t index) const { return m_Lods[index]; }
+
+const std::vector<float>& Mesh::GetSkinVertices() const { return m_SkinVertices; }
+
+size_t Mesh::GetNumSkinVertices() const { return m_SkinVertices.size() / SKIN_VERTEX_SIZE; }
+
+const std::vector<unsigned int>& Mesh::GetSkinIndices() const { return m_SkinIndices; }
+
+const std::vector<float>& Mesh::GetVertices() const { return m_Vertices; }
+
+const std::vector<unsigned int>& Mesh::GetIndices() const { return m_Indices; }
@@ -4,6 +4,19 @@
 #include <vector>
 #include <string>
 
+// floats per PosNormTex vertex
+const size_t MESH_VERTEX_SIZE = 8;
+
+// one level of detail, a range of the mesh's index buffer. LOD 0 is the
+// full mesh, the rest are drawn once the mesh's projected diameter is
+// below m_ScreenSize of the screen height
+struct MeshLod
+{
+  unsigned int m_IndexOffset;
+  unsigned int m_NumIndices;
+  float m_ScreenSize;
+};
+
 class Mesh
 {
 private:
@@ -17,10 +30,19 @@ private:
   float m_Radius;
   float m_SpecPower; // specular power of surface
   class AABB m_Box;
+  // CPU copy of skinned (PosNormSkinTex) meshes for CpuSkinning / hit tests
+  std::vector<float> m_SkinVertices;
+  std::vector<unsigned int> m_SkinIndices;
+  // CPU copy of unskinned (PosNormTex) meshes for static batching
+  std::vector<float> m_Vertices;
+  std::vector<unsigned int> m_Indices;
+  // all LODs share the vertex array, their indices follow LOD 0's
+  std::vector<MeshLod> m_Lods;
 public:
   Mesh();
   ~Mesh();
 
+  // renderer may be null to load headless (no textures or GPU buffers)
   bool Load(const std::string & fileName, class Renderer* renderer);
   void Unload();
 
@@ -30,4 +52,16 @@ public:
   float GetRadius() const;
   float GetSpecPower() const;
   const AABB& GetBox() const;
+  size_t GetNumLods() const;
+  const MeshLod& GetLod(size_t index) const;
+
+  // empty unless the mesh is skinned, SKIN_VERTEX_SIZE words per vertex
+  const std::vector<float>& GetSkinVertices() const;
+  size_t GetNumSkinVertices() const;
+  const std::vector<unsigned int>& GetSkinIndices() const;
+
+  // empty if the mesh is skinned, MESH_VERTEX_SIZE floats per vertex
+  // (position, normal, uv). Indices are LOD 0's
+  const std::vector<float>& GetVertices() const;
+  const std::vector<unsigned int>& GetIndices() const;
 };
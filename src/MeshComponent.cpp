@@ -6,12 +6,15 @@
 #include "Renderer.h"
 #include "Texture.h"
 #include "VertexArray.h"
+#include "Constants.h"
 
 MeshComponent::MeshComponent(class Actor* owner, bool isSkinned)
   :Component(owner)
   , m_Mesh(nullptr)
   , m_TextureIndex(0)
+  , m_Lod(0)
   , m_IsSkeletal(isSkinned)
+  , m_MeshIndex(0)
 {
   m_Owner->GetGame()->GetRenderer()->AddMeshComp(this);
 }
@@ -40,8 +43,12 @@ void MeshComponent::Draw(class Shader* shader)
     // set the mesh's vertex array as active
     VertexArray* va = m_Mesh->GetVertexArray();
     va->SetActive();
-    // draw
-    glDrawElements(GL_TRIANGLES, va->GetNumIndices(), GL_UNSIGNED_INT, nullptr);
+    // quantized vertices carry octahedral normals the shader has to unpack
+    shader->SetIntUniform("uOctNormals", va->GetLayout() == VertexArray::PosNormTexQuantized);
+    // draw the selected LOD's range of the index buffer
+    const MeshLod& lod = m_Mesh->GetLod(m_Lod);
+    glDrawElements(GL_TRIANGLES, lod.m_NumIndices, va->GetIndexType()
+      , reinterpret_cast<const void*>(static_cast<size_t>(lod.m_IndexOffset) * va->GetIndexSize()));
   }
 }
 
@@ -49,6 +56,7 @@ void MeshComponent::Draw(class Shader* shader)
 void MeshComponent::SetMesh(class Mesh* mesh)
 {
   m_Mesh = mesh;
+  m_Lod = 0;
 }
 
 void MeshComponent::SetTextureIndex(size_t index)
@@ -56,6 +64,32 @@ void MeshComponent::SetTextureIndex(size_t index)
   m_TextureIndex = index;
 }
 
+void MeshComponent::SelectLod(const Vector3& cameraPos, float projScale)
+{
+  if (!m_Mesh || m_Mesh->GetNumLods() < 2)
+  {
+    return;
+  }
+
+  // projected diameter as a fraction of the screen height
+  float radius = m_Mesh->GetRadius() * m_Owner->GetScale();
+  float dist = (m_Owner->GetPosition() - cameraPos).Length();
+  float size = dist > radius ? radius * projScale / dist : Math::Infinity;
+
+  // a coarser LOD once well under its switch point, back to finer ones
+  // only once well over the current one's
+  size_t numLods = m_Mesh->GetNumLods();
+  while (m_Lod + 1 < numLods
+    && size < m_Mesh->GetLod(m_Lod + 1).m_ScreenSize * (1.0f - MESH_LOD_HYSTERESIS))
+  {
+    ++m_Lod;
+  }
+  while (m_Lod > 0 && size > m_Mesh->GetLod(m_Lod).m_ScreenSize * (1.0f + MESH_LOD_HYSTERESIS))
+  {
+    --m_Lod;
+  }
+}
+
 const std::string& MeshComponent::GetShaderName() const
 {
   return m_Mesh->GetShaderName();
@@ -1,6 +1,7 @@
 #pragma once
 
 #include "Component.h"
+#include "Math.h"
 #include <cstddef>
 #include <string>
 
@@ -16,16 +17,30 @@ public:
   // set the mesh/ texture index used by the mesh comp
   virtual void SetMesh(class Mesh* mesh);
   void SetTextureIndex(size_t index);
+  class Mesh* GetMesh() const { return m_Mesh; }
+  size_t GetTextureIndex() const { return m_TextureIndex; }
   const std::string& GetShaderName() const;
 
+  // picks the LOD to draw from how big the mesh's bounding sphere is on
+  // screen. projScale is the projection's y scale (1 / tan(fovY / 2))
+  void SelectLod(const Vector3& cameraPos, float projScale);
+  size_t GetLod() const { return m_Lod; }
+
   void SetVisible(bool visible) { m_Visible = visible; }
 	bool GetVisible() const { return m_Visible; }
 
   bool IsSkeletal() const;
+
+  // slot in the renderer's mesh list, or in its static section's once
+  // batched. Kept by Renderer
+  size_t GetMeshIndex() const { return m_MeshIndex; }
+  void SetMeshIndex(size_t index) { m_MeshIndex = index; }
 protected:
   class Mesh* m_Mesh;
   size_t m_TextureIndex;
+  size_t m_Lod;
 private:
   bool m_IsSkeletal;
   bool m_Visible;
+  size_t m_MeshIndex;
 };
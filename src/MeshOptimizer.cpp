@@ -0,0 +1,665 @@
+#include "MeshOptimizer.h"
+#include "Math.h"
+#include "Constants.h"
+#include "Mesh.h"
+#include "include/rapidjson/document.h"
+#include "include/rapidjson/stringbuffer.h"
+#include "include/rapidjson/writer.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <fstream>
+#include <sstream>
+#include <SDL2/SDL_log.h>
+
+namespace
+{
+  // Forsyth's vertex scoring, with the constants from the article. It
+  // models an LRU cache bigger than the hardware's so it looks ahead a bit
+  const int FORSYTH_CACHE_SIZE = 32;
+  const float CACHE_DECAY_POWER = 1.5f;
+  const float LAST_TRI_SCORE = 0.75f;
+  const float VALENCE_BOOST_SCALE = 2.0f;
+  const float VALENCE_BOOST_POWER = 0.5f;
+
+  // bytes per PosNormTexQuantized vertex
+  const size_t QUANTIZED_VERTEX_SIZE = 20;
+
+  float VertexScore(int cachePosition, unsigned int remaining)
+  {
+    // no triangles left to draw, never worth picking
+    if (remaining == 0)
+    {
+      return -1.0f;
+    }
+    float score = 0.0f;
+    if (cachePosition >= 0)
+    {
+      // the last triangle's vertices get a fixed score so the next one
+      // doesn't just reuse the same edge every time
+      if (cachePosition < 3)
+      {
+        score = LAST_TRI_SCORE;
+      }
+      else
+      {
+        float scale = 1.0f / (FORSYTH_CACHE_SIZE - 3);
+        score = powf(1.0f - (cachePosition - 3) * scale, CACHE_DECAY_POWER);
+      }
+    }
+    // vertices with few triangles left get finished off first
+    score += VALENCE_BOOST_SCALE * powf(static_cast<float>(remaining), -VALENCE_BOOST_POWER);
+    return score;
+  }
+
+  // FIFO cache simulation. A vertex is cached while fewer than
+  // MESH_VERTEX_CACHE_SIZE misses happened since it was loaded
+  struct FifoCache
+  {
+    std::vector<unsigned int> m_Loaded;
+    unsigned int m_Time;
+
+    FifoCache(size_t numVertices)
+      : m_Loaded(numVertices, 0)
+      , m_Time(MESH_VERTEX_CACHE_SIZE + 1)
+    {}
+
+    // misses for one triangle
+    int Triangle(const unsigned int* tri)
+    {
+      int misses = 0;
+      for (int k = 0; k < 3; ++k)
+      {
+        if (m_Time - m_Loaded[tri[k]] > static_cast<unsigned>(MESH_VERTEX_CACHE_SIZE))
+        {
+          m_Loaded[tri[k]] = m_Time++;
+          ++misses;
+        }
+      }
+      return misses;
+    }
+
+    void Flush()
+    {
+      m_Time += MESH_VERTEX_CACHE_SIZE + 1;
+    }
+  };
+
+  Vector3 GetPosition(const std::vector<float>& vertices, size_t stride, unsigned int index)
+  {
+    const float* v = &vertices[index * stride];
+    return Vector3(v[0], v[1], v[2]);
+  }
+
+  uint16_t FloatToHalf(float value)
+  {
+    uint32_t bits;
+    memcpy(&bits, &value, sizeof(bits));
+    uint16_t sign = static_cast<uint16_t>((bits >> 16) & 0x8000);
+    int exponent = static_cast<int>((bits >> 23) & 0xff) - 127 + 15;
+    uint32_t mantissa = bits & 0x7fffff;
+
+    if (((bits >> 23) & 0xff) == 0xff)
+    {
+      // inf / nan
+      return sign | 0x7c00 | (mantissa ? 0x200 : 0);
+    }
+    if (exponent >= 31)
+    {
+      return sign | 0x7c00;
+    }
+    if (exponent <= 0)
+    {
+      // denormal half, or too small for one
+      if (exponent < -10)
+      {
+        return sign;
+      }
+      mantissa |= 0x800000;
+      int shift = 14 - exponent;
+      uint32_t half = mantissa >> shift;
+      if ((mantissa >> (shift - 1)) & 1)
+      {
+        ++half;
+      }
+      return sign | static_cast<uint16_t>(half);
+    }
+    // rounding may carry into the exponent, which is still right
+    uint32_t half = (static_cast<uint32_t>(exponent) << 10) | (mantissa >> 13);
+    if (mantissa & 0x1000)
+    {
+      ++half;
+    }
+    return sign | static_cast<uint16_t>(half);
+  }
+
+  int16_t ToSnorm16(float value)
+  {
+    value = Math::Clamp(value, -1.0f, 1.0f);
+    return static_cast<int16_t>(roundf(value * 32767.0f));
+  }
+
+  // unit normal to a point on the octahedron |x| + |y| + |z| = 1, the
+  // lower half folded out over the corners of the xy square
+  void OctEncode(const Vector3& n, float& outX, float& outY)
+  {
+    float l1 = Math::Abs(n.x) + Math::Abs(n.y) + Math::Abs(n.z);
+    if (l1 <= 0.0f)
+    {
+      outX = outY = 0.0f;
+      return;
+    }
+    outX = n.x / l1;
+    outY = n.y / l1;
+    if (n.z < 0.0f)
+    {
+      float x = (1.0f - Math::Abs(outY)) * (outX >= 0.0f ? 1.0f : -1.0f);
+      float y = (1.0f - Math::Abs(outX)) * (outY >= 0.0f ? 1.0f : -1.0f);
+      outX = x;
+      outY = y;
+    }
+  }
+
+  std::string ToJson(const rapidjson::Value& value)
+  {
+    rapidjson::StringBuffer buffer;
+    rapidjson::Writer<rapidjson::StringBuffer> writer(buffer);
+    value.Accept(writer);
+    return buffer.GetString();
+  }
+
+  bool ReadIndices(const rapidjson::Value& indJson, size_t numVertices, std::vector<unsigned int>& out)
+  {
+    if (!indJson.IsArray())
+    {
+      return false;
+    }
+    for (rapidjson::SizeType i = 0; i < indJson.Size(); i++)
+    {
+      const rapidjson::Value& ind = indJson[i];
+      if (!ind.IsArray() || ind.Size() != 3)
+      {
+        return false;
+      }
+      for (rapidjson::SizeType j = 0; j < 3; j++)
+      {
+        if (!ind[j].IsUint() || ind[j].GetUint() >= numVertices)
+        {
+          return false;
+        }
+        out.emplace_back(ind[j].GetUint());
+      }
+    }
+    return true;
+  }
+
+  void WriteIndices(std::ostream& out, const std::vector<unsigned int>& indices, const char* indent)
+  {
+    for (size_t i = 0; i < indices.size(); i += 3)
+    {
+      out << indent << "[" << indices[i] << "," << indices[i + 1] << "," << indices[i + 2] << "]"
+        << (i + 3 < indices.size() ? ",\n" : "\n");
+    }
+  }
+}
+
+float MeshOptimizer::ComputeAcmr(const std::vector<unsigned int>& indices, size_t numVertices)
+{
+  size_t numTris = indices.size() / 3;
+  if (numTris == 0)
+  {
+    return 0.0f;
+  }
+  FifoCache cache(numVertices);
+  size_t misses = 0;
+  for (size_t t = 0; t < numTris; ++t)
+  {
+    misses += cache.Triangle(&indices[t * 3]);
+  }
+  return static_cast<float>(misses) / numTris;
+}
+
+void MeshOptimizer::OptimizeVertexCache(std::vector<unsigned int>& indices, size_t numVertices)
+{
+  size_t numTris = indices.size() / 3;
+  if (numTris == 0)
+  {
+    return;
+  }
+
+  // triangles using each vertex, the live ones kept at the front of each
+  // vertex's range
+  std::vector<unsigned int> remaining(numVertices, 0);
+  for (unsigned int index : indices)
+  {
+    ++remaining[index];
+  }
+  std::vector<unsigned int> offsets(numVertices + 1, 0);
+  for (size_t v = 0; v < numVertices; ++v)
+  {
+    offsets[v + 1] = offsets[v] + remaining[v];
+  }
+  std::vector<unsigned int> adjacency(indices.size());
+  std::vector<unsigned int> fill(offsets.begin(), offsets.end() - 1);
+  for (size_t i = 0; i < indices.size(); ++i)
+  {
+    adjacency[fill[indices[i]]++] = static_cast<unsigned>(i / 3);
+  }
+
+  std::vector<float> vertexScore(numVertices);
+  for (size_t v = 0; v < numVertices; ++v)
+  {
+    vertexScore[v] = VertexScore(-1, remaining[v]);
+  }
+  std::vector<float> triScore(numTris);
+  std::vector<bool> emitted(numTris, false);
+  int best = 0;
+  for (size_t t = 0; t < numTris; ++t)
+  {
+    triScore[t] = vertexScore[indices[t * 3]] + vertexScore[indices[t * 3 + 1]] + vertexScore[indices[t * 3 + 2]];
+    if (triScore[t] > triScore[best])
+    {
+      best = static_cast<int>(t);
+    }
+  }
+
+  std::vector<unsigned int> cache;
+  std::vector<unsigned int> newCache;
+  std::vector<unsigned int> out;
+  out.reserve(indices.size());
+  size_t cursor = 0;
+  while (out.size() < indices.size())
+  {
+    if (best < 0)
+    {
+      // nothing in the cache has triangles left, start on the next one
+      while (emitted[cursor])
+      {
+        ++cursor;
+      }
+      best = static_cast<int>(cursor);
+    }
+
+    const unsigned int* tri = &indices[best * 3];
+    emitted[best] = true;
+    out.insert(out.end(), tri, tri + 3);
+
+    for (int k = 0; k < 3; ++k)
+    {
+      unsigned int v = tri[k];
+      unsigned int* begin = &adjacency[offsets[v]];
+      unsigned int* end = begin + remaining[v];
+      unsigned int* found = std::find(begin, end, static_cast<unsigned>(best));
+      if (found != end)
+      {
+        *found = *(end - 1);
+        --remaining[v];
+      }
+    }
+
+    // the triangle's vertices go to the front, the rest move down
+    newCache.assign(tri, tri + 3);
+    for (unsigned int v : cache)
+    {
+      if (v != tri[0] && v != tri[1] && v != tri[2])
+      {
+        newCache.emplace_back(v);
+      }
+    }
+    for (size_t i = FORSYTH_CACHE_SIZE; i < newCache.size(); ++i)
+    {
+      vertexScore[newCache[i]] = VertexScore(-1, remaining[newCache[i]]);
+    }
+    for (size_t i = 0; i < newCache.size() && i < static_cast<size_t>(FORSYTH_CACHE_SIZE); ++i)
+    {
+      vertexScore[newCache[i]] = VertexScore(static_cast<int>(i), remaining[newCache[i]]);
+    }
+
+    // only triangles touching the cache changed score, the best of them
+    // goes next
+    best = -1;
+    float bestScore = -1.0f;
+    for (unsigned int v : newCache)
+    {
+      for (unsigned int a = offsets[v]; a < offsets[v] + remaining[v]; ++a)
+      {
+        unsigned int t = adjacency[a];
+        triScore[t] = vertexScore[indices[t * 3]] + vertexScore[indices[t * 3 + 1]] + vertexScore[indices[t * 3 + 2]];
+        if (triScore[t] > bestScore)
+        {
+          bestScore = triScore[t];
+          best = static_cast<int>(t);
+        }
+      }
+    }
+
+    newCache.resize(std::min(newCache.size(), static_cast<size_t>(FORSYTH_CACHE_SIZE)));
+    cache.swap(newCache);
+  }
+
+  // exported meshes are often already close to optimal, don't make them worse
+  if (ComputeAcmr(out, numVertices) < ComputeAcmr(indices, numVertices))
+  {
+    indices.swap(out);
+  }
+}
+
+void MeshOptimizer::OptimizeOverdraw(std::vector<unsigned int>& indices
+  , const std::vector<float>& vertices, size_t stride)
+{
+  size_t numTris = indices.size() / 3;
+  size_t numVertices = vertices.size() / stride;
+  if (numTris == 0)
+  {
+    return;
+  }
+
+  // hard boundaries: triangles where the cache order starts a new strip
+  // (all three vertices miss), splitting there costs nothing
+  std::vector<size_t> hard;
+  {
+    FifoCache cache(numVertices);
+    for (size_t t = 0; t < numTris; ++t)
+    {
+      if (cache.Triangle(&indices[t * 3]) == 3)
+      {
+        hard.emplace_back(t);
+      }
+    }
+    hard.emplace_back(numTris);
+  }
+
+  // soft boundaries: a cluster is cut once its own ACMR, starting from an
+  // empty cache, is within the threshold of the hard cluster's
+  std::vector<size_t> clusters;
+  for (size_t h = 0; h + 1 < hard.size(); ++h)
+  {
+    size_t begin = hard[h];
+    size_t end = hard[h + 1];
+    FifoCache cache(numVertices);
+    size_t misses = 0;
+    for (size_t t = begin; t < end; ++t)
+    {
+      misses += cache.Triangle(&indices[t * 3]);
+    }
+    float target = static_cast<float>(misses) / (end - begin) * MESH_OVERDRAW_THRESHOLD;
+
+    cache.Flush();
+    clusters.emplace_back(begin);
+    size_t start = begin;
+    misses = 0;
+    for (size_t t = begin; t < end; ++t)
+    {
+      misses += cache.Triangle(&indices[t * 3]);
+      if (t + 1 < end && static_cast<float>(misses) / (t + 1 - start) <= target)
+      {
+        clusters.emplace_back(t + 1);
+        start = t + 1;
+        misses = 0;
+        cache.Flush();
+      }
+    }
+    // the leftover never got down to the target, it stays with the
+    // cluster before it rather than starting from a cold cache
+    if (start != begin && static_cast<float>(misses) / (end - start) > target)
+    {
+      clusters.pop_back();
+    }
+  }
+  clusters.emplace_back(numTris);
+
+  // area weighted centroid of the whole mesh and of each cluster, plus the
+  // cluster's summed (area weighted) normal
+  std::vector<Vector3> centroids(clusters.size() - 1, Vector3::Zero);
+  std::vector<Vector3> normals(clusters.size() - 1, Vector3::Zero);
+  std::vector<float> areas(clusters.size() - 1, 0.0f);
+  Vector3 meshCentroid = Vector3::Zero;
+  float meshArea = 0.0f;
+  for (size_t c = 0; c + 1 < clusters.size(); ++c)
+  {
+    for (size_t t = clusters[c]; t < clusters[c + 1]; ++t)
+    {
+      Vector3 a = GetPosition(vertices, stride, indices[t * 3]);
+      Vector3 b = GetPosition(vertices, stride, indices[t * 3 + 1]);
+      Vector3 d = GetPosition(vertices, stride, indices[t * 3 + 2]);
+      Vector3 normal = Vector3::Cross(b - a, d - a);
+      float area = normal.Length();
+      Vector3 center = (a + b + d) * (1.0f / 3.0f);
+      centroids[c] += center * area;
+      normals[c] += normal;
+      areas[c] += area;
+    }
+    meshCentroid += centroids[c];
+    meshArea += areas[c];
+    if (areas[c] > 0.0f)
+    {
+      centroids[c] *= 1.0f / areas[c];
+    }
+  }
+  if (meshArea > 0.0f)
+  {
+    meshCentroid *= 1.0f / meshArea;
+  }
+
+  // clusters out on the surface, facing away from the center, tend to
+  // hide the rest, so they're drawn first
+  std::vector<float> keys(centroids.size(), 0.0f);
+  std::vector<size_t> order(centroids.size());
+  for (size_t c = 0; c < centroids.size(); ++c)
+  {
+    order[c] = c;
+    if (normals[c].LengthSq() > 0.0f)
+    {
+      keys[c] = Vector3::Dot(centroids[c] - meshCentroid, Vector3::Normalize(normals[c]));
+    }
+  }
+  std::stable_sort(order.begin(), order.end(), [&keys](size_t a, size_t b)
+  {
+    return keys[a] > keys[b];
+  });
+
+  std::vector<unsigned int> out;
+  out.reserve(indices.size());
+  for (size_t c : order)
+  {
+    out.insert(out.end(), indices.begin() + clusters[c] * 3, indices.begin() + clusters[c + 1] * 3);
+  }
+  indices.swap(out);
+}
+
+void MeshOptimizer::OptimizeVertexFetch(std::vector<std::vector<unsigned int>*>& indexLists
+  , size_t numVertices, std::vector<unsigned int>& remap)
+{
+  const unsigned int unused = ~0u;
+  remap.assign(numVertices, unused);
+  unsigned int next = 0;
+  for (std::vector<unsigned int>* list : indexLists)
+  {
+    for (unsigned int& index : *list)
+    {
+      if (remap[index] == unused)
+      {
+        remap[index] = next++;
+      }
+      index = remap[index];
+    }
+  }
+  for (unsigned int& index : remap)
+  {
+    if (index == unused)
+    {
+      index = next++;
+    }
+  }
+}
+
+void MeshOptimizer::Quantize(const std::vector<float>& vertices, std::vector<uint8_t>& out)
+{
+  size_t numVertices = vertices.size() / MESH_VERTEX_SIZE;
+  out.resize(numVertices * QUANTIZED_VERTEX_SIZE);
+  for (size_t i = 0; i < numVertices; ++i)
+  {
+    const float* v = &vertices[i * MESH_VERTEX_SIZE];
+    uint8_t* dest = &out[i * QUANTIZED_VERTEX_SIZE];
+
+    memcpy(dest, v, 3 * sizeof(float));
+
+    float octX, octY;
+    OctEncode(Vector3(v[3], v[4], v[5]), octX, octY);
+    int16_t normal[2] = { ToSnorm16(octX), ToSnorm16(octY) };
+    memcpy(dest + 12, normal, sizeof(normal));
+
+    uint16_t uv[2] = { FloatToHalf(v[6]), FloatToHalf(v[7]) };
+    memcpy(dest + 16, uv, sizeof(uv));
+  }
+}
+
+bool MeshOptimizer::Optimize(const std::string& inFile, const std::string& outFile, bool quantize)
+{
+  std::ifstream file(inFile);
+  if (!file.is_open())
+  {
+    SDL_Log("File not found: Mesh %s", inFile.c_str());
+    return false;
+  }
+  std::stringstream fileStream;
+  fileStream << file.rdbuf();
+  std::string contents = fileStream.str();
+  file.close();
+
+  rapidjson::Document doc;
+  doc.Parse(contents.c_str());
+  if (!doc.IsObject() || !doc.HasMember("vertices") || !doc["vertices"].IsArray()
+    || !doc.HasMember("indices") || !doc.HasMember("vertexformat"))
+  {
+    SDL_Log("Mesh %s is not valid json", inFile.c_str());
+    return false;
+  }
+  if (quantize && std::string(doc["vertexformat"].GetString()) != "PosNormTex")
+  {
+    SDL_Log("Mesh %s: only PosNormTex meshes can be quantized", inFile.c_str());
+    return false;
+  }
+
+  // only positions matter here, they lead every vertex format
+  const rapidjson::Value& vertsJson = doc["vertices"];
+  size_t numVertices = vertsJson.Size();
+  std::vector<float> positions;
+  positions.reserve(numVertices * 3);
+  for (rapidjson::SizeType i = 0; i < vertsJson.Size(); i++)
+  {
+    const rapidjson::Value& vert = vertsJson[i];
+    if (!vert.IsArray() || vert.Size() < 3)
+    {
+      SDL_Log("Unexpected vertex format for %s", inFile.c_str());
+      return false;
+    }
+    for (rapidjson::SizeType j = 0; j < 3; j++)
+    {
+      positions.emplace_back(static_cast<float>(vert[j].GetDouble()));
+    }
+  }
+
+  // the full mesh first, then each lod
+  std::vector<std::vector<unsigned int>> lists(1);
+  if (!ReadIndices(doc["indices"], numVertices, lists[0]))
+  {
+    SDL_Log("Invalid indices for %s", inFile.c_str());
+    return false;
+  }
+  auto lodsIter = doc.FindMember("lods");
+  if (lodsIter != doc.MemberEnd())
+  {
+    const rapidjson::Value& lods = lodsIter->value;
+    for (rapidjson::SizeType i = 0; lods.IsArray() && i < lods.Size(); i++)
+    {
+      lists.emplace_back();
+      if (!lods[i].IsObject() || !lods[i].HasMember("indices") || !lods[i].HasMember("screenSize")
+        || !ReadIndices(lods[i]["indices"], numVertices, lists.back()))
+      {
+        SDL_Log("Mesh %s: lod %d is invalid", inFile.c_str(), i + 1);
+        return false;
+      }
+    }
+  }
+
+  std::vector<std::vector<unsigned int>*> listPtrs;
+  for (size_t l = 0; l < lists.size(); ++l)
+  {
+    float before = ComputeAcmr(lists[l], numVertices);
+    OptimizeVertexCache(lists[l], numVertices);
+    float cacheOrder = ComputeAcmr(lists[l], numVertices);
+    OptimizeOverdraw(lists[l], positions, 3);
+    float after = ComputeAcmr(lists[l], numVertices);
+    SDL_Log("Mesh %s lod %d: %d triangles, ACMR %f -> %f (cache order %f)", inFile.c_str()
+      , static_cast<int>(l), static_cast<int>(lists[l].size() / 3), before, after, cacheOrder);
+    listPtrs.emplace_back(&lists[l]);
+  }
+
+  std::vector<unsigned int> remap;
+  OptimizeVertexFetch(listPtrs, numVertices, remap);
+  std::vector<unsigned int> order(numVertices);
+  for (size_t v = 0; v < numVertices; ++v)
+  {
+    order[remap[v]] = static_cast<unsigned>(v);
+  }
+
+  // written back in the layout the exporter uses, one vertex / triangle
+  // per line, every other member as it was
+  std::ofstream out(outFile);
+  if (!out.is_open())
+  {
+    SDL_Log("Can't write mesh %s", outFile.c_str());
+    return false;
+  }
+  out << "{";
+  bool first = true;
+  for (auto member = doc.MemberBegin(); member != doc.MemberEnd(); ++member)
+  {
+    std::string name = member->name.GetString();
+    if (name == "quantize")
+    {
+      continue;
+    }
+    out << (first ? "\n" : ",\n") << "\t\"" << name << "\":";
+    first = false;
+    if (name == "vertices")
+    {
+      out << "[\n";
+      for (size_t v = 0; v < numVertices; ++v)
+      {
+        out << "\t\t" << ToJson(vertsJson[order[v]]) << (v + 1 < numVertices ? ",\n" : "\n");
+      }
+      out << "\t]";
+    }
+    else if (name == "indices")
+    {
+      out << "[\n";
+      WriteIndices(out, lists[0], "\t\t");
+      out << "\t]";
+    }
+    else if (name == "lods")
+    {
+      const rapidjson::Value& lods = member->value;
+      out << "[\n";
+      for (rapidjson::SizeType i = 0; i < lods.Size(); i++)
+      {
+        out << "\t\t{\n\t\t\t\"screenSize\":" << ToJson(lods[i]["screenSize"]) << ",\n\t\t\t\"indices\":[\n";
+        WriteIndices(out, lists[i + 1], "\t\t\t\t");
+        out << "\t\t\t]\n\t\t}" << (i + 1 < lods.Size() ? ",\n" : "\n");
+      }
+      out << "\t]";
+    }
+    else
+    {
+      out << ToJson(member->value);
+    }
+  }
+  if (quantize)
+  {
+    out << ",\n\t\"quantize\":true";
+  }
+  out << "\n}\n";
+  return static_cast<bool>(out);
+}
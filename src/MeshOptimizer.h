@@ -0,0 +1,45 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+// offline triangle / vertex reordering for .gpmesh files, so meshes are
+// cheap for the GPU's post-transform vertex cache and draw front to back
+// within themselves, plus the packing for quantized (PosNormTexQuantized)
+// vertex arrays
+class MeshOptimizer
+{
+public:
+  // average cache miss ratio, vertices shaded per triangle with a FIFO
+  // cache of MESH_VERTEX_CACHE_SIZE entries. 0.5 is about the best a
+  // regular grid can do, 3 means no vertex is ever reused
+  static float ComputeAcmr(const std::vector<unsigned int>& indices, size_t numVertices);
+
+  // reorders triangles for the vertex cache (Forsyth, "Linear-speed vertex
+  // cache optimisation")
+  static void OptimizeVertexCache(std::vector<unsigned int>& indices, size_t numVertices);
+
+  // reorders clusters of cache optimized triangles so the ones facing out
+  // from the mesh's center are drawn first (Sander et al., "Fast triangle
+  // reordering for vertex locality and reduced overdraw"). ACMR gets at
+  // most MESH_OVERDRAW_THRESHOLD times worse
+  static void OptimizeOverdraw(std::vector<unsigned int>& indices
+    , const std::vector<float>& vertices, size_t stride);
+
+  // numbers vertices in the order the index lists first use them, so
+  // vertex fetch walks memory forwards. Fills remap (old index -> new),
+  // rewrites the lists; vertices nothing uses go last
+  static void OptimizeVertexFetch(std::vector<std::vector<unsigned int>*>& indexLists
+    , size_t numVertices, std::vector<unsigned int>& remap);
+
+  // PosNormTex floats to PosNormTexQuantized: float position, octahedral
+  // normal in two snorm shorts, half float uv. 20 bytes instead of 32
+  static void Quantize(const std::vector<float>& vertices, std::vector<uint8_t>& out);
+
+  // reads a .gpmesh, optimizes its full index list and every lod and
+  // writes it to outFile, logging ACMR before / after. quantize marks the
+  // mesh to be loaded with quantized vertices (PosNormTex only)
+  static bool Optimize(const std::string& inFile, const std::string& outFile, bool quantize);
+};
@@ -0,0 +1,608 @@
+#include "MeshSimplifier.h"
+#include "Math.h"
+#include "Constants.h"
+#include "Mesh.h"
+#include "include/rapidjson/document.h"
+
+#include <algorithm>
+#include <array>
+#include <cstdio>
+#include <fstream>
+#include <map>
+#include <queue>
+#include <sstream>
+#include <SDL2/SDL_log.h>
+
+namespace
+{
+  // open mesh borders are held in place by planes along them, weighted
+  // this much more than the faces
+  const double BOUNDARY_WEIGHT = 10.0;
+  // a collapse is refused if it turns a triangle further than this
+  // (cosine between old and new normal)
+  const float MIN_NORMAL_DOT = 0.2f;
+
+  // symmetric 4x4 plane quadric: a2 ab ac ad b2 bc bd c2 cd d2
+  struct Quadric
+  {
+    double m_A[10];
+    double m_Weight;
+  };
+
+  void AddPlane(Quadric& q, const Vector3& n, float d, double weight)
+  {
+    double a = n.x, b = n.y, c = n.z, dd = d;
+    q.m_A[0] += weight * a * a;
+    q.m_A[1] += weight * a * b;
+    q.m_A[2] += weight * a * c;
+    q.m_A[3] += weight * a * dd;
+    q.m_A[4] += weight * b * b;
+    q.m_A[5] += weight * b * c;
+    q.m_A[6] += weight * b * dd;
+    q.m_A[7] += weight * c * c;
+    q.m_A[8] += weight * c * dd;
+    q.m_A[9] += weight * dd * dd;
+    q.m_Weight += weight;
+  }
+
+  void AddQuadric(Quadric& q, const Quadric& other)
+  {
+    for (int i = 0; i < 10; ++i)
+    {
+      q.m_A[i] += other.m_A[i];
+    }
+    q.m_Weight += other.m_Weight;
+  }
+
+  // weighted mean squared distance from p to the quadrics' planes
+  double Error(const Quadric& q0, const Quadric& q1, const Vector3& p)
+  {
+    const double* a = q0.m_A;
+    const double* b = q1.m_A;
+    double x = p.x, y = p.y, z = p.z;
+    double e = (a[0] + b[0]) * x * x + 2.0 * (a[1] + b[1]) * x * y + 2.0 * (a[2] + b[2]) * x * z
+      + 2.0 * (a[3] + b[3]) * x + (a[4] + b[4]) * y * y + 2.0 * (a[5] + b[5]) * y * z
+      + 2.0 * (a[6] + b[6]) * y + (a[7] + b[7]) * z * z + 2.0 * (a[8] + b[8]) * z + (a[9] + b[9]);
+    double w = q0.m_Weight + q1.m_Weight;
+    return w > 0.0 ? Math::Max(e, 0.0) / w : 0.0;
+  }
+
+  // closest point on triangle abc to p (Ericson, Real-Time Collision
+  // Detection 5.1.5), returned as the distance
+  float PointTriangleDistance(const Vector3& p, const Vector3& a, const Vector3& b, const Vector3& c)
+  {
+    Vector3 ab = b - a;
+    Vector3 ac = c - a;
+    Vector3 ap = p - a;
+    float d1 = Vector3::Dot(ab, ap);
+    float d2 = Vector3::Dot(ac, ap);
+    if (d1 <= 0.0f && d2 <= 0.0f)
+    {
+      return ap.Length();
+    }
+    Vector3 bp = p - b;
+    float d3 = Vector3::Dot(ab, bp);
+    float d4 = Vector3::Dot(ac, bp);
+    if (d3 >= 0.0f && d4 <= d3)
+    {
+      return bp.Length();
+    }
+    float vc = d1 * d4 - d3 * d2;
+    if (vc <= 0.0f && d1 >= 0.0f && d3 <= 0.0f)
+    {
+      return (p - (a + ab * (d1 / (d1 - d3)))).Length();
+    }
+    Vector3 cp = p - c;
+    float d5 = Vector3::Dot(ab, cp);
+    float d6 = Vector3::Dot(ac, cp);
+    if (d6 >= 0.0f && d5 <= d6)
+    {
+      return cp.Length();
+    }
+    float vb = d5 * d2 - d1 * d6;
+    if (vb <= 0.0f && d2 >= 0.0f && d6 <= 0.0f)
+    {
+      return (p - (a + ac * (d2 / (d2 - d6)))).Length();
+    }
+    float va = d3 * d6 - d5 * d4;
+    if (va <= 0.0f && d4 - d3 >= 0.0f && d5 - d6 >= 0.0f)
+    {
+      return (p - (b + (c - b) * ((d4 - d3) / ((d4 - d3) + (d5 - d6))))).Length();
+    }
+    float denom = 1.0f / (va + vb + vc);
+    return (p - (a + ab * (vb * denom) + ac * (vc * denom))).Length();
+  }
+
+  // how far the furthest original vertex is from the simplified surface.
+  // Brute force, fine for an offline tool
+  float MaxDeviation(const std::vector<float>& vertices, size_t stride, const std::vector<unsigned int>& indices)
+  {
+    auto position = [&](unsigned int i) {
+      return Vector3(vertices[i * stride], vertices[i * stride + 1], vertices[i * stride + 2]);
+    };
+    float maxDist = 0.0f;
+    for (size_t v = 0; v < vertices.size() / stride; ++v)
+    {
+      Vector3 p = position(static_cast<unsigned int>(v));
+      float best = Math::Infinity;
+      for (size_t i = 0; i < indices.size() && best > maxDist; i += 3)
+      {
+        best = Math::Min(best, PointTriangleDistance(p
+          , position(indices[i]), position(indices[i + 1]), position(indices[i + 2])));
+      }
+      maxDist = Math::Max(maxDist, best);
+    }
+    return maxDist;
+  }
+
+  struct Collapse
+  {
+    double m_Cost;
+    unsigned int m_From;
+    unsigned int m_To;
+    unsigned int m_FromVersion;
+    unsigned int m_ToVersion;
+
+    bool operator>(const Collapse& other) const { return m_Cost > other.m_Cost; }
+  };
+
+  class Simplifier
+  {
+  public:
+    Simplifier(const std::vector<float>& vertices, size_t stride, const std::vector<unsigned int>& indices);
+    double Run(size_t targetIndexCount);
+    void GetIndices(std::vector<unsigned int>& outIndices) const;
+
+  private:
+    bool Contains(unsigned int tri, unsigned int welded) const;
+    void PushEdges(unsigned int v);
+    void PushCollapse(unsigned int from, unsigned int to);
+    bool CanCollapse(unsigned int from, unsigned int to) const;
+    void DoCollapse(unsigned int from, unsigned int to);
+    unsigned int PickOriginal(unsigned int from, unsigned int to
+      , const std::vector<std::pair<unsigned int, unsigned int>>& pairs) const;
+
+    const std::vector<float>& m_Vertices;
+    size_t m_Stride;
+
+    // per original vertex, its welded (unique position) vertex
+    std::vector<unsigned int> m_Remap;
+    // per welded vertex
+    std::vector<Vector3> m_Positions;
+    std::vector<std::vector<unsigned int>> m_Originals;
+    std::vector<std::vector<unsigned int>> m_VertTris;
+    std::vector<Quadric> m_Quadrics;
+    std::vector<unsigned int> m_Versions;
+    std::vector<bool> m_VertAlive;
+
+    // triangles over original vertices
+    std::vector<std::array<unsigned int, 3>> m_Tris;
+    std::vector<bool> m_TriAlive;
+    size_t m_NumAliveTris;
+
+    std::priority_queue<Collapse, std::vector<Collapse>, std::greater<Collapse>> m_Heap;
+  };
+
+  Simplifier::Simplifier(const std::vector<float>& vertices, size_t stride, const std::vector<unsigned int>& indices)
+    : m_Vertices(vertices)
+    , m_Stride(stride)
+    , m_NumAliveTris(0)
+  {
+    size_t numVerts = vertices.size() / stride;
+    m_Remap.resize(numVerts);
+    std::map<std::array<float, 3>, unsigned int> welded;
+    for (size_t i = 0; i < numVerts; ++i)
+    {
+      std::array<float, 3> key = { vertices[i * stride], vertices[i * stride + 1], vertices[i * stride + 2] };
+      auto it = welded.emplace(key, static_cast<unsigned int>(m_Positions.size()));
+      if (it.second)
+      {
+        m_Positions.emplace_back(Vector3(key[0], key[1], key[2]));
+        m_Originals.emplace_back();
+      }
+      m_Remap[i] = it.first->second;
+      m_Originals[it.first->second].emplace_back(static_cast<unsigned int>(i));
+    }
+
+    size_t numWelded = m_Positions.size();
+    m_VertTris.resize(numWelded);
+    m_Quadrics.assign(numWelded, Quadric{ { 0.0 }, 0.0 });
+    m_Versions.assign(numWelded, 0);
+    m_VertAlive.assign(numWelded, true);
+
+    // welded edge -> how many triangles use it, and the last one that did
+    std::map<std::pair<unsigned int, unsigned int>, std::pair<int, unsigned int>> edges;
+    size_t numTris = indices.size() / 3;
+    m_Tris.resize(numTris);
+    m_TriAlive.assign(numTris, false);
+    for (size_t t = 0; t < numTris; ++t)
+    {
+      m_Tris[t] = { indices[t * 3], indices[t * 3 + 1], indices[t * 3 + 2] };
+      unsigned int w[3] = { m_Remap[m_Tris[t][0]], m_Remap[m_Tris[t][1]], m_Remap[m_Tris[t][2]] };
+      if (w[0] == w[1] || w[1] == w[2] || w[0] == w[2])
+      {
+        continue;
+      }
+      m_TriAlive[t] = true;
+      ++m_NumAliveTris;
+
+      Vector3 n = Vector3::Cross(m_Positions[w[1]] - m_Positions[w[0]], m_Positions[w[2]] - m_Positions[w[0]]);
+      float area = n.Length() * 0.5f;
+      for (int k = 0; k < 3; ++k)
+      {
+        m_VertTris[w[k]].emplace_back(static_cast<unsigned int>(t));
+        unsigned int a = w[k], b = w[(k + 1) % 3];
+        auto& edge = edges[std::make_pair(Math::Min(a, b), Math::Max(a, b))];
+        edge.first++;
+        edge.second = static_cast<unsigned int>(t);
+      }
+      if (area > 0.0f)
+      {
+        n *= 0.5f / area;
+        float d = -Vector3::Dot(n, m_Positions[w[0]]);
+        for (int k = 0; k < 3; ++k)
+        {
+          AddPlane(m_Quadrics[w[k]], n, d, area);
+        }
+      }
+    }
+
+    for (const auto& edge : edges)
+    {
+      unsigned int a = edge.first.first, b = edge.first.second;
+      if (edge.second.first == 1)
+      {
+        const std::array<unsigned int, 3>& tri = m_Tris[edge.second.second];
+        Vector3 faceNormal = Vector3::Cross(m_Positions[m_Remap[tri[1]]] - m_Positions[m_Remap[tri[0]]]
+          , m_Positions[m_Remap[tri[2]]] - m_Positions[m_Remap[tri[0]]]);
+        Vector3 dir = m_Positions[b] - m_Positions[a];
+        Vector3 n = Vector3::Cross(dir, faceNormal);
+        if (n.LengthSq() > 0.0f)
+        {
+          n.Normalize();
+          float d = -Vector3::Dot(n, m_Positions[a]);
+          double weight = BOUNDARY_WEIGHT * dir.LengthSq();
+          AddPlane(m_Quadrics[a], n, d, weight);
+          AddPlane(m_Quadrics[b], n, d, weight);
+        }
+      }
+    }
+    for (const auto& edge : edges)
+    {
+      PushCollapse(edge.first.first, edge.first.second);
+      PushCollapse(edge.first.second, edge.first.first);
+    }
+  }
+
+  double Simplifier::Run(size_t targetIndexCount)
+  {
+    double maxError = 0.0;
+    while (m_NumAliveTris * 3 > targetIndexCount && !m_Heap.empty())
+    {
+      Collapse c = m_Heap.top();
+      m_Heap.pop();
+      if (!m_VertAlive[c.m_From] || !m_VertAlive[c.m_To]
+        || m_Versions[c.m_From] != c.m_FromVersion || m_Versions[c.m_To] != c.m_ToVersion)
+      {
+        continue;
+      }
+      if (!CanCollapse(c.m_From, c.m_To))
+      {
+        continue;
+      }
+      DoCollapse(c.m_From, c.m_To);
+      maxError = Math::Max(maxError, c.m_Cost);
+    }
+    return maxError;
+  }
+
+  void Simplifier::GetIndices(std::vector<unsigned int>& outIndices) const
+  {
+    outIndices.clear();
+    for (size_t t = 0; t < m_Tris.size(); ++t)
+    {
+      if (m_TriAlive[t])
+      {
+        outIndices.insert(outIndices.end(), m_Tris[t].begin(), m_Tris[t].end());
+      }
+    }
+  }
+
+  bool Simplifier::Contains(unsigned int tri, unsigned int welded) const
+  {
+    const std::array<unsigned int, 3>& t = m_Tris[tri];
+    return m_Remap[t[0]] == welded || m_Remap[t[1]] == welded || m_Remap[t[2]] == welded;
+  }
+
+  void Simplifier::PushEdges(unsigned int v)
+  {
+    std::vector<unsigned int> neighbors;
+    for (unsigned int t : m_VertTris[v])
+    {
+      for (unsigned int corner : m_Tris[t])
+      {
+        if (m_Remap[corner] != v)
+        {
+          neighbors.emplace_back(m_Remap[corner]);
+        }
+      }
+    }
+    std::sort(neighbors.begin(), neighbors.end());
+    neighbors.erase(std::unique(neighbors.begin(), neighbors.end()), neighbors.end());
+    for (unsigned int n : neighbors)
+    {
+      PushCollapse(v, n);
+      PushCollapse(n, v);
+    }
+  }
+
+  void Simplifier::PushCollapse(unsigned int from, unsigned int to)
+  {
+    double cost = Error(m_Quadrics[from], m_Quadrics[to], m_Positions[to]);
+    m_Heap.push(Collapse{ cost, from, to, m_Versions[from], m_Versions[to] });
+  }
+
+  bool Simplifier::CanCollapse(unsigned int from, unsigned int to) const
+  {
+    // triangles that stay must not flip or go flat
+    for (unsigned int t : m_VertTris[from])
+    {
+      if (!m_TriAlive[t] || Contains(t, to))
+      {
+        continue;
+      }
+      Vector3 p[3];
+      Vector3 moved[3];
+      for (int k = 0; k < 3; ++k)
+      {
+        unsigned int w = m_Remap[m_Tris[t][k]];
+        p[k] = m_Positions[w];
+        moved[k] = w == from ? m_Positions[to] : p[k];
+      }
+      Vector3 before = Vector3::Cross(p[1] - p[0], p[2] - p[0]);
+      Vector3 after = Vector3::Cross(moved[1] - moved[0], moved[2] - moved[0]);
+      float lengths = Math::Sqrt(before.LengthSq() * after.LengthSq());
+      if (lengths <= 0.0f || Vector3::Dot(before, after) < MIN_NORMAL_DOT * lengths)
+      {
+        return false;
+      }
+    }
+    return true;
+  }
+
+  void Simplifier::DoCollapse(unsigned int from, unsigned int to)
+  {
+    // triangles on the edge go, their corners tell which original vertex
+    // of 'to' each original of 'from' lines up with across seams
+    std::vector<std::pair<unsigned int, unsigned int>> pairs;
+    for (unsigned int t : m_VertTris[from])
+    {
+      if (!m_TriAlive[t] || !Contains(t, to))
+      {
+        continue;
+      }
+      unsigned int a = 0, b = 0;
+      for (unsigned int corner : m_Tris[t])
+      {
+        if (m_Remap[corner] == from)
+        {
+          a = corner;
+        }
+        else if (m_Remap[corner] == to)
+        {
+          b = corner;
+        }
+      }
+      pairs.emplace_back(a, b);
+      m_TriAlive[t] = false;
+      --m_NumAliveTris;
+    }
+
+    for (unsigned int t : m_VertTris[from])
+    {
+      if (!m_TriAlive[t])
+      {
+        continue;
+      }
+      for (unsigned int& corner : m_Tris[t])
+      {
+        if (m_Remap[corner] == from)
+        {
+          corner = PickOriginal(corner, to, pairs);
+        }
+      }
+      m_VertTris[to].emplace_back(t);
+    }
+
+    AddQuadric(m_Quadrics[to], m_Quadrics[from]);
+    m_VertAlive[from] = false;
+    m_VertTris[from].clear();
+    m_Versions[to]++;
+
+    std::vector<unsigned int>& tris = m_VertTris[to];
+    tris.erase(std::remove_if(tris.begin(), tris.end(),
+      [this](unsigned int t) { return !m_TriAlive[t]; }), tris.end());
+    PushEdges(to);
+  }
+
+  unsigned int Simplifier::PickOriginal(unsigned int from, unsigned int to
+    , const std::vector<std::pair<unsigned int, unsigned int>>& pairs) const
+  {
+    for (const auto& pair : pairs)
+    {
+      if (pair.first == from)
+      {
+        return pair.second;
+      }
+    }
+
+    // otherwise the one with the closest normal / uv
+    unsigned int best = m_Originals[to][0];
+    float bestDist = Math::Infinity;
+    for (unsigned int candidate : m_Originals[to])
+    {
+      float dist = 0.0f;
+      for (size_t i = 3; i < m_Stride; ++i)
+      {
+        float diff = m_Vertices[from * m_Stride + i] - m_Vertices[candidate * m_Stride + i];
+        dist += diff * diff;
+      }
+      if (dist < bestDist)
+      {
+        bestDist = dist;
+        best = candidate;
+      }
+    }
+    return best;
+  }
+}
+
+void MeshSimplifier::Simplify(const std::vector<float>& vertices, size_t stride
+  , const std::vector<unsigned int>& indices, size_t targetIndexCount
+  , std::vector<unsigned int>& outIndices, float& outError)
+{
+  outError = 0.0f;
+  if (stride < 3 || targetIndexCount >= indices.size())
+  {
+    outIndices = indices;
+    return;
+  }
+
+  Simplifier simplifier(vertices, stride, indices);
+  outError = static_cast<float>(Math::Sqrt(static_cast<float>(simplifier.Run(targetIndexCount))));
+  simplifier.GetIndices(outIndices);
+}
+
+bool MeshSimplifier::GenerateLods(const std::string& inFile, const std::string& outFile, int numLods)
+{
+  std::ifstream file(inFile);
+  if (!file.is_open())
+  {
+    SDL_Log("File not found: Mesh %s", inFile.c_str());
+    return false;
+  }
+  std::stringstream fileStream;
+  fileStream << file.rdbuf();
+  std::string contents = fileStream.str();
+  file.close();
+
+  rapidjson::Document doc;
+  doc.Parse(contents.c_str());
+  if (!doc.IsObject() || !doc.HasMember("vertices") || !doc.HasMember("indices"))
+  {
+    SDL_Log("Mesh %s is not valid json", inFile.c_str());
+    return false;
+  }
+  if (!doc.HasMember("vertexformat") || std::string(doc["vertexformat"].GetString()) != "PosNormTex")
+  {
+    SDL_Log("Mesh %s: only PosNormTex meshes get lods", inFile.c_str());
+    return false;
+  }
+  if (doc.HasMember("lods"))
+  {
+    SDL_Log("Mesh %s already has lods", inFile.c_str());
+    return false;
+  }
+
+  std::vector<float> vertices;
+  float radius = 0.0f;
+  const rapidjson::Value& vertsJson = doc["vertices"];
+  for (rapidjson::SizeType i = 0; i < vertsJson.Size(); i++)
+  {
+    const rapidjson::Value& vert = vertsJson[i];
+    if (!vert.IsArray() || vert.Size() != MESH_VERTEX_SIZE)
+    {
+      SDL_Log("Unexpected vertex format for %s", inFile.c_str());
+      return false;
+    }
+    for (rapidjson::SizeType j = 0; j < vert.Size(); j++)
+    {
+      vertices.emplace_back(static_cast<float>(vert[j].GetDouble()));
+    }
+    size_t p = vertices.size() - MESH_VERTEX_SIZE;
+    radius = Math::Max(radius, Vector3(vertices[p], vertices[p + 1], vertices[p + 2]).Length());
+  }
+
+  std::vector<unsigned int> indices;
+  const rapidjson::Value& indJson = doc["indices"];
+  for (rapidjson::SizeType i = 0; i < indJson.Size(); i++)
+  {
+    const rapidjson::Value& ind = indJson[i];
+    if (!ind.IsArray() || ind.Size() != 3)
+    {
+      SDL_Log("Invalid indices for %s", inFile.c_str());
+      return false;
+    }
+    for (rapidjson::SizeType j = 0; j < 3; j++)
+    {
+      indices.emplace_back(ind[j].GetUint());
+    }
+  }
+
+  // each level from the full mesh, so its error is against the original
+  std::ostringstream lods;
+  std::vector<unsigned int> prev = indices;
+  float prevScreenSize = Math::Infinity;
+  int written = 0;
+  for (int level = 1; level <= numLods; ++level)
+  {
+    size_t target = (indices.size() / 3 >> level) * 3;
+    std::vector<unsigned int> lod;
+    float error = 0.0f;
+    Simplify(vertices, MESH_VERTEX_SIZE, indices, target, lod, error);
+    // not worth a level if it barely got smaller
+    if (lod.empty() || lod.size() * 10 > prev.size() * 9)
+    {
+      break;
+    }
+    // the quadric error is an average over planes, the screen size goes
+    // by the worst case
+    error = MaxDeviation(vertices, MESH_VERTEX_SIZE, lod);
+
+    // error in pixels = error * screenSize * SCREEN_HEIGHT / (2 * radius)
+    float screenSize = prevScreenSize;
+    if (error > 0.0f)
+    {
+      screenSize = 2.0f * radius * MESH_LOD_PIXEL_ERROR / (error * SCREEN_HEIGHT);
+    }
+    screenSize = Math::Min(screenSize, prevScreenSize);
+    if (screenSize == Math::Infinity)
+    {
+      // lossless, use it for anything
+      screenSize = 1000.0f;
+    }
+    SDL_Log("Mesh %s lod %d: %d -> %d triangles, error %f, screen size %f", inFile.c_str(), level
+      , static_cast<int>(indices.size() / 3), static_cast<int>(lod.size() / 3), error, screenSize);
+
+    char buffer[64];
+    snprintf(buffer, sizeof(buffer), "%f", screenSize);
+    lods << (written > 0 ? ",\n" : "") << "\t\t{\n\t\t\t\"screenSize\":" << buffer << ",\n\t\t\t\"indices\":[\n";
+    for (size_t i = 0; i < lod.size(); i += 3)
+    {
+      lods << "\t\t\t\t[" << lod[i] << "," << lod[i + 1] << "," << lod[i + 2] << "]"
+        << (i + 3 < lod.size() ? ",\n" : "\n");
+    }
+    lods << "\t\t\t]\n\t\t}";
+
+    prev = lod;
+    prevScreenSize = screenSize;
+    ++written;
+  }
+
+  // the rest of the file is kept as it was written, lods go at the end
+  size_t end = contents.find_last_of('}');
+  size_t last = contents.find_last_not_of(" \t\r\n", end - 1);
+  std::ofstream out(outFile);
+  if (!out.is_open())
+  {
+    SDL_Log("Can't write mesh %s", outFile.c_str());
+    return false;
+  }
+  out << contents.substr(0, last + 1);
+  if (written > 0)
+  {
+    out << ",\n\t\"lods\":[\n" << lods.str() << "\n\t]";
+  }
+  out << "\n}\n";
+  return static_cast<bool>(out);
+}
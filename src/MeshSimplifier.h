@@ -0,0 +1,29 @@
+#pragma once
+
+#include <cstddef>
+#include <string>
+#include <vector>
+
+// quadric error metric (Garland / Heckbert) mesh simplification, used
+// offline to add lower detail index lists ("lods") to .gpmesh files.
+// Edges are collapsed onto one of their ends, so every LOD indexes the
+// original vertex buffer and a mesh keeps a single vertex array
+class MeshSimplifier
+{
+public:
+  // reduces indices (triangle list over vertices, stride floats each,
+  // position first) towards targetIndexCount. Vertices sharing a position
+  // (uv / normal seams) are welded while collapsing so seams don't tear.
+  // outError is the quadric error of the worst collapse (root of the mean
+  // squared distance to the merged planes, in object units).
+  // Stops early rather than flip triangles
+  static void Simplify(const std::vector<float>& vertices, size_t stride
+    , const std::vector<unsigned int>& indices, size_t targetIndexCount
+    , std::vector<unsigned int>& outIndices, float& outError);
+
+  // reads a PosNormTex .gpmesh without lods, adds up to numLods levels,
+  // each about half the triangles of the one before, and writes it to
+  // outFile. Each LOD gets the screen size (projected diameter / screen
+  // height) below which its error is under MESH_LOD_PIXEL_ERROR pixels
+  static bool GenerateLods(const std::string& inFile, const std::string& outFile, int numLods);
+};
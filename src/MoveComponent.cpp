@@ -12,6 +12,16 @@ MoveComponent::MoveComponent(class Actor* owner, int updateOrder)
 {}
 
 void MoveComponent::Update(float deltaTime)
+{
+  Vector3 forward;
+  Vector3 other;
+  ComputeMove(deltaTime, forward, other);
+
+  // update position
+  m_Owner->SetPosition(m_Owner->GetPosition() + forward + other);
+}
+
+void MoveComponent::ComputeMove(float deltaTime, Vector3& outForward, Vector3& outOther)
 {
   if(!Math::NearZero(m_AngularSpeed))
   {
@@ -27,21 +37,22 @@ void MoveComponent::Update(float deltaTime)
     m_Owner->SetRotation(rot);
   }
 
-  Vector3 pos = m_Owner->GetPosition();
+  outForward = Vector3::Zero;
+  outOther = Vector3::Zero;
   if (!Math::NearZero(m_ForwardSpeed) ||
       !Math::NearZero(m_StrafeSpeed)  ||
       !Math::NearZero(m_JumpSpeed))
   {
     // update pos based on forward speed
-    pos += m_Owner->GetForward() * m_ForwardSpeed * deltaTime;
+    outForward = m_Owner->GetForward() * m_ForwardSpeed * deltaTime;
 
     // update position based on strafe
-    pos += m_Owner->GetRight() * m_StrafeSpeed * deltaTime;
+    outOther += m_Owner->GetRight() * m_StrafeSpeed * deltaTime;
 
     // update based on up (jump) speed
     if (m_JumpSpeed > 0.0f)
     {
-      pos += m_Owner->GetUp() * m_JumpSpeed * deltaTime;
+      outOther += m_Owner->GetUp() * m_JumpSpeed * deltaTime;
       m_JumpSpeed -= 50;
     }
   }
@@ -49,11 +60,8 @@ void MoveComponent::Update(float deltaTime)
   // add gravity
   if (!m_IsGrounded)
   {
-    pos += Vector3(0.0f, 0.0f, -330.0f) * deltaTime;
+    outOther += Vector3(0.0f, 0.0f, -330.0f) * deltaTime;
   }
-
-  // update position
-  m_Owner->SetPosition(pos);
 }
 
 float MoveComponent::GetAngularSpeed() const { return m_AngularSpeed; }
@@ -1,5 +1,6 @@
 #pragma once
 #include "Component.h"
+#include "Math.h"
 
 class MoveComponent: public Component
 {
@@ -25,4 +26,10 @@ public:
 
   void SetIsGrounded(bool value);
   bool GetIsGrounded() const;
+protected:
+  // turns the owner by the angular speed and works out this frame's move
+  // without applying it: outForward along the owner's forward, outOther
+  // the strafe, jump and gravity. For subclasses that move the owner
+  // some other way (BallMoveComp sweeps the forward part)
+  void ComputeMove(float deltaTime, Vector3& outForward, Vector3& outOther);
 };
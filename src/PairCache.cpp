@@ -0,0 +1,175 @@
+#include "PairCache.h"
+
+#include <algorithm>
+
+namespace
+{
+  const int EmptySlot = -1;
+  // start at 64 slots, table is grown to keep it at most half full
+  const unsigned InitialShift = 64 - 6;
+}
+
+PairCache::PairCache()
+  :m_Table(static_cast<size_t>(1) << (64 - InitialShift), EmptySlot)
+  , m_Shift(InitialShift)
+{}
+
+uint64_t PairCache::MakeKey(int a, int b)
+{
+  uint32_t lo = static_cast<uint32_t>(a < b ? a : b);
+  uint32_t hi = static_cast<uint32_t>(a < b ? b : a);
+  return (static_cast<uint64_t>(lo) << 32) | hi;
+}
+
+size_t PairCache::GetSlot(uint64_t key) const
+{
+  // fibonacci hashing, the top bits are the best mixed
+  return static_cast<size_t>((key * 0x9E3779B97F4A7C15ull) >> m_Shift);
+}
+
+size_t PairCache::FindSlot(uint64_t key) const
+{
+  size_t mask = m_Table.size() - 1;
+  size_t slot = GetSlot(key);
+  while (m_Table[slot] != EmptySlot)
+  {
+    const Pair& pair = m_Pairs[m_Table[slot]];
+    if (MakeKey(pair.m_A, pair.m_B) == key)
+    {
+      break;
+    }
+    slot = (slot + 1) & mask;
+  }
+  return slot;
+}
+
+bool PairCache::Add(int a, int b)
+{
+  uint64_t key = MakeKey(a, b);
+  size_t slot = FindSlot(key);
+  if (m_Table[slot] != EmptySlot)
+  {
+    return false;
+  }
+
+  Pair pair;
+  pair.m_A = a < b ? a : b;
+  pair.m_B = a < b ? b : a;
+  m_Table[slot] = static_cast<int>(m_Pairs.size());
+  m_Pairs.emplace_back(pair);
+
+  if (m_Pairs.size() * 2 > m_Table.size())
+  {
+    Grow();
+  }
+  return true;
+}
+
+bool PairCache::Remove(int a, int b)
+{
+  uint64_t key = MakeKey(a, b);
+  size_t slot = FindSlot(key);
+  int index = m_Table[slot];
+  if (index == EmptySlot)
+  {
+    return false;
+  }
+
+  // backward shift deletion: pull later entries of the probe run into the
+  // hole so lookups never need tombstones
+  size_t mask = m_Table.size() - 1;
+  size_t hole = slot;
+  size_t next = (hole + 1) & mask;
+  while (m_Table[next] != EmptySlot)
+  {
+    const Pair& pair = m_Pairs[m_Table[next]];
+    size_t home = GetSlot(MakeKey(pair.m_A, pair.m_B));
+    // move it back unless its home slot lies cyclically in (hole, next]
+    if (((next - home) & mask) >= ((next - hole) & mask))
+    {
+      m_Table[hole] = m_Table[next];
+      hole = next;
+    }
+    next = (next + 1) & mask;
+  }
+  m_Table[hole] = EmptySlot;
+
+  // swap last pair into the freed spot and repoint its slot
+  int last = static_cast<int>(m_Pairs.size()) - 1;
+  if (index != last)
+  {
+    const Pair& moved = m_Pairs[last];
+    m_Table[FindSlot(MakeKey(moved.m_A, moved.m_B))] = index;
+    m_Pairs[index] = moved;
+  }
+  m_Pairs.pop_back();
+  return true;
+}
+
+bool PairCache::Contains(int a, int b) const
+{
+  return m_Table[FindSlot(MakeKey(a, b))] != EmptySlot;
+}
+
+int PairCache::Find(int a, int b) const
+{
+  return m_Table[FindSlot(MakeKey(a, b))];
+}
+
+void PairCache::RemoveAll(int id)
+{
+  size_t i = 0;
+  while (i < m_Pairs.size())
+  {
+    if (m_Pairs[i].m_A == id || m_Pairs[i].m_B == id)
+    {
+      // last pair is swapped into i, look at i again
+      Remove(m_Pairs[i].m_A, m_Pairs[i].m_B);
+      continue;
+    }
+    ++i;
+  }
+}
+
+void PairCache::RemoveAll(const std::vector<unsigned char>& ids)
+{
+  auto flagged = [&ids](int id) {
+    return static_cast<size_t>(id) < ids.size() && ids[id] != 0;
+  };
+  size_t i = 0;
+  while (i < m_Pairs.size())
+  {
+    if (flagged(m_Pairs[i].m_A) || flagged(m_Pairs[i].m_B))
+    {
+      Remove(m_Pairs[i].m_A, m_Pairs[i].m_B);
+      continue;
+    }
+    ++i;
+  }
+}
+
+void PairCache::Clear()
+{
+  m_Pairs.clear();
+  std::fill(m_Table.begin(), m_Table.end(), EmptySlot);
+}
+
+const std::vector<PairCache::Pair>& PairCache::GetPairs() const
+{
+  return m_Pairs;
+}
+
+size_t PairCache::GetNumPairs() const
+{
+  return m_Pairs.size();
+}
+
+void PairCache::Grow()
+{
+  --m_Shift;
+  m_Table.assign(static_cast<size_t>(1) << (64 - m_Shift), EmptySlot);
+  for (size_t i = 0; i < m_Pairs.size(); ++i)
+  {
+    m_Table[FindSlot(MakeKey(m_Pairs[i].m_A, m_Pairs[i].m_B))] = static_cast<int>(i);
+  }
+}
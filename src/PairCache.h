@@ -0,0 +1,51 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+// set of unordered (id, id) pairs for the broadphases, an open addressed
+// hash table (linear probing) over a dense pair array so pairs can be
+// walked without touching the table. Pairs are stored smaller id first
+class PairCache
+{
+public:
+  struct Pair
+  {
+    int m_A;
+    int m_B;
+  };
+
+  PairCache();
+
+  // returns true if the pair wasn't in the cache yet
+  bool Add(int a, int b);
+  // returns true if the pair was in the cache, the last pair
+  // is moved into the removed pair's place in GetPairs()
+  bool Remove(int a, int b);
+  bool Contains(int a, int b) const;
+  // index of the pair in GetPairs(), -1 if it isn't in the cache
+  int Find(int a, int b) const;
+
+  // removes every pair with id in it
+  void RemoveAll(int id);
+  // removes every pair with an id flagged in ids (indexed by id), one
+  // pass over the pairs however many ids are flagged
+  void RemoveAll(const std::vector<unsigned char>& ids);
+  void Clear();
+
+  const std::vector<Pair>& GetPairs() const;
+  size_t GetNumPairs() const;
+
+private:
+  static uint64_t MakeKey(int a, int b);
+  size_t GetSlot(uint64_t key) const;
+  // slot holding key or the empty slot it would go in
+  size_t FindSlot(uint64_t key) const;
+  void Grow();
+
+  std::vector<Pair> m_Pairs;
+  // index into m_Pairs, -1 for empty slots. size is a power of 2
+  std::vector<int> m_Table;
+  unsigned m_Shift;
+};
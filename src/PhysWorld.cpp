@@ -1,255 +1,921 @@
 #include "PhysWorld.h"
 #include "BoxComponent.h"
+#include "RigidBodyComponent.h"
+#include "Actor.h"
+#include "Constants.h"
+#include "Game.h"
+#include "JobSystem.h"
 #include <algorithm>
 #include <SDL2/SDL.h>
-#include <unordered_map>
-#include <set>
-#include <utility> // std::pair
+
+namespace
+{
+	// for pairs whose world boxes overlap, rotated boxes are only loosely
+	// bounded by theirs
+	bool OBBsOverlap(const BoxComponent* a, const BoxComponent* b)
+	{
+		return (!a->IsRotated() && !b->IsRotated()) || Intersect(a->GetWorldOBB(), b->GetWorldOBB());
+	}
+
+	// each box's collision mask has the other's layer
+	bool MasksMatch(const BoxComponent* a, const BoxComponent* b)
+	{
+		return (a->GetLayer() & b->GetCollisionMask()) && (b->GetLayer() & a->GetCollisionMask());
+	}
+
+	// whether a pair the broadphase found is worth the exact tests
+	bool WantsContact(const BoxComponent* a, const BoxComponent* b, uint32_t layerMask)
+	{
+		return (a->GetLayer() & layerMask) && (b->GetLayer() & layerMask)
+			&& !(a->IsStatic() && b->IsStatic()) && MasksMatch(a, b);
+	}
+}
 
 PhysWorld::PhysWorld(Game* game)
 	:m_Game(game)
+	, m_Tree(PHYS_BROADPHASE_MARGIN)
+	, m_CastBatch(0)
+	, m_SweepBatch(0)
+	, m_Grid(PHYS_GRID_CELL_SIZE)
+	, m_Accumulator(0.0f)
+	, m_TickCount(0)
 {
+	std::fill(m_ContactEventStart, m_ContactEventStart + ContactEvent::E_NumTypes + 1, 0);
 }
 
-bool PhysWorld::SegmentCast(const LineSegment& l, CollisionInfo& outColl)
+bool PhysWorld::SegmentCast(const LineSegment& l, CollisionInfo& outColl
+	, uint32_t layerMask, Actor* ignore)
 {
-	bool collided = false;
-	// Initialize closestT to infinity, so first
-	// intersection will always update closestT
-	float closestT = Math::Infinity;
-	Vector3 norm;
-	// Test against all boxes
-	for (auto box : m_BoxesX)
+	SegmentQuery query{ l, layerMask, ignore };
+	CastPacket(&query, 1, &outColl);
+	return outColl.m_Box != nullptr;
+}
+
+void PhysWorld::CastPacket(const SegmentQuery* queries, size_t count, CollisionInfo* outColl) const
+{
+	AABBTree::RayPacket packet;
+	for (size_t lane = 0; lane < count; ++lane)
 	{
-		float t;
-		// Does the segment intersect with the box?
-		if (Intersect(l, box->GetWorldBox(), t, norm))
+		packet.SetSegment(static_cast<int>(lane), queries[lane].m_Segment);
+		outColl[lane].m_Box = nullptr;
+		outColl[lane].m_Actor = nullptr;
+	}
+
+	// the packet's max t for a lane is its closest hit so far,
+	// so the walk skips anything further away
+	m_Tree.RayCast(packet, [&](int proxy, int laneMask)
+	{
+		BoxComponent* box = static_cast<BoxComponent*>(m_Tree.GetUserData(proxy));
+		for (size_t lane = 0; lane < count; ++lane)
 		{
-			// Is this closer than previous intersection?
-			if (t < closestT)
+			const SegmentQuery& query = queries[lane];
+			if (!(laneMask & (1 << lane)) || !(box->GetLayer() & query.m_LayerMask)
+				|| box->GetOwner() == query.m_Ignore)
+			{
+				continue;
+			}
+
+			float t;
+			Vector3 norm;
+			if (Intersect(query.m_Segment, box->GetWorldBox(), t, norm) && t < packet.m_MaxT[lane])
 			{
-				outColl.m_Point = l.PointOnSegment(t);
-				outColl.m_Normal = norm;
-				outColl.m_Box = box;
-				outColl.m_Actor = box->GetOwner();
-				collided = true;
+				packet.m_MaxT[lane] = t;
+				outColl[lane].m_Point = query.m_Segment.PointOnSegment(t);
+				outColl[lane].m_Normal = norm;
+				outColl[lane].m_Box = box;
+				outColl[lane].m_Actor = box->GetOwner();
 			}
 		}
-	}
-	return collided;
+	});
 }
 
-void PhysWorld::TestPairwise(std::function<void(Actor*, Actor*)> func)
+void PhysWorld::SegmentCastBatch(const SegmentQuery* queries, size_t count, CollisionInfo* outColl)
 {
-	// Naive implementation O(n^2)
-	for (size_t i = 0; i < m_BoxesX.size(); i++)
+	size_t numPackets = (count + 3) / 4;
+	m_Game->GetJobSystem()->ParallelFor(numPackets, 16, [this, queries, count, outColl](size_t begin, size_t end)
 	{
-		// Don't need to test vs itself and any previous i values
-		for (size_t j = i + 1; j < m_BoxesX.size(); j++)
+		for (size_t i = begin; i < end; ++i)
 		{
-			BoxComponent* a = m_BoxesX[i];
-			BoxComponent* b = m_BoxesX[j];
-			if (Intersect(a->GetWorldBox(), b->GetWorldBox()))
-			{
-				// Call supplied function to handle intersection
-				func(a->GetOwner(), b->GetOwner());
-			}
+			size_t first = i * 4;
+			CastPacket(queries + first, Math::Min(count - first, static_cast<size_t>(4)), outColl + first);
 		}
+	});
+}
+
+PhysWorld::CastTicket PhysWorld::QueueSegmentCast(const SegmentQuery& query)
+{
+	CastTicket ticket;
+	ticket.m_Index = m_QueuedCasts.size();
+	ticket.m_Batch = m_CastBatch + 1;
+	m_QueuedCasts.emplace_back(query);
+	return ticket;
+}
+
+void PhysWorld::ProcessQueuedCasts()
+{
+	// queued casts become the processed batch, keep both vectors' capacity
+	m_ProcessedCasts.swap(m_QueuedCasts);
+	m_QueuedCasts.clear();
+	++m_CastBatch;
+
+	m_CastResults.resize(m_ProcessedCasts.size());
+	SegmentCastBatch(m_ProcessedCasts.data(), m_ProcessedCasts.size(), m_CastResults.data());
+}
+
+const PhysWorld::CollisionInfo* PhysWorld::GetQueuedCastResult(const CastTicket& ticket) const
+{
+	if (ticket.m_Batch != m_CastBatch || ticket.m_Index >= m_CastResults.size())
+	{
+		return nullptr;
 	}
+	return &m_CastResults[ticket.m_Index];
 }
 
-struct Pairs
+namespace
 {
-	std::set<std::pair<BoxComponent*, BoxComponent*>> pairs;
+	// largest half extent, the sphere inside a box fitted around a sphere mesh
+	Sphere BoundingSphere(const AABB& box)
+	{
+		Vector3 extents = (box.m_Max - box.m_Min) * 0.5f;
+		Sphere sphere;
+		sphere.m_Center = (box.m_Min + box.m_Max) * 0.5f;
+		sphere.m_Radius = Math::Max(extents.x, Math::Max(extents.y, extents.z));
+		return sphere;
+	}
 
-	void Add(BoxComponent* a, BoxComponent* b)
+	// half size of the swept shape along each axis
+	Vector3 SweepExtents(const BoxComponent* box)
 	{
-		// only add if neither permutation is in set
-		auto revP = std::make_pair(b, a);
-		bool isIn = pairs.find(revP) != pairs.end();
-		if (!isIn)
+		const AABB& world = box->GetWorldBox();
+		if (box->GetCollisionMode() == BoxComponent::E_ContinuousSphere)
 		{
-			auto p = std::make_pair(a, b);
-			pairs.insert(p); // if p already in, nothing happens
+			float radius = BoundingSphere(world).m_Radius;
+			return Vector3(radius, radius, radius);
 		}
+		return (world.m_Max - world.m_Min) * 0.5f;
 	}
 
-	void Remove(BoxComponent* a, BoxComponent* b)
+	// where a shape moved t of the way touches along an axis normal
+	Vector3 ContactPoint(const BoxComponent* box, const Vector3& displacement, float t, const Vector3& normal)
 	{
-		// remove pair, in either permutation, if in set
-		auto p = std::make_pair(a, b);
-		auto revP = std::make_pair(b, a);
+		const AABB& world = box->GetWorldBox();
+		Vector3 extents = SweepExtents(box);
+		Vector3 center = (world.m_Min + world.m_Max) * 0.5f + displacement * t;
+		return center - Vector3(normal.x * extents.x, normal.y * extents.y, normal.z * extents.z);
+	}
+}
+
+PhysWorld::SweepTicket PhysWorld::QueueSweep(const SweepQuery& query)
+{
+	SweepTicket ticket;
+	ticket.m_Index = m_QueuedSweeps.size();
+	ticket.m_Batch = m_SweepBatch + 1;
+	m_QueuedSweeps.emplace_back(query);
+	return ticket;
+}
 
-		bool isIn     = pairs.find(p) != pairs.end();
-		bool isInRev = pairs.find(revP) != pairs.end();
+void PhysWorld::ProcessSweeps()
+{
+	// queued sweeps become the processed batch, keep both vectors' capacity
+	m_ProcessedSweeps.swap(m_QueuedSweeps);
+	m_QueuedSweeps.clear();
+	++m_SweepBatch;
+
+	size_t count = m_ProcessedSweeps.size();
+	m_SweepResults.resize(count);
+	m_SweptBoxes.assign(count, AABB(Vector3::Zero, Vector3::Zero));
+	m_SweepOrder.clear();
+	for (size_t i = 0; i < count; ++i)
+	{
+		m_SweepResults[i].m_Hit.m_Box = nullptr;
+		m_SweepResults[i].m_Hit.m_Actor = nullptr;
+		m_SweepResults[i].m_Time = 1.0f;
 
-		// delete either permutation
-		if (isIn)
+		// boxes taken out of the world (their section is unloading) move freely
+		const SweepQuery& query = m_ProcessedSweeps[i];
+		if (!query.m_Box || query.m_Box->GetCollisionMode() == BoxComponent::E_Discrete
+			|| query.m_Box->GetProxyId() == AABBTree::NullNode)
 		{
-			pairs.erase(p);
+			continue;
 		}
-		if (isInRev)
+
+		// everything the box touches on the way
+		const AABB& start = query.m_Box->GetWorldBox();
+		AABB swept = start;
+		swept.UpdateMinMax(start.m_Min + query.m_Displacement);
+		swept.UpdateMinMax(start.m_Max + query.m_Displacement);
+		m_SweptBoxes[i] = swept;
+		m_SweepOrder.emplace_back(static_cast<int>(i));
+
+		int proxy = query.m_Box->GetProxyId();
+		if (static_cast<size_t>(proxy) >= m_ProxySweep.size())
 		{
-			pairs.erase(revP);
+			m_ProxySweep.resize(proxy + 1, -1);
 		}
+		m_ProxySweep[proxy] = static_cast<int>(i);
 	}
-};
-
-void PhysWorld::TestSweepAndPrune(std::function<void(Actor*, Actor*)> func)
-{
-	// 3d sweep and prune
 
-	// pairs to check for collision by axis
-	Pairs pairs;
-
-	// Sort by min.x
-	std::sort(m_BoxesX.begin(), m_BoxesX.end(),
-		[](BoxComponent* a, BoxComponent* b) {
-			return a->GetWorldBox().m_Min.x <
-				b->GetWorldBox().m_Min.x;
+	// still boxes, every sweep on its own so spread them over the job system
+	m_Impacts.resize(count);
+	m_Game->GetJobSystem()->ParallelFor(count, 16, [this](size_t begin, size_t end)
+	{
+		for (size_t i = begin; i < end; ++i)
+		{
+			SweepStatic(i, m_Impacts[i]);
+		}
 	});
+	m_Impacts.erase(std::remove_if(m_Impacts.begin(), m_Impacts.end(),
+		[](const ImpactEvent& e) { return e.m_Hit.m_Box == nullptr; }), m_Impacts.end());
 
-	// prune by x axis
-	for (size_t i = 0; i < m_BoxesX.size(); i++)
+	// moving against moving, only pairs whose swept boxes overlap along x
+	std::sort(m_SweepOrder.begin(), m_SweepOrder.end(), [this](int a, int b) {
+		return m_SweptBoxes[a].m_Min.x < m_SweptBoxes[b].m_Min.x;
+	});
+	for (size_t i = 0; i < m_SweepOrder.size(); ++i)
 	{
-		// Get max.x for current box
-		BoxComponent* a = m_BoxesX[i];
-		float max = a->GetWorldBox().m_Max.x;
-		for (size_t j = i + 1; j < m_BoxesX.size(); j++)
+		int a = m_SweepOrder[i];
+		for (size_t j = i + 1; j < m_SweepOrder.size(); ++j)
 		{
-			BoxComponent* b = m_BoxesX[j];
-			// If AABB[j] min is past the max bounds of AABB[i],
-			// then there aren't any other possible intersections
-			// against AABB[i]
-			if (b->GetWorldBox().m_Min.x > max)
+			int b = m_SweepOrder[j];
+			if (m_SweptBoxes[b].m_Min.x > m_SweptBoxes[a].m_Max.x)
 			{
 				break;
 			}
-			// add to possible pairs
-			else
+
+			ImpactEvent event;
+			if (Intersect(m_SweptBoxes[a], m_SweptBoxes[b]) && SweepPair(a, b, event))
 			{
-				pairs.Add(a, b);
+				m_Impacts.emplace_back(event);
 			}
 		}
 	}
 
-	// if no pairs in list, return !
-	if (pairs.pairs.empty()) { return; }
-
-	// sort by min.y
-	std::sort(m_BoxesY.begin(), m_BoxesY.end(),
-		[](BoxComponent* a, BoxComponent* b) {
-			return a->GetWorldBox().m_Min.y <
-				b->GetWorldBox().m_Min.y;
+	// earliest hit first, ties by index so it doesn't depend on job timing.
+	// A hit only counts if neither box already stopped earlier in the frame
+	std::sort(m_Impacts.begin(), m_Impacts.end(), [](const ImpactEvent& a, const ImpactEvent& b) {
+		if (a.m_Time != b.m_Time) { return a.m_Time < b.m_Time; }
+		if (a.m_A != b.m_A) { return a.m_A < b.m_A; }
+		return a.m_B < b.m_B;
 	});
-
-	// prune by y axis
-	for (size_t i = 0; i < m_BoxesY.size(); i++)
+	for (const ImpactEvent& e : m_Impacts)
 	{
-		// Get max.x for current box
-		BoxComponent* a = m_BoxesY[i];
-		float max = a->GetWorldBox().m_Max.y;
-		for (size_t j = i + 1; j < m_BoxesY.size(); j++)
+		SweepResult& resultA = m_SweepResults[e.m_A];
+		if (resultA.m_Hit.m_Box)
 		{
-			BoxComponent* b = m_BoxesY[j];
-			// If AABB[j] min is past the max bounds of AABB[i],
-			// then there aren't any other possible intersections
-			// against AABB[i]
-			if (b->GetWorldBox().m_Min.y > max)
-			{
-				pairs.Remove(a, b);
-				break;
-			}
-			// check for collision ( z axis) -> store pairs (x, y axis )
-			else
+			continue;
+		}
+
+		if (e.m_B >= 0)
+		{
+			SweepResult& resultB = m_SweepResults[e.m_B];
+			if (resultB.m_Hit.m_Box)
 			{
-				pairs.Add(a, b);
+				continue;
 			}
+			// same contact seen from the other box
+			resultB.m_Time = e.m_Time;
+			resultB.m_Hit.m_Point = e.m_Hit.m_Point;
+			resultB.m_Hit.m_Normal = -1.0f * e.m_Hit.m_Normal;
+			resultB.m_Hit.m_Box = m_ProcessedSweeps[e.m_A].m_Box;
+			resultB.m_Hit.m_Actor = m_ProcessedSweeps[e.m_A].m_Box->GetOwner();
 		}
+		resultA.m_Time = e.m_Time;
+		resultA.m_Hit = e.m_Hit;
 	}
 
-	// if no pairs, return !
-	if (pairs.pairs.empty()) { return; }
+	// move the owners, stopping a little short of whatever they hit
+	for (size_t i = 0; i < count; ++i)
+	{
+		const SweepQuery& query = m_ProcessedSweeps[i];
+		if (!query.m_Box)
+		{
+			continue;
+		}
 
-	// sort by min.z
-	std::sort(m_BoxesZ.begin(), m_BoxesZ.end(),
-		[](BoxComponent* a, BoxComponent* b) {
-			return a->GetWorldBox().m_Min.z <
-				b->GetWorldBox().m_Min.z;
+		float t = m_SweepResults[i].m_Time;
+		if (m_SweepResults[i].m_Hit.m_Box)
+		{
+			float length = query.m_Displacement.Length();
+			t = length > 0.0f ? Math::Max(t - PHYS_CCD_SKIN / length, 0.0f) : 0.0f;
+		}
+
+		Actor* owner = query.m_Box->GetOwner();
+		owner->SetPosition(owner->GetPosition() + query.m_Displacement * t);
+		owner->ComputeWorldTransform();
+	}
+
+	for (int index : m_SweepOrder)
+	{
+		m_ProxySweep[m_ProcessedSweeps[index].m_Box->GetProxyId()] = -1;
+	}
+}
+
+void PhysWorld::SweepStatic(size_t index, ImpactEvent& outEvent) const
+{
+	outEvent.m_Time = 1.0f;
+	outEvent.m_A = static_cast<int>(index);
+	outEvent.m_B = -1;
+	outEvent.m_Hit.m_Box = nullptr;
+	outEvent.m_Hit.m_Actor = nullptr;
+
+	const SweepQuery& query = m_ProcessedSweeps[index];
+	if (!query.m_Box || query.m_Box->GetCollisionMode() == BoxComponent::E_Discrete
+		|| query.m_Box->GetProxyId() == AABBTree::NullNode)
+	{
+		return;
+	}
+
+	const AABB& box = query.m_Box->GetWorldBox();
+	Sphere sphere = BoundingSphere(box);
+	bool isSphere = query.m_Box->GetCollisionMode() == BoxComponent::E_ContinuousSphere;
+	m_Tree.Query(m_SweptBoxes[index], [&](int proxy)
+	{
+		BoxComponent* other = static_cast<BoxComponent*>(m_Tree.GetUserData(proxy));
+		// other moving boxes are handled pair by pair
+		bool moving = static_cast<size_t>(proxy) < m_ProxySweep.size() && m_ProxySweep[proxy] >= 0;
+		if (other == query.m_Box || moving || !(other->GetLayer() & query.m_LayerMask)
+			|| other->GetOwner() == query.m_Ignore || !MasksMatch(query.m_Box, other))
+		{
+			return true;
+		}
+
+		float t;
+		Vector3 norm;
+		bool hit = isSphere ? SweptSphere(sphere, query.m_Displacement, other->GetWorldBox(), t, norm)
+			: SweptAABB(box, query.m_Displacement, other->GetWorldBox(), t, norm);
+		if (hit && (t < outEvent.m_Time || !outEvent.m_Hit.m_Box))
+		{
+			outEvent.m_Time = t;
+			outEvent.m_Hit.m_Point = ContactPoint(query.m_Box, query.m_Displacement, t, norm);
+			outEvent.m_Hit.m_Normal = norm;
+			outEvent.m_Hit.m_Box = other;
+			outEvent.m_Hit.m_Actor = other->GetOwner();
+		}
+		return true;
 	});
+}
 
-	// prune by z axis and test intersections for remaining pairs
-	for (size_t i = 0; i < m_BoxesZ.size(); i++)
+bool PhysWorld::SweepPair(size_t a, size_t b, ImpactEvent& outEvent) const
+{
+	const SweepQuery& queryA = m_ProcessedSweeps[a];
+	const SweepQuery& queryB = m_ProcessedSweeps[b];
+	BoxComponent* boxA = queryA.m_Box;
+	BoxComponent* boxB = queryB.m_Box;
+	// both have to want to stop at the other
+	if (!(boxB->GetLayer() & queryA.m_LayerMask) || !(boxA->GetLayer() & queryB.m_LayerMask)
+		|| boxB->GetOwner() == queryA.m_Ignore || boxA->GetOwner() == queryB.m_Ignore
+		|| !MasksMatch(boxA, boxB))
 	{
-		// Get max.x for current box
-		BoxComponent* a = m_BoxesZ[i];
-		float max = a->GetWorldBox().m_Max.z;
-		for (size_t j = i + 1; j < m_BoxesZ.size(); j++)
+		return false;
+	}
+
+	float t;
+	Vector3 norm;
+	if (boxA->GetCollisionMode() == BoxComponent::E_ContinuousSphere
+		&& boxB->GetCollisionMode() == BoxComponent::E_ContinuousSphere)
+	{
+		Sphere startA = BoundingSphere(boxA->GetWorldBox());
+		Sphere startB = BoundingSphere(boxB->GetWorldBox());
+		Sphere endA = startA;
+		endA.m_Center += queryA.m_Displacement;
+		Sphere endB = startB;
+		endB.m_Center += queryB.m_Displacement;
+		if (!SweptSphere(startA, endA, startB, endB, t))
 		{
-			BoxComponent* b = m_BoxesZ[j];
-			// If AABB[j] min is past the max bounds of AABB[i],
-			// then there aren't any other possible intersections
-			// against AABB[i]
-			if (b->GetWorldBox().m_Min.z > max)
-			{
-				// remove from pair list (y & z axis)
-				pairs.Remove(a, b);
-				break;
-			}
-			// check for collision ( z axis) -> store pairs (x, y axis )
-			else
+			return false;
+		}
+		// center to center where they touch
+		norm = (startA.m_Center + queryA.m_Displacement * t) - (startB.m_Center + queryB.m_Displacement * t);
+		if (Math::NearZero(norm.LengthSq(), 1e-12f))
+		{
+			return false;
+		}
+		norm.Normalize();
+	}
+	else
+	{
+		// a moving relative to b, spheres swept as their boxes
+		Vector3 relative = queryA.m_Displacement - queryB.m_Displacement;
+		if (!SweptAABB(boxA->GetWorldBox(), relative, boxB->GetWorldBox(), t, norm))
+		{
+			return false;
+		}
+	}
+
+	outEvent.m_Time = t;
+	outEvent.m_A = static_cast<int>(a);
+	outEvent.m_B = static_cast<int>(b);
+	outEvent.m_Hit.m_Point = ContactPoint(boxA, queryA.m_Displacement, t, norm);
+	outEvent.m_Hit.m_Normal = norm;
+	outEvent.m_Hit.m_Box = boxB;
+	outEvent.m_Hit.m_Actor = boxB->GetOwner();
+	return true;
+}
+
+const PhysWorld::SweepResult* PhysWorld::GetSweepResult(const SweepTicket& ticket) const
+{
+	if (ticket.m_Batch != m_SweepBatch || ticket.m_Index >= m_SweepResults.size())
+	{
+		return nullptr;
+	}
+	return &m_SweepResults[ticket.m_Index];
+}
+
+void PhysWorld::TestPairwise(uint32_t layerMask)
+{
+	// Naive implementation O(n^2), but 4 boxes at a time
+	m_BoxArray.Clear();
+	m_BoxArray.Reserve(m_Boxes.size());
+	for (BoxComponent* box : m_Boxes)
+	{
+		m_BoxArray.Add(box->GetWorldBox());
+	}
+
+	const size_t grainSize = 64;
+	JobSystem* jobs = m_Game->GetJobSystem();
+	m_PairScratch.resize(jobs->GetNumThreads());
+	for (PairScratch& scratch : m_PairScratch)
+	{
+		scratch.m_HitIndices.resize(m_Boxes.size());
+	}
+	m_ChunkPairs.resize((m_Boxes.size() + grainSize - 1) / grainSize);
+	for (std::vector<PairCache::Pair>& pairs : m_ChunkPairs)
+	{
+		pairs.clear();
+	}
+
+	jobs->ParallelFor(m_Boxes.size(), grainSize, [this, layerMask, grainSize](size_t begin, size_t end)
+	{
+		PairScratch& scratch = m_PairScratch[JobSystem::GetThreadIndex()];
+		// chunks claimed in any order, but each one's pairs land in its own slot
+		std::vector<PairCache::Pair>& pairs = m_ChunkPairs[begin / grainSize];
+		for (size_t i = begin; i < end; i++)
+		{
+			BoxComponent* a = m_Boxes[i];
+			if (!(a->GetLayer() & layerMask)) { continue; }
+
+			size_t count = CollisionSIMD::IntersectBox(a->GetWorldBox(), m_BoxArray, scratch.m_HitIndices.data());
+			for (size_t k = 0; k < count; k++)
 			{
-				pairs.Add(a, b);
+				// Don't need to test vs itself and any previous i values
+				size_t j = static_cast<size_t>(scratch.m_HitIndices[k]);
+				BoxComponent* b = m_Boxes[j];
+				if (j > i && WantsContact(a, b, layerMask))
+				{
+					pairs.emplace_back(PairCache::Pair{ a->GetProxyId(), b->GetProxyId() });
+				}
 			}
 		}
+	});
+
+	m_ContactCandidates.clear();
+	for (const std::vector<PairCache::Pair>& pairs : m_ChunkPairs)
+	{
+		m_ContactCandidates.insert(m_ContactCandidates.end(), pairs.begin(), pairs.end());
+	}
+	ReportContacts();
+}
+
+void PhysWorld::TestSweepAndPrune(uint32_t layerMask)
+{
+	// endpoints stay sorted between calls, only boxes that moved cost anything.
+	// Its own begin/end events are for the world boxes, the contact events
+	// below replace them
+	m_SweepAndPrune.Update();
+	m_SweepAndPrune.ClearEvents();
+
+	// every cached pair's world boxes overlap on all 3 axes
+	m_ContactCandidates.clear();
+	for (const PairCache::Pair& pair : m_SweepAndPrune.GetPairs().GetPairs())
+	{
+		const BoxComponent* a = static_cast<BoxComponent*>(m_Tree.GetUserData(pair.m_A));
+		const BoxComponent* b = static_cast<BoxComponent*>(m_Tree.GetUserData(pair.m_B));
+		if (WantsContact(a, b, layerMask))
+		{
+			m_ContactCandidates.emplace_back(pair);
+		}
+	}
+	ReportContacts();
+}
+
+void PhysWorld::TestTree(uint32_t layerMask)
+{
+	// find new pairs for every proxy that was reinserted
+	for (int proxy : m_MoveBuffer)
+	{
+		if (proxy == AABBTree::NullNode) { continue; }
+
+		const BoxComponent* box = static_cast<BoxComponent*>(m_Tree.GetUserData(proxy));
+		m_Tree.Query(m_Tree.GetFatBox(proxy), [this, proxy, box](int other)
+		{
+			if (other == proxy) { return true; }
+			// both moved, the other one will find this pair
+			BoxComponent* otherBox = static_cast<BoxComponent*>(m_Tree.GetUserData(other));
+			if (otherBox->IsProxyMoved() && other > proxy) { return true; }
+			// never wanted whatever the layer mask, keep it out of the cache
+			if (!MasksMatch(box, otherBox) || (box->IsStatic() && otherBox->IsStatic())) { return true; }
+
+			m_TreePairs.Add(proxy, other);
+			return true;
+		});
+	}
+
+	for (int proxy : m_MoveBuffer)
+	{
+		if (proxy == AABBTree::NullNode) { continue; }
+		static_cast<BoxComponent*>(m_Tree.GetUserData(proxy))->SetProxyMoved(false);
+	}
+	m_MoveBuffer.clear();
+
+	// drop pairs whose fat boxes separated, the rest go on to the exact tests
+	m_ContactCandidates.clear();
+	const std::vector<PairCache::Pair>& pairs = m_TreePairs.GetPairs();
+	size_t i = 0;
+	while (i < pairs.size())
+	{
+		int proxyA = pairs[i].m_A;
+		int proxyB = pairs[i].m_B;
+		if (!Intersect(m_Tree.GetFatBox(proxyA), m_Tree.GetFatBox(proxyB)))
+		{
+			// last pair is swapped into i
+			m_TreePairs.Remove(proxyA, proxyB);
+			continue;
+		}
+
+		const BoxComponent* a = static_cast<BoxComponent*>(m_Tree.GetUserData(proxyA));
+		const BoxComponent* b = static_cast<BoxComponent*>(m_Tree.GetUserData(proxyB));
+		if (WantsContact(a, b, layerMask))
+		{
+			m_ContactCandidates.emplace_back(pairs[i]);
+		}
+		++i;
+	}
+	ReportContacts();
+}
+
+void PhysWorld::ReportContacts()
+{
+	// exact tests, each pair on its own
+	size_t count = m_ContactCandidates.size();
+	m_CandidateTouching.resize(count);
+	m_Game->GetJobSystem()->ParallelFor(count, 256, [this](size_t begin, size_t end)
+	{
+		for (size_t i = begin; i < end; ++i)
+		{
+			const BoxComponent* a = static_cast<BoxComponent*>(m_Tree.GetUserData(m_ContactCandidates[i].m_A));
+			const BoxComponent* b = static_cast<BoxComponent*>(m_Tree.GetUserData(m_ContactCandidates[i].m_B));
+			m_CandidateTouching[i] = Intersect(a->GetWorldBox(), b->GetWorldBox()) && OBBsOverlap(a, b);
+		}
+	});
+
+	// begin for pairs that weren't touching before, stay for the rest
+	m_UnsortedEvents.clear();
+	size_t counts[ContactEvent::E_NumTypes] = {};
+	m_TouchingFound.assign(m_Touching.GetNumPairs(), 0);
+	for (size_t i = 0; i < count; ++i)
+	{
+		if (!m_CandidateTouching[i]) { continue; }
+
+		int proxyA = std::min(m_ContactCandidates[i].m_A, m_ContactCandidates[i].m_B);
+		int proxyB = std::max(m_ContactCandidates[i].m_A, m_ContactCandidates[i].m_B);
+		ContactEvent event;
+		event.m_A = static_cast<BoxComponent*>(m_Tree.GetUserData(proxyA));
+		event.m_B = static_cast<BoxComponent*>(m_Tree.GetUserData(proxyB));
+
+		int index = m_Touching.Find(proxyA, proxyB);
+		if (index < 0)
+		{
+			m_Touching.Add(proxyA, proxyB);
+			m_TouchingFound.emplace_back(1);
+			event.m_Type = ContactEvent::E_Begin;
+		}
+		else
+		{
+			m_TouchingFound[index] = 1;
+			event.m_Type = ContactEvent::E_Stay;
+		}
+		m_UnsortedEvents.emplace_back(event);
+		++counts[event.m_Type];
+	}
+
+	// the ones not found again have ended
+	const std::vector<PairCache::Pair>& touching = m_Touching.GetPairs();
+	size_t i = 0;
+	while (i < touching.size())
+	{
+		if (m_TouchingFound[i]) { ++i; continue; }
+
+		ContactEvent event;
+		event.m_A = static_cast<BoxComponent*>(m_Tree.GetUserData(touching[i].m_A));
+		event.m_B = static_cast<BoxComponent*>(m_Tree.GetUserData(touching[i].m_B));
+		event.m_Type = ContactEvent::E_End;
+		m_UnsortedEvents.emplace_back(event);
+		++counts[ContactEvent::E_End];
+
+		// last pair is swapped into i, same for its flag
+		m_TouchingFound[i] = m_TouchingFound.back();
+		m_TouchingFound.pop_back();
+		m_Touching.Remove(touching[i].m_A, touching[i].m_B);
+	}
+
+	// group by type, keeping their order within each group
+	m_ContactEventStart[0] = 0;
+	for (int type = 0; type < ContactEvent::E_NumTypes; ++type)
+	{
+		m_ContactEventStart[type + 1] = m_ContactEventStart[type] + counts[type];
+	}
+	size_t next[ContactEvent::E_NumTypes];
+	std::copy(m_ContactEventStart, m_ContactEventStart + ContactEvent::E_NumTypes, next);
+	m_ContactEvents.resize(m_UnsortedEvents.size());
+	for (const ContactEvent& event : m_UnsortedEvents)
+	{
+		m_ContactEvents[next[event.m_Type]++] = event;
+	}
+}
+
+const std::vector<PhysWorld::ContactEvent>& PhysWorld::GetContactEvents() const
+{
+	return m_ContactEvents;
+}
+
+const PhysWorld::ContactEvent* PhysWorld::GetContactEvents(ContactEvent::Type type, size_t& outCount) const
+{
+	outCount = m_ContactEventStart[type + 1] - m_ContactEventStart[type];
+	return m_ContactEvents.data() + m_ContactEventStart[type];
+}
+
+void PhysWorld::RefilterBox(BoxComponent* box)
+{
+	// TestTree only caches pairs the masks allow, look for this box's
+	// pairs again
+	int proxy = box->GetProxyId();
+	if (proxy != AABBTree::NullNode && !box->IsProxyMoved())
+	{
+		box->SetProxyMoved(true);
+		m_MoveBuffer.emplace_back(proxy);
+	}
+}
+
+void PhysWorld::UpdateBox(BoxComponent* box, const Vector3& displacement)
+{
+	int proxy = box->GetProxyId();
+	if (proxy == AABBTree::NullNode) { return; }
+
+	m_SweepAndPrune.SetBox(proxy, box->GetWorldBox());
+	m_Grid.SetBox(proxy, box->GetWorldBox(), box->IsStatic() ? SpatialGrid::Static : SpatialGrid::Dynamic);
+
+	if (m_Tree.MoveProxy(proxy, box->GetWorldBox(), displacement) && !box->IsProxyMoved())
+	{
+		box->SetProxyMoved(true);
+		m_MoveBuffer.emplace_back(proxy);
 	}
+}
+
+const AABBTree& PhysWorld::GetTree() const
+{
+	return m_Tree;
+}
 
-	// loop over pairs and check for collisions
-	auto it = pairs.pairs.begin();
-	while (it != pairs.pairs.end())
+const SpatialGrid& PhysWorld::GetGrid() const
+{
+	return m_Grid;
+}
+
+void PhysWorld::Simulate(float deltaTime)
+{
+	// fixed ticks, so the same inputs give the same simulation whatever
+	// the frame rate. Drop what doesn't fit rather than fall further behind
+	m_Accumulator = Math::Min(m_Accumulator + deltaTime, PHYS_TICK * PHYS_MAX_TICKS);
+	const float subStep = PHYS_TICK / PHYS_SUBSTEPS;
+	while (m_Accumulator >= PHYS_TICK)
 	{
-		it++;
-		auto pair = (*it);
-		auto a = pair.first;
-		auto b = pair.second;
-		if (Intersect(a->GetWorldBox(), b->GetWorldBox()))
+		m_RigidBodies.BeginTick();
+		for (int i = 0; i < PHYS_SUBSTEPS; ++i)
 		{
-			func(a->GetOwner(), b->GetOwner());
+			m_RigidBodies.Step(subStep, m_Grid, m_Game->GetJobSystem());
 		}
+		m_Accumulator -= PHYS_TICK;
+		++m_TickCount;
 	}
+
+	// user data is the RigidBodyComponent
+	m_RigidBodies.ForEachInterpolated(GetInterpolation(), [](void* userData, const Vector3& position, const Quaternion& rotation)
+	{
+		static_cast<RigidBodyComponent*>(userData)->SyncOwner(position, rotation);
+	});
+}
+
+float PhysWorld::GetInterpolation() const
+{
+	return m_Accumulator / PHYS_TICK;
+}
+
+uint32_t PhysWorld::GetTickCount() const
+{
+	return m_TickCount;
+}
+
+RigidBodySystem& PhysWorld::GetRigidBodies()
+{
+	return m_RigidBodies;
+}
+
+bool PhysWorld::ResolveBoxCollisions(const BoxComponent* box, uint32_t layerMask
+	, Vector3& outOffset, bool& outGrounded)
+{
+	outOffset = Vector3::Zero;
+	outGrounded = false;
+
+	m_GridHits.clear();
+	m_Grid.Query(box->GetWorldBox(), SpatialGrid::Static, [this, box, layerMask](int id) {
+		const BoxComponent* other = static_cast<BoxComponent*>(m_Tree.GetUserData(id));
+		if (other != box && (other->GetLayer() & layerMask) != 0 && MasksMatch(box, other))
+		{
+			m_GridHits.emplace_back(id);
+		}
+		return true;
+	});
+	if (m_GridHits.empty())
+	{
+		return false;
+	}
+
+	// resolve in id order so the result doesn't depend on cell layout
+	std::sort(m_GridHits.begin(), m_GridHits.end());
+
+	AABB moved = box->GetWorldBox();
+	bool collided = false;
+	for (int id : m_GridHits)
+	{
+		const AABB& staticBox = m_Grid.GetBox(id);
+		// earlier pushes may have moved it clear
+		if (!Intersect(moved, staticBox))
+		{
+			continue;
+		}
+		collided = true;
+
+		// Calculate all our differences
+		float dx1 = staticBox.m_Max.x - moved.m_Min.x;
+		float dx2 = staticBox.m_Min.x - moved.m_Max.x;
+		float dy1 = staticBox.m_Max.y - moved.m_Min.y;
+		float dy2 = staticBox.m_Min.y - moved.m_Max.y;
+		float dz1 = staticBox.m_Max.z - moved.m_Min.z;
+		float dz2 = staticBox.m_Min.z - moved.m_Max.z;
+
+		// Set dx to whichever of dx1/dx2 have a lower abs (same for dy, dz)
+		float dx = Math::Abs(dx1) < Math::Abs(dx2) ? dx1 : dx2;
+		float dy = Math::Abs(dy1) < Math::Abs(dy2) ? dy1 : dy2;
+		float dz = Math::Abs(dz1) < Math::Abs(dz2) ? dz1 : dz2;
+
+		// Whichever is closest, adjust x/y position
+		Vector3 push = Vector3::Zero;
+		if (Math::Abs(dx) <= Math::Abs(dy) && Math::Abs(dx) <= Math::Abs(dz))
+		{
+			push.x = dx;
+		}
+		else if (Math::Abs(dy) <= Math::Abs(dx) && Math::Abs(dy) <= Math::Abs(dz))
+		{
+			push.y = dy;
+		}
+		else
+		{
+			push.z = dz;
+		}
+
+		// check if grounded (dz2 is top of plane)
+		if (dz2 < 0.0f)
+		{
+			outGrounded = true;
+		}
+
+		moved.m_Min += push;
+		moved.m_Max += push;
+		outOffset += push;
+	}
+	return collided;
 }
 
 void PhysWorld::AddBox(BoxComponent* box)
 {
-	m_BoxesX.emplace_back(box);
-	m_BoxesY.emplace_back(box);
-	m_BoxesZ.emplace_back(box);
+	box->SetBoxIndex(static_cast<int>(m_Boxes.size()));
+	m_Boxes.emplace_back(box);
+
+	// the tree proxy id doubles as the box id for the other broadphases
+	int proxy = m_Tree.CreateProxy(box->GetWorldBox(), box);
+	box->SetProxyId(proxy);
+	box->SetProxyMoved(true);
+	m_MoveBuffer.emplace_back(proxy);
+	m_SweepAndPrune.AddBox(proxy, box->GetWorldBox());
+	m_Grid.AddBox(proxy, box->GetWorldBox(), box->IsStatic() ? SpatialGrid::Static : SpatialGrid::Dynamic);
 }
 
 void PhysWorld::RemoveBox(BoxComponent* box)
 {
-	auto iter = std::find(m_BoxesX.begin(), m_BoxesX.end(), box);
-	if (iter != m_BoxesX.end())
+	RemoveBoxes(&box, 1);
+}
+
+void PhysWorld::RemoveBoxes(BoxComponent* const* boxes, size_t count)
+{
+	// swap each to the end of the vector and pop it off, then flag its
+	// proxy so everything below is one pass however many boxes go
+	size_t numRemoved = 0;
+	for (size_t i = 0; i < count; ++i)
 	{
-		// Swap to end of vector and pop off (avoid erase copies)
-		std::iter_swap(iter, m_BoxesX.end() - 1);
-		m_BoxesX.pop_back();
+		BoxComponent* box = boxes[i];
+		int index = box->GetBoxIndex();
+		if (index < 0) { continue; }
+		m_Boxes[index] = m_Boxes.back();
+		m_Boxes[index]->SetBoxIndex(index);
+		m_Boxes.pop_back();
+		box->SetBoxIndex(-1);
+
+		int proxy = box->GetProxyId();
+		if (static_cast<size_t>(proxy) >= m_RemovedProxies.size())
+		{
+			m_RemovedProxies.resize(proxy + 1, 0);
+		}
+		m_RemovedProxies[proxy] = 1;
+		++numRemoved;
 	}
+	if (numRemoved == 0) { return; }
 
-	iter = std::find(m_BoxesY.begin(), m_BoxesY.end(), box);
-	if (iter != m_BoxesY.end())
+	// boxes still in the world have valid proxies, ones taken out
+	// earlier were already set to null below
+	auto removed = [this](const BoxComponent* box) {
+		if (!box) { return false; }
+		size_t proxy = static_cast<size_t>(box->GetProxyId());
+		return proxy < m_RemovedProxies.size() && m_RemovedProxies[proxy] != 0;
+	};
+
+	// processed casts are read through their tickets until the next batch,
+	// a box that's gone reads as a miss
+	for (CollisionInfo& result : m_CastResults)
 	{
-		// Swap to end of vector and pop off (avoid erase copies)
-		std::iter_swap(iter, m_BoxesY.end() - 1);
-		m_BoxesY.pop_back();
+		if (removed(result.m_Box))
+		{
+			result.m_Box = nullptr;
+			result.m_Actor = nullptr;
+		}
 	}
 
-	iter = std::find(m_BoxesZ.begin(), m_BoxesZ.end(), box);
-	if (iter != m_BoxesZ.end())
+	// forget any pairs and pending moves for these proxies before the ids are reused
+	m_TreePairs.RemoveAll(m_RemovedProxies);
+	m_SweepAndPrune.RemoveBoxes(m_RemovedProxies);
+
+	// no end event for a box that's gone
+	m_Touching.RemoveAll(m_RemovedProxies);
+	for (ContactEvent& event : m_ContactEvents)
 	{
-		// Swap to end of vector and pop off (avoid erase copies)
-		std::iter_swap(iter, m_BoxesZ.end() - 1);
-		m_BoxesZ.pop_back();
+		if (removed(event.m_A)) { event.m_A = nullptr; }
+		if (removed(event.m_B)) { event.m_B = nullptr; }
 	}
 
+	// don't move or report a box that's gone
+	for (SweepQuery& query : m_QueuedSweeps)
+	{
+		if (removed(query.m_Box))
+		{
+			query.m_Box = nullptr;
+		}
+	}
+	for (SweepResult& result : m_SweepResults)
+	{
+		if (removed(result.m_Hit.m_Box))
+		{
+			result.m_Hit.m_Box = nullptr;
+			result.m_Hit.m_Actor = nullptr;
+		}
+	}
+	for (int& moved : m_MoveBuffer)
+	{
+		if (static_cast<size_t>(moved) < m_RemovedProxies.size() && m_RemovedProxies[moved] != 0)
+		{
+			moved = AABBTree::NullNode;
+		}
+	}
+
+	for (size_t i = 0; i < count; ++i)
+	{
+		BoxComponent* box = boxes[i];
+		int proxy = box->GetProxyId();
+		if (proxy == AABBTree::NullNode || m_RemovedProxies[proxy] == 0) { continue; }
+		m_Grid.RemoveBox(proxy);
+		m_Tree.DestroyProxy(proxy);
+		m_RemovedProxies[proxy] = 0;
+		box->SetProxyId(AABBTree::NullNode);
+	}
+}
+
+void PhysWorld::RemoveSectionBoxes(int section)
+{
+	m_SectionBoxes.clear();
+	for (BoxComponent* box : m_Boxes)
+	{
+		if (box->GetOwner()->GetSceneSection() == section)
+		{
+			m_SectionBoxes.emplace_back(box);
+		}
+	}
+	RemoveBoxes(m_SectionBoxes.data(), m_SectionBoxes.size());
 }
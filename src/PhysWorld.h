@@ -2,8 +2,14 @@
 
 #include "Math.h"
 #include "Collision.h"
+#include "Constants.h"
+#include "AABBTree.h"
+#include "PairCache.h"
+#include "SweepAndPrune.h"
+#include "CollisionSIMD.h"
+#include "SpatialGrid.h"
+#include "RigidBodySystem.h"
 #include <vector>
-#include <functional>
 
 class PhysWorld
 {
@@ -26,23 +32,227 @@ public:
 	};
 
 	// Test a line segment against boxes
-	// Returns true if it collides against a box
-	bool SegmentCast(const LineSegment& l, CollisionInfo& outColl);
+	// Returns true if it collides against a box, outColl is the closest hit
+	bool SegmentCast(const LineSegment& l, CollisionInfo& outColl
+		, uint32_t layerMask = COLLISION_LAYER_ALL, class Actor* ignore = nullptr);
+
+  // what a batched segment cast can hit
+  struct SegmentQuery
+  {
+    LineSegment m_Segment;
+    uint32_t m_LayerMask;  // only boxes on one of these layers
+    class Actor* m_Ignore; // boxes owned by this actor are skipped, can be null
+  };
+
+  // closest hit for every query, outColl[i].m_Box is null if query i hit nothing
+  // segments go through the tree 4 at a time, packets are spread over the job system
+  void SegmentCastBatch(const SegmentQuery* queries, size_t count, CollisionInfo* outColl);
+
+  // deferred casts: queued during the frame, run as one batch by
+  // ProcessQueuedCasts and read back until the next batch. Nothing in the
+  // game queues casts now, so Game doesn't call it every frame; whoever
+  // starts queueing them should run it after the actors update
+  struct CastTicket
+  {
+    size_t m_Index;
+    unsigned m_Batch;
+    CastTicket() :m_Index(0), m_Batch(0) {}
+  };
+  CastTicket QueueSegmentCast(const SegmentQuery& query);
+  void ProcessQueuedCasts();
+  // nullptr if the ticket isn't from the last processed batch,
+  // otherwise the result (m_Box null for a miss)
+  const CollisionInfo* GetQueuedCastResult(const CastTicket& ticket) const;
+
+  // continuous collision: a box asks to move by a displacement this frame,
+  // ProcessSweeps then sweeps every queued box (sphere or box, set per
+  // BoxComponent) through the broadphase in one pass, handles hits in time
+  // of impact order and moves the owners. Results are read back next frame.
+  // Boxes only stop at boxes their collision masks agree on
+  struct SweepQuery
+  {
+    class BoxComponent* m_Box;
+    Vector3 m_Displacement;
+    uint32_t m_LayerMask;  // only stops at boxes on one of these layers
+    class Actor* m_Ignore; // boxes owned by this actor are skipped, can be null
+  };
+  struct SweepResult
+  {
+    // m_Box null if the whole displacement was free
+    CollisionInfo m_Hit;
+    // fraction of the displacement moved
+    float m_Time;
+  };
+  struct SweepTicket
+  {
+    size_t m_Index;
+    unsigned m_Batch;
+    SweepTicket() :m_Index(0), m_Batch(0) {}
+  };
+  SweepTicket QueueSweep(const SweepQuery& query);
+  void ProcessSweeps();
+  // nullptr if the ticket isn't from the last processed batch
+  const SweepResult* GetSweepResult(const SweepTicket& ticket) const;
+
+  // what the Test functions below report, one per touching pair. Boxes are
+  // stored in proxy id order (GetProxyId), not by which one moved
+  struct ContactEvent
+  {
+    enum Type { E_Begin, E_Stay, E_End, E_NumTypes };
+    class BoxComponent* m_A;
+    class BoxComponent* m_B;
+    Type m_Type;
+  };
+
+  // each Test function finds the pairs of boxes touching now (world boxes
+  // overlap, OBBs too for rotated boxes) and compares them with the pairs
+  // from the last Test call to write the contact events. Only boxes on one
+  // of layerMask's layers take part, and only pairs whose collision masks
+  // have each other's layer (static boxes never touch each other). These
+  // are checked before the exact tests, which run on the job system
 
 	// Tests collisions using naive pairwise
-	void TestPairwise(std::function<void(class Actor*, class Actor*)> f);
+	void TestPairwise(uint32_t layerMask = COLLISION_LAYER_ALL);
+
+  // test collisions using incremental sweep and prune, endpoints stay sorted
+  // between calls and overlapping pairs are cached
+	void TestSweepAndPrune(uint32_t layerMask = COLLISION_LAYER_ALL);
 
-  // Test collisions using sweep and prune (only test for collision if overlapping x-axis)
-	void TestSweepAndPrune(std::function<void(class Actor*, class Actor*)> f);
+  // test collisions using the dynamic aabb tree, candidate pairs are kept
+  // between calls and only boxes that left their fat box are re-queried
+  void TestTree(uint32_t layerMask = COLLISION_LAYER_ALL);
+
+  // events from the last Test call, every begin first, then the stays,
+  // then the ends. Valid until the next Test call, a box removed since
+  // is set to null in its events
+  const std::vector<ContactEvent>& GetContactEvents() const;
+  // just the events of one type, to handle them in one batch
+  const ContactEvent* GetContactEvents(ContactEvent::Type type, size_t& outCount) const;
 
   // add / remove box components from the world
   void AddBox(class BoxComponent* box);
   void RemoveBox(class BoxComponent* box);
+  // many boxes at once, the pair caches, endpoint lists and queued
+  // work are walked once rather than once per box
+  void RemoveBoxes(class BoxComponent* const* boxes, size_t count);
+  // boxes of a scene section's actors, when SceneLoader unloads it. The
+  // actors are deleted over the next frames and don't collide meanwhile
+  void RemoveSectionBoxes(int section);
+
+  // called by BoxComponent when its world box changes
+  void UpdateBox(class BoxComponent* box, const Vector3& displacement);
+  // called by BoxComponent when its layer, collision mask or static flag
+  // changes
+  void RefilterBox(class BoxComponent* box);
+
+  const AABBTree& GetTree() const;
+
+  // every box by its proxy id, static boxes in the static cells
+  const SpatialGrid& GetGrid() const;
+
+  // pushes box out of every static box on one of layerMask it overlaps and
+  // collides with (by their collision masks), one at a time along the axis
+  // that needs the smallest move. outOffset is the total move, outGrounded
+  // is set if it ended up resting on top of one.
+  // Returns false if nothing overlapped
+  bool ResolveBoxCollisions(const class BoxComponent* box, uint32_t layerMask
+    , Vector3& outOffset, bool& outGrounded);
+
+  // runs as many fixed PHYS_TICK ticks as fit in the time since the last
+  // call (at most PHYS_MAX_TICKS per call), each PHYS_SUBSTEPS rigid body
+  // steps. Leftover time carries over. Owners of moving bodies are then
+  // placed between the last two ticks by GetInterpolation, for rendering
+  void Simulate(float deltaTime);
+  // 0 at the start of the last tick, 1 at its end
+  float GetInterpolation() const;
+  // ticks run so far, to line replays and lockstep inputs up with
+  uint32_t GetTickCount() const;
+
+  RigidBodySystem& GetRigidBodies();
 private:
+  // narrows m_ContactCandidates (proxy pairs, world boxes may overlap)
+  // down to the touching ones and writes the contact events
+  void ReportContacts();
+
+  // up to 4 queries through the tree as one packet
+  void CastPacket(const SegmentQuery* queries, size_t count, CollisionInfo* outColl) const;
+
   class Game* m_Game;
 
-  // sorted by axis for sweep and prune
-  std::vector<class BoxComponent*> m_BoxesX;
-  std::vector<class BoxComponent*> m_BoxesY;
-  std::vector<class BoxComponent*> m_BoxesZ;
+  // every box, for the linear tests
+  std::vector<class BoxComponent*> m_Boxes;
+  // world boxes of m_Boxes, SoA for the batch tests
+  AABBArray m_BoxArray;
+
+  // per thread, for TestPairwise
+  struct PairScratch
+  {
+    std::vector<int> m_HitIndices;
+  };
+  std::vector<PairScratch> m_PairScratch;
+  // TestPairwise's pairs per chunk of boxes, joined in chunk order so the
+  // candidates don't depend on which thread ran which chunk
+  std::vector<std::vector<PairCache::Pair>> m_ChunkPairs;
+
+  std::vector<PairCache::Pair> m_ContactCandidates;
+  std::vector<unsigned char> m_CandidateTouching;
+  // touching pairs as of the last Test call, with a flag per pair for
+  // the ones found again by this call
+  PairCache m_Touching;
+  std::vector<unsigned char> m_TouchingFound;
+  // grouped by type, m_ContactEventStart[type] is where each group starts
+  std::vector<ContactEvent> m_ContactEvents;
+  std::vector<ContactEvent> m_UnsortedEvents;
+  size_t m_ContactEventStart[ContactEvent::E_NumTypes + 1];
+
+  // broadphase, proxy ids are stored on each BoxComponent
+  AABBTree m_Tree;
+  // proxies whose fat box changed since the last TestTree
+  std::vector<int> m_MoveBuffer;
+  // flags by proxy id for the proxies RemoveBoxes is taking out
+  std::vector<unsigned char> m_RemovedProxies;
+  std::vector<class BoxComponent*> m_SectionBoxes;
+  // fat box overlaps found so far
+  PairCache m_TreePairs;
+
+  // queued casts, and results of the last processed batch
+  std::vector<SegmentQuery> m_QueuedCasts;
+  std::vector<SegmentQuery> m_ProcessedCasts;
+  std::vector<CollisionInfo> m_CastResults;
+  unsigned m_CastBatch;
+
+  // time of impact of a sweep, m_B is the other sweep's index for two
+  // moving boxes and -1 for a still one
+  struct ImpactEvent
+  {
+    float m_Time;
+    int m_A;
+    int m_B;
+    CollisionInfo m_Hit; // as seen by m_A
+  };
+  // earliest hit of one sweep against boxes that aren't sweeping
+  void SweepStatic(size_t index, ImpactEvent& outEvent) const;
+  // both sweeps against each other
+  bool SweepPair(size_t a, size_t b, ImpactEvent& outEvent) const;
+
+  std::vector<SweepQuery> m_QueuedSweeps;
+  std::vector<SweepQuery> m_ProcessedSweeps;
+  std::vector<SweepResult> m_SweepResults;
+  std::vector<ImpactEvent> m_Impacts;
+  // box swept over its whole move, per processed sweep
+  std::vector<AABB> m_SweptBoxes;
+  std::vector<int> m_SweepOrder;
+  // processed sweep index by proxy id, -1 for boxes not sweeping
+  std::vector<int> m_ProxySweep;
+  unsigned m_SweepBatch;
+
+  SpatialGrid m_Grid;
+  std::vector<int> m_GridHits;
+
+  RigidBodySystem m_RigidBodies;
+  // time not yet simulated, less than a tick
+  float m_Accumulator;
+  uint32_t m_TickCount;
+
+  SweepAndPrune m_SweepAndPrune;
 };
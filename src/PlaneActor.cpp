@@ -9,6 +9,8 @@ PlaneActor::PlaneActor(Game* game)
 	:Actor(game)
 {
 	SetScale(10.0f);
+	// floor and wall tiles never move
+	SetStatic(true);
 	MeshComponent* mc = new MeshComponent(this);
 	Mesh* mesh = GetGame()->GetRenderer()->GetMesh("assets/Plane.gpmesh");
 	mc->SetMesh(mesh);
@@ -16,6 +18,7 @@ PlaneActor::PlaneActor(Game* game)
 	// add collision box
 	m_Box = new BoxComponent(this);
 	m_Box->SetObjectBox(mesh->GetBox());
+	m_Box->SetStatic(true);
 
 	game->AddPlane(this);
 }
@@ -6,15 +6,52 @@
 #include "SpriteComponent.h"
 #include "MeshComponent.h"
 #include "SkeletalMeshComponent.h"
+#include "SkinningBuffer.h"
+#include "Skeleton.h"
+#include "Actor.h"
+#include "StaticMeshBatch.h"
 
 #include <algorithm>
+#include <unordered_set>
 #include <GL/glew.h>
 
 const int numPointLights = 2;
 
+namespace
+{
+  // false if box is entirely outside one of the clip planes of viewProj
+  // (row vectors, so each plane is the w column +- one of the others)
+  bool BoxInView(const AABB& box, const Matrix4& viewProj)
+  {
+    const float (*m)[4] = viewProj.mat;
+    for (int axis = 0; axis < 3; ++axis)
+    {
+      for (float sign = -1.0f; sign <= 1.0f; sign += 2.0f)
+      {
+        float a = m[0][3] + sign * m[0][axis];
+        float b = m[1][3] + sign * m[1][axis];
+        float c = m[2][3] + sign * m[2][axis];
+        float d = m[3][3] + sign * m[3][axis];
+        // the corner furthest along the plane's normal
+        float dist = a * (a > 0.0f ? box.m_Max.x : box.m_Min.x)
+          + b * (b > 0.0f ? box.m_Max.y : box.m_Min.y)
+          + c * (c > 0.0f ? box.m_Max.z : box.m_Min.z) + d;
+        if (dist < 0.0f)
+        {
+          return false;
+        }
+      }
+    }
+    return true;
+  }
+}
+
 Renderer::Renderer(Game* game)
-  :m_Game(game)
+  :m_SpritesDirty(false)
+  , m_Game(game)
   , m_SpriteShader(nullptr)
+  , m_SkinnedShader(nullptr)
+  , m_SkinningBuffer(nullptr)
 {
   // set up point lights vector
   for(int i = 0; i < numPointLights; ++i)
@@ -35,6 +72,10 @@ Renderer::~Renderer()
   {
     delete pointLight;
   }
+  for (StaticSection& section : m_StaticSections)
+  {
+    delete section.m_Batch;
+  }
 }
 
 bool Renderer::Initialize(float width, float height)
@@ -111,12 +152,24 @@ bool Renderer::Initialize(float width, float height)
   // create quad for drawing sprites
   CreateSpriteVerts();
 
+  m_SkinningBuffer = new SkinningBuffer();
+  if (!m_SkinningBuffer->Initialize())
+  {
+    return false;
+  }
+
   return true;
 }
 
 void Renderer::ShutDown()
 {
   delete m_SpriteVerts;
+  if (m_SkinningBuffer)
+  {
+    m_SkinningBuffer->ShutDown();
+    delete m_SkinningBuffer;
+    m_SkinningBuffer = nullptr;
+  }
   m_SpriteShader->Unload();
   delete m_SpriteShader;
   for(auto ms: m_MeshShaders)
@@ -130,6 +183,13 @@ void Renderer::ShutDown()
 
 void Renderer::UnloadData()
 {
+  // merged buffers, and the textures they use are going
+  for (StaticSection& section : m_StaticSections)
+  {
+    delete section.m_Batch;
+  }
+  m_StaticSections.clear();
+
   // destroy textures
   for(auto t : m_Textures)
   {
@@ -159,6 +219,19 @@ void Renderer::Draw()
   glEnable(GL_DEPTH_TEST);
   glDisable(GL_BLEND);
 
+  BuildDirtyStaticSections();
+  Matrix4 viewProj = m_View * m_Projection;
+
+  // level of detail from how big each mesh is on screen this frame
+  Matrix4 invView = m_View;
+  invView.Invert();
+  Vector3 cameraPos = invView.GetTranslation();
+  float projScale = m_Projection.mat[1][1];
+  for (auto mc : m_MeshComps)
+  {
+    mc->SelectLod(cameraPos, projScale);
+  }
+
   // draw all shaders, grouped by which shader they use
   for(Shader* shader : m_MeshShaders)
   {
@@ -166,8 +239,16 @@ void Renderer::Draw()
     shader->SetActive();
 
     // Update view-projection matrix
-    shader->SetMatrixUniform("uViewProj", m_View * m_Projection);
+    shader->SetMatrixUniform("uViewProj", viewProj);
     SetLightUniforms(shader);
+    for (const StaticSection& section : m_StaticSections)
+    {
+      // whole sections behind the camera or off to the side are skipped
+      if (BoxInView(section.m_Batch->GetBounds(), viewProj))
+      {
+        section.m_Batch->Draw(shader);
+      }
+    }
     for (auto mc : m_MeshComps)
     {
       // only draw if shader matches mesh components shader
@@ -179,18 +260,7 @@ void Renderer::Draw()
   }
 
   // draw all skeletal skinned meshes
-  m_SkinnedShader->SetActive();
-  // update view projection matrix
-  m_SkinnedShader->SetMatrixUniform("uViewProj", m_View * m_Projection);
-  // update lighting Uniforms
-  SetLightUniforms(m_SkinnedShader);
-  for(auto sk : m_SkeletalMeshComps)
-  {
-    //if(sk->GetVisible())
-    //{
-      sk->Draw(m_SkinnedShader);
-    //}
-  }
+  DrawSkinnedMeshes();
 
   // Draw all sprite components
   // Disable depth buffering
@@ -200,6 +270,9 @@ void Renderer::Draw()
   glBlendEquationSeparate(GL_FUNC_ADD, GL_FUNC_ADD);
   glBlendFuncSeparate(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA, GL_ONE, GL_ZERO);
 
+  // make sure sprites are in draw order
+  SortSprites();
+
   // Set shader/vao as active
   m_SpriteShader->SetActive();
   m_SpriteVerts->SetActive();
@@ -212,28 +285,135 @@ void Renderer::Draw()
   SDL_GL_SwapWindow(m_Window);
 }
 
-void Renderer::AddSprite(SpriteComponent* sprite)
+void Renderer::DrawSkinnedMeshes()
 {
-	// Find the insertion point in the sorted vector
-	// (The first element with a higher draw order than me)
-	int myDrawOrder = sprite->GetDrawOrder();
-	auto iter = m_Sprites.begin();
-	for (; iter != m_Sprites.end(); ++iter)
-	{
-		if (myDrawOrder < (*iter)->GetDrawOrder())
-		{
-			break;
-		}
-	}
+  // pack every palette once, only the bones the skeleton has
+  m_SkinningBuffer->Begin();
+  m_SkinnedInstances.clear();
+  for (auto sk : m_SkeletalMeshComps)
+  {
+    Mesh* mesh = sk->GetMesh();
+    if (!mesh) { continue; }
+
+    size_t numBones = sk->GetSkeleton() ? sk->GetSkeleton()->GetNumBones() : MAX_SKELETON_BONES;
+    SkinnedInstance inst;
+    inst.m_VertexArray = mesh->GetVertexArray();
+    inst.m_Texture = mesh->GetTexture(sk->GetTextureIndex());
+    inst.m_Comp = sk;
+    inst.m_PaletteOffset = m_SkinningBuffer->AddPalette(sk->GetPalette().m_Entry, numBones);
+    m_SkinnedInstances.emplace_back(inst);
+  }
+
+  // group instances that can share a draw call
+  std::sort(m_SkinnedInstances.begin(), m_SkinnedInstances.end(),
+    [](const SkinnedInstance& a, const SkinnedInstance& b) {
+      if (a.m_VertexArray != b.m_VertexArray)
+      {
+        return a.m_VertexArray < b.m_VertexArray;
+      }
+      return a.m_Texture < b.m_Texture;
+  });
+
+  // instance records go after all the palettes (4 texels each),
+  // in sorted order so each group's records are back to back
+  unsigned instanceBase = 0;
+  for (size_t i = 0; i < m_SkinnedInstances.size(); ++i)
+  {
+    const SkinnedInstance& inst = m_SkinnedInstances[i];
+    unsigned offset = m_SkinningBuffer->AddInstance(
+      inst.m_Comp->GetOwner()->GetWorldTransform(), inst.m_PaletteOffset);
+    if (i == 0)
+    {
+      instanceBase = offset;
+    }
+  }
+
+  m_SkinnedShader->SetActive();
+  // update view projection matrix
+  m_SkinnedShader->SetMatrixUniform("uViewProj", m_View * m_Projection);
+  // update lighting Uniforms
+  SetLightUniforms(m_SkinnedShader);
+
+  // one upload for everything, bound to texture unit 1
+  m_SkinningBuffer->Upload(1);
+  m_SkinnedShader->SetIntUniform("uSkinningBuffer", 1);
+
+  for (size_t begin = 0; begin < m_SkinnedInstances.size();)
+  {
+    const SkinnedInstance& first = m_SkinnedInstances[begin];
+    size_t end = begin + 1;
+    while (end < m_SkinnedInstances.size()
+      && m_SkinnedInstances[end].m_VertexArray == first.m_VertexArray
+      && m_SkinnedInstances[end].m_Texture == first.m_Texture)
+    {
+      ++end;
+    }
+
+    m_SkinnedShader->SetIntUniform("uInstanceOffset", static_cast<int>(instanceBase + begin * 4));
+    m_SkinnedShader->SetFloatUniform("uSpecPower", first.m_Comp->GetMesh()->GetSpecPower());
+    if (first.m_Texture)
+    {
+      first.m_Texture->SetActive();
+    }
+    first.m_VertexArray->SetActive();
+    glDrawElementsInstanced(GL_TRIANGLES, first.m_VertexArray->GetNumIndices()
+      , first.m_VertexArray->GetIndexType(), nullptr, static_cast<GLsizei>(end - begin));
+
+    begin = end;
+  }
+}
 
-	// Inserts element before position of iterator
-	m_Sprites.insert(iter, sprite);
+void Renderer::AddSprite(SpriteComponent* sprite)
+{
+  // append and sort later, keeps spawning lots of sprites in one frame cheap
+  sprite->SetSpriteIndex(m_Sprites.size());
+  m_Sprites.emplace_back(sprite);
+  m_SpritesDirty = true;
 }
 
 void Renderer::RemoveSprite(SpriteComponent* sprite)
 {
-	auto iter = std::find(m_Sprites.begin(), m_Sprites.end(), sprite);
-	m_Sprites.erase(iter);
+  // null out the slot, it gets compacted on the next sort
+  size_t index = sprite->GetSpriteIndex();
+  if (index < m_Sprites.size() && m_Sprites[index] == sprite)
+  {
+    m_Sprites[index] = nullptr;
+    m_SpritesDirty = true;
+  }
+}
+
+void Renderer::MarkSpritesDirty()
+{
+  m_SpritesDirty = true;
+}
+
+VertexArray* Renderer::GetSpriteVerts()
+{
+  return m_SpriteVerts;
+}
+
+void Renderer::SortSprites()
+{
+  if (!m_SpritesDirty)
+  {
+    return;
+  }
+  m_SpritesDirty = false;
+
+  // drop removed sprites (keeps relative order)
+  m_Sprites.erase(std::remove(m_Sprites.begin(), m_Sprites.end(), nullptr), m_Sprites.end());
+
+  // stable sort so sprites with equal draw order keep insertion order
+  std::stable_sort(m_Sprites.begin(), m_Sprites.end(),
+    [](const SpriteComponent* a, const SpriteComponent* b) {
+      return a->GetDrawOrder() < b->GetDrawOrder();
+  });
+
+  // slots moved, so update each sprite's index
+  for (size_t i = 0; i < m_Sprites.size(); ++i)
+  {
+    m_Sprites[i]->SetSpriteIndex(i);
+  }
 }
 
 void Renderer::AddMeshComp(MeshComponent* mesh)
@@ -244,6 +424,7 @@ void Renderer::AddMeshComp(MeshComponent* mesh)
     m_SkeletalMeshComps.emplace_back(sk);
   } else
   {
+    mesh->SetMeshIndex(m_MeshComps.size());
     m_MeshComps.emplace_back(mesh);
   }
 }
@@ -255,10 +436,178 @@ void Renderer::RemoveMeshComp(MeshComponent* mesh)
     SkeletalMeshComponent* sk = static_cast<SkeletalMeshComponent*>(mesh);
     auto iter = std::find(m_SkeletalMeshComps.begin(), m_SkeletalMeshComps.end(), sk);
     m_SkeletalMeshComps.erase(iter);
-  } else
+    return;
+  }
+
+  // swap and pop through its slot, draw order of meshes doesn't matter
+  size_t index = mesh->GetMeshIndex();
+  if (index < m_MeshComps.size() && m_MeshComps[index] == mesh)
   {
-    auto iter = std::find(m_MeshComps.begin(), m_MeshComps.end(), mesh);
-    m_MeshComps.erase(iter);
+    m_MeshComps[index] = m_MeshComps.back();
+    m_MeshComps[index]->SetMeshIndex(index);
+    m_MeshComps.pop_back();
+    return;
+  }
+
+  // baked into its section's batch, take it back out before the next draw.
+  // A dropped section isn't there any more
+  int sectionIndex = mesh->GetOwner()->GetSceneSection();
+  for (size_t i = 0; i < m_StaticSections.size(); ++i)
+  {
+    StaticSection& section = m_StaticSections[i];
+    if (section.m_Section != sectionIndex)
+    {
+      continue;
+    }
+    if (index >= section.m_Comps.size() || section.m_Comps[index] != mesh)
+    {
+      return;
+    }
+    section.m_Comps[index] = section.m_Comps.back();
+    section.m_Comps[index]->SetMeshIndex(index);
+    section.m_Comps.pop_back();
+    section.m_Dirty = true;
+    if (section.m_Comps.empty())
+    {
+      delete section.m_Batch;
+      m_StaticSections[i] = m_StaticSections.back();
+      m_StaticSections.pop_back();
+    }
+    return;
+  }
+}
+
+void Renderer::BuildStaticBatch(const std::vector<Actor*>& actors)
+{
+  for (Actor* actor : actors)
+  {
+    if (!actor->IsStatic())
+    {
+      continue;
+    }
+    // once per component of a finished section, not per frame
+    for (Component* comp : actor->GetComponents())
+    {
+      MeshComponent* mc = dynamic_cast<MeshComponent*>(comp);
+      // meshes without a CPU copy can't be merged, they stay as they were
+      if (!mc || mc->IsSkeletal() || !mc->GetMesh() || mc->GetMesh()->GetVertices().empty())
+      {
+        continue;
+      }
+      size_t index = mc->GetMeshIndex();
+      if (index >= m_MeshComps.size() || m_MeshComps[index] != mc)
+      {
+        continue; // already batched
+      }
+      m_MeshComps[index] = m_MeshComps.back();
+      m_MeshComps[index]->SetMeshIndex(index);
+      m_MeshComps.pop_back();
+
+      int sectionIndex = actor->GetSceneSection();
+      auto section = std::find_if(m_StaticSections.begin(), m_StaticSections.end(),
+        [sectionIndex](const StaticSection& s) { return s.m_Section == sectionIndex; });
+      if (section == m_StaticSections.end())
+      {
+        m_StaticSections.emplace_back(StaticSection{ sectionIndex, {}, new StaticMeshBatch(), false });
+        section = m_StaticSections.end() - 1;
+      }
+      mc->SetMeshIndex(section->m_Comps.size());
+      section->m_Comps.emplace_back(mc);
+      section->m_Dirty = true;
+    }
+  }
+  BuildDirtyStaticSections();
+}
+
+void Renderer::DropStaticSection(int section)
+{
+  for (size_t i = 0; i < m_StaticSections.size(); ++i)
+  {
+    if (m_StaticSections[i].m_Section == section)
+    {
+      delete m_StaticSections[i].m_Batch;
+      m_StaticSections[i] = m_StaticSections.back();
+      m_StaticSections.pop_back();
+      return;
+    }
+  }
+}
+
+void Renderer::BuildDirtyStaticSections()
+{
+  for (StaticSection& section : m_StaticSections)
+  {
+    if (section.m_Dirty)
+    {
+      section.m_Batch->Build(section.m_Comps);
+      section.m_Dirty = false;
+    }
+  }
+}
+
+void Renderer::UnloadUnusedAssets()
+{
+  std::unordered_set<Mesh*> usedMeshes;
+  std::unordered_set<Texture*> usedTextures;
+  auto useMesh = [&](MeshComponent* mc) {
+    Mesh* mesh = mc->GetMesh();
+    if (mesh && usedMeshes.insert(mesh).second)
+    {
+      for (size_t i = 0; Texture* t = mesh->GetTexture(i); ++i)
+      {
+        usedTextures.insert(t);
+      }
+    }
+  };
+  for (MeshComponent* mc : m_MeshComps)
+  {
+    useMesh(mc);
+  }
+  for (const StaticSection& section : m_StaticSections)
+  {
+    for (MeshComponent* mc : section.m_Comps)
+    {
+      useMesh(mc);
+    }
+  }
+  for (SkeletalMeshComponent* sk : m_SkeletalMeshComps)
+  {
+    useMesh(sk);
+  }
+  for (SpriteComponent* sprite : m_Sprites)
+  {
+    // removed sprites are nulled until the next sort
+    if (sprite && sprite->GetTexture())
+    {
+      usedTextures.insert(sprite->GetTexture());
+    }
+  }
+
+  for (auto it = m_Meshes.begin(); it != m_Meshes.end();)
+  {
+    if (usedMeshes.count(it->second) == 0)
+    {
+      it->second->Unload();
+      delete it->second;
+      it = m_Meshes.erase(it);
+    }
+    else
+    {
+      ++it;
+    }
+  }
+  for (auto it = m_Textures.begin(); it != m_Textures.end();)
+  {
+    if (usedTextures.count(it->second) == 0)
+    {
+      it->second->Unload();
+      delete it->second;
+      it = m_Textures.erase(it);
+    }
+    else
+    {
+      ++it;
+    }
   }
 }
 
@@ -36,12 +36,27 @@ public:
 
   void AddSprite(class SpriteComponent* sprite);
   void RemoveSprite(class SpriteComponent* sprite);
+  // called by sprites whose draw order changed, re-sorted before next draw
+  void MarkSpritesDirty();
+  // the quad every sprite is drawn with, active while sprites draw
+  class VertexArray* GetSpriteVerts();
 
   void AddMeshComp(class MeshComponent* mesh);
   void RemoveMeshComp(class MeshComponent* mesh);
+  // mesh comps of the static ones of actors (Actor::IsStatic) stop being
+  // drawn one by one and are merged into a static batch per scene section
+  // (actors made in code share section -1). Only sections that got new
+  // meshes are built, a section losing one is rebuilt before the next draw
+  void BuildStaticBatch(const std::vector<class Actor*>& actors);
+  // stops drawing a section's batch without rebuilding it, for a section
+  // that's being unloaded: its static actors are all about to be deleted
+  void DropStaticSection(int section);
 
   class Texture* GetTexture(const std::string& fileName);
   class Mesh* GetMesh(const std::string& fileName);
+  // frees meshes and textures no component is using any more, after a
+  // part of the level was unloaded. They're loaded again if asked for
+  void UnloadUnusedAssets();
   void SetViewMatrix(const Matrix4& view);
   void SetAmbientLight(const Vector3& ambient);
   DirectionalLight& GetDirectionalLight();
@@ -56,6 +71,13 @@ private:
   bool LoadShaders();
   void CreateSpriteVerts();
   void SetLightUniforms(class Shader* shader);
+  // compacts removed sprites and re-sorts by draw order (once per frame at most)
+  void SortSprites();
+  // rebuilds the static sections marked dirty
+  void BuildDirtyStaticSections();
+  // uploads every palette once and draws skinned meshes instanced,
+  // one draw per vertex array + texture
+  void DrawSkinnedMeshes();
 
   // Map of textures loaded
   std::unordered_map<std::string, class Texture*> m_Textures;
@@ -63,11 +85,23 @@ private:
   std::unordered_map<std::string, class Mesh*> m_Meshes;
 
   // All the sprite components drawn
+  // add/remove are O(1): removed slots are nulled and the vector is
+  // compacted and stable sorted by draw order lazily before drawing
   std::vector<class SpriteComponent*> m_Sprites;
+  bool m_SpritesDirty;
 
   // All mesh components drawn
   std::vector<class MeshComponent*> m_MeshComps;
   std::vector<class SkeletalMeshComponent*> m_SkeletalMeshComps;
+  // drawn through the static batches instead, grouped by scene section
+  struct StaticSection
+  {
+    int m_Section;
+    std::vector<class MeshComponent*> m_Comps;
+    class StaticMeshBatch* m_Batch;
+    bool m_Dirty;
+  };
+  std::vector<StaticSection> m_StaticSections;
 
   // Game
   class Game* m_Game;
@@ -78,6 +112,18 @@ private:
   class VertexArray* m_SpriteVerts;
 
   class Shader* m_SkinnedShader; // for animations
+  // per-frame palettes/instances read by the skinned shader
+  class SkinningBuffer* m_SkinningBuffer;
+
+  // skinned meshes gathered for this frame's batches
+  struct SkinnedInstance
+  {
+    class VertexArray* m_VertexArray;
+    class Texture* m_Texture;
+    class SkeletalMeshComponent* m_Comp;
+    unsigned m_PaletteOffset;
+  };
+  std::vector<SkinnedInstance> m_SkinnedInstances;
 
   // Mesh shaders
   std::vector<class Shader*> m_MeshShaders;
@@ -0,0 +1,105 @@
+#include "RigidBodyComponent.h"
+#include "RigidBodySystem.h"
+#include "Game.h"
+#include "Actor.h"
+#include "PhysWorld.h"
+
+RigidBodyComponent::RigidBodyComponent(class Actor* owner, int updateOrder)
+  :Component(owner, updateOrder)
+  , m_OwnerPosition(owner->GetPosition())
+  , m_OwnerRotation(owner->GetRotation())
+{
+  RigidBodySystem::ShapeDesc shape{ RigidBodySystem::E_Sphere, Vector3(1.0f, 0.0f, 0.0f) };
+  m_Body = GetBodies()->AddBody(shape, 1.0f, m_Owner->GetPosition(), m_Owner->GetRotation(), this);
+}
+
+RigidBodyComponent::~RigidBodyComponent()
+{
+  GetBodies()->RemoveBody(m_Body);
+}
+
+void RigidBodyComponent::OnUpdateWorldTransform()
+{
+  // the owner is drawn between physics ticks, so compare against where
+  // physics last put it rather than the body
+  const Vector3& pos = m_Owner->GetPosition();
+  const Quaternion& rot = m_Owner->GetRotation();
+  if (pos.x != m_OwnerPosition.x || pos.y != m_OwnerPosition.y || pos.z != m_OwnerPosition.z
+    || rot.x != m_OwnerRotation.x || rot.y != m_OwnerRotation.y || rot.z != m_OwnerRotation.z
+    || rot.w != m_OwnerRotation.w)
+  {
+    m_OwnerPosition = pos;
+    m_OwnerRotation = rot;
+    GetBodies()->SetTransform(m_Body, pos, rot);
+  }
+}
+
+void RigidBodyComponent::SetSphere(float radius)
+{
+  GetBodies()->SetShape(m_Body, RigidBodySystem::ShapeDesc{ RigidBodySystem::E_Sphere, Vector3(radius, 0.0f, 0.0f) });
+}
+
+void RigidBodyComponent::SetBox(const Vector3& halfExtents)
+{
+  GetBodies()->SetShape(m_Body, RigidBodySystem::ShapeDesc{ RigidBodySystem::E_Box, halfExtents });
+}
+
+void RigidBodyComponent::SetCapsule(float radius, float halfLength)
+{
+  GetBodies()->SetShape(m_Body, RigidBodySystem::ShapeDesc{ RigidBodySystem::E_Capsule, Vector3(radius, halfLength, 0.0f) });
+}
+
+void RigidBodyComponent::SetMass(float mass)
+{
+  GetBodies()->SetMass(m_Body, mass);
+}
+
+void RigidBodyComponent::SetMaterial(float friction, float restitution)
+{
+  GetBodies()->SetMaterial(m_Body, friction, restitution);
+}
+
+void RigidBodyComponent::SetVelocity(const Vector3& velocity)
+{
+  GetBodies()->SetLinearVelocity(m_Body, velocity);
+}
+
+const Vector3& RigidBodyComponent::GetVelocity() const
+{
+  return GetBodies()->GetLinearVelocity(m_Body);
+}
+
+void RigidBodyComponent::SetAngularVelocity(const Vector3& velocity)
+{
+  GetBodies()->SetAngularVelocity(m_Body, velocity);
+}
+
+void RigidBodyComponent::ApplyImpulse(const Vector3& impulse, const Vector3& point)
+{
+  GetBodies()->ApplyImpulse(m_Body, impulse, point);
+}
+
+bool RigidBodyComponent::IsAwake() const
+{
+  return GetBodies()->IsAwake(m_Body);
+}
+
+int RigidBodyComponent::GetBodyId() const
+{
+  return m_Body;
+}
+
+void RigidBodyComponent::SyncOwner(const Vector3& position, const Quaternion& rotation)
+{
+  m_OwnerPosition = position;
+  m_OwnerRotation = rotation;
+  m_Owner->SetPosition(position);
+  m_Owner->SetRotation(rotation);
+  // in time for this frame's draw
+  m_Owner->ComputeWorldTransform();
+}
+
+RigidBodySystem* RigidBodyComponent::GetBodies() const
+{
+  return &m_Owner->GetGame()->GetPhysWorld()->GetRigidBodies();
+}
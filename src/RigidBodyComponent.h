@@ -0,0 +1,45 @@
+#pragma once
+
+#include "Component.h"
+#include "Math.h"
+
+// makes the owner a rigid body in the PhysWorld, the body drives the
+// owner's position and rotation. Sizes are in world units, the owner's
+// scale isn't applied. Starts as a dynamic unit sphere of mass 1
+class RigidBodyComponent : public Component
+{
+public:
+  RigidBodyComponent(class Actor* owner, int updateOrder = 100);
+  ~RigidBodyComponent();
+
+  // gameplay moving the owner teleports the body there
+  void OnUpdateWorldTransform() override;
+
+  void SetSphere(float radius);
+  void SetBox(const Vector3& halfExtents);
+  // segment along the owner's local z
+  void SetCapsule(float radius, float halfLength);
+  // 0 makes it fixed
+  void SetMass(float mass);
+  void SetMaterial(float friction, float restitution);
+
+  void SetVelocity(const Vector3& velocity);
+  const Vector3& GetVelocity() const;
+  void SetAngularVelocity(const Vector3& velocity);
+  // impulse at a world space point
+  void ApplyImpulse(const Vector3& impulse, const Vector3& point);
+  bool IsAwake() const;
+
+  int GetBodyId() const;
+
+  // called by PhysWorld to move the owner to where the body is drawn
+  void SyncOwner(const Vector3& position, const Quaternion& rotation);
+private:
+  class RigidBodySystem* GetBodies() const;
+
+  int m_Body;
+  // where the owner was last put by SyncOwner or found by
+  // OnUpdateWorldTransform, anything else is gameplay moving it
+  Vector3 m_OwnerPosition;
+  Quaternion m_OwnerRotation;
+};
@@ -0,0 +1,1001 @@
+#include "RigidBodySystem.h"
+#include "SpatialGrid.h"
+#include "JobSystem.h"
+#include "Constants.h"
+
+#include <algorithm>
+
+namespace
+{
+  // solver tuning
+  const float Baumgarte = 0.2f;
+  // penetration left alone so resting contacts don't jitter
+  const float PenetrationSlop = 0.5f;
+  // approach speed below which contacts don't bounce
+  const float RestitutionThreshold = 50.0f;
+  const float LinearDamping = 0.05f;
+  const float AngularDamping = 0.1f;
+
+  // an island sleeps once every body in it has been slower than this
+  // for TimeToSleep seconds
+  const float SleepLinearSpeed = 5.0f;
+  const float SleepAngularSpeed = 0.1f;
+  const float TimeToSleep = 0.5f;
+
+  const int MaxContactsPerPair = ContactManifold::MaxPoints;
+
+  struct ShapeInstance
+  {
+    RigidBodySystem::ShapeType m_Type;
+    Vector3 m_Position;
+    Quaternion m_Rotation;
+    Vector3 m_Size;
+  };
+
+  struct ContactPoint
+  {
+    Vector3 m_Point;
+    // from shape a to shape b
+    Vector3 m_Normal;
+    float m_Depth;
+    int m_Feature;
+  };
+
+  Quaternion Inverse(const Quaternion& q)
+  {
+    Quaternion inv = q;
+    inv.Conjugate();
+    return inv;
+  }
+
+  float GetAxis(const Vector3& v, int axis)
+  {
+    return v.GetAsFloatPtr()[axis];
+  }
+
+  void SetAxis(Vector3& v, int axis, float value)
+  {
+    if (axis == 0) { v.x = value; }
+    else if (axis == 1) { v.y = value; }
+    else { v.z = value; }
+  }
+
+  Capsule ToCapsule(const ShapeInstance& capsule)
+  {
+    Vector3 axis = Vector3::Transform(Vector3::UnitZ, capsule.m_Rotation) * capsule.m_Size.y;
+    return Capsule{ LineSegment(capsule.m_Position - axis, capsule.m_Position + axis), capsule.m_Size.x };
+  }
+
+  OBB ToOBB(const ShapeInstance& box)
+  {
+    return OBB{ box.m_Position, box.m_Rotation, box.m_Size };
+  }
+
+  // copies a Collision manifold out, flipped if the shapes were swapped
+  int FromManifold(const ContactManifold& manifold, bool flip, ContactPoint* out)
+  {
+    Vector3 normal = flip ? -1.0f * manifold.m_Normal : manifold.m_Normal;
+    for (int i = 0; i < manifold.m_NumPoints; ++i)
+    {
+      out[i].m_Point = manifold.m_Points[i].m_Position;
+      out[i].m_Normal = normal;
+      out[i].m_Depth = manifold.m_Points[i].m_Depth;
+      out[i].m_Feature = manifold.m_Points[i].m_Feature;
+    }
+    return manifold.m_NumPoints;
+  }
+
+  int SphereSphere(const Vector3& centerA, float radiusA, const Vector3& centerB, float radiusB
+    , int feature, ContactPoint* out)
+  {
+    Vector3 d = centerB - centerA;
+    float distSq = d.LengthSq();
+    float reach = radiusA + radiusB + PHYS_CONTACT_MARGIN;
+    if (distSq > reach * reach)
+    {
+      return 0;
+    }
+
+    float dist = Math::Sqrt(distSq);
+    out->m_Normal = dist > 1e-6f ? d * (1.0f / dist) : Vector3::UnitZ;
+    out->m_Depth = radiusA + radiusB - dist;
+    out->m_Point = centerA + out->m_Normal * (radiusA - 0.5f * out->m_Depth);
+    out->m_Feature = feature;
+    return 1;
+  }
+
+  // normal from the sphere to the box
+  int SphereBox(const Vector3& center, float radius, const ShapeInstance& box, int feature, ContactPoint* out)
+  {
+    Vector3 local = Vector3::Transform(center - box.m_Position, Inverse(box.m_Rotation));
+    const Vector3& e = box.m_Size;
+    Vector3 clamped(Math::Clamp(local.x, -e.x, e.x), Math::Clamp(local.y, -e.y, e.y)
+      , Math::Clamp(local.z, -e.z, e.z));
+
+    Vector3 normalLocal = Vector3::Zero;
+    Vector3 surface = clamped;
+    float depth;
+    bool inside = local.x == clamped.x && local.y == clamped.y && local.z == clamped.z;
+    if (inside)
+    {
+      // center inside the box, out through the nearest face
+      int axis = 0;
+      float best = Math::Infinity;
+      for (int i = 0; i < 3; ++i)
+      {
+        float pen = GetAxis(e, i) - Math::Abs(GetAxis(local, i));
+        if (pen < best)
+        {
+          best = pen;
+          axis = i;
+        }
+      }
+      float sign = GetAxis(local, axis) >= 0.0f ? 1.0f : -1.0f;
+      SetAxis(normalLocal, axis, sign);
+      SetAxis(surface, axis, sign * GetAxis(e, axis));
+      depth = radius + best;
+    }
+    else
+    {
+      Vector3 diff = local - clamped;
+      float distSq = diff.LengthSq();
+      float reach = radius + PHYS_CONTACT_MARGIN;
+      if (distSq > reach * reach)
+      {
+        return 0;
+      }
+      float dist = Math::Sqrt(distSq);
+      normalLocal = diff * (1.0f / dist);
+      depth = radius - dist;
+    }
+
+    // normalLocal points from the box out to the sphere
+    out->m_Normal = -1.0f * Vector3::Transform(normalLocal, box.m_Rotation);
+    out->m_Point = box.m_Position + Vector3::Transform(surface, box.m_Rotation);
+    out->m_Depth = depth;
+    out->m_Feature = feature;
+    return 1;
+  }
+
+  int BoxBox(const ShapeInstance& a, const ShapeInstance& b, ContactPoint* out)
+  {
+    ContactManifold manifold;
+    if (!Intersect(ToOBB(a), ToOBB(b), manifold, PHYS_CONTACT_MARGIN))
+    {
+      return 0;
+    }
+    return FromManifold(manifold, false, out);
+  }
+
+  int SphereCapsule(const ShapeInstance& sphere, const ShapeInstance& capsule, ContactPoint* out)
+  {
+    Vector3 closest = ToCapsule(capsule).m_Segment.ClosestPoint(sphere.m_Position);
+    return SphereSphere(sphere.m_Position, sphere.m_Size.x, closest, capsule.m_Size.x, 0, out);
+  }
+
+  int BoxCapsule(const ShapeInstance& box, const ShapeInstance& capsule, ContactPoint* out)
+  {
+    ContactManifold manifold;
+    if (!Intersect(ToCapsule(capsule), ToOBB(box), manifold, PHYS_CONTACT_MARGIN))
+    {
+      return 0;
+    }
+    // the manifold's normal is from the capsule to the box
+    return FromManifold(manifold, true, out);
+  }
+
+  int CapsuleCapsule(const ShapeInstance& a, const ShapeInstance& b, ContactPoint* out)
+  {
+    Capsule capsuleA = ToCapsule(a);
+    Capsule capsuleB = ToCapsule(b);
+    const LineSegment& segA = capsuleA.m_Segment;
+    const LineSegment& segB = capsuleB.m_Segment;
+
+    // side by side, support both ends so it doesn't roll on one point
+    Vector3 dirA = segA.m_End - segA.m_Start;
+    Vector3 dirB = segB.m_End - segB.m_Start;
+    float crossSq = Vector3::Cross(dirA, dirB).LengthSq();
+    if (crossSq < 1e-4f * dirA.LengthSq() * dirB.LengthSq())
+    {
+      int count = 0;
+      count += SphereSphere(segA.m_Start, a.m_Size.x, segB.ClosestPoint(segA.m_Start), b.m_Size.x, 0, out + count);
+      count += SphereSphere(segA.m_End, a.m_Size.x, segB.ClosestPoint(segA.m_End), b.m_Size.x, 1, out + count);
+      if (count > 0)
+      {
+        return count;
+      }
+    }
+
+    Vector3 closestA;
+    Vector3 closestB;
+    LineSegment::ClosestPoints(segA, segB, closestA, closestB);
+    return SphereSphere(closestA, a.m_Size.x, closestB, b.m_Size.x, 2, out);
+  }
+
+  // contact points between two shapes, normals from a to b
+  int Collide(const ShapeInstance& a, const ShapeInstance& b, ContactPoint* out)
+  {
+    if (a.m_Type > b.m_Type)
+    {
+      int count = Collide(b, a, out);
+      for (int i = 0; i < count; ++i)
+      {
+        out[i].m_Normal = -1.0f * out[i].m_Normal;
+      }
+      return count;
+    }
+
+    switch (a.m_Type)
+    {
+    case RigidBodySystem::E_Sphere:
+      if (b.m_Type == RigidBodySystem::E_Sphere)
+      {
+        return SphereSphere(a.m_Position, a.m_Size.x, b.m_Position, b.m_Size.x, 0, out);
+      }
+      if (b.m_Type == RigidBodySystem::E_Box)
+      {
+        return SphereBox(a.m_Position, a.m_Size.x, b, 0, out);
+      }
+      return SphereCapsule(a, b, out);
+    case RigidBodySystem::E_Box:
+      if (b.m_Type == RigidBodySystem::E_Box)
+      {
+        return BoxBox(a, b, out);
+      }
+      return BoxCapsule(a, b, out);
+    default:
+      return CapsuleCapsule(a, b, out);
+    }
+  }
+
+  bool KeyLess(int a1, int b1, int f1, int a2, int b2, int f2)
+  {
+    if (a1 != a2) { return a1 < a2; }
+    if (b1 != b2) { return b1 < b2; }
+    return f1 < f2;
+  }
+}
+
+RigidBodySystem::RigidBodySystem()
+{
+}
+
+int RigidBodySystem::AddBody(const ShapeDesc& shape, float mass, const Vector3& position
+  , const Quaternion& rotation, void* userData)
+{
+  int handle;
+  if (!m_FreeHandles.empty())
+  {
+    handle = m_FreeHandles.back();
+    m_FreeHandles.pop_back();
+  }
+  else
+  {
+    handle = static_cast<int>(m_HandleToIndex.size());
+    m_HandleToIndex.emplace_back(-1);
+  }
+
+  size_t index = m_Position.size();
+  m_HandleToIndex[handle] = static_cast<int>(index);
+  m_Position.emplace_back(position);
+  m_Rotation.emplace_back(rotation);
+  m_PrevPosition.emplace_back(position);
+  m_PrevRotation.emplace_back(rotation);
+  m_LinearVelocity.emplace_back(Vector3::Zero);
+  m_AngularVelocity.emplace_back(Vector3::Zero);
+  m_InvMass.emplace_back(mass > 0.0f ? 1.0f / mass : 0.0f);
+  m_InvInertia.emplace_back(Vector3::Zero);
+  m_Shape.emplace_back(shape);
+  m_Friction.emplace_back(0.5f);
+  m_Restitution.emplace_back(0.0f);
+  m_SleepTime.emplace_back(0.0f);
+  // fixed bodies never need to be awake
+  m_Awake.emplace_back(mass > 0.0f ? 1 : 0);
+  m_Moved.emplace_back(0);
+  m_UserData.emplace_back(userData);
+  m_Handle.emplace_back(handle);
+
+  UpdateMassProperties(index);
+  m_BroadPhase.AddBox(handle, ComputeBox(index));
+  return handle;
+}
+
+void RigidBodySystem::RemoveBody(int handle)
+{
+  size_t index = m_HandleToIndex[handle];
+  size_t last = m_Position.size() - 1;
+  if (index != last)
+  {
+    // Swap to end of vector and pop off
+    m_Position[index] = m_Position[last];
+    m_Rotation[index] = m_Rotation[last];
+    m_PrevPosition[index] = m_PrevPosition[last];
+    m_PrevRotation[index] = m_PrevRotation[last];
+    m_LinearVelocity[index] = m_LinearVelocity[last];
+    m_AngularVelocity[index] = m_AngularVelocity[last];
+    m_InvMass[index] = m_InvMass[last];
+    m_InvInertia[index] = m_InvInertia[last];
+    m_Shape[index] = m_Shape[last];
+    m_Friction[index] = m_Friction[last];
+    m_Restitution[index] = m_Restitution[last];
+    m_SleepTime[index] = m_SleepTime[last];
+    m_Awake[index] = m_Awake[last];
+    m_Moved[index] = m_Moved[last];
+    m_UserData[index] = m_UserData[last];
+    m_Handle[index] = m_Handle[last];
+    m_HandleToIndex[m_Handle[index]] = static_cast<int>(index);
+  }
+  m_Position.pop_back();
+  m_Rotation.pop_back();
+  m_PrevPosition.pop_back();
+  m_PrevRotation.pop_back();
+  m_LinearVelocity.pop_back();
+  m_AngularVelocity.pop_back();
+  m_InvMass.pop_back();
+  m_InvInertia.pop_back();
+  m_Shape.pop_back();
+  m_Friction.pop_back();
+  m_Restitution.pop_back();
+  m_SleepTime.pop_back();
+  m_Awake.pop_back();
+  m_Moved.pop_back();
+  m_UserData.pop_back();
+  m_Handle.pop_back();
+
+  m_BroadPhase.RemoveBox(handle);
+  // the handle gets reused, don't warm start its next contacts from these
+  m_Cache.erase(std::remove_if(m_Cache.begin(), m_Cache.end(), [handle](const CachedImpulse& c) {
+    return c.m_KeyA == handle || c.m_KeyB == handle;
+  }), m_Cache.end());
+  m_HandleToIndex[handle] = -1;
+  m_FreeHandles.emplace_back(handle);
+}
+
+void RigidBodySystem::SetShape(int handle, const ShapeDesc& shape)
+{
+  size_t index = m_HandleToIndex[handle];
+  m_Shape[index] = shape;
+  UpdateMassProperties(index);
+  m_BroadPhase.SetBox(handle, ComputeBox(index));
+  Wake(handle);
+}
+
+void RigidBodySystem::SetMass(int handle, float mass)
+{
+  size_t index = m_HandleToIndex[handle];
+  m_InvMass[index] = mass > 0.0f ? 1.0f / mass : 0.0f;
+  UpdateMassProperties(index);
+  if (mass > 0.0f)
+  {
+    Wake(handle);
+  }
+  else
+  {
+    m_Awake[index] = 0;
+    m_LinearVelocity[index] = Vector3::Zero;
+    m_AngularVelocity[index] = Vector3::Zero;
+  }
+}
+
+void RigidBodySystem::SetMaterial(int handle, float friction, float restitution)
+{
+  size_t index = m_HandleToIndex[handle];
+  m_Friction[index] = friction;
+  m_Restitution[index] = restitution;
+}
+
+void RigidBodySystem::SetTransform(int handle, const Vector3& position, const Quaternion& rotation)
+{
+  size_t index = m_HandleToIndex[handle];
+  m_Position[index] = position;
+  m_Rotation[index] = rotation;
+  m_PrevPosition[index] = position;
+  m_PrevRotation[index] = rotation;
+  m_BroadPhase.SetBox(handle, ComputeBox(index));
+  Wake(handle);
+}
+
+void RigidBodySystem::SetLinearVelocity(int handle, const Vector3& velocity)
+{
+  size_t index = m_HandleToIndex[handle];
+  if (m_InvMass[index] == 0.0f) { return; }
+  m_LinearVelocity[index] = velocity;
+  Wake(handle);
+}
+
+void RigidBodySystem::SetAngularVelocity(int handle, const Vector3& velocity)
+{
+  size_t index = m_HandleToIndex[handle];
+  if (m_InvMass[index] == 0.0f) { return; }
+  m_AngularVelocity[index] = velocity;
+  Wake(handle);
+}
+
+void RigidBodySystem::ApplyImpulse(int handle, const Vector3& impulse, const Vector3& point)
+{
+  size_t index = m_HandleToIndex[handle];
+  if (m_InvMass[index] == 0.0f) { return; }
+  m_LinearVelocity[index] += impulse * m_InvMass[index];
+  m_AngularVelocity[index] += ApplyInvInertia(index, Vector3::Cross(point - m_Position[index], impulse));
+  Wake(handle);
+}
+
+void RigidBodySystem::Wake(int handle)
+{
+  size_t index = m_HandleToIndex[handle];
+  if (m_InvMass[index] > 0.0f)
+  {
+    m_Awake[index] = 1;
+    m_SleepTime[index] = 0.0f;
+  }
+}
+
+const Vector3& RigidBodySystem::GetPosition(int handle) const
+{
+  return m_Position[m_HandleToIndex[handle]];
+}
+
+const Quaternion& RigidBodySystem::GetRotation(int handle) const
+{
+  return m_Rotation[m_HandleToIndex[handle]];
+}
+
+const Vector3& RigidBodySystem::GetLinearVelocity(int handle) const
+{
+  return m_LinearVelocity[m_HandleToIndex[handle]];
+}
+
+const Vector3& RigidBodySystem::GetAngularVelocity(int handle) const
+{
+  return m_AngularVelocity[m_HandleToIndex[handle]];
+}
+
+bool RigidBodySystem::IsAwake(int handle) const
+{
+  return m_Awake[m_HandleToIndex[handle]] != 0;
+}
+
+void* RigidBodySystem::GetUserData(int handle) const
+{
+  return m_UserData[m_HandleToIndex[handle]];
+}
+
+size_t RigidBodySystem::GetNumBodies() const
+{
+  return m_Position.size();
+}
+
+size_t RigidBodySystem::GetNumContacts() const
+{
+  return m_Contacts.size();
+}
+
+size_t RigidBodySystem::GetNumIslands() const
+{
+  return m_Islands.size();
+}
+
+void RigidBodySystem::BeginTick()
+{
+  m_PrevPosition = m_Position;
+  m_PrevRotation = m_Rotation;
+  for (unsigned char& moved : m_Moved)
+  {
+    moved = (moved & 1) << 1;
+  }
+}
+
+void RigidBodySystem::Step(float deltaTime, const SpatialGrid& staticBoxes, JobSystem* jobs)
+{
+  if (deltaTime <= 0.0f) { return; }
+
+  // gravity, then refit the broadphase for everything that can move
+  Vector3 gravity(0.0f, 0.0f, PHYS_GRAVITY * deltaTime);
+  for (size_t i = 0; i < m_Position.size(); ++i)
+  {
+    if (m_Awake[i])
+    {
+      m_LinearVelocity[i] += gravity;
+      m_BroadPhase.SetBox(m_Handle[i], ComputeBox(i));
+    }
+  }
+  m_BroadPhase.Update();
+  m_BroadPhase.ClearEvents();
+
+  FindContacts(staticBoxes);
+  BuildIslands();
+
+  // islands share no bodies, so each can be solved on its own thread
+  auto solve = [this, deltaTime](size_t begin, size_t end)
+  {
+    for (size_t i = begin; i < end; ++i)
+    {
+      SolveIsland(m_Islands[i], deltaTime);
+    }
+  };
+  if (jobs)
+  {
+    jobs->ParallelFor(m_Islands.size(), 1, solve);
+  }
+  else
+  {
+    solve(0, m_Islands.size());
+  }
+
+  StoreImpulses();
+}
+
+AABB RigidBodySystem::ComputeBox(size_t index) const
+{
+  const ShapeDesc& shape = m_Shape[index];
+  const Vector3& pos = m_Position[index];
+  const Quaternion& rot = m_Rotation[index];
+  Vector3 extents;
+  switch (shape.m_Type)
+  {
+  case E_Sphere:
+    extents = Vector3(shape.m_Size.x, shape.m_Size.x, shape.m_Size.x);
+    break;
+  case E_Box:
+  {
+    // rotated box extents along each world axis
+    Vector3 x = Vector3::Transform(Vector3::UnitX, rot) * shape.m_Size.x;
+    Vector3 y = Vector3::Transform(Vector3::UnitY, rot) * shape.m_Size.y;
+    Vector3 z = Vector3::Transform(Vector3::UnitZ, rot) * shape.m_Size.z;
+    extents = Vector3(Math::Abs(x.x) + Math::Abs(y.x) + Math::Abs(z.x)
+      , Math::Abs(x.y) + Math::Abs(y.y) + Math::Abs(z.y)
+      , Math::Abs(x.z) + Math::Abs(y.z) + Math::Abs(z.z));
+    break;
+  }
+  default:
+  {
+    Vector3 axis = Vector3::Transform(Vector3::UnitZ, rot) * shape.m_Size.y;
+    extents = Vector3(Math::Abs(axis.x), Math::Abs(axis.y), Math::Abs(axis.z))
+      + Vector3(shape.m_Size.x, shape.m_Size.x, shape.m_Size.x);
+    break;
+  }
+  }
+
+  // grown by the margin so speculative contacts are found
+  extents += Vector3(PHYS_CONTACT_MARGIN, PHYS_CONTACT_MARGIN, PHYS_CONTACT_MARGIN);
+  return AABB(pos - extents, pos + extents);
+}
+
+void RigidBodySystem::UpdateMassProperties(size_t index)
+{
+  float invMass = m_InvMass[index];
+  if (invMass == 0.0f)
+  {
+    m_InvInertia[index] = Vector3::Zero;
+    return;
+  }
+
+  // solid shapes, a capsule is treated as a cylinder of the same length
+  float mass = 1.0f / invMass;
+  const Vector3& size = m_Shape[index].m_Size;
+  Vector3 inertia;
+  switch (m_Shape[index].m_Type)
+  {
+  case E_Sphere:
+  {
+    float i = 0.4f * mass * size.x * size.x;
+    inertia = Vector3(i, i, i);
+    break;
+  }
+  case E_Box:
+    inertia = Vector3(size.y * size.y + size.z * size.z, size.x * size.x + size.z * size.z
+      , size.x * size.x + size.y * size.y) * (mass / 3.0f);
+    break;
+  default:
+  {
+    float length = 2.0f * (size.y + size.x);
+    float side = mass * (3.0f * size.x * size.x + length * length) / 12.0f;
+    inertia = Vector3(side, side, 0.5f * mass * size.x * size.x);
+    break;
+  }
+  }
+  m_InvInertia[index] = Vector3(1.0f / inertia.x, 1.0f / inertia.y, 1.0f / inertia.z);
+}
+
+Vector3 RigidBodySystem::ApplyInvInertia(size_t index, const Vector3& v) const
+{
+  // into body space, scale by the diagonal tensor, back out
+  const Quaternion& rot = m_Rotation[index];
+  Vector3 local = Vector3::Transform(v, Inverse(rot));
+  return Vector3::Transform(local * m_InvInertia[index], rot);
+}
+
+void RigidBodySystem::FindContacts(const SpatialGrid& staticBoxes)
+{
+  m_Contacts.clear();
+  ContactPoint points[MaxContactsPerPair];
+
+  auto addContacts = [this, &points](int a, int b, int keyB, int count)
+  {
+    float friction = b >= 0 ? Math::Sqrt(m_Friction[a] * m_Friction[b]) : m_Friction[a];
+    float restitution = b >= 0 ? Math::Max(m_Restitution[a], m_Restitution[b]) : m_Restitution[a];
+    for (int i = 0; i < count; ++i)
+    {
+      Contact c;
+      c.m_A = a;
+      c.m_B = b;
+      c.m_KeyA = m_Handle[a];
+      c.m_KeyB = keyB;
+      c.m_Feature = points[i].m_Feature;
+      c.m_Point = points[i].m_Point;
+      c.m_Normal = points[i].m_Normal;
+      c.m_Depth = points[i].m_Depth;
+      c.m_Friction = friction;
+      c.m_Restitution = restitution;
+
+      // warm start from last step's impulse on the same feature
+      c.m_NormalImpulse = 0.0f;
+      c.m_TangentImpulse1 = 0.0f;
+      c.m_TangentImpulse2 = 0.0f;
+      auto iter = std::lower_bound(m_Cache.begin(), m_Cache.end(), c, [](const CachedImpulse& cached, const Contact& key) {
+        return KeyLess(cached.m_KeyA, cached.m_KeyB, cached.m_Feature, key.m_KeyA, key.m_KeyB, key.m_Feature);
+      });
+      if (iter != m_Cache.end() && iter->m_KeyA == c.m_KeyA && iter->m_KeyB == c.m_KeyB && iter->m_Feature == c.m_Feature)
+      {
+        c.m_NormalImpulse = iter->m_NormalImpulse;
+        c.m_TangentImpulse1 = iter->m_TangentImpulse1;
+        c.m_TangentImpulse2 = iter->m_TangentImpulse2;
+      }
+      m_Contacts.emplace_back(c);
+    }
+  };
+
+  auto instance = [this](size_t index)
+  {
+    ShapeInstance shape;
+    shape.m_Type = m_Shape[index].m_Type;
+    shape.m_Position = m_Position[index];
+    shape.m_Rotation = m_Rotation[index];
+    shape.m_Size = m_Shape[index].m_Size;
+    return shape;
+  };
+
+  // body vs body, skipping pairs where neither can move
+  for (const PairCache::Pair& pair : m_BroadPhase.GetPairs().GetPairs())
+  {
+    int a = m_HandleToIndex[pair.m_A];
+    int b = m_HandleToIndex[pair.m_B];
+    if (!m_Awake[a] && !m_Awake[b])
+    {
+      continue;
+    }
+    int count = Collide(instance(a), instance(b), points);
+    addContacts(a, b, m_Handle[b], count);
+  }
+
+  // awake bodies vs the static level boxes
+  for (size_t i = 0; i < m_Position.size(); ++i)
+  {
+    if (!m_Awake[i])
+    {
+      continue;
+    }
+
+    m_StaticHits.clear();
+    staticBoxes.Query(ComputeBox(i), SpatialGrid::Static, [this](int id) {
+      m_StaticHits.emplace_back(id);
+      return true;
+    });
+    // same order every run
+    std::sort(m_StaticHits.begin(), m_StaticHits.end());
+
+    ShapeInstance body = instance(i);
+    for (int id : m_StaticHits)
+    {
+      const AABB& box = staticBoxes.GetBox(id);
+      ShapeInstance level;
+      level.m_Type = E_Box;
+      level.m_Position = (box.m_Min + box.m_Max) * 0.5f;
+      level.m_Rotation = Quaternion::Identity;
+      level.m_Size = (box.m_Max - box.m_Min) * 0.5f;
+      int count = Collide(body, level, points);
+      addContacts(static_cast<int>(i), -1, -1 - id, count);
+    }
+  }
+}
+
+int RigidBodySystem::FindRoot(int index)
+{
+  while (m_Parent[index] != index)
+  {
+    // path halving
+    m_Parent[index] = m_Parent[m_Parent[index]];
+    index = m_Parent[index];
+  }
+  return index;
+}
+
+void RigidBodySystem::BuildIslands()
+{
+  size_t numBodies = m_Position.size();
+  m_Parent.resize(numBodies);
+  for (size_t i = 0; i < numBodies; ++i)
+  {
+    m_Parent[i] = static_cast<int>(i);
+  }
+
+  // bodies touching join an island, fixed bodies don't link anything
+  for (const Contact& c : m_Contacts)
+  {
+    if (c.m_B >= 0 && m_InvMass[c.m_A] > 0.0f && m_InvMass[c.m_B] > 0.0f)
+    {
+      int rootA = FindRoot(c.m_A);
+      int rootB = FindRoot(c.m_B);
+      if (rootA != rootB)
+      {
+        m_Parent[Math::Max(rootA, rootB)] = Math::Min(rootA, rootB);
+      }
+    }
+  }
+
+  // anything awake in an island wakes the rest of it
+  m_IslandOfRoot.assign(numBodies, -1);
+  for (size_t i = 0; i < numBodies; ++i)
+  {
+    if (m_Awake[i])
+    {
+      m_IslandOfRoot[FindRoot(static_cast<int>(i))] = 0;
+    }
+  }
+  m_Islands.clear();
+  for (size_t i = 0; i < numBodies; ++i)
+  {
+    if (m_InvMass[i] == 0.0f)
+    {
+      continue;
+    }
+    int root = FindRoot(static_cast<int>(i));
+    if (m_IslandOfRoot[root] < 0)
+    {
+      continue;
+    }
+    if (!m_Awake[i])
+    {
+      m_Awake[i] = 1;
+      m_SleepTime[i] = 0.0f;
+    }
+    if (root == static_cast<int>(i))
+    {
+      m_IslandOfRoot[root] = static_cast<int>(m_Islands.size());
+      m_Islands.emplace_back(Island{ 0, 0, 0, 0 });
+    }
+  }
+  // roots come before the rest of their island (smallest index is the root),
+  // so every body's island exists by now. Count, then bucket
+  for (size_t i = 0; i < numBodies; ++i)
+  {
+    if (m_Awake[i])
+    {
+      ++m_Islands[m_IslandOfRoot[FindRoot(static_cast<int>(i))]].m_NumBodies;
+    }
+  }
+  auto contactIsland = [this](const Contact& c) {
+    int body = m_InvMass[c.m_A] > 0.0f ? c.m_A : c.m_B;
+    return m_IslandOfRoot[FindRoot(body)];
+  };
+  for (const Contact& c : m_Contacts)
+  {
+    ++m_Islands[contactIsland(c)].m_NumContacts;
+  }
+
+  size_t bodyOffset = 0;
+  size_t contactOffset = 0;
+  for (Island& island : m_Islands)
+  {
+    island.m_FirstBody = bodyOffset;
+    island.m_FirstContact = contactOffset;
+    bodyOffset += island.m_NumBodies;
+    contactOffset += island.m_NumContacts;
+    island.m_NumBodies = 0;
+    island.m_NumContacts = 0;
+  }
+
+  m_IslandBodies.resize(bodyOffset);
+  for (size_t i = 0; i < numBodies; ++i)
+  {
+    if (m_Awake[i])
+    {
+      Island& island = m_Islands[m_IslandOfRoot[FindRoot(static_cast<int>(i))]];
+      m_IslandBodies[island.m_FirstBody + island.m_NumBodies++] = static_cast<int>(i);
+    }
+  }
+
+  // contacts grouped by island, in the order they were found
+  std::vector<Contact> sorted(m_Contacts.size());
+  for (const Contact& c : m_Contacts)
+  {
+    Island& island = m_Islands[contactIsland(c)];
+    sorted[island.m_FirstContact + island.m_NumContacts++] = c;
+  }
+  m_Contacts.swap(sorted);
+}
+
+void RigidBodySystem::PrepareContact(Contact& c, float deltaTime)
+{
+  int a = c.m_A;
+  int b = c.m_B;
+  float invMassA = m_InvMass[a];
+  float invMassB = b >= 0 ? m_InvMass[b] : 0.0f;
+
+  c.m_RA = c.m_Point - m_Position[a];
+  c.m_RB = b >= 0 ? c.m_Point - m_Position[b] : Vector3::Zero;
+
+  // any two directions across the normal
+  const Vector3& n = c.m_Normal;
+  if (Math::Abs(n.x) >= 0.57735f)
+  {
+    c.m_Tangent1 = Vector3::Normalize(Vector3(n.y, -n.x, 0.0f));
+  }
+  else
+  {
+    c.m_Tangent1 = Vector3::Normalize(Vector3(0.0f, n.z, -n.y));
+  }
+  c.m_Tangent2 = Vector3::Cross(n, c.m_Tangent1);
+
+  // effective mass along a direction at the contact
+  auto effectiveMass = [&](const Vector3& dir)
+  {
+    float k = invMassA + invMassB;
+    Vector3 rnA = Vector3::Cross(c.m_RA, dir);
+    k += Vector3::Dot(rnA, ApplyInvInertia(a, rnA));
+    if (b >= 0)
+    {
+      Vector3 rnB = Vector3::Cross(c.m_RB, dir);
+      k += Vector3::Dot(rnB, ApplyInvInertia(b, rnB));
+    }
+    return k > 0.0f ? 1.0f / k : 0.0f;
+  };
+  c.m_NormalMass = effectiveMass(n);
+  c.m_TangentMass1 = effectiveMass(c.m_Tangent1);
+  c.m_TangentMass2 = effectiveMass(c.m_Tangent2);
+
+  Vector3 velA = m_LinearVelocity[a] + Vector3::Cross(m_AngularVelocity[a], c.m_RA);
+  Vector3 velB = b >= 0 ? m_LinearVelocity[b] + Vector3::Cross(m_AngularVelocity[b], c.m_RB) : Vector3::Zero;
+  float approach = Vector3::Dot(velB - velA, n);
+
+  if (c.m_Depth < 0.0f)
+  {
+    // still apart, may close the gap this step but no further
+    c.m_Bias = -c.m_Depth / deltaTime;
+  }
+  else
+  {
+    // push out what's past the slop over a few steps
+    c.m_Bias = -Baumgarte / deltaTime * Math::Max(c.m_Depth - PenetrationSlop, 0.0f);
+  }
+  if (c.m_Restitution > 0.0f && approach < -RestitutionThreshold)
+  {
+    c.m_Bias = Math::Min(c.m_Bias, 0.0f) + c.m_Restitution * approach;
+  }
+}
+
+void RigidBodySystem::SolveIsland(const Island& island, float deltaTime)
+{
+  Contact* contacts = m_Contacts.data() + island.m_FirstContact;
+  size_t numContacts = island.m_NumContacts;
+
+  auto applyImpulse = [this](const Contact& c, const Vector3& impulse)
+  {
+    // fixed bodies are shared between islands, never write to them
+    if (m_InvMass[c.m_A] > 0.0f)
+    {
+      m_LinearVelocity[c.m_A] -= impulse * m_InvMass[c.m_A];
+      m_AngularVelocity[c.m_A] -= ApplyInvInertia(c.m_A, Vector3::Cross(c.m_RA, impulse));
+    }
+    if (c.m_B >= 0 && m_InvMass[c.m_B] > 0.0f)
+    {
+      m_LinearVelocity[c.m_B] += impulse * m_InvMass[c.m_B];
+      m_AngularVelocity[c.m_B] += ApplyInvInertia(c.m_B, Vector3::Cross(c.m_RB, impulse));
+    }
+  };
+  auto relativeVelocity = [this](const Contact& c)
+  {
+    Vector3 velA = m_LinearVelocity[c.m_A] + Vector3::Cross(m_AngularVelocity[c.m_A], c.m_RA);
+    if (c.m_B < 0)
+    {
+      return -1.0f * velA;
+    }
+    return m_LinearVelocity[c.m_B] + Vector3::Cross(m_AngularVelocity[c.m_B], c.m_RB) - velA;
+  };
+
+  for (size_t i = 0; i < numContacts; ++i)
+  {
+    Contact& c = contacts[i];
+    PrepareContact(c, deltaTime);
+    applyImpulse(c, c.m_Normal * c.m_NormalImpulse + c.m_Tangent1 * c.m_TangentImpulse1
+      + c.m_Tangent2 * c.m_TangentImpulse2);
+  }
+
+  for (int iteration = 0; iteration < PHYS_SOLVER_ITERATIONS; ++iteration)
+  {
+    for (size_t i = 0; i < numContacts; ++i)
+    {
+      Contact& c = contacts[i];
+
+      // friction, limited by the current normal impulse
+      float maxFriction = c.m_Friction * c.m_NormalImpulse;
+      Vector3 dv = relativeVelocity(c);
+      float lambda = -c.m_TangentMass1 * Vector3::Dot(dv, c.m_Tangent1);
+      float old = c.m_TangentImpulse1;
+      c.m_TangentImpulse1 = Math::Clamp(old + lambda, -maxFriction, maxFriction);
+      applyImpulse(c, c.m_Tangent1 * (c.m_TangentImpulse1 - old));
+
+      dv = relativeVelocity(c);
+      lambda = -c.m_TangentMass2 * Vector3::Dot(dv, c.m_Tangent2);
+      old = c.m_TangentImpulse2;
+      c.m_TangentImpulse2 = Math::Clamp(old + lambda, -maxFriction, maxFriction);
+      applyImpulse(c, c.m_Tangent2 * (c.m_TangentImpulse2 - old));
+
+      // normal, accumulated impulse can only push
+      dv = relativeVelocity(c);
+      lambda = -c.m_NormalMass * (Vector3::Dot(dv, c.m_Normal) + c.m_Bias);
+      old = c.m_NormalImpulse;
+      c.m_NormalImpulse = Math::Max(old + lambda, 0.0f);
+      applyImpulse(c, c.m_Normal * (c.m_NormalImpulse - old));
+    }
+  }
+
+  // integrate, and put the island to sleep once all of it has settled
+  float linearDamping = 1.0f / (1.0f + deltaTime * LinearDamping);
+  float angularDamping = 1.0f / (1.0f + deltaTime * AngularDamping);
+  float minSleepTime = Math::Infinity;
+  const int* bodies = m_IslandBodies.data() + island.m_FirstBody;
+  for (size_t i = 0; i < island.m_NumBodies; ++i)
+  {
+    int b = bodies[i];
+    Vector3& v = m_LinearVelocity[b];
+    Vector3& w = m_AngularVelocity[b];
+    v *= linearDamping;
+    w *= angularDamping;
+
+    m_Position[b] += v * deltaTime;
+    // q += 0.5 * (w, 0) * q * dt
+    Quaternion& q = m_Rotation[b];
+    Vector3 qv(q.x, q.y, q.z);
+    Vector3 dv = (q.w * w + Vector3::Cross(w, qv)) * (0.5f * deltaTime);
+    float dw = -0.5f * deltaTime * Vector3::Dot(w, qv);
+    q = Quaternion(q.x + dv.x, q.y + dv.y, q.z + dv.z, q.w + dw);
+    q.Normalize();
+    m_Moved[b] |= 1;
+
+    if (v.LengthSq() < SleepLinearSpeed * SleepLinearSpeed
+      && w.LengthSq() < SleepAngularSpeed * SleepAngularSpeed)
+    {
+      m_SleepTime[b] += deltaTime;
+    }
+    else
+    {
+      m_SleepTime[b] = 0.0f;
+    }
+    minSleepTime = Math::Min(minSleepTime, m_SleepTime[b]);
+  }
+
+  if (minSleepTime >= TimeToSleep)
+  {
+    for (size_t i = 0; i < island.m_NumBodies; ++i)
+    {
+      int b = bodies[i];
+      m_Awake[b] = 0;
+      m_LinearVelocity[b] = Vector3::Zero;
+      m_AngularVelocity[b] = Vector3::Zero;
+    }
+  }
+}
+
+void RigidBodySystem::StoreImpulses()
+{
+  m_Cache.clear();
+  for (const Contact& c : m_Contacts)
+  {
+    m_Cache.emplace_back(CachedImpulse{ c.m_KeyA, c.m_KeyB, c.m_Feature
+      , c.m_NormalImpulse, c.m_TangentImpulse1, c.m_TangentImpulse2 });
+  }
+  std::sort(m_Cache.begin(), m_Cache.end(), [](const CachedImpulse& a, const CachedImpulse& b) {
+    return KeyLess(a.m_KeyA, a.m_KeyB, a.m_Feature, b.m_KeyA, b.m_KeyB, b.m_Feature);
+  });
+}
@@ -0,0 +1,189 @@
+#pragma once
+
+#include "Math.h"
+#include "Collision.h"
+#include "SweepAndPrune.h"
+#include <cstdint>
+#include <vector>
+
+// rigid body dynamics for PhysWorld: contact generation between bodies and
+// against the static boxes in the PhysWorld grid, a sequential impulse
+// solver with warm starting, and islands that sleep once they come to rest.
+// Body state is stored one array per field and islands touch disjoint
+// bodies, so islands are solved in parallel on the job system.
+// Bodies are identified by handles that stay valid until RemoveBody
+class RigidBodySystem
+{
+public:
+  enum ShapeType { E_Sphere, E_Box, E_Capsule };
+
+  // sphere: m_Size.x is the radius
+  // box: m_Size is the half extents
+  // capsule: m_Size.x is the radius, m_Size.y half the length of the
+  // segment, which runs along the body's local z
+  struct ShapeDesc
+  {
+    ShapeType m_Type;
+    Vector3 m_Size;
+  };
+
+  RigidBodySystem();
+
+  // mass 0 makes a fixed body, it collides but never moves
+  int AddBody(const ShapeDesc& shape, float mass, const Vector3& position
+    , const Quaternion& rotation, void* userData);
+  void RemoveBody(int handle);
+
+  void SetShape(int handle, const ShapeDesc& shape);
+  void SetMass(int handle, float mass);
+  void SetMaterial(int handle, float friction, float restitution);
+  // moves the body straight there and wakes it, without blending from
+  // where it was
+  void SetTransform(int handle, const Vector3& position, const Quaternion& rotation);
+  void SetLinearVelocity(int handle, const Vector3& velocity);
+  void SetAngularVelocity(int handle, const Vector3& velocity);
+  void ApplyImpulse(int handle, const Vector3& impulse, const Vector3& point);
+  void Wake(int handle);
+
+  const Vector3& GetPosition(int handle) const;
+  const Quaternion& GetRotation(int handle) const;
+  const Vector3& GetLinearVelocity(int handle) const;
+  const Vector3& GetAngularVelocity(int handle) const;
+  bool IsAwake(int handle) const;
+  void* GetUserData(int handle) const;
+
+  // call at the start of every fixed tick, before its Steps. Remembers
+  // where the bodies are, the start of the blend for ForEachInterpolated
+  void BeginTick();
+  // advances every awake body by deltaTime. staticBoxes are the static
+  // cells of the PhysWorld grid, jobs can be null to solve on this thread.
+  // Same bodies and calls in the same order give the same results
+  void Step(float deltaTime, const class SpatialGrid& staticBoxes, class JobSystem* jobs);
+
+  // calls callback(userData, position, rotation) for each body that moved
+  // in the last two ticks, blended from the start of the last tick (alpha 0)
+  // to where it is now (alpha 1)
+  template <typename Callback>
+  void ForEachInterpolated(float alpha, Callback&& callback) const;
+
+  size_t GetNumBodies() const;
+  size_t GetNumContacts() const;
+  size_t GetNumIslands() const;
+
+private:
+  struct Contact
+  {
+    // body indices, m_B is -1 against a static box
+    int m_A;
+    int m_B;
+    // warm start key: handles (or -1 - grid id for static boxes) and
+    // which feature of the shapes touched
+    int m_KeyA;
+    int m_KeyB;
+    int m_Feature;
+
+    Vector3 m_Point;
+    // from A to B
+    Vector3 m_Normal;
+    // negative while they're still apart (speculative contact)
+    float m_Depth;
+    float m_Friction;
+    float m_Restitution;
+
+    Vector3 m_RA;
+    Vector3 m_RB;
+    Vector3 m_Tangent1;
+    Vector3 m_Tangent2;
+    float m_NormalMass;
+    float m_TangentMass1;
+    float m_TangentMass2;
+    float m_Bias;
+
+    float m_NormalImpulse;
+    float m_TangentImpulse1;
+    float m_TangentImpulse2;
+  };
+
+  struct CachedImpulse
+  {
+    int m_KeyA;
+    int m_KeyB;
+    int m_Feature;
+    float m_NormalImpulse;
+    float m_TangentImpulse1;
+    float m_TangentImpulse2;
+  };
+
+  struct Island
+  {
+    // ranges into m_IslandBodies and m_Contacts
+    size_t m_FirstBody;
+    size_t m_NumBodies;
+    size_t m_FirstContact;
+    size_t m_NumContacts;
+  };
+
+  AABB ComputeBox(size_t index) const;
+  void UpdateMassProperties(size_t index);
+  Vector3 ApplyInvInertia(size_t index, const Vector3& v) const;
+
+  void FindContacts(const class SpatialGrid& staticBoxes);
+  void BuildIslands();
+  void SolveIsland(const Island& island, float deltaTime);
+  void PrepareContact(Contact& c, float deltaTime);
+  void StoreImpulses();
+
+  int FindRoot(int index);
+
+  // per body, indexed by m_HandleToIndex[handle]
+  std::vector<Vector3> m_Position;
+  std::vector<Quaternion> m_Rotation;
+  // as of BeginTick
+  std::vector<Vector3> m_PrevPosition;
+  std::vector<Quaternion> m_PrevRotation;
+  std::vector<Vector3> m_LinearVelocity;
+  std::vector<Vector3> m_AngularVelocity;
+  std::vector<float> m_InvMass;
+  // diagonal of the inverse inertia tensor in body space
+  std::vector<Vector3> m_InvInertia;
+  std::vector<ShapeDesc> m_Shape;
+  std::vector<float> m_Friction;
+  std::vector<float> m_Restitution;
+  std::vector<float> m_SleepTime;
+  std::vector<unsigned char> m_Awake;
+  // bit 0 moved this tick, bit 1 moved last tick
+  std::vector<unsigned char> m_Moved;
+  std::vector<void*> m_UserData;
+  std::vector<int> m_Handle;
+
+  std::vector<int> m_HandleToIndex;
+  std::vector<int> m_FreeHandles;
+
+  // body vs body candidates, ids are handles
+  SweepAndPrune m_BroadPhase;
+
+  std::vector<Contact> m_Contacts;
+  // last step's impulses sorted by key, matched to new contacts
+  std::vector<CachedImpulse> m_Cache;
+  std::vector<int> m_StaticHits;
+
+  // union find parent per body, then bodies grouped by island
+  std::vector<int> m_Parent;
+  std::vector<int> m_IslandBodies;
+  std::vector<Island> m_Islands;
+  std::vector<int> m_IslandOfRoot;
+};
+
+template <typename Callback>
+void RigidBodySystem::ForEachInterpolated(float alpha, Callback&& callback) const
+{
+  for (size_t i = 0; i < m_Position.size(); ++i)
+  {
+    // bodies that stopped last tick still finish their blend this tick
+    if (m_Moved[i])
+    {
+      callback(m_UserData[i], Vector3::Lerp(m_PrevPosition[i], m_Position[i], alpha)
+        , Quaternion::Slerp(m_PrevRotation[i], m_Rotation[i], alpha));
+    }
+  }
+}
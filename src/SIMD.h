@@ -0,0 +1,10 @@
+#pragma once
+
+// SSE is used by the batch kernels (animation, skinning, collision) when the
+// target has it, every kernel keeps a scalar path for other targets
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define USE_SSE 1
+#include <emmintrin.h>
+#else
+#define USE_SSE 0
+#endif
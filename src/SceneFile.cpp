@@ -0,0 +1,707 @@
+#include "SceneFile.h"
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <fstream>
+#include <sstream>
+#include "include/rapidjson/document.h"
+#include <SDL2/SDL_log.h>
+
+namespace
+{
+  const char SCENE_MAGIC[4] = { 'G', 'P', 'S', 'C' };
+  const uint32_t SCENE_VERSION = 1;
+  const char* COOKED_EXTENSION = ".gpscenebin";
+
+  const char* ACTOR_TYPE_NAMES[SceneFile::E_NumActorTypes] =
+    { "Actor", "PlaneActor", "TargetActor", "FollowActor", "FPSActor" };
+  const char* COMPONENT_TYPE_NAMES[SceneFile::E_NumComponentTypes] =
+    { "MeshComponent", "SpriteComponent" };
+
+  // actor record flags in the cooked file
+  const uint8_t ACTOR_STATIC       = 1 << 0;
+  const uint8_t ACTOR_HAS_ROTATION = 1 << 1;
+  const uint8_t ACTOR_HAS_SCALE    = 1 << 2;
+  const uint8_t ACTOR_HAS_POSITION = 1 << 3;
+
+  // the cooked file is written and read as raw little endian values
+  template <typename T>
+  void Write(std::string& out, const T& value)
+  {
+    out.append(reinterpret_cast<const char*>(&value), sizeof(T));
+  }
+
+  void WriteVector3(std::string& out, const Vector3& v)
+  {
+    Write(out, v.x);
+    Write(out, v.y);
+    Write(out, v.z);
+  }
+
+  struct Reader
+  {
+    const char* m_Data;
+    size_t m_Size;
+    size_t m_Pos;
+    bool m_Ok;
+
+    template <typename T>
+    T Read()
+    {
+      T value = T();
+      if (m_Pos + sizeof(T) > m_Size)
+      {
+        m_Ok = false;
+        return value;
+      }
+      memcpy(&value, m_Data + m_Pos, sizeof(T));
+      m_Pos += sizeof(T);
+      return value;
+    }
+
+    Vector3 ReadVector3()
+    {
+      float x = Read<float>();
+      float y = Read<float>();
+      float z = Read<float>();
+      return Vector3(x, y, z);
+    }
+  };
+
+  bool ReadFile(const std::string& fileName, std::string& outContents)
+  {
+    std::ifstream file(fileName);
+    if (!file.is_open())
+    {
+      return false;
+    }
+    std::stringstream fileStream;
+    fileStream << file.rdbuf();
+    outContents = fileStream.str();
+    return true;
+  }
+
+  bool GetVector3(const rapidjson::Value& obj, const char* name, Vector3& out)
+  {
+    auto it = obj.FindMember(name);
+    if (it == obj.MemberEnd() || !it->value.IsArray() || it->value.Size() != 3)
+    {
+      return false;
+    }
+    const rapidjson::Value& v = it->value;
+    out = Vector3(static_cast<float>(v[0].GetDouble())
+      , static_cast<float>(v[1].GetDouble())
+      , static_cast<float>(v[2].GetDouble()));
+    return true;
+  }
+
+  float GetFloat(const rapidjson::Value& obj, const char* name, float def)
+  {
+    auto it = obj.FindMember(name);
+    if (it == obj.MemberEnd() || !it->value.IsNumber())
+    {
+      return def;
+    }
+    return static_cast<float>(it->value.GetDouble());
+  }
+
+  int GetInt(const rapidjson::Value& obj, const char* name, int def)
+  {
+    auto it = obj.FindMember(name);
+    if (it == obj.MemberEnd() || !it->value.IsInt())
+    {
+      return def;
+    }
+    return it->value.GetInt();
+  }
+
+  bool GetBool(const rapidjson::Value& obj, const char* name, bool def)
+  {
+    auto it = obj.FindMember(name);
+    if (it == obj.MemberEnd() || !it->value.IsBool())
+    {
+      return def;
+    }
+    return it->value.GetBool();
+  }
+
+  template <size_t N>
+  int FindName(const char* const (&names)[N], const char* name)
+  {
+    for (size_t i = 0; i < N; ++i)
+    {
+      if (strcmp(names[i], name) == 0)
+      {
+        return static_cast<int>(i);
+      }
+    }
+    return -1;
+  }
+
+  void WriteActor(std::string& out, const SceneFile::ActorDesc& actor)
+  {
+    uint8_t flags = 0;
+    flags |= actor.m_Static ? ACTOR_STATIC : 0;
+    flags |= actor.m_HasRotation ? ACTOR_HAS_ROTATION : 0;
+    flags |= actor.m_HasScale ? ACTOR_HAS_SCALE : 0;
+    flags |= actor.m_HasPosition ? ACTOR_HAS_POSITION : 0;
+    Write(out, static_cast<uint8_t>(actor.m_Type));
+    Write(out, flags);
+    Write(out, static_cast<uint16_t>(actor.m_Components.size()));
+    WriteVector3(out, actor.m_Position);
+    Write(out, actor.m_Rotation.x);
+    Write(out, actor.m_Rotation.y);
+    Write(out, actor.m_Rotation.z);
+    Write(out, actor.m_Rotation.w);
+    Write(out, actor.m_Scale);
+    for (const SceneFile::ComponentDesc& comp : actor.m_Components)
+    {
+      Write(out, static_cast<uint8_t>(comp.m_Type));
+      Write(out, static_cast<int32_t>(comp.m_Asset));
+      Write(out, static_cast<int32_t>(comp.m_Value));
+    }
+  }
+
+  bool ReadActor(Reader& in, size_t numAssets, SceneFile::ActorDesc& outActor)
+  {
+    uint8_t type = in.Read<uint8_t>();
+    uint8_t flags = in.Read<uint8_t>();
+    uint16_t numComps = in.Read<uint16_t>();
+    outActor.m_Type = static_cast<SceneFile::ActorType>(type);
+    outActor.m_Static = (flags & ACTOR_STATIC) != 0;
+    outActor.m_HasRotation = (flags & ACTOR_HAS_ROTATION) != 0;
+    outActor.m_HasScale = (flags & ACTOR_HAS_SCALE) != 0;
+    outActor.m_HasPosition = (flags & ACTOR_HAS_POSITION) != 0;
+    outActor.m_Position = in.ReadVector3();
+    outActor.m_Rotation.x = in.Read<float>();
+    outActor.m_Rotation.y = in.Read<float>();
+    outActor.m_Rotation.z = in.Read<float>();
+    outActor.m_Rotation.w = in.Read<float>();
+    outActor.m_Scale = in.Read<float>();
+    if (type >= SceneFile::E_NumActorTypes)
+    {
+      return false;
+    }
+
+    outActor.m_Components.resize(numComps);
+    for (SceneFile::ComponentDesc& comp : outActor.m_Components)
+    {
+      uint8_t compType = in.Read<uint8_t>();
+      comp.m_Type = static_cast<SceneFile::ComponentType>(compType);
+      comp.m_Asset = in.Read<int32_t>();
+      comp.m_Value = in.Read<int32_t>();
+      if (compType >= SceneFile::E_NumComponentTypes
+        || comp.m_Asset < -1 || comp.m_Asset >= static_cast<int>(numAssets))
+      {
+        return false;
+      }
+    }
+    return in.m_Ok;
+  }
+}
+
+SceneFile::SceneFile()
+  : m_Cooked(false)
+{
+  Clear();
+}
+
+bool SceneFile::Load(const std::string& fileName)
+{
+  size_t extLen = strlen(COOKED_EXTENSION);
+  if (fileName.size() > extLen
+    && fileName.compare(fileName.size() - extLen, extLen, COOKED_EXTENSION) == 0)
+  {
+    return LoadBinary(fileName);
+  }
+  return LoadJson(fileName);
+}
+
+bool SceneFile::LoadJson(const std::string& fileName)
+{
+  Clear();
+
+  std::string contents;
+  if (!ReadFile(fileName, contents))
+  {
+    SDL_Log("File not found: Scene %s", fileName.c_str());
+    return false;
+  }
+  rapidjson::StringStream jsonStr(contents.c_str());
+  rapidjson::Document doc;
+  doc.ParseStream(jsonStr);
+
+  if (!doc.IsObject())
+  {
+    SDL_Log("Scene %s is not valid json", fileName.c_str());
+    return false;
+  }
+
+  if (GetInt(doc, "version", 0) != static_cast<int>(SCENE_VERSION))
+  {
+    SDL_Log("Scene %s unknown format", fileName.c_str());
+    return false;
+  }
+
+  m_CellSize = GetFloat(doc, "cellSize", m_CellSize);
+  if (m_CellSize <= 0.0f)
+  {
+    SDL_Log("Scene %s has an invalid cell size", fileName.c_str());
+    return false;
+  }
+
+  auto lights = doc.FindMember("lights");
+  if (lights != doc.MemberEnd() && lights->value.IsObject())
+  {
+    const rapidjson::Value& l = lights->value;
+    GetVector3(l, "ambient", m_AmbientLight);
+    auto dir = l.FindMember("directional");
+    if (dir != l.MemberEnd() && dir->value.IsObject())
+    {
+      GetVector3(dir->value, "direction", m_LightDirection);
+      GetVector3(dir->value, "diffuseColor", m_LightDiffuseColor);
+      GetVector3(dir->value, "specColor", m_LightSpecColor);
+    }
+    auto points = l.FindMember("point");
+    if (points != l.MemberEnd() && points->value.IsArray())
+    {
+      for (rapidjson::SizeType i = 0; i < points->value.Size(); i++)
+      {
+        const rapidjson::Value& p = points->value[i];
+        PointLightDesc light;
+        light.m_Position = Vector3::Zero;
+        light.m_DiffuseColor = Vector3::Zero;
+        light.m_SpecColor = Vector3::Zero;
+        if (!p.IsObject() || !GetVector3(p, "position", light.m_Position))
+        {
+          SDL_Log("Scene %s: point light %d is invalid", fileName.c_str(), i);
+          return false;
+        }
+        GetVector3(p, "diffuseColor", light.m_DiffuseColor);
+        GetVector3(p, "specColor", light.m_SpecColor);
+        light.m_SpecPower = GetFloat(p, "specPower", 1.0f);
+        light.m_Radius = GetFloat(p, "radius", 1000.0f);
+        m_PointLights.emplace_back(light);
+      }
+    }
+  }
+
+  auto actorsMember = doc.FindMember("actors");
+  if (actorsMember == doc.MemberEnd() || !actorsMember->value.IsArray())
+  {
+    SDL_Log("Scene %s doesn't have an actor array", fileName.c_str());
+    return false;
+  }
+  const rapidjson::Value& actors = actorsMember->value;
+
+  std::vector<ActorDesc> descs;
+  std::vector<bool> global;
+  descs.reserve(actors.Size());
+  global.reserve(actors.Size());
+  for (rapidjson::SizeType i = 0; i < actors.Size(); i++)
+  {
+    const rapidjson::Value& a = actors[i];
+    auto type = a.IsObject() ? a.FindMember("type") : a.MemberEnd();
+    int typeIndex = (type != a.MemberEnd() && type->value.IsString())
+      ? FindName(ACTOR_TYPE_NAMES, type->value.GetString()) : -1;
+    if (typeIndex < 0)
+    {
+      SDL_Log("Scene %s: actor %d has an unknown type", fileName.c_str(), i);
+      return false;
+    }
+
+    ActorDesc desc;
+    desc.m_Type = static_cast<ActorType>(typeIndex);
+    desc.m_Static = GetBool(a, "static", false);
+    desc.m_Position = Vector3::Zero;
+    desc.m_HasPosition = GetVector3(a, "position", desc.m_Position);
+    desc.m_Rotation = Quaternion::Identity;
+    auto rot = a.FindMember("rotation");
+    desc.m_HasRotation = rot != a.MemberEnd() && rot->value.IsArray() && rot->value.Size() == 4;
+    if (desc.m_HasRotation)
+    {
+      // x, y, z, w
+      desc.m_Rotation = Quaternion(static_cast<float>(rot->value[0].GetDouble())
+        , static_cast<float>(rot->value[1].GetDouble())
+        , static_cast<float>(rot->value[2].GetDouble())
+        , static_cast<float>(rot->value[3].GetDouble()));
+    }
+    desc.m_Scale = GetFloat(a, "scale", 1.0f);
+    desc.m_HasScale = a.HasMember("scale");
+
+    auto comps = a.FindMember("components");
+    if (comps != a.MemberEnd() && comps->value.IsArray())
+    {
+      for (rapidjson::SizeType c = 0; c < comps->value.Size(); c++)
+      {
+        const rapidjson::Value& cv = comps->value[c];
+        auto compType = cv.IsObject() ? cv.FindMember("type") : cv.MemberEnd();
+        int compIndex = (compType != cv.MemberEnd() && compType->value.IsString())
+          ? FindName(COMPONENT_TYPE_NAMES, compType->value.GetString()) : -1;
+        if (compIndex < 0)
+        {
+          SDL_Log("Scene %s: actor %d component %d has an unknown type", fileName.c_str(), i, c);
+          return false;
+        }
+
+        ComponentDesc comp;
+        comp.m_Type = static_cast<ComponentType>(compIndex);
+        const char* assetKey = comp.m_Type == E_MeshComponent ? "mesh" : "texture";
+        auto asset = cv.FindMember(assetKey);
+        comp.m_Asset = (asset != cv.MemberEnd() && asset->value.IsString())
+          ? AddAsset(asset->value.GetString()) : -1;
+        comp.m_Value = comp.m_Type == E_MeshComponent
+          ? GetInt(cv, "textureIndex", 0)
+          : GetInt(cv, "drawOrder", 100);
+        desc.m_Components.emplace_back(comp);
+      }
+    }
+
+    descs.emplace_back(std::move(desc));
+    global.push_back(GetBool(a, "global", false));
+  }
+
+  BuildSections(descs, global);
+  m_FileName = fileName;
+  m_Cooked = false;
+  return true;
+}
+
+bool SceneFile::LoadBinary(const std::string& fileName)
+{
+  Clear();
+
+  // only the tables are read here, sections stay on disk
+  std::ifstream file(fileName, std::ios::in | std::ios::binary);
+  if (!file.is_open())
+  {
+    SDL_Log("File not found: Scene %s", fileName.c_str());
+    return false;
+  }
+
+  char magic[4];
+  uint32_t version = 0;
+  uint32_t headerSize = 0;
+  file.read(magic, sizeof(magic));
+  file.read(reinterpret_cast<char*>(&version), sizeof(version));
+  file.read(reinterpret_cast<char*>(&headerSize), sizeof(headerSize));
+  if (!file || memcmp(magic, SCENE_MAGIC, sizeof(magic)) != 0 || version != SCENE_VERSION)
+  {
+    SDL_Log("Scene %s unknown format", fileName.c_str());
+    return false;
+  }
+
+  std::string header(headerSize, '\0');
+  file.read(&header[0], headerSize);
+  if (!file)
+  {
+    SDL_Log("Scene %s is truncated", fileName.c_str());
+    return false;
+  }
+
+  Reader in{ header.data(), header.size(), 0, true };
+  m_CellSize = in.Read<float>();
+  m_AmbientLight = in.ReadVector3();
+  m_LightDirection = in.ReadVector3();
+  m_LightDiffuseColor = in.ReadVector3();
+  m_LightSpecColor = in.ReadVector3();
+  uint32_t numLights = in.Read<uint32_t>();
+  for (uint32_t i = 0; i < numLights && in.m_Ok; ++i)
+  {
+    PointLightDesc light;
+    light.m_Position = in.ReadVector3();
+    light.m_DiffuseColor = in.ReadVector3();
+    light.m_SpecColor = in.ReadVector3();
+    light.m_SpecPower = in.Read<float>();
+    light.m_Radius = in.Read<float>();
+    m_PointLights.emplace_back(light);
+  }
+
+  uint32_t numAssets = in.Read<uint32_t>();
+  for (uint32_t i = 0; i < numAssets && in.m_Ok; ++i)
+  {
+    uint32_t len = in.Read<uint32_t>();
+    if (in.m_Pos + len > in.m_Size)
+    {
+      in.m_Ok = false;
+      break;
+    }
+    m_Assets.emplace_back(in.m_Data + in.m_Pos, len);
+    in.m_Pos += len;
+  }
+
+  uint32_t numSections = in.Read<uint32_t>();
+  for (uint32_t i = 0; i < numSections && in.m_Ok; ++i)
+  {
+    Section section;
+    section.m_CellX = in.Read<int32_t>();
+    section.m_CellY = in.Read<int32_t>();
+    section.m_Global = in.Read<uint8_t>() != 0;
+    section.m_NumActors = in.Read<uint32_t>();
+    section.m_Offset = in.Read<uint64_t>();
+    section.m_Size = in.Read<uint64_t>();
+    m_Sections.emplace_back(section);
+  }
+
+  if (!in.m_Ok || m_Sections.empty() || !m_Sections[0].m_Global || m_CellSize <= 0.0f)
+  {
+    SDL_Log("Scene %s has an invalid header", fileName.c_str());
+    Clear();
+    return false;
+  }
+
+  m_FileName = fileName;
+  m_Cooked = true;
+  return true;
+}
+
+bool SceneFile::SaveBinary(const std::string& fileName) const
+{
+  if (m_Cooked)
+  {
+    SDL_Log("Scene %s is already cooked", m_FileName.c_str());
+    return false;
+  }
+
+  // section blocks first, their offsets go in the header
+  std::vector<std::string> blocks(m_Sections.size());
+  for (size_t i = 0; i < m_Sections.size(); ++i)
+  {
+    const Section& section = m_Sections[i];
+    for (uint64_t a = section.m_Offset; a < section.m_Offset + section.m_NumActors; ++a)
+    {
+      WriteActor(blocks[i], m_Actors[a]);
+    }
+  }
+
+  std::string header;
+  Write(header, m_CellSize);
+  WriteVector3(header, m_AmbientLight);
+  WriteVector3(header, m_LightDirection);
+  WriteVector3(header, m_LightDiffuseColor);
+  WriteVector3(header, m_LightSpecColor);
+  Write(header, static_cast<uint32_t>(m_PointLights.size()));
+  for (const PointLightDesc& light : m_PointLights)
+  {
+    WriteVector3(header, light.m_Position);
+    WriteVector3(header, light.m_DiffuseColor);
+    WriteVector3(header, light.m_SpecColor);
+    Write(header, light.m_SpecPower);
+    Write(header, light.m_Radius);
+  }
+  Write(header, static_cast<uint32_t>(m_Assets.size()));
+  for (const std::string& asset : m_Assets)
+  {
+    Write(header, static_cast<uint32_t>(asset.size()));
+    header.append(asset);
+  }
+
+  // the section table has a fixed size, so offsets are known up front
+  const size_t sectionEntrySize = 4 + 4 + 1 + 4 + 8 + 8;
+  uint64_t offset = sizeof(SCENE_MAGIC) + sizeof(uint32_t) * 2 + header.size()
+    + sizeof(uint32_t) + sectionEntrySize * m_Sections.size();
+  Write(header, static_cast<uint32_t>(m_Sections.size()));
+  for (size_t i = 0; i < m_Sections.size(); ++i)
+  {
+    const Section& section = m_Sections[i];
+    Write(header, static_cast<int32_t>(section.m_CellX));
+    Write(header, static_cast<int32_t>(section.m_CellY));
+    Write(header, static_cast<uint8_t>(section.m_Global ? 1 : 0));
+    Write(header, section.m_NumActors);
+    Write(header, offset);
+    Write(header, static_cast<uint64_t>(blocks[i].size()));
+    offset += blocks[i].size();
+  }
+
+  std::ofstream file(fileName, std::ios::out | std::ios::binary | std::ios::trunc);
+  if (!file.is_open())
+  {
+    SDL_Log("Can't write scene %s", fileName.c_str());
+    return false;
+  }
+  file.write(SCENE_MAGIC, sizeof(SCENE_MAGIC));
+  file.write(reinterpret_cast<const char*>(&SCENE_VERSION), sizeof(SCENE_VERSION));
+  uint32_t headerSize = static_cast<uint32_t>(header.size());
+  file.write(reinterpret_cast<const char*>(&headerSize), sizeof(headerSize));
+  file.write(header.data(), header.size());
+  for (const std::string& block : blocks)
+  {
+    file.write(block.data(), block.size());
+  }
+  if (!file)
+  {
+    SDL_Log("Failed writing scene %s", fileName.c_str());
+    return false;
+  }
+  return true;
+}
+
+bool SceneFile::Cook(const std::string& inFile, const std::string& outFile)
+{
+  SceneFile scene;
+  if (!scene.LoadJson(inFile) || !scene.SaveBinary(outFile))
+  {
+    return false;
+  }
+  SDL_Log("Cooked scene %s: %d actors in %d sections, %d assets"
+    , outFile.c_str()
+    , static_cast<int>(scene.m_Actors.size())
+    , static_cast<int>(scene.m_Sections.size())
+    , static_cast<int>(scene.m_Assets.size()));
+  return true;
+}
+
+size_t SceneFile::GetNumSections() const
+{
+  return m_Sections.size();
+}
+
+const SceneFile::Section& SceneFile::GetSection(size_t index) const
+{
+  return m_Sections[index];
+}
+
+int SceneFile::FindSection(int cellX, int cellY) const
+{
+  // cells are sorted after the global section
+  auto first = m_Sections.begin() + (m_Sections.empty() ? 0 : 1);
+  auto it = std::lower_bound(first, m_Sections.end(), cellX, [cellY](const Section& s, int x) {
+    return s.m_CellY != cellY ? s.m_CellY < cellY : s.m_CellX < x;
+  });
+  if (it == m_Sections.end() || it->m_CellX != cellX || it->m_CellY != cellY)
+  {
+    return -1;
+  }
+  return static_cast<int>(it - m_Sections.begin());
+}
+
+float SceneFile::GetCellSize() const
+{
+  return m_CellSize;
+}
+
+void SceneFile::GetCell(const Vector3& pos, int& outCellX, int& outCellY) const
+{
+  outCellX = static_cast<int>(std::floor(pos.x / m_CellSize));
+  outCellY = static_cast<int>(std::floor(pos.y / m_CellSize));
+}
+
+bool SceneFile::ReadSection(size_t index, std::vector<ActorDesc>& outActors) const
+{
+  if (index >= m_Sections.size())
+  {
+    return false;
+  }
+  const Section& section = m_Sections[index];
+
+  if (!m_Cooked)
+  {
+    outActors.insert(outActors.end()
+      , m_Actors.begin() + section.m_Offset
+      , m_Actors.begin() + section.m_Offset + section.m_NumActors);
+    return true;
+  }
+
+  std::ifstream file(m_FileName, std::ios::in | std::ios::binary);
+  std::string block(section.m_Size, '\0');
+  if (file.is_open())
+  {
+    file.seekg(section.m_Offset);
+    file.read(&block[0], block.size());
+  }
+  if (!file)
+  {
+    SDL_Log("Scene %s: can't read section %d", m_FileName.c_str(), static_cast<int>(index));
+    return false;
+  }
+
+  Reader in{ block.data(), block.size(), 0, true };
+  size_t first = outActors.size();
+  outActors.resize(first + section.m_NumActors);
+  for (size_t i = first; i < outActors.size(); ++i)
+  {
+    if (!ReadActor(in, m_Assets.size(), outActors[i]))
+    {
+      SDL_Log("Scene %s: section %d is corrupt", m_FileName.c_str(), static_cast<int>(index));
+      outActors.resize(first);
+      return false;
+    }
+  }
+  return true;
+}
+
+const std::string& SceneFile::GetAsset(int index) const
+{
+  return m_Assets[index];
+}
+
+void SceneFile::Clear()
+{
+  m_FileName.clear();
+  m_Cooked = false;
+  m_CellSize = 1000.0f;
+  m_AmbientLight = Vector3::Zero;
+  m_LightDirection = Vector3::NegUnitZ;
+  m_LightDiffuseColor = Vector3::Zero;
+  m_LightSpecColor = Vector3::Zero;
+  m_PointLights.clear();
+  m_Assets.clear();
+  m_Sections.clear();
+  m_Actors.clear();
+}
+
+int SceneFile::AddAsset(const std::string& name)
+{
+  auto it = std::find(m_Assets.begin(), m_Assets.end(), name);
+  if (it != m_Assets.end())
+  {
+    return static_cast<int>(it - m_Assets.begin());
+  }
+  m_Assets.emplace_back(name);
+  return static_cast<int>(m_Assets.size() - 1);
+}
+
+void SceneFile::BuildSections(std::vector<ActorDesc>& actors, const std::vector<bool>& global)
+{
+  struct Keyed
+  {
+    int m_CellX;
+    int m_CellY;
+    bool m_Global;
+    size_t m_Index;
+  };
+  std::vector<Keyed> keys(actors.size());
+  for (size_t i = 0; i < actors.size(); ++i)
+  {
+    keys[i].m_Global = global[i];
+    keys[i].m_Index = i;
+    GetCell(actors[i].m_Position, keys[i].m_CellX, keys[i].m_CellY);
+  }
+
+  // global first, then cells by y then x, file order inside a section
+  std::stable_sort(keys.begin(), keys.end(), [](const Keyed& a, const Keyed& b) {
+    if (a.m_Global != b.m_Global)
+    {
+      return a.m_Global;
+    }
+    if (a.m_Global)
+    {
+      return false;
+    }
+    return a.m_CellY != b.m_CellY ? a.m_CellY < b.m_CellY : a.m_CellX < b.m_CellX;
+  });
+
+  // the global section is always there, even if empty
+  m_Sections.push_back(Section{ 0, 0, true, 0, 0, 0 });
+  m_Actors.reserve(actors.size());
+  for (const Keyed& key : keys)
+  {
+    Section& last = m_Sections.back();
+    if (!key.m_Global && (last.m_Global || last.m_CellX != key.m_CellX || last.m_CellY != key.m_CellY))
+    {
+      m_Sections.push_back(Section{ key.m_CellX, key.m_CellY, false, 0, m_Actors.size(), 0 });
+    }
+    m_Sections.back().m_NumActors++;
+    m_Actors.emplace_back(std::move(actors[key.m_Index]));
+  }
+}
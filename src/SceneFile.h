@@ -0,0 +1,113 @@
+#pragma once
+
+#include "Math.h"
+#include <cstdint>
+#include <string>
+#include <vector>
+
+// a level as data: lights plus the actors to create, each with a type,
+// transform and components. Authored as json (.gpscene) and cooked to a
+// binary file (.gpscenebin) for shipping. Actors are split into sections,
+// one global section (player, HUD) and one per cellSize x cellSize cell
+// in x/y holding the actors positioned in it. A cooked file only reads
+// its tables on Load, each section is read from disk when it's asked for
+class SceneFile
+{
+public:
+  enum ActorType { E_Actor, E_PlaneActor, E_TargetActor, E_FollowActor, E_FPSActor, E_NumActorTypes };
+  enum ComponentType { E_MeshComponent, E_SpriteComponent, E_NumComponentTypes };
+
+  struct ComponentDesc
+  {
+    ComponentType m_Type;
+    // index into GetAsset, mesh or texture file, -1 for none
+    int m_Asset;
+    // mesh: texture index, sprite: draw order
+    int m_Value;
+  };
+
+  struct ActorDesc
+  {
+    ActorType m_Type;
+    bool m_Static;
+    // otherwise what the actor type's constructor set is kept
+    bool m_HasPosition;
+    bool m_HasRotation;
+    bool m_HasScale;
+    Vector3 m_Position;
+    Quaternion m_Rotation;
+    float m_Scale;
+    std::vector<ComponentDesc> m_Components;
+  };
+
+  struct PointLightDesc
+  {
+    Vector3 m_Position;
+    Vector3 m_DiffuseColor;
+    Vector3 m_SpecColor;
+    float m_SpecPower;
+    float m_Radius;
+  };
+
+  struct Section
+  {
+    int m_CellX;
+    int m_CellY;
+    bool m_Global;
+    uint32_t m_NumActors;
+    // where its actors are, in the cooked file or in m_Actors
+    uint64_t m_Offset;
+    uint64_t m_Size;
+  };
+
+  SceneFile();
+
+  // .gpscenebin files are read as cooked, anything else as json
+  bool Load(const std::string& fileName);
+  bool LoadJson(const std::string& fileName);
+  bool LoadBinary(const std::string& fileName);
+  bool SaveBinary(const std::string& fileName) const;
+  // json in, cooked binary out
+  static bool Cook(const std::string& inFile, const std::string& outFile);
+
+  // section 0 is the global one, the rest are cells sorted by y then x
+  size_t GetNumSections() const;
+  const Section& GetSection(size_t index) const;
+  // -1 if no actors are in that cell
+  int FindSection(int cellX, int cellY) const;
+  float GetCellSize() const;
+  void GetCell(const Vector3& pos, int& outCellX, int& outCellY) const;
+
+  // appends one section's actors. Only reads the file (each call opens its
+  // own stream) or const data, so it's safe to call from other threads
+  bool ReadSection(size_t index, std::vector<ActorDesc>& outActors) const;
+
+  const std::string& GetAsset(int index) const;
+
+  const Vector3& GetAmbientLight() const { return m_AmbientLight; }
+  const Vector3& GetLightDirection() const { return m_LightDirection; }
+  const Vector3& GetLightDiffuseColor() const { return m_LightDiffuseColor; }
+  const Vector3& GetLightSpecColor() const { return m_LightSpecColor; }
+  const std::vector<PointLightDesc>& GetPointLights() const { return m_PointLights; }
+
+private:
+  void Clear();
+  int AddAsset(const std::string& name);
+  // sorts actors into sections, for scenes loaded from json
+  void BuildSections(std::vector<ActorDesc>& actors, const std::vector<bool>& global);
+
+  std::string m_FileName;
+  bool m_Cooked;
+
+  float m_CellSize;
+  Vector3 m_AmbientLight;
+  Vector3 m_LightDirection;
+  Vector3 m_LightDiffuseColor;
+  Vector3 m_LightSpecColor;
+  std::vector<PointLightDesc> m_PointLights;
+
+  std::vector<std::string> m_Assets;
+  std::vector<Section> m_Sections;
+  // every actor in section order, json scenes only
+  std::vector<ActorDesc> m_Actors;
+};
@@ -0,0 +1,327 @@
+#include "SceneLoader.h"
+#include "Game.h"
+#include "Renderer.h"
+#include "PhysWorld.h"
+#include "Actor.h"
+#include "PlaneActor.h"
+#include "TargetActor.h"
+#include "FollowActor.h"
+#include "FPSActor.h"
+#include "MeshComponent.h"
+#include "SpriteComponent.h"
+#include "JobSystem.h"
+
+#include <algorithm>
+#include <fstream>
+#include <thread>
+#include <SDL2/SDL.h>
+
+SceneLoader::SceneLoader(Game* game)
+  : m_Game(game)
+  , m_ReadsInFlight(0)
+  , m_ReleaseAssets(false)
+{}
+
+SceneLoader::~SceneLoader()
+{
+  WaitForReads();
+}
+
+bool SceneLoader::Open(const std::string& fileName)
+{
+  WaitForReads();
+  m_Requests.clear();
+  m_Unloads.clear();
+  m_ReleaseAssets = false;
+
+  std::string cooked = fileName + "bin";
+  bool loaded = std::ifstream(cooked).good() && m_Scene.LoadBinary(cooked);
+  if (!loaded && !m_Scene.Load(fileName))
+  {
+    m_States.clear();
+    m_SectionActors.clear();
+    return false;
+  }
+  m_States.assign(m_Scene.GetNumSections(), E_Unloaded);
+  m_SectionActors.assign(m_Scene.GetNumSections(), std::vector<Actor*>());
+
+  ApplyLights();
+  return true;
+}
+
+void SceneLoader::QueueSection(size_t index)
+{
+  if (index >= m_States.size() || m_States[index] != E_Unloaded)
+  {
+    return;
+  }
+  m_States[index] = E_Loading;
+
+  std::shared_ptr<Request> request = std::make_shared<Request>();
+  request->m_Index = index;
+  request->m_Next = 0;
+  request->m_Ok = false;
+  request->m_HasStatic = false;
+  request->m_Ready = false;
+  m_Requests.emplace_back(request);
+
+  // the read only touches the request and the (const) scene tables
+  ++m_ReadsInFlight;
+  m_Game->GetJobSystem()->Submit([this, request]() {
+    request->m_Ok = m_Scene.ReadSection(request->m_Index, request->m_Actors);
+    request->m_Ready.store(true, std::memory_order_release);
+    --m_ReadsInFlight;
+  });
+}
+
+void SceneLoader::UnloadSection(size_t index)
+{
+  if (index >= m_States.size()
+    || m_States[index] == E_Unloaded || m_States[index] == E_Unloading)
+  {
+    return;
+  }
+
+  // a read still running keeps its request alive until it's done
+  m_Requests.erase(std::remove_if(m_Requests.begin(), m_Requests.end(),
+    [index](const std::shared_ptr<Request>& r) { return r->m_Index == index; }), m_Requests.end());
+
+  // its batched static meshes go now, rather than being rebuilt as each
+  // of its actors is deleted, and its boxes leave the broadphases as one
+  // batch rather than one box per deleted actor
+  m_Game->GetRenderer()->DropStaticSection(static_cast<int>(index));
+  m_Game->GetPhysWorld()->RemoveSectionBoxes(static_cast<int>(index));
+  m_States[index] = E_Unloading;
+  m_Unloads.emplace_back(index);
+}
+
+SceneLoader::SectionState SceneLoader::GetSectionState(size_t index) const
+{
+  return index < m_States.size() ? m_States[index] : E_Unloaded;
+}
+
+void SceneLoader::Update(float budgetSeconds)
+{
+  Uint64 start = SDL_GetPerformanceCounter();
+  Uint64 budget = static_cast<Uint64>(budgetSeconds * SDL_GetPerformanceFrequency());
+
+  bool worked = false;
+  while (!worked || SDL_GetPerformanceCounter() - start < budget)
+  {
+    if (!Step())
+    {
+      break;
+    }
+    worked = true;
+  }
+
+  if (m_ReleaseAssets && m_Unloads.empty())
+  {
+    m_Game->GetRenderer()->UnloadUnusedAssets();
+    m_ReleaseAssets = false;
+  }
+}
+
+void SceneLoader::LoadQueued()
+{
+  WaitForReads();
+  while (Step())
+  {}
+}
+
+bool SceneLoader::IsLoading() const
+{
+  return !m_Requests.empty() || !m_Unloads.empty();
+}
+
+void SceneLoader::RemoveActor(Actor* actor)
+{
+  int section = actor->GetSceneSection();
+  if (section < 0 || section >= static_cast<int>(m_SectionActors.size()))
+  {
+    return;
+  }
+  std::vector<Actor*>& actors = m_SectionActors[section];
+  // unloading deletes from the back, so look there first
+  auto it = std::find(actors.rbegin(), actors.rend(), actor);
+  if (it != actors.rend())
+  {
+    std::iter_swap(it, actors.rbegin());
+    actors.pop_back();
+  }
+}
+
+const SceneFile& SceneLoader::GetScene() const
+{
+  return m_Scene;
+}
+
+bool SceneLoader::Step()
+{
+  // unloads first, they free what new sections will need
+  if (!m_Unloads.empty())
+  {
+    size_t index = m_Unloads.front();
+    std::vector<Actor*>& actors = m_SectionActors[index];
+    if (actors.empty())
+    {
+      m_States[index] = E_Unloaded;
+      m_Unloads.erase(m_Unloads.begin());
+      m_ReleaseAssets = true;
+    }
+    else
+    {
+      // takes itself out of the list through Game::RemoveActor
+      delete actors.back();
+    }
+    return true;
+  }
+
+  for (size_t i = 0; i < m_Requests.size(); ++i)
+  {
+    Request& request = *m_Requests[i];
+    if (!request.m_Ready.load(std::memory_order_acquire))
+    {
+      continue;
+    }
+    if (!request.m_Ok || request.m_Next == request.m_Actors.size())
+    {
+      FinishRequest(i);
+      return true;
+    }
+
+    Actor* actor = CreateActor(request.m_Actors[request.m_Next++]);
+    actor->SetSceneSection(static_cast<int>(request.m_Index));
+    m_SectionActors[request.m_Index].emplace_back(actor);
+    // placed right away, static ones are drawn and collide one by one
+    // until FinishRequest batches them
+    actor->ComputeWorldTransform();
+    if (actor->IsStatic())
+    {
+      request.m_HasStatic = true;
+    }
+    return true;
+  }
+  return false;
+}
+
+void SceneLoader::FinishRequest(size_t requestIndex)
+{
+  std::shared_ptr<Request> request = m_Requests[requestIndex];
+  m_Requests.erase(m_Requests.begin() + requestIndex);
+  m_States[request->m_Index] = E_Loaded;
+
+  // merge any static meshes the section brought in
+  if (request->m_HasStatic)
+  {
+    m_Game->BuildStaticGeometry(m_SectionActors[request->m_Index]);
+  }
+}
+
+void SceneLoader::WaitForReads()
+{
+  while (m_ReadsInFlight > 0)
+  {
+    std::this_thread::yield();
+  }
+}
+
+Actor* SceneLoader::CreateActor(const SceneFile::ActorDesc& desc)
+{
+  Actor* actor = nullptr;
+  switch (desc.m_Type)
+  {
+    case SceneFile::E_PlaneActor:
+      actor = new PlaneActor(m_Game);
+      break;
+    case SceneFile::E_TargetActor:
+      actor = new TargetActor(m_Game);
+      break;
+    case SceneFile::E_FollowActor:
+      actor = new FollowActor(m_Game);
+      break;
+    case SceneFile::E_FPSActor:
+      actor = new FPSActor(m_Game);
+      break;
+    default:
+      actor = new Actor(m_Game);
+      break;
+  }
+
+  if (desc.m_HasPosition)
+  {
+    actor->SetPosition(desc.m_Position);
+  }
+  if (desc.m_HasRotation)
+  {
+    actor->SetRotation(desc.m_Rotation);
+  }
+  if (desc.m_HasScale)
+  {
+    actor->SetScale(desc.m_Scale);
+  }
+  if (desc.m_Static)
+  {
+    actor->SetStatic(true);
+  }
+
+  Renderer* renderer = m_Game->GetRenderer();
+  for (const SceneFile::ComponentDesc& comp : desc.m_Components)
+  {
+    if (comp.m_Type == SceneFile::E_MeshComponent)
+    {
+      MeshComponent* mc = new MeshComponent(actor);
+      if (comp.m_Asset >= 0)
+      {
+        mc->SetMesh(renderer->GetMesh(m_Scene.GetAsset(comp.m_Asset)));
+      }
+      mc->SetTextureIndex(static_cast<size_t>(comp.m_Value));
+    }
+    else if (comp.m_Type == SceneFile::E_SpriteComponent)
+    {
+      SpriteComponent* sc = new SpriteComponent(actor, comp.m_Value);
+      if (comp.m_Asset >= 0)
+      {
+        sc->SetTexture(renderer->GetTexture(m_Scene.GetAsset(comp.m_Asset)));
+      }
+    }
+  }
+  return actor;
+}
+
+void SceneLoader::ApplyLights()
+{
+  Renderer* renderer = m_Game->GetRenderer();
+  renderer->SetAmbientLight(m_Scene.GetAmbientLight());
+  DirectionalLight& dir = renderer->GetDirectionalLight();
+  dir.m_Direction = m_Scene.GetLightDirection();
+  dir.m_DiffuseColor = m_Scene.GetLightDiffuseColor();
+  dir.m_SpecColor = m_Scene.GetLightSpecColor();
+
+  // the renderer has a fixed set of point lights, extra ones are dropped
+  // and unused ones switched off
+  std::vector<PointLight*> pointLights = renderer->GetPointLights();
+  const std::vector<SceneFile::PointLightDesc>& descs = m_Scene.GetPointLights();
+  for (size_t i = 0; i < pointLights.size(); ++i)
+  {
+    PointLight* light = pointLights[i];
+    if (i < descs.size())
+    {
+      light->m_Pos = descs[i].m_Position;
+      light->m_DiffuseColor = descs[i].m_DiffuseColor;
+      light->m_SpecColor = descs[i].m_SpecColor;
+      light->m_SpecPower = descs[i].m_SpecPower;
+      light->m_RadiusInfluence = descs[i].m_Radius;
+    }
+    else
+    {
+      light->m_DiffuseColor = Vector3::Zero;
+      light->m_SpecColor = Vector3::Zero;
+    }
+  }
+  if (descs.size() > pointLights.size())
+  {
+    SDL_Log("Scene has %d point lights, only %d are used"
+      , static_cast<int>(descs.size()), static_cast<int>(pointLights.size()));
+  }
+}
@@ -0,0 +1,77 @@
+#pragma once
+
+#include "SceneFile.h"
+#include <atomic>
+#include <memory>
+#include <string>
+#include <vector>
+
+// creates and destroys a SceneFile's actors a section at a time. Queued
+// sections are read from disk on JobSystem workers, then each Update
+// creates (or deletes, for unloaded sections) actors until its time
+// budget is spent, so a level comes in and goes out over several frames
+class SceneLoader
+{
+public:
+  enum SectionState { E_Unloaded, E_Loading, E_Loaded, E_Unloading };
+
+  SceneLoader(class Game* game);
+  // waits for reads still running on workers
+  ~SceneLoader();
+
+  // reads the scene's tables and sets the renderer's lights. A cooked
+  // .gpscenebin next to a json scene is used instead of it
+  bool Open(const std::string& fileName);
+
+  // starts reading an unloaded section, ignored in any other state
+  void QueueSection(size_t index);
+  // drops a section's pending read or its actors, loaded or not
+  void UnloadSection(size_t index);
+  SectionState GetSectionState(size_t index) const;
+
+  // deletes / creates actors for up to budgetSeconds, always doing at
+  // least one if there's work that's ready
+  void Update(float budgetSeconds);
+  // waits for every queued read and creates all of it, for level start
+  void LoadQueued();
+  bool IsLoading() const;
+
+  // Game lets us know when an actor we made is deleted by anyone else
+  void RemoveActor(class Actor* actor);
+
+  const SceneFile& GetScene() const;
+
+private:
+  struct Request
+  {
+    size_t m_Index;
+    std::vector<SceneFile::ActorDesc> m_Actors;
+    size_t m_Next;
+    bool m_Ok;
+    bool m_HasStatic;
+    // set by the worker once m_Actors is filled in
+    std::atomic<bool> m_Ready;
+  };
+
+  class Actor* CreateActor(const SceneFile::ActorDesc& desc);
+  // one step of work, false if nothing is ready
+  bool Step();
+  void FinishRequest(size_t requestIndex);
+  void WaitForReads();
+  void ApplyLights();
+
+  class Game* m_Game;
+  SceneFile m_Scene;
+
+  std::vector<SectionState> m_States;
+  // actors alive per section, deleted from the back when unloading
+  std::vector<std::vector<class Actor*>> m_SectionActors;
+
+  // in the order they were queued, shared with the worker reading them
+  std::vector<std::shared_ptr<Request>> m_Requests;
+  std::vector<size_t> m_Unloads;
+  // reads submitted and not finished, the scene must outlive them
+  std::atomic<int> m_ReadsInFlight;
+  // something was unloaded, free unused assets once unloads are done
+  bool m_ReleaseAssets;
+};
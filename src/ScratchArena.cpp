@@ -0,0 +1,37 @@
+#include "ScratchArena.h"
+
+#include <cstdint>
+#include <SDL2/SDL_log.h>
+
+ScratchArena::ScratchArena(size_t capacity)
+  :m_Buffer(capacity)
+  , m_Offset(0)
+  , m_HighWater(0)
+{}
+
+void* ScratchArena::Allocate(size_t size, size_t alignment)
+{
+  // align the actual address, the vector's storage only guarantees max_align_t
+  uintptr_t base = reinterpret_cast<uintptr_t>(m_Buffer.data());
+  uintptr_t aligned = (base + m_Offset + alignment - 1) & ~static_cast<uintptr_t>(alignment - 1);
+  size_t begin = static_cast<size_t>(aligned - base);
+
+  if (begin + size > m_Buffer.size())
+  {
+    SDL_Log("ScratchArena out of space (%zu of %zu bytes)", begin + size, m_Buffer.size());
+    return nullptr;
+  }
+
+  m_Offset = begin + size;
+  if (m_Offset > m_HighWater)
+  {
+    m_HighWater = m_Offset;
+  }
+  return m_Buffer.data() + begin;
+}
+
+size_t ScratchArena::GetMarker() const { return m_Offset; }
+void ScratchArena::Rewind(size_t marker) { m_Offset = marker; }
+void ScratchArena::Reset() { m_Offset = 0; }
+size_t ScratchArena::GetCapacity() const { return m_Buffer.size(); }
+size_t ScratchArena::GetHighWater() const { return m_HighWater; }
@@ -0,0 +1,30 @@
+#pragma once
+
+#include <cstddef>
+#include <vector>
+
+// linear allocator for short lived per-frame data (intermediate poses etc.)
+// allocations are released all at once by rewinding to a marker,
+// nothing is ever freed individually and nothing is constructed
+class ScratchArena
+{
+public:
+  ScratchArena(size_t capacity = 64 * 1024);
+
+  // returns nullptr if the arena is out of space
+  void* Allocate(size_t size, size_t alignment = 16);
+
+  // save the current position and later release everything allocated since
+  size_t GetMarker() const;
+  void Rewind(size_t marker);
+  void Reset();
+
+  size_t GetCapacity() const;
+  // most bytes ever in use at once (for sizing the arena)
+  size_t GetHighWater() const;
+
+private:
+  std::vector<unsigned char> m_Buffer;
+  size_t m_Offset;
+  size_t m_HighWater;
+};
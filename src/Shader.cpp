@@ -88,6 +88,13 @@ void Shader::SetFloatUniform(const char* name, float value)
 	glUniform1f(loc, value);
 }
 
+void Shader::SetIntUniform(const char* name, int value)
+{
+	GLuint loc = glGetUniformLocation(m_ShaderProgram, name);
+	// Send the int data (also used for sampler units)
+	glUniform1i(loc, value);
+}
+
 
 bool Shader::CompileShader(const std::string& fileName, GLenum shaderType, GLuint& outShader)
 {
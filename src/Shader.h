@@ -24,6 +24,7 @@ public:
   void SetMatrixUniforms(const char* name, Matrix4* matrices, unsigned count);
   void SetVectorUniform(const char* name, const Vector3& vector);
   void SetFloatUniform(const char* name, float value);
+  void SetIntUniform(const char* name, int value);
 
   const std::string& GetShaderName() const;
 private:
@@ -1,86 +1,302 @@
 #include "SkeletalMeshComponent.h"
-#include "Shader.h"
-#include "Mesh.h"
 #include "Actor.h"
 #include "Game.h"
-#include "Renderer.h"
-#include "Texture.h"
-#include "VertexArray.h"
 #include "Skeleton.h"
 #include "Animation.h"
+#include "AnimationSystem.h"
+#include "LocalPose.h"
+#include "BoneMask.h"
+#include "ScratchArena.h"
+#include "CpuSkinning.h"
+#include "Mesh.h"
+
+#include <cstring>
+#include <SDL2/SDL.h>
 
 SkeletalMeshComponent::SkeletalMeshComponent(class Actor* owner)
   :MeshComponent(owner, true)
-{}
+  , m_Skeleton(nullptr)
+  , m_PoseCacheValid(false)
+  , m_Animation(nullptr)
+  , m_AnimPlayRate(1.0f)
+  , m_AnimTime(0.0f)
+  , m_PrevAnimation(nullptr)
+  , m_PrevAnimPlayRate(1.0f)
+  , m_PrevAnimTime(0.0f)
+  , m_BlendTime(0.0f)
+  , m_BlendElapsed(0.0f)
+  , m_LoggedFallback(false)
+{
+  for (AnimLayer& layer : m_Layers)
+  {
+    layer.m_Animation = nullptr;
+    layer.m_Mask = nullptr;
+    layer.m_Weight = 0.0f;
+    layer.m_PlayRate = 1.0f;
+    layer.m_Time = 0.0f;
+    layer.m_Additive = false;
+  }
+  m_Owner->GetGame()->GetAnimationSystem()->AddSkeletalMesh(this);
+}
+
+SkeletalMeshComponent::~SkeletalMeshComponent()
+{
+  m_Owner->GetGame()->GetAnimationSystem()->RemoveSkeletalMesh(this);
+}
+
+namespace
+{
+  // advances an animation time, wrapping around at the clip's duration
+  void AdvanceAnimTime(float& time, float deltaTime, float playRate, const Animation* anim)
+  {
+    time += deltaTime * playRate;
+    while (time > anim->GetDuration())
+    {
+      time -= anim->GetDuration();
+    }
+  }
+}
 
 void SkeletalMeshComponent::Update(float deltaTime)
 {
   if(m_Animation && m_Skeleton)
   {
-    m_AnimTime += deltaTime * m_AnimPlayRate;
+    AdvanceAnimTime(m_AnimTime, deltaTime, m_AnimPlayRate, m_Animation);
 
-    // wrap around anim time if past duration
-    while(m_AnimTime > m_Animation->GetDuration())
+    // fade out the previous clip, it keeps playing until it's gone
+    if (m_PrevAnimation)
     {
-      m_AnimTime -= m_Animation->GetDuration();
+      m_BlendElapsed += deltaTime;
+      if (m_BlendElapsed >= m_BlendTime)
+      {
+        m_PrevAnimation = nullptr;
+      }
+      else
+      {
+        AdvanceAnimTime(m_PrevAnimTime, deltaTime, m_PrevAnimPlayRate, m_PrevAnimation);
+      }
     }
 
-    // recompute matrix palette
-    ComputeMatrixPalette();
+    for (AnimLayer& layer : m_Layers)
+    {
+      if (layer.m_Animation)
+      {
+        AdvanceAnimTime(layer.m_Time, deltaTime, layer.m_PlayRate, layer.m_Animation);
+      }
+    }
+
+    // matrix palette is recomputed in a batch by the AnimationSystem
   }
 }
 
-void SkeletalMeshComponent::Draw(class Shader* shader)
+void SkeletalMeshComponent::ComputeMatrixPalette()
+{
+  ComputeMatrixPalette(m_AnimTime);
+}
+
+void SkeletalMeshComponent::ComputeMatrixPalette(float inTime)
 {
-  if (m_Mesh)
+  // intermediate poses live in this thread's scratch arena
+  // and are released again before returning
+  ScratchArena& arena = m_Owner->GetGame()->GetAnimationSystem()->GetScratchArena();
+  size_t marker = arena.GetMarker();
+  size_t numBones = m_Skeleton->GetNumBones();
+
+  // a clip made for another skeleton would be sampled past the pose
+  if (m_Animation->GetNumBones() != numBones)
   {
-    // Set the world transform
-    shader->SetMatrixUniform("uWorldTransform", m_Owner->GetWorldTransform());
+    FallBackToBindPose("animation and skeleton bone counts differ");
+    return;
+  }
 
-    // Set the matrix palette
-    shader->SetMatrixUniforms("uMatrixPalette", &m_Palette.m_Entry[0], MAX_SKELETON_BONES);
+  // blend everything in local space, one hierarchy pass at the end
+  LocalPose pose;
+  LocalPose layerPose;
+  LocalPose refPose;
+  if (!pose.Allocate(arena, numBones) || !layerPose.Allocate(arena, numBones)
+    || !refPose.Allocate(arena, numBones))
+  {
+    arena.Rewind(marker);
+    FallBackToBindPose("scratch arena is out of space for the poses");
+    return;
+  }
+
+  m_Animation->SampleLocalPose(inTime, pose);
+
+  if (m_PrevAnimation && m_PrevAnimation->GetNumBones() == numBones)
+  {
+    m_PrevAnimation->SampleLocalPose(m_PrevAnimTime, layerPose);
+    LocalPose::Blend(layerPose, pose, m_BlendElapsed / m_BlendTime, nullptr, pose);
+  }
 
-    // Set specular power
-    shader->SetFloatUniform("uSpecPower", m_Mesh->GetSpecPower());
-    // Set the active texture
-    Texture* t = m_Mesh->GetTexture(m_TextureIndex);
-    if (t)
+  bool partial = false;
+  for (const AnimLayer& layer : m_Layers)
+  {
+    if (!layer.m_Animation || layer.m_Weight <= 0.0f
+      || layer.m_Animation->GetNumBones() != numBones)
+    {
+      continue;
+    }
+    partial = partial || layer.m_Mask || layer.m_Additive;
+
+    const float* boneWeights = layer.m_Mask ? layer.m_Mask->GetWeights() : nullptr;
+    layer.m_Animation->SampleLocalPose(layer.m_Time, layerPose);
+    if (layer.m_Additive)
+    {
+      layer.m_Animation->SampleLocalPose(0.0f, refPose);
+      LocalPose::Additive(pose, layerPose, refPose, layer.m_Weight, boneWeights, pose);
+    }
+    else
     {
-      t->SetActive();
+      LocalPose::Blend(pose, layerPose, layer.m_Weight, boneWeights, pose);
     }
-    // Set the mesh's vertex array as active
-    VertexArray* va = m_Mesh->GetVertexArray();
-    va->SetActive();
-    // Draw
-    glDrawElements(GL_TRIANGLES, va->GetNumIndices(), GL_UNSIGNED_INT, nullptr);
   }
+
+  // a clip playing on its own moves (nearly) every bone, comparing them
+  // first costs more than it skips. Layers can leave parts of the rig still,
+  // then only bones that moved (or whose parent moved) are recomputed
+  if (!partial)
+  {
+    LocalPose::ToGlobal(m_Skeleton, pose, m_GlobalPose, nullptr, nullptr);
+    arena.Rewind(marker);
+    m_GlobalPose.ToPalette(m_Skeleton, nullptr, m_Palette.m_Entry);
+    if (m_PoseCacheValid)
+    {
+      m_CachedLocalPose.Invalidate();
+      m_PoseCacheValid = false;
+    }
+    return;
+  }
+
+  unsigned char dirty[MAX_SKELETON_BONES];
+  LocalPose::ToGlobal(m_Skeleton, pose, m_GlobalPose, &m_CachedLocalPose, dirty);
+  m_PoseCacheValid = true;
+  arena.Rewind(marker);
+
+  // setup the palette for each bone that changed
+  m_GlobalPose.ToPalette(m_Skeleton, dirty, m_Palette.m_Entry);
 }
 
-void SkeletalMeshComponent::ComputeMatrixPalette()
+void SkeletalMeshComponent::FallBackToBindPose(const char* reason)
 {
-  const std::vector<Matrix4>& globalInvBindPoses = m_Skeleton->GetGlobalInvBindPoses();
-  std::vector<Matrix4> currentPoses;
-  m_Animation->GetGlobalPoseAtTime(currentPoses, m_Skeleton, m_AnimTime);
+  if (!m_LoggedFallback)
+  {
+    SDL_Log("Skeletal mesh can't be animated (%s), drawing the bind pose", reason);
+    m_LoggedFallback = true;
+  }
 
-  // setup the palette for each bone
-  for(size_t i = 0; i < m_Skeleton->GetNumBones(); ++i)
+  // every bone at its bind pose leaves the vertices where they are
+  size_t numBones = m_Skeleton->GetNumBones();
+  for (size_t i = 0; i < numBones; ++i)
   {
-    // global inverse bind pose matrix times current pose matrix
-    m_Palette.m_Entry[i] = globalInvBindPoses[i] * currentPoses[i];
+    m_Palette.m_Entry[i] = Matrix4::Identity;
+  }
+  if (m_PoseCacheValid)
+  {
+    m_CachedLocalPose.Invalidate();
+    m_PoseCacheValid = false;
   }
 }
 
-float SkeletalMeshComponent::PlayAnimation(const Animation* anim, float playRate)
+bool SkeletalMeshComponent::SkinVertices(std::vector<Vector3>& outPositions
+  , std::vector<Vector3>* outNormals) const
 {
+  if (!m_Mesh || m_Mesh->GetNumSkinVertices() == 0) { return false; }
+
+  size_t numVerts = m_Mesh->GetNumSkinVertices();
+  outPositions.resize(numVerts);
+  if (outNormals)
+  {
+    outNormals->resize(numVerts);
+  }
+  CpuSkinning::SkinVertices(m_Mesh->GetSkinVertices().data(), numVerts, m_Palette.m_Entry
+    , outPositions.data(), outNormals ? outNormals->data() : nullptr);
+  return true;
+}
+
+void SkeletalMeshComponent::CopyPalette(const SkeletalMeshComponent& other)
+{
+  size_t numBones = m_Skeleton ? m_Skeleton->GetNumBones() : MAX_SKELETON_BONES;
+  memcpy(m_Palette.m_Entry, other.m_Palette.m_Entry, numBones * sizeof(Matrix4));
+  // the palette no longer matches our cached pose
+  if (m_PoseCacheStorage.size() > 0)
+  {
+    m_CachedLocalPose.Invalidate();
+    m_PoseCacheValid = false;
+  }
+}
+
+float SkeletalMeshComponent::PlayAnimation(const Animation* anim, float playRate, float blendTime)
+{
+  // fade from the clip that was playing (if we'd already started it)
+  if (blendTime > 0.0f && m_Animation && m_Animation != anim)
+  {
+    m_PrevAnimation = m_Animation;
+    m_PrevAnimPlayRate = m_AnimPlayRate;
+    m_PrevAnimTime = m_AnimTime;
+    m_BlendTime = blendTime;
+    m_BlendElapsed = 0.0f;
+  }
+  else
+  {
+    m_PrevAnimation = nullptr;
+  }
+
   m_Animation = anim;
   m_AnimTime = 0.0f;
   m_AnimPlayRate = playRate;
+  m_LoggedFallback = false;
 
-  if (!m_Animation) { return 0.0f; }
+  if (!m_Animation || !m_Skeleton) { return 0.0f; }
   ComputeMatrixPalette();
 
   return m_Animation->GetDuration();
 }
 
+void SkeletalMeshComponent::SetLayer(size_t layer, const Animation* anim, float weight
+  , const BoneMask* mask, bool additive, float playRate)
+{
+  if (layer >= MAX_ANIM_LAYERS) { return; }
+
+  AnimLayer& l = m_Layers[layer];
+  l.m_Animation = anim;
+  l.m_Mask = mask;
+  l.m_Weight = weight;
+  l.m_PlayRate = playRate;
+  l.m_Time = 0.0f;
+  l.m_Additive = additive;
+}
+
+void SkeletalMeshComponent::SetLayerWeight(size_t layer, float weight)
+{
+  if (layer >= MAX_ANIM_LAYERS) { return; }
+  m_Layers[layer].m_Weight = weight;
+}
+
+void SkeletalMeshComponent::ClearLayer(size_t layer)
+{
+  SetLayer(layer, nullptr, 0.0f);
+}
+
+bool SkeletalMeshComponent::IsBlending() const
+{
+  if (m_PrevAnimation) { return true; }
+  for (const AnimLayer& layer : m_Layers)
+  {
+    if (layer.m_Animation && layer.m_Weight > 0.0f) { return true; }
+  }
+  return false;
+}
+
 void SkeletalMeshComponent::SetSkeleton(const class Skeleton* sk)
-{ m_Skeleton = sk; }
+{
+  m_Skeleton = sk;
+  // preallocate so per-frame evaluation never resizes
+  size_t numBones = sk ? sk->GetNumBones() : 0;
+  size_t poseSize = LocalPose::GetStorageSize(numBones);
+  m_PoseCacheStorage.assign(poseSize * 2, 0.0f);
+  m_GlobalPose.Attach(m_PoseCacheStorage.data(), numBones);
+  m_CachedLocalPose.Attach(m_PoseCacheStorage.data() + poseSize, numBones);
+  m_CachedLocalPose.Invalidate();
+  m_PoseCacheValid = false;
+}
@@ -2,27 +2,94 @@
 
 #include "MeshComponent.h"
 #include "MatrixPalette.h"
+#include "LocalPose.h"
+#include <vector>
+
+// animation layers on top of the base clip
+const size_t MAX_ANIM_LAYERS = 4;
 
 class SkeletalMeshComponent: public MeshComponent
 {
 public:
   SkeletalMeshComponent(class Actor* owner);
+  ~SkeletalMeshComponent();
 
   void Update(float deltaTime);
 
-  void Draw(class Shader* shader) override;
+  // skinned meshes are drawn in instanced batches by the Renderer,
+  // which uploads GetPalette() for the skeleton's bones
 
   void SetSkeleton(const class Skeleton* sk);
   void ComputeMatrixPalette();
-  float PlayAnimation(const class Animation* anim, float playRate);
+  // evaluates the base clip at inTime (plus any cross-fade and layers)
+  // into the palette (called from AnimationSystem worker threads)
+  void ComputeMatrixPalette(float inTime);
+  // skins the mesh on the CPU with the current palette into object space
+  // positions (and normals if outNormals isn't null), for hit tests
+  // against the animated mesh. false if the mesh isn't skinned
+  bool SkinVertices(std::vector<Vector3>& outPositions, std::vector<Vector3>* outNormals) const;
+  // copies the palette of an instance playing the same pose
+  void CopyPalette(const SkeletalMeshComponent& other);
+  // blendTime > 0 cross-fades from whatever was playing instead of popping
+  float PlayAnimation(const class Animation* anim, float playRate, float blendTime = 0.0f);
+
+  // layers are applied in order on top of the base clip (and its cross-fade).
+  // an override layer blends towards its clip by weight, an additive layer
+  // adds its clip's motion relative to the clip's first frame.
+  // mask (optional, must outlive the layer) scales weight per bone
+  void SetLayer(size_t layer, const class Animation* anim, float weight
+    , const class BoneMask* mask = nullptr, bool additive = false, float playRate = 1.0f);
+  void SetLayerWeight(size_t layer, float weight);
+  void ClearLayer(size_t layer);
+
+  // true while more than one clip contributes to the pose
+  // (such poses can't be shared between instances)
+  bool IsBlending() const;
+
+  const MatrixPalette& GetPalette() const { return m_Palette; }
+  const class Skeleton* GetSkeleton() const { return m_Skeleton; }
+  const class Animation* GetAnimation() const { return m_Animation; }
+  float GetAnimTime() const { return m_AnimTime; }
 protected:
+  struct AnimLayer
+  {
+    const class Animation* m_Animation;
+    const class BoneMask* m_Mask;
+    float m_Weight;
+    float m_PlayRate;
+    float m_Time;
+    bool m_Additive;
+  };
+
   const class Skeleton* m_Skeleton;
 
   MatrixPalette m_Palette;
+  // last evaluated global pose and the local pose it came from, bones whose
+  // local transform (and every ancestor's) is unchanged keep their palette entry.
+  // Only compared while masked / additive layers can leave bones still,
+  // the cache is left invalidated (m_PoseCacheValid false) otherwise
+  std::vector<float> m_PoseCacheStorage;
+  LocalPose m_GlobalPose;
+  LocalPose m_CachedLocalPose;
+  bool m_PoseCacheValid;
   // animation currently playing
   const class Animation* m_Animation;
   // play rate of animation (1.0 is normal speed)
   float m_AnimPlayRate;
   // current time in the animation
   float m_AnimTime;
+
+  // clip being faded out, blended by m_BlendElapsed / m_BlendTime
+  const class Animation* m_PrevAnimation;
+  float m_PrevAnimPlayRate;
+  float m_PrevAnimTime;
+  float m_BlendTime;
+  float m_BlendElapsed;
+
+  AnimLayer m_Layers[MAX_ANIM_LAYERS];
+
+  // a pose that can't be evaluated is drawn as the bind pose rather than
+  // keeping the last palette, reason is logged once per clip
+  void FallBackToBindPose(const char* reason);
+  bool m_LoggedFallback;
 };
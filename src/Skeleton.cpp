@@ -1,6 +1,7 @@
 #include "Skeleton.h"
 #include "MatrixPalette.h"
 #include "Animation.h"
+#include <algorithm>
 #include <fstream>
 #include <sstream>
 #include "include/rapidjson/document.h"
@@ -111,6 +112,11 @@ bool Skeleton::Load(const std::string& fileName)
 		m_Bones.emplace_back(temp);
 	}
 
+	if (!BuildLevels(fileName))
+	{
+		return false;
+	}
+
 	// Now that we have the bones
 	ComputeGlobalInvBindPose();
 
@@ -122,6 +128,74 @@ size_t Skeleton::GetNumBones() const { return m_Bones.size(); }
 const Skeleton::Bone& Skeleton::GetBone(size_t idx) const { return m_Bones[idx]; }
 const std::vector<Skeleton::Bone>& Skeleton::GetBones() const { return m_Bones; }
 const std::vector<Matrix4>& Skeleton::GetGlobalInvBindPoses() const { return m_GlobalInvBindPoses; }
+const std::vector<size_t>& Skeleton::GetLevelOrder() const { return m_LevelOrder; }
+const std::vector<size_t>& Skeleton::GetLevelStarts() const { return m_LevelStarts; }
+const std::vector<int>& Skeleton::GetParentIndices() const { return m_ParentIndices; }
+size_t Skeleton::GetNumLevels() const { return m_LevelStarts.empty() ? 0 : m_LevelStarts.size() - 1; }
+
+bool Skeleton::BuildLevels(const std::string& fileName)
+{
+  const size_t count = m_Bones.size();
+  m_ParentIndices.resize(count);
+  for (size_t i = 0; i < count; ++i)
+  {
+    int parent = m_Bones[i].m_Parent;
+    if (parent < -1 || parent >= static_cast<int>(count) || parent == static_cast<int>(i))
+    {
+      SDL_Log("Skeleton %s: Bone %zu has an invalid parent.", fileName.c_str(), i);
+      return false;
+    }
+    m_ParentIndices[i] = parent;
+  }
+
+  // depth of each bone: walk up to the first bone with a known depth,
+  // then fill in the chain on the way back down. a chain longer than
+  // the bone count means the parents loop
+  const size_t Unknown = static_cast<size_t>(-1);
+  std::vector<size_t> depth(count, Unknown);
+  std::vector<int> chain;
+  size_t maxDepth = 0;
+  for (size_t i = 0; i < count; ++i)
+  {
+    chain.clear();
+    int bone = static_cast<int>(i);
+    while (bone != -1 && depth[bone] == Unknown)
+    {
+      chain.emplace_back(bone);
+      if (chain.size() > count)
+      {
+        SDL_Log("Skeleton %s: Bone %zu is part of a parent cycle.", fileName.c_str(), i);
+        return false;
+      }
+      bone = m_Bones[bone].m_Parent;
+    }
+
+    size_t d = bone == -1 ? 0 : depth[bone] + 1;
+    for (auto it = chain.rbegin(); it != chain.rend(); ++it)
+    {
+      depth[*it] = d++;
+    }
+    maxDepth = std::max(maxDepth, depth[i]);
+  }
+
+  // counting sort by depth, stable so file order is kept within a level
+  m_LevelStarts.assign(count ? maxDepth + 2 : 1, 0);
+  for (size_t i = 0; i < count; ++i)
+  {
+    ++m_LevelStarts[depth[i] + 1];
+  }
+  for (size_t l = 1; l < m_LevelStarts.size(); ++l)
+  {
+    m_LevelStarts[l] += m_LevelStarts[l - 1];
+  }
+  m_LevelOrder.resize(count);
+  std::vector<size_t> next(m_LevelStarts.begin(), m_LevelStarts.end() - 1);
+  for (size_t i = 0; i < count; ++i)
+  {
+    m_LevelOrder[next[depth[i]]++] = i;
+  }
+  return true;
+}
 
 // computes the global inverse bind pose for each bone
 // called when loading the skeleton
@@ -131,15 +205,14 @@ void Skeleton::ComputeGlobalInvBindPose()
   m_GlobalInvBindPoses.resize(GetNumBones());
 
   // step 1: Compute global bind pose for each bone
-  // global bind pose for root is just local bind pose
-  m_GlobalInvBindPoses[0] = m_Bones[0].m_LocalBindPose.ToMatrix();
-
-  // each remaining bone's global bind pose is its local pose
-  // multiplied by its parent's global bind pose
-  for(size_t i = 1; i < m_GlobalInvBindPoses.size(); ++i)
+  // global bind pose for a root is just local bind pose,
+  // each other bone's global bind pose is its local pose
+  // multiplied by its parent's global bind pose (level order, parents first)
+  for(size_t i : m_LevelOrder)
   {
     Matrix4 localMat = m_Bones[i].m_LocalBindPose.ToMatrix();
-    m_GlobalInvBindPoses[i] = localMat * m_GlobalInvBindPoses[m_Bones[i].m_Parent];
+    int parent = m_Bones[i].m_Parent;
+    m_GlobalInvBindPoses[i] = parent < 0 ? localMat : localMat * m_GlobalInvBindPoses[parent];
   }
 
   // setp 2: invert each matrix
@@ -25,11 +25,27 @@ public:
   const std::vector<Bone>& GetBones() const;
   const std::vector<Matrix4>& GetGlobalInvBindPoses() const;
 
+  // bone indices sorted by depth, so every parent comes before its children
+  // (bone indices themselves keep the file order animations/meshes use).
+  // depth level l is GetLevelOrder()[GetLevelStarts()[l] .. GetLevelStarts()[l + 1])
+  // and bones within one level don't depend on each other
+  const std::vector<size_t>& GetLevelOrder() const;
+  const std::vector<size_t>& GetLevelStarts() const;
+  size_t GetNumLevels() const;
+  // parent of each bone packed tightly (-1 for roots) for the pose evaluator
+  const std::vector<int>& GetParentIndices() const;
+
   // computes the global inverse bind pose for each bone
   // called when loading the skeleton
   void ComputeGlobalInvBindPose();
 
 private:
+  // checks parents are valid and acyclic and builds the level order
+  bool BuildLevels(const std::string& fileName);
+
   std::vector<Bone> m_Bones;
   std::vector<Matrix4> m_GlobalInvBindPoses;
+  std::vector<size_t> m_LevelOrder;
+  std::vector<size_t> m_LevelStarts;
+  std::vector<int> m_ParentIndices;
 };
@@ -0,0 +1,117 @@
+#include "SkinningBuffer.h"
+
+#include <GL/glew.h>
+#include <SDL2/SDL_log.h>
+
+namespace
+{
+  // floats per RGBA32F texel
+  const size_t TexelSize = 4;
+}
+
+SkinningBuffer::SkinningBuffer()
+  :m_Current(0)
+  , m_UploadSize(0)
+{
+  for (size_t i = 0; i < SKINNING_BUFFER_RING; ++i)
+  {
+    m_Buffers[i] = 0;
+    m_Textures[i] = 0;
+    m_Capacity[i] = 0;
+  }
+}
+
+bool SkinningBuffer::Initialize()
+{
+  glGenBuffers(SKINNING_BUFFER_RING, m_Buffers);
+  glGenTextures(SKINNING_BUFFER_RING, m_Textures);
+  if (glGetError() != GL_NO_ERROR)
+  {
+    SDL_Log("Failed to create skinning buffers");
+    return false;
+  }
+  return true;
+}
+
+void SkinningBuffer::ShutDown()
+{
+  glDeleteTextures(SKINNING_BUFFER_RING, m_Textures);
+  glDeleteBuffers(SKINNING_BUFFER_RING, m_Buffers);
+  for (size_t i = 0; i < SKINNING_BUFFER_RING; ++i)
+  {
+    m_Buffers[i] = 0;
+    m_Textures[i] = 0;
+    m_Capacity[i] = 0;
+  }
+}
+
+void SkinningBuffer::Begin()
+{
+  m_Data.clear();
+}
+
+void SkinningBuffer::PackAffine(const Matrix4& mat)
+{
+  // column c dotted with (x, y, z, 1) gives component c of the transformed
+  // point, the 4th column of an affine matrix is always (0, 0, 0, 1)
+  for (int c = 0; c < 3; ++c)
+  {
+    m_Data.emplace_back(mat.mat[0][c]);
+    m_Data.emplace_back(mat.mat[1][c]);
+    m_Data.emplace_back(mat.mat[2][c]);
+    m_Data.emplace_back(mat.mat[3][c]);
+  }
+}
+
+unsigned SkinningBuffer::AddPalette(const Matrix4* palette, size_t numBones)
+{
+  unsigned offset = static_cast<unsigned>(m_Data.size() / TexelSize);
+  for (size_t i = 0; i < numBones; ++i)
+  {
+    PackAffine(palette[i]);
+  }
+  return offset;
+}
+
+unsigned SkinningBuffer::AddInstance(const Matrix4& worldTransform, unsigned paletteOffset)
+{
+  unsigned offset = static_cast<unsigned>(m_Data.size() / TexelSize);
+  PackAffine(worldTransform);
+  // floats hold integers exactly up to 2^24 texels
+  m_Data.emplace_back(static_cast<float>(paletteOffset));
+  m_Data.emplace_back(0.0f);
+  m_Data.emplace_back(0.0f);
+  m_Data.emplace_back(0.0f);
+  return offset;
+}
+
+void SkinningBuffer::Upload(unsigned textureUnit)
+{
+  // cycle through the ring so we never write a buffer the GPU may still read
+  m_Current = (m_Current + 1) % SKINNING_BUFFER_RING;
+  m_UploadSize = m_Data.size() * sizeof(float);
+
+  glBindBuffer(GL_TEXTURE_BUFFER, m_Buffers[m_Current]);
+  if (m_UploadSize > m_Capacity[m_Current])
+  {
+    // grow with some headroom so adding a few characters doesn't reallocate
+    m_Capacity[m_Current] = m_UploadSize + m_UploadSize / 2;
+    glBufferData(GL_TEXTURE_BUFFER, m_Capacity[m_Current], nullptr, GL_STREAM_DRAW);
+
+    // storage changed, re-attach it to the buffer texture
+    glBindTexture(GL_TEXTURE_BUFFER, m_Textures[m_Current]);
+    glTexBuffer(GL_TEXTURE_BUFFER, GL_RGBA32F, m_Buffers[m_Current]);
+  }
+  if (m_UploadSize > 0)
+  {
+    glBufferSubData(GL_TEXTURE_BUFFER, 0, m_UploadSize, m_Data.data());
+  }
+  glBindBuffer(GL_TEXTURE_BUFFER, 0);
+
+  glActiveTexture(GL_TEXTURE0 + textureUnit);
+  glBindTexture(GL_TEXTURE_BUFFER, m_Textures[m_Current]);
+  // mesh textures go on unit 0
+  glActiveTexture(GL_TEXTURE0);
+}
+
+size_t SkinningBuffer::GetUploadSize() const { return m_UploadSize; }
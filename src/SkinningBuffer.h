@@ -0,0 +1,49 @@
+#pragma once
+
+#include "Math.h"
+#include <cstddef>
+#include <vector>
+
+// frames of skinning data kept in flight on the GPU before a buffer is reused
+const size_t SKINNING_BUFFER_RING = 3;
+
+// per-frame GPU buffer holding every skinned mesh's matrix palette packed as
+// 3x4 affine matrices (3 RGBA32F texels per bone, only the skeleton's real
+// bones) plus per instance records (world transform + palette offset).
+// Skinned.vert reads it through a buffer texture so every skinned mesh that
+// shares a vertex array and texture can be drawn with one instanced call
+class SkinningBuffer
+{
+public:
+  SkinningBuffer();
+
+  bool Initialize();
+  void ShutDown();
+
+  // start filling a new frame
+  void Begin();
+
+  // packs numBones palette matrices, returns the texel offset of the palette
+  unsigned AddPalette(const Matrix4* palette, size_t numBones);
+  // adds an instance record, returns its texel offset. records for one
+  // instanced draw must be added back to back
+  unsigned AddInstance(const Matrix4& worldTransform, unsigned paletteOffset);
+
+  // uploads this frame's data into the next buffer of the ring
+  // and binds it to the given texture unit
+  void Upload(unsigned textureUnit);
+
+  // size of the last upload (for profiling)
+  size_t GetUploadSize() const;
+
+private:
+  // writes the first three columns of an affine row-vector matrix as texels
+  void PackAffine(const Matrix4& mat);
+
+  std::vector<float> m_Data;
+  unsigned m_Buffers[SKINNING_BUFFER_RING];  // OpenGL IDs of buffer objects
+  unsigned m_Textures[SKINNING_BUFFER_RING]; // buffer textures viewing them
+  size_t m_Capacity[SKINNING_BUFFER_RING];   // allocated bytes of each buffer
+  size_t m_Current;
+  size_t m_UploadSize;
+};
@@ -0,0 +1,319 @@
+#include "SpatialGrid.h"
+
+#include <algorithm>
+
+namespace
+{
+  const int EmptySlot = -1;
+  // start at 256 slots, table is grown to keep it at most half full
+  const unsigned InitialShift = 64 - 8;
+  // cell coordinates are packed into 21 bits each
+  const int MaxCoord = (1 << 20) - 1;
+}
+
+SpatialGrid::SpatialGrid(float cellSize)
+  :m_CellSize(cellSize)
+  , m_InvCellSize(1.0f / cellSize)
+  , m_Table(static_cast<size_t>(1) << (64 - InitialShift), EmptySlot)
+  , m_Shift(InitialShift)
+{
+  Clear();
+}
+
+void SpatialGrid::AddBox(int id, const AABB& box, Layer layer)
+{
+  if (static_cast<size_t>(id) >= m_Entries.size())
+  {
+    m_Entries.resize(id + 1);
+  }
+
+  Entry& entry = m_Entries[id];
+  entry.m_Box = box;
+  entry.m_Cells = GetRange(box);
+  entry.m_Layer = layer;
+  Link(id);
+}
+
+void SpatialGrid::RemoveBox(int id)
+{
+  if (static_cast<size_t>(id) >= m_Entries.size() || m_Entries[id].m_Layer == 0) { return; }
+
+  Unlink(id);
+  m_Entries[id].m_Layer = 0;
+}
+
+void SpatialGrid::SetBox(int id, const AABB& box, Layer layer)
+{
+  Entry& entry = m_Entries[id];
+  entry.m_Box = box;
+
+  CellRange range = GetRange(box);
+  bool sameCells = entry.m_Layer == layer;
+  for (int axis = 0; axis < 3; ++axis)
+  {
+    sameCells = sameCells && range.m_Min[axis] == entry.m_Cells.m_Min[axis]
+      && range.m_Max[axis] == entry.m_Cells.m_Max[axis];
+  }
+  if (sameCells) { return; }
+
+  Unlink(id);
+  entry.m_Cells = range;
+  entry.m_Layer = layer;
+  Link(id);
+}
+
+const AABB& SpatialGrid::GetBox(int id) const
+{
+  return m_Entries[id].m_Box;
+}
+
+size_t SpatialGrid::QueryNearest(const Vector3& point, size_t k, float maxDistance, int layers
+  , int* outIds, float* outDistSq) const
+{
+  if (k == 0 || m_Cells.empty()) { return 0; }
+
+  const float* p = point.GetAsFloatPtr();
+  CellRange pointCell = GetRange(AABB(point, point));
+  const int* center = pointCell.m_Min;
+
+  float maxDistSq = maxDistance * maxDistance;
+  size_t found = 0;
+
+  // search shells of cells around the point's cell, ring r is every cell r
+  // steps away on at least one axis. Anything outside ring r is at least
+  // r cells away, so stop once the k-th best is closer than that
+  for (int r = 0; ; ++r)
+  {
+    // no need to look past the cells that were ever used
+    int lo[3];
+    int hi[3];
+    for (int axis = 0; axis < 3; ++axis)
+    {
+      lo[axis] = Math::Max(center[axis] - r, m_UsedMin[axis]);
+      hi[axis] = Math::Min(center[axis] + r, m_UsedMax[axis]);
+    }
+
+    for (int x = lo[0]; x <= hi[0]; ++x)
+    {
+      for (int y = lo[1]; y <= hi[1]; ++y)
+      {
+        // inside the shell only the z = +-r faces are on ring r
+        bool onEdge = x == center[0] - r || x == center[0] + r
+          || y == center[1] - r || y == center[1] + r;
+        int zStep = onEdge ? 1 : 2 * r;
+        for (int z = onEdge ? lo[2] : center[2] - r; z <= hi[2]; z += zStep)
+        {
+          if (z < lo[2]) { continue; }
+
+          for (int layer = Static; layer <= Dynamic; layer <<= 1)
+          {
+            if ((layers & layer) == 0) { continue; }
+            int cell = FindCell(MakeKey(x, y, z, layer));
+            if (cell < 0) { continue; }
+
+            for (int id : m_Cells[cell].m_Ids)
+            {
+              const AABB& box = m_Entries[id].m_Box;
+              float distSq = 0.0f;
+              const float* boxMin = box.m_Min.GetAsFloatPtr();
+              const float* boxMax = box.m_Max.GetAsFloatPtr();
+              for (int axis = 0; axis < 3; ++axis)
+              {
+                float d = Math::Max(boxMin[axis] - p[axis], 0.0f) + Math::Max(p[axis] - boxMax[axis], 0.0f);
+                distSq += d * d;
+              }
+              if (distSq > maxDistSq) { continue; }
+              if (found == k && distSq >= outDistSq[found - 1]) { continue; }
+              // boxes spanning cells show up more than once
+              if (std::find(outIds, outIds + found, id) != outIds + found) { continue; }
+
+              // insert into the sorted list, dropping the worst when full
+              size_t i = found < k ? found++ : found - 1;
+              while (i > 0 && outDistSq[i - 1] > distSq)
+              {
+                outIds[i] = outIds[i - 1];
+                outDistSq[i] = outDistSq[i - 1];
+                --i;
+              }
+              outIds[i] = id;
+              outDistSq[i] = distSq;
+            }
+          }
+        }
+      }
+    }
+
+    float reach = r * m_CellSize;
+    if (found == k && outDistSq[found - 1] <= reach * reach) { break; }
+    if (reach > maxDistance) { break; }
+
+    // every used cell has been searched
+    bool covered = true;
+    for (int axis = 0; axis < 3; ++axis)
+    {
+      covered = covered && center[axis] - r <= m_UsedMin[axis] && center[axis] + r >= m_UsedMax[axis];
+    }
+    if (covered) { break; }
+  }
+  return found;
+}
+
+float SpatialGrid::GetCellSize() const
+{
+  return m_CellSize;
+}
+
+size_t SpatialGrid::GetNumCells() const
+{
+  return m_Cells.size();
+}
+
+void SpatialGrid::Clear()
+{
+  m_Entries.clear();
+  m_Cells.clear();
+  std::fill(m_Table.begin(), m_Table.end(), EmptySlot);
+  for (int axis = 0; axis < 3; ++axis)
+  {
+    m_UsedMin[axis] = MaxCoord;
+    m_UsedMax[axis] = -MaxCoord;
+  }
+}
+
+SpatialGrid::CellRange SpatialGrid::GetRange(const AABB& box) const
+{
+  CellRange range;
+  const float* boxMin = box.m_Min.GetAsFloatPtr();
+  const float* boxMax = box.m_Max.GetAsFloatPtr();
+  for (int axis = 0; axis < 3; ++axis)
+  {
+    // clamp in float first, huge boxes would overflow the int cast
+    float lo = Math::Clamp(Math::Floor(boxMin[axis] * m_InvCellSize), static_cast<float>(-MaxCoord), static_cast<float>(MaxCoord));
+    float hi = Math::Clamp(Math::Floor(boxMax[axis] * m_InvCellSize), static_cast<float>(-MaxCoord), static_cast<float>(MaxCoord));
+    range.m_Min[axis] = static_cast<int>(lo);
+    range.m_Max[axis] = static_cast<int>(hi);
+  }
+  return range;
+}
+
+uint64_t SpatialGrid::MakeKey(int x, int y, int z, int layer)
+{
+  const uint64_t mask = (1u << 21) - 1;
+  return (static_cast<uint64_t>(layer == Dynamic) << 63)
+    | ((static_cast<uint64_t>(x) & mask) << 42)
+    | ((static_cast<uint64_t>(y) & mask) << 21)
+    | (static_cast<uint64_t>(z) & mask);
+}
+
+size_t SpatialGrid::GetSlot(uint64_t key) const
+{
+  // fibonacci hashing, the top bits are the best mixed
+  return static_cast<size_t>((key * 0x9E3779B97F4A7C15ull) >> m_Shift);
+}
+
+int SpatialGrid::FindCell(uint64_t key) const
+{
+  size_t mask = m_Table.size() - 1;
+  size_t slot = GetSlot(key);
+  while (m_Table[slot] != EmptySlot)
+  {
+    if (m_Cells[m_Table[slot]].m_Key == key)
+    {
+      return m_Table[slot];
+    }
+    slot = (slot + 1) & mask;
+  }
+  return EmptySlot;
+}
+
+int SpatialGrid::FindOrAddCell(uint64_t key)
+{
+  // cells are never removed, so no deletion to handle in the table
+  size_t mask = m_Table.size() - 1;
+  size_t slot = GetSlot(key);
+  while (m_Table[slot] != EmptySlot)
+  {
+    if (m_Cells[m_Table[slot]].m_Key == key)
+    {
+      return m_Table[slot];
+    }
+    slot = (slot + 1) & mask;
+  }
+
+  int index = static_cast<int>(m_Cells.size());
+  m_Table[slot] = index;
+  m_Cells.emplace_back();
+  m_Cells.back().m_Key = key;
+
+  if (m_Cells.size() * 2 > m_Table.size())
+  {
+    Grow();
+  }
+  return index;
+}
+
+void SpatialGrid::Grow()
+{
+  --m_Shift;
+  m_Table.assign(static_cast<size_t>(1) << (64 - m_Shift), EmptySlot);
+  size_t mask = m_Table.size() - 1;
+  for (size_t i = 0; i < m_Cells.size(); ++i)
+  {
+    size_t slot = GetSlot(m_Cells[i].m_Key);
+    while (m_Table[slot] != EmptySlot)
+    {
+      slot = (slot + 1) & mask;
+    }
+    m_Table[slot] = static_cast<int>(i);
+  }
+}
+
+void SpatialGrid::Link(int id)
+{
+  const Entry& entry = m_Entries[id];
+  const CellRange& range = entry.m_Cells;
+  for (int axis = 0; axis < 3; ++axis)
+  {
+    m_UsedMin[axis] = Math::Min(m_UsedMin[axis], range.m_Min[axis]);
+    m_UsedMax[axis] = Math::Max(m_UsedMax[axis], range.m_Max[axis]);
+  }
+
+  for (int x = range.m_Min[0]; x <= range.m_Max[0]; ++x)
+  {
+    for (int y = range.m_Min[1]; y <= range.m_Max[1]; ++y)
+    {
+      for (int z = range.m_Min[2]; z <= range.m_Max[2]; ++z)
+      {
+        // FindOrAddCell can grow m_Cells, so don't hold on to the cell
+        int cell = FindOrAddCell(MakeKey(x, y, z, entry.m_Layer));
+        m_Cells[cell].m_Ids.emplace_back(id);
+      }
+    }
+  }
+}
+
+void SpatialGrid::Unlink(int id)
+{
+  const Entry& entry = m_Entries[id];
+  const CellRange& range = entry.m_Cells;
+  for (int x = range.m_Min[0]; x <= range.m_Max[0]; ++x)
+  {
+    for (int y = range.m_Min[1]; y <= range.m_Max[1]; ++y)
+    {
+      for (int z = range.m_Min[2]; z <= range.m_Max[2]; ++z)
+      {
+        int cell = FindCell(MakeKey(x, y, z, entry.m_Layer));
+        if (cell < 0) { continue; }
+
+        // Swap to end of vector and pop off
+        std::vector<int>& ids = m_Cells[cell].m_Ids;
+        auto iter = std::find(ids.begin(), ids.end(), id);
+        if (iter != ids.end())
+        {
+          std::iter_swap(iter, ids.end() - 1);
+          ids.pop_back();
+        }
+      }
+    }
+  }
+}
@@ -0,0 +1,131 @@
+#pragma once
+
+#include "Collision.h"
+#include <cstdint>
+#include <vector>
+
+// uniform grid hashed by cell coordinates, so only cells that hold
+// something take memory. A box is listed in every cell it touches.
+// Static boxes (level geometry) and dynamic boxes are kept in separate
+// cells so queries can look at just one of them. Boxes are identified
+// by caller chosen ids (small non-negative ints)
+class SpatialGrid
+{
+public:
+  // bits for the query layer masks
+  enum Layer { Static = 1, Dynamic = 2, AllLayers = Static | Dynamic };
+
+  SpatialGrid(float cellSize);
+
+  void AddBox(int id, const AABB& box, Layer layer);
+  void RemoveBox(int id);
+  // only touches the cells if the box covers different cells or changes layer
+  void SetBox(int id, const AABB& box, Layer layer);
+
+  const AABB& GetBox(int id) const;
+
+  // calls callback(id) once for every box on one of layers overlapping box,
+  // stops early if callback returns false
+  template <typename Callback>
+  void Query(const AABB& box, int layers, Callback&& callback) const;
+
+  // up to k boxes closest to point (distance to the box, 0 inside it) and
+  // no further than maxDistance, nearest first. outIds and outDistSq need
+  // room for k, returns how many were found
+  size_t QueryNearest(const Vector3& point, size_t k, float maxDistance, int layers
+    , int* outIds, float* outDistSq) const;
+
+  float GetCellSize() const;
+  // cells allocated so far, empty cells are kept for reuse
+  size_t GetNumCells() const;
+
+  void Clear();
+
+private:
+  struct CellRange
+  {
+    int m_Min[3];
+    int m_Max[3];
+  };
+
+  struct Entry
+  {
+    Entry() :m_Box(Vector3::Zero, Vector3::Zero), m_Layer(0) {}
+
+    AABB m_Box;
+    CellRange m_Cells;
+    // 0 while the id isn't in the grid
+    int m_Layer;
+  };
+
+  struct Cell
+  {
+    uint64_t m_Key;
+    std::vector<int> m_Ids;
+  };
+
+  CellRange GetRange(const AABB& box) const;
+  static uint64_t MakeKey(int x, int y, int z, int layer);
+  size_t GetSlot(uint64_t key) const;
+  // index into m_Cells, -1 if the cell was never used
+  int FindCell(uint64_t key) const;
+  int FindOrAddCell(uint64_t key);
+  void Grow();
+
+  void Link(int id);
+  void Unlink(int id);
+
+  float m_CellSize;
+  float m_InvCellSize;
+
+  // indexed by id
+  std::vector<Entry> m_Entries;
+
+  std::vector<Cell> m_Cells;
+  // index into m_Cells, -1 for empty slots. size is a power of 2
+  std::vector<int> m_Table;
+  unsigned m_Shift;
+  // cells ever used, bounds the nearest search
+  int m_UsedMin[3];
+  int m_UsedMax[3];
+};
+
+template <typename Callback>
+void SpatialGrid::Query(const AABB& box, int layers, Callback&& callback) const
+{
+  CellRange range = GetRange(box);
+  for (int layer = Static; layer <= Dynamic; layer <<= 1)
+  {
+    if ((layers & layer) == 0) { continue; }
+
+    for (int x = range.m_Min[0]; x <= range.m_Max[0]; ++x)
+    {
+      for (int y = range.m_Min[1]; y <= range.m_Max[1]; ++y)
+      {
+        for (int z = range.m_Min[2]; z <= range.m_Max[2]; ++z)
+        {
+          int cell = FindCell(MakeKey(x, y, z, layer));
+          if (cell < 0) { continue; }
+
+          for (int id : m_Cells[cell].m_Ids)
+          {
+            // a box in several of the cells is only reported from the
+            // first one both it and the query cover
+            const Entry& entry = m_Entries[id];
+            if (x != Math::Max(entry.m_Cells.m_Min[0], range.m_Min[0])
+              || y != Math::Max(entry.m_Cells.m_Min[1], range.m_Min[1])
+              || z != Math::Max(entry.m_Cells.m_Min[2], range.m_Min[2]))
+            {
+              continue;
+            }
+
+            if (Intersect(entry.m_Box, box) && !callback(id))
+            {
+              return;
+            }
+          }
+        }
+      }
+    }
+  }
+}
@@ -4,6 +4,7 @@
 #include "Shader.h"
 #include "Texture.h"
 #include "Renderer.h"
+#include "VertexArray.h"
 
 #include <GL/glew.h>
 
@@ -13,6 +14,7 @@ SpriteComponent::SpriteComponent(class Actor* owner, int drawOrder)
   , m_DrawOrder(drawOrder)
   , m_TextureWidth(0)
   , m_TextureHeight(0)
+  , m_SpriteIndex(0)
   {
     m_Owner->GetGame()->GetRenderer()->AddSprite(this);
   }
@@ -40,10 +42,11 @@ void SpriteComponent::Draw(Shader* shader)
     m_Texture->SetActive();
 
     // draw quad
+    VertexArray* verts = m_Owner->GetGame()->GetRenderer()->GetSpriteVerts();
     glDrawElements(
       GL_TRIANGLES
-      , 6                 // number of indices in index buffer
-      , GL_UNSIGNED_INT   // type of each index
+      , 6                     // number of indices in index buffer
+      , verts->GetIndexType() // type of each index
       , nullptr
     );
   }
@@ -56,6 +59,21 @@ void SpriteComponent::SetTexture(Texture* texture)
   m_TextureHeight = texture->GetHeight();
 }
 
+Texture* SpriteComponent::GetTexture() const {return m_Texture;}
+
 int SpriteComponent::GetDrawOrder() const {return m_DrawOrder;}
+
+void SpriteComponent::SetDrawOrder(int drawOrder)
+{
+  if (drawOrder != m_DrawOrder)
+  {
+    m_DrawOrder = drawOrder;
+    // renderer re-sorts before the next draw
+    m_Owner->GetGame()->GetRenderer()->MarkSpritesDirty();
+  }
+}
+
+size_t SpriteComponent::GetSpriteIndex() const { return m_SpriteIndex; }
+void SpriteComponent::SetSpriteIndex(size_t index) { m_SpriteIndex = index; }
 int SpriteComponent::GetTextureHeight() const {return m_TextureHeight;}
 int SpriteComponent::GetTextureWidth() const {return m_TextureWidth;}
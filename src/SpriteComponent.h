@@ -2,6 +2,7 @@
 
 #include <SDL2/SDL.h>
 #include "Component.h"
+#include <cstddef>
 
 class SpriteComponent: public Component {
  private:
@@ -10,13 +11,19 @@ class SpriteComponent: public Component {
    int m_DrawOrder;
    int m_TextureWidth;
    int m_TextureHeight;
+   // slot in the renderer's sprite list (owned by Renderer)
+   size_t m_SpriteIndex;
  public:
    SpriteComponent(class Actor* owner, int drawOrder = 100);
    ~SpriteComponent();
    virtual void Draw(class Shader* shader);
    virtual void SetTexture(class Texture* texture);
+   class Texture* GetTexture() const;
 
    int GetDrawOrder() const;
+   void SetDrawOrder(int drawOrder);
+   size_t GetSpriteIndex() const;
+   void SetSpriteIndex(size_t index);
    int GetTextureHeight() const;
    int GetTextureWidth() const;
  };
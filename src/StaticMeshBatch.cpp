@@ -0,0 +1,186 @@
+#include "StaticMeshBatch.h"
+#include "MeshComponent.h"
+#include "Mesh.h"
+#include "Shader.h"
+#include "Texture.h"
+#include "VertexArray.h"
+#include "Actor.h"
+
+#include <algorithm>
+#include <GL/glew.h>
+
+namespace
+{
+  struct Entry
+  {
+    MeshComponent* m_Comp;
+    Texture* m_Texture;
+  };
+
+  bool SameMaterial(const Entry& a, const Entry& b)
+  {
+    return a.m_Comp->GetShaderName() == b.m_Comp->GetShaderName()
+      && a.m_Texture == b.m_Texture
+      && a.m_Comp->GetMesh()->GetSpecPower() == b.m_Comp->GetMesh()->GetSpecPower();
+  }
+}
+
+StaticMeshBatch::StaticMeshBatch()
+  :m_Bounds(Vector3::Infinity, Vector3::NegInfinity)
+{}
+
+StaticMeshBatch::~StaticMeshBatch()
+{
+  Clear();
+}
+
+void StaticMeshBatch::Build(const std::vector<MeshComponent*>& comps)
+{
+  Clear();
+
+  std::vector<Entry> entries;
+  entries.reserve(comps.size());
+  for (MeshComponent* mc : comps)
+  {
+    Mesh* mesh = mc->GetMesh();
+    if (mc->IsSkeletal() || !mesh || mesh->GetVertices().empty())
+    {
+      continue;
+    }
+    entries.emplace_back(Entry{ mc, mesh->GetTexture(mc->GetTextureIndex()) });
+  }
+
+  // every mesh's box into world space in one pass, for the bounds
+  m_Boxes.clear();
+  m_Transforms.clear();
+  for (const Entry& entry : entries)
+  {
+    m_Boxes.emplace_back(entry.m_Comp->GetMesh()->GetBox());
+    m_Transforms.emplace_back(entry.m_Comp->GetOwner()->GetWorldTransform());
+  }
+  TransformBoxes(m_Boxes.data(), m_Transforms.data(), m_Boxes.data(), m_Boxes.size());
+  for (const AABB& box : m_Boxes)
+  {
+    m_Bounds.UpdateMinMax(box.m_Min);
+    m_Bounds.UpdateMinMax(box.m_Max);
+  }
+
+  // same materials next to each other
+  std::stable_sort(entries.begin(), entries.end(), [](const Entry& a, const Entry& b) {
+    int shader = a.m_Comp->GetShaderName().compare(b.m_Comp->GetShaderName());
+    if (shader != 0)
+    {
+      return shader < 0;
+    }
+    if (a.m_Texture != b.m_Texture)
+    {
+      return a.m_Texture < b.m_Texture;
+    }
+    return a.m_Comp->GetMesh()->GetSpecPower() < b.m_Comp->GetMesh()->GetSpecPower();
+  });
+
+  for (size_t begin = 0; begin < entries.size();)
+  {
+    size_t end = begin + 1;
+    while (end < entries.size() && SameMaterial(entries[begin], entries[end]))
+    {
+      ++end;
+    }
+
+    m_Vertices.clear();
+    m_Indices.clear();
+    for (size_t i = begin; i < end; ++i)
+    {
+      const Mesh* mesh = entries[i].m_Comp->GetMesh();
+      Matrix4 world = entries[i].m_Comp->GetOwner()->GetWorldTransform();
+      unsigned int base = static_cast<unsigned int>(m_Vertices.size() / MESH_VERTEX_SIZE);
+
+      // bake the world transform in, actor scale is uniform so normals
+      // only need renormalizing
+      const std::vector<float>& verts = mesh->GetVertices();
+      for (size_t v = 0; v < verts.size(); v += MESH_VERTEX_SIZE)
+      {
+        Vector3 pos = Vector3::Transform(Vector3(verts[v], verts[v + 1], verts[v + 2]), world);
+        Vector3 norm = Vector3::Transform(Vector3(verts[v + 3], verts[v + 4], verts[v + 5]), world, 0.0f);
+        if (norm.LengthSq() > 0.0f)
+        {
+          norm.Normalize();
+        }
+        m_Vertices.insert(m_Vertices.end(), { pos.x, pos.y, pos.z, norm.x, norm.y, norm.z });
+        m_Vertices.insert(m_Vertices.end(), verts.begin() + v + 6, verts.begin() + v + MESH_VERTEX_SIZE);
+      }
+      for (unsigned int index : mesh->GetIndices())
+      {
+        m_Indices.emplace_back(base + index);
+      }
+    }
+
+    Batch batch;
+    batch.m_ShaderName = entries[begin].m_Comp->GetShaderName();
+    batch.m_Texture = entries[begin].m_Texture;
+    batch.m_SpecPower = entries[begin].m_Comp->GetMesh()->GetSpecPower();
+    batch.m_VertexArray = new VertexArray(m_Vertices.data()
+      , static_cast<unsigned>(m_Vertices.size() / MESH_VERTEX_SIZE)
+      , m_Indices.data()
+      , static_cast<unsigned>(m_Indices.size())
+      , VertexArray::PosNormTex);
+    m_Batches.emplace_back(batch);
+
+    begin = end;
+  }
+
+  // only needed while building
+  m_Vertices = std::vector<float>();
+  m_Indices = std::vector<unsigned int>();
+  m_Boxes = std::vector<AABB>();
+  m_Transforms = std::vector<Matrix4>();
+}
+
+void StaticMeshBatch::Clear()
+{
+  for (Batch& batch : m_Batches)
+  {
+    delete batch.m_VertexArray;
+  }
+  m_Batches.clear();
+  m_Bounds = AABB(Vector3::Infinity, Vector3::NegInfinity);
+}
+
+void StaticMeshBatch::Draw(Shader* shader)
+{
+  bool first = true;
+  for (const Batch& batch : m_Batches)
+  {
+    if (batch.m_ShaderName != shader->GetShaderName())
+    {
+      continue;
+    }
+
+    // already in world space
+    if (first)
+    {
+      shader->SetMatrixUniform("uWorldTransform", Matrix4::Identity);
+      // batches are built from the float vertices
+      shader->SetIntUniform("uOctNormals", 0);
+      first = false;
+    }
+    shader->SetFloatUniform("uSpecPower", batch.m_SpecPower);
+    if (batch.m_Texture)
+    {
+      batch.m_Texture->SetActive();
+    }
+    batch.m_VertexArray->SetActive();
+    glDrawElements(GL_TRIANGLES, batch.m_VertexArray->GetNumIndices()
+      , batch.m_VertexArray->GetIndexType(), nullptr);
+  }
+}
+
+size_t StaticMeshBatch::GetNumBatches() const
+{
+  return m_Batches.size();
+}
+
+const AABB& StaticMeshBatch::GetBounds() const
+{
+  return m_Bounds;
+}
@@ -0,0 +1,49 @@
+#pragma once
+
+#include "Math.h"
+#include "Collision.h"
+#include <string>
+#include <vector>
+
+// the meshes of actors that never move, baked into world space and merged
+// into one vertex array per material (shader, texture and specular power),
+// so a whole level of tiles draws in a handful of calls. The mesh
+// components stay with their actors, Renderer just stops drawing them
+// one by one
+class StaticMeshBatch
+{
+public:
+  StaticMeshBatch();
+  ~StaticMeshBatch();
+
+  // merges comps as their owners are placed now, replacing what was built
+  // before. Skinned meshes can't be merged and are left out
+  void Build(const std::vector<class MeshComponent*>& comps);
+  void Clear();
+
+  // draws every batch whose meshes use this (active) shader
+  void Draw(class Shader* shader);
+
+  size_t GetNumBatches() const;
+  // world space box around everything built, empty (min > max) when
+  // nothing was
+  const AABB& GetBounds() const;
+
+private:
+  struct Batch
+  {
+    std::string m_ShaderName;
+    class Texture* m_Texture;
+    float m_SpecPower;
+    class VertexArray* m_VertexArray;
+  };
+  std::vector<Batch> m_Batches;
+  AABB m_Bounds;
+
+  // merged vertices / indices while building
+  std::vector<float> m_Vertices;
+  std::vector<unsigned int> m_Indices;
+  // object space mesh boxes / world transforms, refit together for m_Bounds
+  std::vector<AABB> m_Boxes;
+  std::vector<Matrix4> m_Transforms;
+};
@@ -0,0 +1,225 @@
+#include "SweepAndPrune.h"
+
+#include <algorithm>
+
+namespace
+{
+  // m_Status values
+  const unsigned char Unused = 0;
+  const unsigned char Sorted = 1;
+  const unsigned char Pending = 2;
+}
+
+SweepAndPrune::SweepAndPrune()
+  :m_NumPending(0)
+  , m_NumSwaps(0)
+{}
+
+void SweepAndPrune::AddBox(int id, const AABB& box)
+{
+  if (static_cast<size_t>(id) >= m_Boxes.size())
+  {
+    m_Boxes.resize(id + 1, AABB(Vector3::Zero, Vector3::Zero));
+    m_Status.resize(id + 1, Unused);
+  }
+  m_Boxes[id] = box;
+  m_Status[id] = Pending;
+  ++m_NumPending;
+
+  // new endpoints go on the end, the next Update merges them in
+  for (int axis = 0; axis < 3; ++axis)
+  {
+    Endpoint minPoint;
+    minPoint.m_Value = box.m_Min.GetAsFloatPtr()[axis];
+    minPoint.m_Data = static_cast<uint32_t>(id) << 1;
+    Endpoint maxPoint;
+    maxPoint.m_Value = box.m_Max.GetAsFloatPtr()[axis];
+    maxPoint.m_Data = (static_cast<uint32_t>(id) << 1) | 1;
+    m_Endpoints[axis].emplace_back(minPoint);
+    m_Endpoints[axis].emplace_back(maxPoint);
+  }
+}
+
+void SweepAndPrune::RemoveBox(int id)
+{
+  if (static_cast<size_t>(id) >= m_Status.size() || m_Status[id] == Unused) { return; }
+
+  for (int axis = 0; axis < 3; ++axis)
+  {
+    // keep the rest in order, no need to re-sort
+    std::vector<Endpoint>& endpoints = m_Endpoints[axis];
+    endpoints.erase(std::remove_if(endpoints.begin(), endpoints.end(),
+      [id](const Endpoint& e) { return e.GetId() == id; }), endpoints.end());
+  }
+  m_Pairs.RemoveAll(id);
+  if (m_Status[id] == Pending)
+  {
+    --m_NumPending;
+  }
+  m_Status[id] = Unused;
+}
+
+void SweepAndPrune::RemoveBoxes(const std::vector<unsigned char>& ids)
+{
+  // only endpoints of added boxes are in the lists, so the flags are enough
+  for (int axis = 0; axis < 3; ++axis)
+  {
+    std::vector<Endpoint>& endpoints = m_Endpoints[axis];
+    endpoints.erase(std::remove_if(endpoints.begin(), endpoints.end(),
+      [&ids](const Endpoint& e) {
+        return static_cast<size_t>(e.GetId()) < ids.size() && ids[e.GetId()] != 0;
+      }), endpoints.end());
+  }
+  m_Pairs.RemoveAll(ids);
+
+  size_t count = std::min(ids.size(), m_Status.size());
+  for (size_t id = 0; id < count; ++id)
+  {
+    if (ids[id] == 0 || m_Status[id] == Unused) { continue; }
+    if (m_Status[id] == Pending)
+    {
+      --m_NumPending;
+    }
+    m_Status[id] = Unused;
+  }
+}
+
+void SweepAndPrune::SetBox(int id, const AABB& box)
+{
+  m_Boxes[id] = box;
+}
+
+void SweepAndPrune::Update()
+{
+  m_NumSwaps = 0;
+
+  for (int axis = 0; axis < 3; ++axis)
+  {
+    for (Endpoint& e : m_Endpoints[axis])
+    {
+      const AABB& box = m_Boxes[e.GetId()];
+      e.m_Value = e.IsMax() ? box.m_Max.GetAsFloatPtr()[axis] : box.m_Min.GetAsFloatPtr()[axis];
+    }
+  }
+
+  // boxes that were already sorted, pending ones are still on the end
+  size_t numSorted = m_Endpoints[0].size() - 2 * m_NumPending;
+  for (int axis = 0; axis < 3; ++axis)
+  {
+    SortAxis(axis, numSorted);
+  }
+
+  if (m_NumPending > 0)
+  {
+    InsertPending();
+  }
+}
+
+void SweepAndPrune::SortAxis(int axis, size_t count)
+{
+  // insertion sort, nearly sorted already so this is close to linear.
+  // every swap of a min and a max is a change in overlap along this axis
+  std::vector<Endpoint>& endpoints = m_Endpoints[axis];
+  for (size_t i = 1; i < count; ++i)
+  {
+    Endpoint current = endpoints[i];
+    size_t j = i;
+    while (j > 0 && current < endpoints[j - 1])
+    {
+      const Endpoint& prev = endpoints[j - 1];
+      int a = current.GetId();
+      int b = prev.GetId();
+      if (current.IsMax() != prev.IsMax() && a != b)
+      {
+        if (!current.IsMax())
+        {
+          // min moved below another max, overlapping here so check the rest
+          if (Intersect(m_Boxes[a], m_Boxes[b]) && m_Pairs.Add(a, b))
+          {
+            m_Events.push_back(OverlapEvent{ Math::Min(a, b), Math::Max(a, b), true });
+          }
+        }
+        else if (m_Pairs.Remove(a, b))
+        {
+          // max moved below another min, separated along this axis
+          m_Events.push_back(OverlapEvent{ Math::Min(a, b), Math::Max(a, b), false });
+        }
+      }
+
+      endpoints[j] = prev;
+      --j;
+      ++m_NumSwaps;
+    }
+    endpoints[j] = current;
+  }
+}
+
+void SweepAndPrune::InsertPending()
+{
+  // a new box sliding in from the end would cross most of the list,
+  // sort the new endpoints on their own and merge instead
+  size_t numSorted = m_Endpoints[0].size() - 2 * m_NumPending;
+  for (int axis = 0; axis < 3; ++axis)
+  {
+    std::vector<Endpoint>& endpoints = m_Endpoints[axis];
+    std::sort(endpoints.begin() + numSorted, endpoints.end());
+    std::inplace_merge(endpoints.begin(), endpoints.begin() + numSorted, endpoints.end());
+  }
+
+  // sweep x keeping the boxes whose interval is open, a pair with
+  // a new box in it that overlaps along x gets the full test
+  m_Active.clear();
+  for (const Endpoint& e : m_Endpoints[0])
+  {
+    int id = e.GetId();
+    if (e.IsMax())
+    {
+      auto iter = std::find(m_Active.begin(), m_Active.end(), id);
+      if (iter != m_Active.end())
+      {
+        *iter = m_Active.back();
+        m_Active.pop_back();
+      }
+      continue;
+    }
+
+    for (int other : m_Active)
+    {
+      if ((m_Status[id] == Pending || m_Status[other] == Pending)
+        && Intersect(m_Boxes[id], m_Boxes[other]) && m_Pairs.Add(id, other))
+      {
+        m_Events.push_back(OverlapEvent{ Math::Min(id, other), Math::Max(id, other), true });
+      }
+    }
+    m_Active.emplace_back(id);
+  }
+
+  for (unsigned char& status : m_Status)
+  {
+    if (status == Pending)
+    {
+      status = Sorted;
+    }
+  }
+  m_NumPending = 0;
+}
+
+const PairCache& SweepAndPrune::GetPairs() const
+{
+  return m_Pairs;
+}
+
+const std::vector<SweepAndPrune::OverlapEvent>& SweepAndPrune::GetEvents() const
+{
+  return m_Events;
+}
+
+void SweepAndPrune::ClearEvents()
+{
+  m_Events.clear();
+}
+
+size_t SweepAndPrune::GetNumSwaps() const
+{
+  return m_NumSwaps;
+}
@@ -0,0 +1,83 @@
+#pragma once
+
+#include "Collision.h"
+#include "PairCache.h"
+#include <cstdint>
+#include <vector>
+
+// incremental 3 axis sweep and prune. Min/max endpoints of every box stay
+// sorted between updates, so when boxes move a little the insertion sort
+// only does a few swaps, and each swap is where an overlap starts or stops.
+// Boxes are identified by caller chosen ids (small non-negative ints)
+class SweepAndPrune
+{
+public:
+  struct OverlapEvent
+  {
+    int m_A;
+    int m_B;
+    bool m_Begin; // false when the pair stopped overlapping
+  };
+
+  SweepAndPrune();
+
+  void AddBox(int id, const AABB& box);
+  // pairs with a removed box are dropped without an end event
+  void RemoveBox(int id);
+  // every box flagged in ids (indexed by id) in one pass over the
+  // endpoints, for removing many at once
+  void RemoveBoxes(const std::vector<unsigned char>& ids);
+  // stores the new box, endpoints are re-sorted by Update
+  void SetBox(int id, const AABB& box);
+
+  // re-sorts the endpoint lists and brings the pair cache up to date,
+  // appending begin/end events for every change
+  void Update();
+
+  // pairs that overlap as of the last Update
+  const PairCache& GetPairs() const;
+
+  // events since the last ClearEvents
+  const std::vector<OverlapEvent>& GetEvents() const;
+  void ClearEvents();
+
+  // endpoint swaps done by the last Update (for profiling), boxes added
+  // since the previous update are merged in and not counted
+  size_t GetNumSwaps() const;
+
+private:
+  struct Endpoint
+  {
+    float m_Value;
+    // id << 1 | 1 for max endpoints
+    uint32_t m_Data;
+
+    int GetId() const { return static_cast<int>(m_Data >> 1); }
+    bool IsMax() const { return (m_Data & 1) != 0; }
+    // at equal values mins go first so touching boxes count as overlapping,
+    // same as Intersect(AABB, AABB)
+    bool operator<(const Endpoint& other) const
+    {
+      return m_Value < other.m_Value
+        || (m_Value == other.m_Value && (m_Data & 1) < (other.m_Data & 1));
+    }
+  };
+
+  // insertion sort of the first count endpoints of one axis
+  void SortAxis(int axis, size_t count);
+  // sorts boxes added since the last update into place and
+  // finds their overlaps with one sweep along x
+  void InsertPending();
+
+  std::vector<Endpoint> m_Endpoints[3];
+  // indexed by id
+  std::vector<AABB> m_Boxes;
+  std::vector<unsigned char> m_Status;
+  // added boxes wait on the end of the endpoint lists until the next update
+  size_t m_NumPending;
+  std::vector<int> m_Active;
+
+  PairCache m_Pairs;
+  std::vector<OverlapEvent> m_Events;
+  size_t m_NumSwaps;
+};
@@ -3,6 +3,7 @@
 #include "Renderer.h"
 #include "MeshComponent.h"
 #include "BoxComponent.h"
+#include "Constants.h"
 #include "Mesh.h"
 
 TargetActor::TargetActor(Game* game)
@@ -16,4 +17,6 @@ TargetActor::TargetActor(Game* game)
 	// Add collision box
 	BoxComponent* bc = new BoxComponent(this);
 	bc->SetObjectBox(mesh->GetBox());
+	bc->SetLayer(COLLISION_LAYER_TARGET);
+	bc->SetTag(COLLISION_TAG_TARGET);
 }
@@ -1,6 +1,8 @@
 #include "VertexArray.h"
 
 #include <GL/glew.h>
+#include <cstdint>
+#include <vector>
 
 // assumes:
 // position (3), normal (3), texUV (2)
@@ -12,6 +14,9 @@ VertexArray::VertexArray(const void* verts
 )
   :m_NumVerts(numVerts)
   , m_NumIndices(numIndices)
+  , m_Layout(layout)
+  , m_IndexType(GL_UNSIGNED_INT)
+  , m_IndexSize(sizeof(unsigned int))
 {
   // create vertex array
   glGenVertexArrays(1, &m_VertexArray);
@@ -22,6 +27,10 @@ VertexArray::VertexArray(const void* verts
   {
     vertexSize = 8 * sizeof(float) + 8 * sizeof(char);
   }
+  else if (layout == PosNormTexQuantized)
+  {
+    vertexSize = 3 * sizeof(float) + 2 * sizeof(int16_t) + 2 * sizeof(uint16_t);
+  }
 
   // create vertex buffer
   glGenBuffers(1, &m_VertexBuffer);
@@ -29,19 +38,30 @@ VertexArray::VertexArray(const void* verts
   // copy data into vertex buffer
   glBufferData(
     GL_ARRAY_BUFFER                 // active buffer type to write to
-    , numVerts * 8 * sizeof(float)  // number of bytes to copy
+    , numVerts * vertexSize         // number of bytes to copy
     , verts                         // source to copy from (pointer)
     , GL_STATIC_DRAW                // how will we use this data?
   );
 
+  // half the index memory / bandwidth when the indices fit in 16 bits
+  std::vector<uint16_t> shortIndices;
+  const void* indexData = indices;
+  if (numVerts <= 0x10000)
+  {
+    shortIndices.assign(indices, indices + numIndices);
+    indexData = shortIndices.data();
+    m_IndexType = GL_UNSIGNED_SHORT;
+    m_IndexSize = sizeof(uint16_t);
+  }
+
   // create index buffer
   glGenBuffers(1, & m_IndexBuffer);
   glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, m_IndexBuffer);
   // copy indices data into index buffer
   glBufferData(
     GL_ELEMENT_ARRAY_BUFFER             // index buffer
-    , numIndices * sizeof(unsigned int) // size of data
-    , indices
+    , numIndices * m_IndexSize          // size of data
+    , indexData
     , GL_STATIC_DRAW
   );
 
@@ -139,6 +159,41 @@ VertexArray::VertexArray(const void* verts
       , reinterpret_cast<void*>(sizeof(float) * 6 + sizeof(char) * 8) // offest pointer
     );
   }
+  else if (layout == PosNormTexQuantized)
+  {
+    // position
+    glEnableVertexAttribArray(0);
+    glVertexAttribPointer(
+      0
+      , 3
+      , GL_FLOAT
+      , GL_FALSE
+      , vertexSize
+      , 0
+    );
+
+    // octahedral normal, -1..1 (decoded in the vertex shader)
+    glEnableVertexAttribArray(1);
+    glVertexAttribPointer(
+      1
+      , 2
+      , GL_SHORT
+      , GL_TRUE
+      , vertexSize
+      , reinterpret_cast<void*>(sizeof(float) * 3)
+    );
+
+    // tex UV
+    glEnableVertexAttribArray(2);
+    glVertexAttribPointer(
+      2
+      , 2
+      , GL_HALF_FLOAT
+      , GL_FALSE
+      , vertexSize
+      , reinterpret_cast<void*>(sizeof(float) * 3 + sizeof(int16_t) * 2)
+    );
+  }
 
 }
 
@@ -164,3 +219,18 @@ unsigned int VertexArray::GetNumVertices() const
 {
   return m_NumVerts;
 }
+
+VertexArray::Layout VertexArray::GetLayout() const
+{
+  return m_Layout;
+}
+
+unsigned int VertexArray::GetIndexType() const
+{
+  return m_IndexType;
+}
+
+unsigned int VertexArray::GetIndexSize() const
+{
+  return m_IndexSize;
+}
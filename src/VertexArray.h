@@ -3,7 +3,9 @@
 class VertexArray
 {
 public:
-  enum Layout { PosNormTex, PosNormSkinTex };
+  // PosNormTexQuantized: float position, octahedral normal in two snorm
+  // shorts, half float uv (see MeshOptimizer::Quantize)
+  enum Layout { PosNormTex, PosNormSkinTex, PosNormTexQuantized };
 
   VertexArray(const void* verts
     , unsigned int numVerts
@@ -17,10 +19,18 @@ public:
   void SetActive();
   unsigned int GetNumIndices() const;
   unsigned int GetNumVertices() const;
+  Layout GetLayout() const;
+  // GL_UNSIGNED_SHORT when every vertex fits in 16 bits, otherwise
+  // GL_UNSIGNED_INT. Use the size for byte offsets into the index buffer
+  unsigned int GetIndexType() const;
+  unsigned int GetIndexSize() const;
 
 private:
   unsigned int m_NumVerts;
   unsigned int m_NumIndices;
+  Layout m_Layout;
+  unsigned int m_IndexType;
+  unsigned int m_IndexSize;
   unsigned int m_VertexBuffer; // OpenGL ID of vertex buffer
   unsigned int m_IndexBuffer;  // OpenGL ID of index buffer
   unsigned int m_VertexArray;  // OpenGL ID of vertex array obj
@@ -0,0 +1,98 @@
+#include "WorldPartition.h"
+#include "Game.h"
+#include "Actor.h"
+#include "SceneLoader.h"
+#include "Constants.h"
+
+#include <algorithm>
+#include <cstdlib>
+
+WorldPartition::WorldPartition(Game* game, SceneLoader* loader)
+  : m_Game(game)
+  , m_Loader(loader)
+  , m_LastPosition(Vector3::Zero)
+  , m_Velocity(Vector3::Zero)
+  , m_HasLast(false)
+{}
+
+void WorldPartition::Update(float deltaTime)
+{
+  Actor* player = m_Game->GetPlayer();
+  if (!player)
+  {
+    m_HasLast = false;
+    return;
+  }
+
+  // smoothed so a single frame's jitter doesn't move the prefetch around
+  Vector3 pos = player->GetPosition();
+  if (m_HasLast && deltaTime > 0.0f)
+  {
+    Vector3 velocity = (pos - m_LastPosition) * (1.0f / deltaTime);
+    m_Velocity = m_Velocity * 0.8f + velocity * 0.2f;
+  }
+  m_LastPosition = pos;
+  m_HasLast = true;
+
+  const SceneFile& scene = m_Loader->GetScene();
+  int cellX, cellY, aheadX, aheadY;
+  scene.GetCell(pos, cellX, cellY);
+  scene.GetCell(pos + m_Velocity * SCENE_PREFETCH_TIME, aheadX, aheadY);
+
+  QueueAround(cellX, cellY);
+  if (aheadX != cellX || aheadY != cellY)
+  {
+    QueueAround(aheadX, aheadY);
+  }
+
+  for (size_t i = 0; i < m_Resident.size();)
+  {
+    const SceneFile::Section& section = scene.GetSection(m_Resident[i]);
+    if (IsNear(section.m_CellX, section.m_CellY, cellX, cellY)
+      || IsNear(section.m_CellX, section.m_CellY, aheadX, aheadY))
+    {
+      ++i;
+      continue;
+    }
+    m_Loader->UnloadSection(m_Resident[i]);
+    m_Resident[i] = m_Resident.back();
+    m_Resident.pop_back();
+  }
+}
+
+size_t WorldPartition::GetNumResident() const
+{
+  return m_Resident.size();
+}
+
+void WorldPartition::QueueAround(int cellX, int cellY)
+{
+  // ring by ring, so the cells closest to the player are read first
+  const SceneFile& scene = m_Loader->GetScene();
+  for (int ring = 0; ring <= SCENE_LOAD_RADIUS; ++ring)
+  {
+    for (int y = cellY - ring; y <= cellY + ring; ++y)
+    {
+      for (int x = cellX - ring; x <= cellX + ring; ++x)
+      {
+        if (std::max(std::abs(x - cellX), std::abs(y - cellY)) != ring)
+        {
+          continue;
+        }
+        // cells still being unloaded are picked up again once they're done
+        int index = scene.FindSection(x, y);
+        if (index > 0 && m_Loader->GetSectionState(index) == SceneLoader::E_Unloaded)
+        {
+          m_Loader->QueueSection(index);
+          m_Resident.emplace_back(index);
+        }
+      }
+    }
+  }
+}
+
+bool WorldPartition::IsNear(int cellX, int cellY, int centerX, int centerY) const
+{
+  return std::abs(cellX - centerX) <= SCENE_UNLOAD_RADIUS
+    && std::abs(cellY - centerY) <= SCENE_UNLOAD_RADIUS;
+}
@@ -0,0 +1,35 @@
+#pragma once
+
+#include "Math.h"
+#include <vector>
+
+// keeps only the scene cells around the player resident. Cells within
+// SCENE_LOAD_RADIUS of the player, and of where it's heading, are queued
+// on the SceneLoader; loaded cells further than SCENE_UNLOAD_RADIUS from
+// both are unloaded. The gap between the two radii stops a player walking
+// along a cell border from loading and unloading the same cells
+class WorldPartition
+{
+public:
+  WorldPartition(class Game* game, class SceneLoader* loader);
+
+  // follows Game::GetPlayer, does nothing without one
+  void Update(float deltaTime);
+
+  size_t GetNumResident() const;
+
+private:
+  void QueueAround(int cellX, int cellY);
+  bool IsNear(int cellX, int cellY, int centerX, int centerY) const;
+
+  class Game* m_Game;
+  class SceneLoader* m_Loader;
+
+  // player position last update, for a smoothed velocity
+  Vector3 m_LastPosition;
+  Vector3 m_Velocity;
+  bool m_HasLast;
+
+  // spatial sections queued or loaded
+  std::vector<size_t> m_Resident;
+};